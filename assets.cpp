@@ -0,0 +1,144 @@
+// @file assets.cpp
+// @brief the asset cache: a file is mapped, decoded straight from the mapping and unmapped
+
+#include "assets.h"
+
+#include <chrono>
+#include "mappedfile.h"
+
+#ifdef DAMA_EMBED_ASSETS
+#include "embedded_assets.h"
+#endif
+
+using namespace std;
+
+typedef chrono::steady_clock Clock;
+
+static string extensionOf(const string& name){
+    size_t dot = name.rfind('.');
+    return dot == string::npos ? string() : name.substr(dot);
+}
+
+static const EmbeddedAsset* findEmbedded(const string& name){
+#ifdef DAMA_EMBED_ASSETS
+    for(const EmbeddedAsset& asset : EMBEDDED_ASSETS){
+        if(name == asset.name)
+            return &asset;
+    }
+#else
+    (void)name;
+#endif
+    return nullptr;
+}
+
+bool AssetCache::embedded(){
+#ifdef DAMA_EMBED_ASSETS
+    return true;
+#else
+    return false;
+#endif
+}
+
+template<typename Decode> bool AssetCache::withBytes(const string& name, Decode decode){
+    Clock::time_point start = Clock::now();
+    bool loaded;
+    if(const EmbeddedAsset* asset = findEmbedded(name)){
+        loaded = decode(asset->data, (int)asset->size);
+        counters.embedded++;
+    }else{
+        MappedFile file;
+        loaded = file.map(name) && decode(file.data(), (int)file.size());
+        counters.bytesRead += file.size();
+    }
+    counters.loadMs += chrono::duration<double, milli>(Clock::now() - start).count();
+    if(loaded)
+        counters.loads++;
+    else
+        counters.missing++;
+    return loaded;
+}
+
+const Sound& AssetCache::sound(const string& name){
+    auto found = sounds.find(name);
+    if(found != sounds.end()){
+        counters.hits++;
+        return found->second;
+    }
+    Sound& sound = sounds[name];
+    sound = Sound();
+    withBytes(name, [&](const unsigned char* data, int size){
+        Wave wave = LoadWaveFromMemory(extensionOf(name).c_str(), data, size);
+        if(!wave.data)
+            return false;
+        counters.bytesDecoded += (uint64_t)wave.frameCount * wave.channels * (wave.sampleSize / 8);
+        sound = LoadSoundFromWave(wave);
+        UnloadWave(wave);
+        return true;
+    });
+    return sound;
+}
+
+const Font& AssetCache::font(const string& name, int size){
+    string key = name + "@" + to_string(size);
+    auto found = fonts.find(key);
+    if(found != fonts.end()){
+        counters.hits++;
+        return found->second;
+    }
+    Font& font = fonts[key];
+    // the default font stands in for one that cannot be loaded, and is never unloaded
+    font = GetFontDefault();
+    withBytes(name, [&](const unsigned char* data, int bytes){
+        Font loaded = LoadFontFromMemory(extensionOf(name).c_str(), data, bytes, size, nullptr, 0);
+        if(!loaded.texture.id)
+            return false;
+        counters.bytesDecoded += GetPixelDataSize(loaded.texture.width, loaded.texture.height, loaded.texture.format);
+        font = loaded;
+        return true;
+    });
+    return font;
+}
+
+const Texture2D& AssetCache::texture(const string& name){
+    auto found = textures.find(name);
+    if(found != textures.end()){
+        counters.hits++;
+        return found->second;
+    }
+    Texture2D& texture = textures[name];
+    texture = Texture2D();
+    withBytes(name, [&](const unsigned char* data, int size){
+        Image image = LoadImageFromMemory(extensionOf(name).c_str(), data, size);
+        if(!image.data)
+            return false;
+        counters.bytesDecoded += GetPixelDataSize(image.width, image.height, image.format);
+        texture = LoadTextureFromImage(image);
+        UnloadImage(image);
+        return true;
+    });
+    return texture;
+}
+
+void AssetCache::unload(){
+    for(auto& entry : sounds){
+        if(entry.second.frameCount)
+            UnloadSound(entry.second);
+    }
+    unsigned int defaultFont = GetFontDefault().texture.id;
+    for(auto& entry : fonts){
+        if(entry.second.texture.id != defaultFont)
+            UnloadFont(entry.second);
+    }
+    for(auto& entry : textures){
+        if(entry.second.id)
+            UnloadTexture(entry.second);
+    }
+    sounds.clear();
+    fonts.clear();
+    textures.clear();
+}
+
+AssetCache& sharedAssets(){
+    static AssetCache cache;
+    return cache;
+}
@@ -0,0 +1,74 @@
+// @file assets.h
+// @brief the sounds, fonts and textures of the front end, each loaded once per process and shared by
+//        reference; a build with EMBED_ASSETS=TRUE carries the files in the binary and reads nothing
+
+#ifndef ASSETS_H
+#define ASSETS_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include "raylib.h"
+
+/// @brief a file compiled into the binary, listed in embedded_assets.h (written by tools/embed.cpp)
+struct EmbeddedAsset{
+    const char* name;               // the path it was read from, with forward slashes
+    const unsigned char* data;
+    size_t size;
+};
+
+/// @brief what the cache has done so far
+struct AssetStats{
+    uint64_t loads = 0;             // assets decoded
+    uint64_t hits = 0;              // requests answered from the cache
+    uint64_t missing = 0;           // requests for an asset that could not be loaded
+    uint64_t embedded = 0;          // loads served from the binary instead of a file
+    uint64_t bytesRead = 0;         // bytes of files mapped (embedded bytes are not counted)
+    uint64_t bytesDecoded = 0;      // samples, pixels and glyph atlases produced
+    double loadMs = 0;              // time spent reading and decoding
+};
+
+/// @brief loads an asset the first time it is asked for and hands out the same handle after that.
+///        Names are paths relative to the working directory, with forward slashes. An asset that
+///        cannot be loaded is an empty handle, which raylib draws and plays as nothing. Use it from
+///        the thread that owns the window and the audio device
+class AssetCache{
+public:
+    AssetCache() = default;
+    ~AssetCache() = default;        // unload() must run while the window and the audio device are open
+    AssetCache(const AssetCache&) = delete;
+    AssetCache& operator=(const AssetCache&) = delete;
+
+    /// @brief a sound; needs the audio device
+    const Sound& sound(const std::string& name);
+
+    /// @brief a font rasterized at a size; needs the window
+    const Font& font(const std::string& name, int size);
+
+    /// @brief a texture; needs the window
+    const Texture2D& texture(const std::string& name);
+
+    /// @brief frees every asset; call it before CloseAudioDevice() and CloseWindow()
+    void unload();
+
+    /// @brief true if the binary carries its assets
+    static bool embedded();
+
+    AssetStats stats() const { return counters; }
+
+private:
+    /// @brief finds the bytes of an asset, in the binary or in a mapped file, and hands them to decode
+    /// @return false if there are none
+    template<typename Decode> bool withBytes(const std::string& name, Decode decode);
+
+    std::unordered_map<std::string, Sound> sounds;
+    std::unordered_map<std::string, Font> fonts;        // keyed by name and size
+    std::unordered_map<std::string, Texture2D> textures;
+    AssetStats counters;
+};
+
+/// @brief the process-wide asset cache
+AssetCache& sharedAssets();
+
+#endif
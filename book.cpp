@@ -0,0 +1,103 @@
+// @file book.cpp
+// @brief probing the memory-mapped opening book
+
+#include "book.h"
+
+#include <algorithm>
+#include <cstring>
+
+using namespace std;
+
+bool OpeningBook::open(const string& path){
+    close();
+    if(!file.map(path) || file.size() < sizeof(BookHeader))
+        return false;
+    const BookHeader* header = reinterpret_cast<const BookHeader*>(file.data());
+    if(memcmp(header->magic, "DBK1", 4) != 0 || header->version > BOOK_VERSION ||
+       header->recordSize != sizeof(BookRecord) ||
+       file.size() != sizeof(BookHeader) + header->records * sizeof(BookRecord)){
+        file.unmap();
+        return false;
+    }
+    records = reinterpret_cast<const BookRecord*>(file.data() + sizeof(BookHeader));
+    count = header->records;
+    gameCount = header->games;
+    return true;
+}
+
+void OpeningBook::close(){
+    file.unmap();
+    records = nullptr;
+    count = 0;
+    gameCount = 0;
+}
+
+/// @brief turns squares around the board: square i becomes 31 - i
+static uint32_t turnSquares(uint32_t squares){
+    uint32_t turned = 0;
+    for(; squares; squares &= squares - 1)
+        turned |= 1u << (SQUARE_COUNT - 1 - firstSquare(squares));
+    return turned;
+}
+
+/// @brief the position with the board turned around and the colours swapped, the same game for the
+///        other side; the book of White's opening then answers Black's (the Hub start)
+static Position turnBoard(const Position& pos){
+    Position turned;
+    turned.white = turnSquares(pos.black);
+    turned.black = turnSquares(pos.white);
+    turned.kings = turnSquares(pos.kings);
+    turned.whiteToMove = !pos.whiteToMove;
+    turned.hash = computeHash(turned);
+    return turned;
+}
+
+void OpeningBook::moves(const Position& pos, vector<BookMove>& moves) const{
+    moves.clear();
+    if(!records)
+        return;
+    auto findKey = [&](uint64_t key){
+        return lower_bound(records, records + count, key,
+                           [](const BookRecord& record, uint64_t key){ return record.key < key; });
+    };
+    uint64_t key = pos.hash;
+    const BookRecord* found = findKey(key);
+    bool turned = found == records + count || found->key != key;
+    if(turned){
+        key = turnBoard(pos).hash;
+        found = findKey(key);
+        if(found == records + count || found->key != key)
+            return;
+    }
+    // a record that is not a legal move here belongs to another position with the same key
+    MoveList legal;
+    generateMoves(pos, legal);
+    for(; found != records + count && found->key == key; found++){
+        for(const Move& move : legal){
+            int from = turned ? SQUARE_COUNT - 1 - move.from : move.from;
+            int to = turned ? SQUARE_COUNT - 1 - move.to : move.to;
+            uint32_t captures = turned ? turnSquares(move.captures) : move.captures;
+            if(from == found->from && to == found->to && captures == found->captures){
+                moves.push_back({move, found->games, found->wins, found->draws, found->losses});
+                break;
+            }
+        }
+    }
+    stable_sort(moves.begin(), moves.end(), [](const BookMove& a, const BookMove& b){
+        return a.score() != b.score() ? a.score() > b.score() : a.games > b.games;
+    });
+}
+
+bool OpeningBook::probe(const Position& pos, Move& best) const{
+    vector<BookMove> found;
+    moves(pos, found);
+    if(found.empty())
+        return false;
+    best = found.front().move;
+    return true;
+}
+
+OpeningBook& sharedBook(){
+    static OpeningBook book;
+    return book;
+}
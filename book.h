@@ -0,0 +1,98 @@
+// @file book.h
+// @brief opening book: move statistics of archive or self-play games in a sorted file of fixed
+//        records, memory-mapped and binary-searched so the engine plays known openings at once
+
+#ifndef BOOK_H
+#define BOOK_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "mappedfile.h"
+#include "rules.h"
+
+const uint16_t BOOK_VERSION = 1;
+const int BOOK_SHARDS = 64;         // bookgen aggregates each range of keys (the top 6 bits) apart
+
+// The file is its header followed by one record per position and move, sorted by key (the Zobrist
+// hash of the position, see computeHash) and then by move. Results are those of the side playing
+// the move.
+struct BookHeader{
+    char magic[4];          // "DBK1"
+    uint16_t version;
+    uint16_t recordSize;    // sizeof(BookRecord)
+    uint64_t records;
+    uint64_t games;         // finished games read
+    uint32_t plies;         // how deep into each game moves were counted
+    uint32_t minGames;      // moves played in fewer games were left out
+};
+
+struct BookRecord{
+    uint64_t key;
+    uint32_t captures;
+    uint8_t from;
+    uint8_t to;
+    uint16_t reserved;
+    uint32_t games;
+    uint32_t wins;
+    uint32_t draws;
+    uint32_t losses;
+};
+
+/// @brief a move of the book with how it has done
+struct BookMove{
+    Move move;
+    uint32_t games;
+    uint32_t wins;
+    uint32_t draws;
+    uint32_t losses;
+
+    /// @brief points per game for the side playing it: a win is 1, a draw 1/2
+    double score() const { return games ? (wins + 0.5 * draws) / games : 0; }
+};
+
+/// @brief true if a record's move comes before another's in the file, for the same key
+inline bool bookRecordLess(const BookRecord& a, const BookRecord& b){
+    if(a.key != b.key)
+        return a.key < b.key;
+    if(a.from != b.from)
+        return a.from < b.from;
+    if(a.to != b.to)
+        return a.to < b.to;
+    return a.captures < b.captures;
+}
+
+/// @brief a memory-mapped book; open() only checks the header, so nothing is parsed at load time
+class OpeningBook{
+public:
+    /// @brief maps a book file
+    /// @return false if there is no readable book there
+    bool open(const std::string& path);
+
+    void close();
+
+    bool isOpen() const { return records != nullptr; }
+    uint64_t size() const { return count; }
+    uint64_t games() const { return gameCount; }
+
+    /// @brief lists the book moves of a position, best score first; a position that is not in the book
+    ///        is looked up turned around with the colours swapped
+    /// @param pos,moves the position and what receives its moves (emptied first)
+    void moves(const Position& pos, std::vector<BookMove>& moves) const;
+
+    /// @brief picks the book move of a position: the best score, and of those the most played
+    /// @param pos,best the position and the move that receives the choice
+    /// @return false if the position is not in the book
+    bool probe(const Position& pos, Move& best) const;
+
+private:
+    MappedFile file;
+    const BookRecord* records = nullptr;
+    uint64_t count = 0;
+    uint64_t gameCount = 0;
+};
+
+/// @brief the process-wide book searchPosition() probes
+OpeningBook& sharedBook();
+
+#endif
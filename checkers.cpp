@@ -7,10 +7,28 @@
 // @rules you can know the rules of the movments by taping the button " help " in the game or go to the "help " function
 
 #include <iostream>
+#include <chrono>
+#include <ctime>
 #include <string>
 #include <cmath>
+#include <cstring>
+#include <deque>
+#include <algorithm>
 #include <fstream>
+#include <thread>
+#include <vector>
 #include "raylib.h"
+#include "rules.h"
+#include "search.h"
+#include "engine.h"
+#include "tablebase.h"
+#include "savefile.h"
+#include "journal.h"
+#include "pdn.h"
+#include "posindex.h"
+#include "book.h"
+#include "gamecore.h"
+#include "assets.h"
 
 using namespace std;
 
@@ -19,6 +37,20 @@ const int BOARD_HEIGHT = 800;
 const int CELL_SIZE = 100;
 const int CELL_CENTER_POS = CELL_SIZE / 2;
 const int QORKI_SIZE = 30;
+const int PANEL_WIDTH = 300;
+const float LAYOUT_SCALE = 1.0f;       // size of the board and the side panel; 1 is a 1100x800 window
+const bool CACHE_BOARD_LAYER = true;   // draw the board and the panel once into a render texture
+const double CPU_MOVE_SECONDS = 1.0;   // time the computer opponent may think about one move
+const bool CPU_PONDER = true;          // the computer keeps thinking on the human's time
+const int TARGET_FPS = 60;
+const bool REDRAW_ON_EVENTS = true;    // keep the last frame and draw again only when something changed
+const double FRAME_REPORT_SECONDS = 10; // how often the frame counter is printed
+const char* TABLEBASE_DIR = "tb";      // endgame tablebase written by tbgen, used when it is there
+const char* JOURNAL_FILE = "autosave.journal";  // every move, so an unfinished game survives a crash
+const char* INDEX_FILE = "games.idx";   // position index of a game archive, written by posindex
+const char* BOOK_FILE = "opening.book"; // opening book written by bookgen; the computer plays from it
+const char* MOVE_SOUND = "Game sound/gamesound.wav";
+const char* CLICK_SOUND = "Game sound/click.mp3";
 
 enum cellType{
     //You might want one more cell type.
@@ -29,6 +61,15 @@ enum cellType{
     player2KingQorki
 };
 
+// Define complementary wood-like colors for the Qorki pieces, by cellType
+const Color QORKI_COLORS[] = {
+    {0, 0, 0, 0},
+    {251, 251, 238, 255},   // Light Beige for Player 1's Qorki
+    {226, 135, 67, 255},    // Light Brown for Player 2's Qorki
+    {255, 215, 0, 255},     // Gold for Player 1's King Qorki
+    {106, 81, 75, 255}      // Dark Brown for Player 2's King Qorki
+};
+
 struct Cell{
     int row;
     int col;
@@ -48,15 +89,15 @@ struct Board{
     Color boardColor;
 };
 
-struct Game{
+// the position, moves, scores and winner are the headless GameState (gamecore.h)
+struct Game : GameState{
     Board board;
-    Cell cellInfo[8][8];
     std::string playerOneName;
     std::string playerTwoName;
-    int p1;
-    int p2;
-    bool turn;
-    int winner;
+    bool playerOneCpu;          // the computer plays for player one
+    bool playerTwoCpu;          // the computer plays for player two
+    int endgame;                // tablebase value of the position for the side to move, -1 if unknown
+    PositionStats archive;      // games of the position index that reached the position
 };
 
 struct Button
@@ -65,6 +106,119 @@ struct Button
     Color color;
 };
 
+// where the board, the pieces and the side panel go: the sizes above scaled once, read by the
+// drawing and by the clicks alike
+struct Layout{
+    float scale;
+    int cellSize;
+    int boardWidth;
+    int boardHeight;
+    int width;                  // of the window
+    int height;
+    float qorkiRadius;
+    Rectangle help, restart, load, save, names;     // buttons of the side panel
+    Rectangle cpuOne, cpuTwo;
+    Rectangle turn;             // the square showing whose turn it is
+
+    /// @brief a length of the unscaled layout, in pixels
+    int px(float length) const { return (int)(length * scale + 0.5f); }
+    /// @brief a rectangle of the unscaled layout
+    Rectangle rect(float x, float y, float w, float h) const { return {x * scale, y * scale, w * scale, h * scale}; }
+    /// @brief a rectangle of the unscaled layout of a dialog, from the dialog's corner
+    Rectangle rect(Vector2 origin, float x, float y, float w, float h) const {
+        return {origin.x + x * scale, origin.y + y * scale, w * scale, h * scale};
+    }
+};
+
+typedef std::chrono::steady_clock Clock;
+
+// the pieces of a position, ready to draw: at most one per dark square
+struct QorkiList{
+    Vector2 centers[SQUARE_COUNT];
+    uint8_t types[SQUARE_COUNT];    // cellType
+    uint8_t squares[SQUARE_COUNT];
+    int count = 0;
+};
+
+enum inputType{
+    inputPress,
+    inputRelease
+};
+
+// a mouse button going down or up, where it happened and when the poll of the input saw it
+struct InputEvent{
+    int type;
+    int button;
+    Vector2 at;
+    Clock::time_point time;
+};
+
+// the piece the player has picked up, by a click or to drag it, and how long the moves took
+struct MovePicker{
+    int selected = -1;              // its square, -1 for none
+    bool held = false;              // the left button is still down since it was picked up
+    std::vector<int> steps;         // landing squares clicked so far, when captures take different routes
+    bool choosing = false;          // a click fit more than one route: the next landings are shown
+    std::vector<double> latencyMs;  // from the input that made each move to the move on the board
+    size_t reported = 0;            // moves in the last report
+
+    void putDown(){
+        selected = -1;
+        held = false;
+        steps.clear();
+        choosing = false;
+    }
+};
+
+// what a square clicked for the piece picked up does (findMove)
+enum targetType{
+    noTarget,           // the piece cannot go there
+    playTarget,         // it ends a single move, which is played
+    stepTarget,         // it is the next landing of more than one capture route
+    ambiguousTarget     // it ends more than one route: the landings between tell them apart
+};
+
+// what the window shows; every screen but the game is drawn over the board, in the same window
+enum screen{
+    gameScreen,
+    helpScreen,
+    nameScreen,
+    fileScreen,
+    gameOverScreen
+};
+
+// a text box of a dialog, kept from frame to frame
+struct TextField{
+    std::string text;
+    int maxChars;
+    int framesCounter = 0;      // frames the mouse has been over the box, for the blinking cursor
+};
+
+// frames drawn, and passes of the loop that drew nothing, since a time
+struct FrameCount{
+    Clock::time_point since;
+    double cpuSince = 0;        // threadCpuSeconds() at since
+    int drawn = 0;
+    int idle = 0;
+    double drawMs = 0;
+};
+
+// the frame counter: the counts since the last report and since startup
+struct FrameMeter{
+    FrameCount period;
+    FrameCount total;
+};
+
+// how long the window took to come up and each change of screen took to draw
+struct ScreenTimes{
+    Clock::time_point started;  // main() was entered
+    Clock::time_point changed;  // the change being timed started
+    bool timing = false;
+    int changes = 0;
+    double totalMs = 0;
+    double worstMs = 0;
+};
+
 
 /// @brief initializes the game
 /// @param game the game to initialize
@@ -74,298 +228,473 @@ void initGame(Game& game);
 /// @param board the board to initialize
 void initBoard(Board& board);
 
+/// @brief places the board, the pieces and the side panel
+/// @param scale 1 for the 1100x800 window
+Layout makeLayout(float scale);
+
 /// @brief draws the board based on board properties
-/// @param board the board to draw
-void drawBoard(Board board);
+/// @param board,layout the board to draw and where
+void drawBoard(const Board& board, const Layout& layout);
+
+/// @brief draws what does not change from frame to frame: the board, its cells, the side panel with
+///        its buttons and labels; drawn once into a render texture
+/// @param board,layout the board and where everything goes
+void drawStaticLayer(const Board& board, const Layout& layout);
+
+/// @brief true on the frame the left button is pressed over a rectangle
+bool clickedOn(Rectangle rect);
 
 /// @brief gets the cell type based on the row and col on initialization
 /// @param row,col the row and col to get the cell type
 int initCellType(int row, int col);
 
-/// @brief draw the cells based on their type
-/// @param cell,board the cells to draw and the board in which the cells will be drawn
-void drawCellsOnBoard(Cell cell[8][8]);
+/// @brief gets the cell type of a board cell in a position
+/// @param pos,row,col the position and the row and col of the cell
+int cellTypeAt(const Position& pos, int row, int col);
+
+/// @brief draw the 64 cells of the board
+void drawCellsOnBoard(const Layout& layout);
 
 /// @brief getCellColor based on the cell type
 /// @param cell the cell to get the color
 Color getCellColor(Cell cell);
 
-/// @brief draw qorki based on the cell type
-/// @param cell the cell to draw the qorki on
-void drawQorki(Cell cell[8][8]);
+/// @brief lists the qorkis of a position with their centers on the screen
+/// @param pos,layout,list the position, where the board is and the list to fill
+void listQorkis(const Position& pos, const Layout& layout, QorkiList& list);
+
+/// @brief draw the qorkis of a position, one batch of circles; the piece picked up is ringed, and
+///        follows the mouse while it is dragged, and the landings of its capture routes are marked
+///        while the player chooses between them
+/// @param pos,layout,picker the position to draw, where the board is and the piece picked up
+void drawQorki(const Position& pos, const Layout& layout, const MovePicker& picker);
 
 /// @brief returns qokri color based on cell type.
 /// @param cell the cell to get the cell type from and determine the qorki color.
 Color getQorkiColor(Cell cell);
 
-/// @brief updates the game cellInfo array based on user click
-/// @param cells the cell infos of the current game.
-void updateGame(Cell cells[8][8], Game& game, Sound& move);
-
-/// @brief returns the cell the user clicked on
-/// @param x,y the x and y coordinates of the click
-Cell getCell(int x, int y);
-
-/// @brief moves the qorki from the selected cell to the target cell
-/// @param selectedCell,targetCell,cells the selected cell, target cell and the game cell info array
-void moveQorki(Cell selectedCell, Cell targetCell, Cell cells[8][8], Sound& move);
+/// @brief updates the game position based on user click
+/// @param game,layout,events the current game, where the board is and the listeners of its moves
+/// @param inputs,picker the presses and releases not handled yet (all taken off) and the piece picked up:
+///        a press picks a piece up, and a press on a square it can go to (either button), or letting go
+///        of the left button over one after dragging the piece there, plays the move, once; when
+///        capture routes share their end, presses on the landings between choose one
+void updateGame(Game& game, const Layout& layout, const GameEvents& events, std::deque<InputEvent>& inputs, MovePicker& picker);
 
-/// @brief handles the qorki actions
-/// @param selectedCell,targetCell,cells the selected cell, target cell and the game cell info array
-void handleQorkiMove(Cell selectedCell, Cell targetCell, Cell cells[8][8], Game& game, Sound& move);
-void handleKingQorkiMove(Cell selectedCell,Cell targetCell,Cell cells[8][8], Game& game, Sound& move);
+/// @brief plays the move of the piece picked up to a square, if the rules allow it
+/// @param game,square,input,picker,events the game, the square, the input asking for it, the piece
+///        picked up (put down after a move) and the listeners
+/// @return false if the piece cannot go there; true also for a landing that narrows the routes down
+bool pickTarget(Game& game, int square, const InputEvent& input, MovePicker& picker, const GameEvents& events);
 
-/// @brief checks if a move is a legal checkers move 
-/// @param selectedCell,targetCell,cells the selected cell, target cell and the game cell info array
-bool isMoveValid(Cell selectedCell, Cell targetCell, Cell cells[8][8], Game& game, Sound& move);
-bool isKingMoveValid(Cell selectedCell, Cell targetCell, Cell cells[8][8], Game& game, Sound& move);
+/// @brief queues the mouse buttons pressed and released at the last poll of the input
+void collectInput(std::deque<InputEvent>& inputs);
 
-/// @brief removes the cell from the game
-/// @param cell,cells the cell to remove and the game cell info array
-void removeQorki(Cell cell, Cell cells[8][8]);
+/// @brief prints the percentiles of the time from the input to the move played, when there are new moves
+/// @param picker,final what was measured and whether the game is closing
+void reportLatency(MovePicker& picker, bool final);
 
-/// @brief Determines the winner of the game based on the current move.
-/// @param selectedCell, targetCell, cells, game the selected cell, target cell, game boardand the game cell info array
-void winner(Cell selectedCell, Cell targetCell, Cell cells[8][8], Game& game);
+/// @brief returns the cell the user clicked on
+/// @param x,y,layout the x and y coordinates of the click and where the board is
+Cell getCell(int x, int y, const Layout& layout);
+
+/// @brief finds the legal move of the piece picked up that a click on a square asks for: the routes
+///        through the landings clicked before, then through or to the square, counted by route so a
+///        capture of a king may end on its own square
+/// @param pos,picker,square the position, the piece picked up with its steps, and the square clicked
+/// @param move receives the move when there is a single one
+/// @return what the click does, a targetType
+int findMove(const Position& pos, const MovePicker& picker, int square, Move& move);
+
+/// @brief the next landing squares of the capture routes that go through the steps clicked so far
+/// @param pos,picker the position and the piece picked up
+uint32_t nextLandings(const Position& pos, const MovePicker& picker);
+
+/// @brief steps through the game with the arrow keys: left takes the last move back, right plays the
+///        next move of a loaded PDN game or the move taken back
+/// @param game,engine,events the current game, the background search (cancelled) and the listeners
+void replayKeys(Game& game, EngineWorker& engine, const GameEvents& events);
+
+/// @brief lets the computer play when it is the turn of a player it controls: asks the engine
+///        worker for a move and plays the answer on a later frame, once it has arrived. On the
+///        human's turn the worker ponders on the reply the computer expects
+/// @param game,engine,events the current game, the background search and the listeners of its moves
+void computerMove(Game& game, EngineWorker& engine, const GameEvents& events);
+
+/// @brief true when it is the turn of a player the computer controls and the game goes on
+bool computerToMove(const Game& game);
+
+/// @brief Determines the winner of the game (the side to move loses when it cannot move) and what
+///        the side panel knows about the position: its endgame value and its archive games.
+/// @param game the game board info
+void winner(Game& game);
 
 /// @brief Checks if the mouse is hovering over the button.
 /// @param button The button to check.
 /// @return Returns true if the mouse is over the button, false otherwise.
 bool is_mouse_over_button(Button button);
 
-/// @brief Resets the game state and restarts the game.
-/// @param game, move The game object to reset.
-void resetGame(Game& game, Sound& move, Sound& click);
+/// @brief Resets the game state and restarts the game, in the same window.
+/// @param game The game object to reset.
+void resetGame(Game& game);
+
+/// @brief dims the board and draws an empty dialog box in the middle of the window
+/// @param layout,width,height the scale of the window and the size of the box, unscaled
+/// @return the top-left corner of the box, which the dialog's contents are drawn from
+Vector2 drawOverlay(const Layout& layout, float width, float height);
+
+/// @brief adds the characters typed since the last frame to a text box, and takes one off on backspace
+/// @param field the text box being typed into
+void typeText(TextField& field);
+
+/// @brief draws a text box with its text, and a blinking cursor while it is typed into
+/// @param field,box,active,layout the text, where the box is, whether the mouse is over it and the scale
+void drawTextField(TextField& field, Rectangle box, bool active, const Layout& layout);
+
+/// @brief Draws one frame of the file name dialog for saving or loading game states.
+/// @param file, type The filename typed so far and Specifies whether the operation is a save or load action.
+/// @return true once a name is confirmed with the button or Enter
+bool text_input(TextField& file, const std::string& type, const Layout& layout, const Sound& click);
+
+/// @brief copies what a save file holds out of a game
+/// @param game the game to copy
+SavedGame savedGame(const Game& game);
 
-/// @brief Handles text input for saving or loading game states.
-/// @param file, type The filename to save to or load from and Specifies whether the operation is a save or load action.
-void text_input(std::string& file, std::string type, Sound& click);
+/// @brief puts a saved game on the board
+/// @param game,saved the game to overwrite and what to put in it
+void restoreGame(Game& game, const SavedGame& saved);
 
-/// @brief Loads a previously saved game from a file.
-/// @param game The game object to load the state into.
-void loadgame(Game& game, Sound& click);
+/// @brief true if a file name ends with an extension such as ".pdn", in any case
+bool hasExtension(const std::string& file, const char* extension);
 
-/// @brief Saves the current game state to a file.
-/// @param game The game object whose state is to be saved.
-void savegame(Game& game, Sound& click);
+/// @brief reads a game of a PDN file, "games.pdn#3" for the third; every move is checked
+/// @param file,saved the name typed and the game, put at its start with the moves to replay
+/// @return false (after printing why) if the game is not there or has a bad move
+bool loadPdnGame(const std::string& file, SavedGame& saved);
 
-/// @brief Displays the help page with instructions or information.
+/// @brief Loads a previously saved game from a file, converts a save of version 1.0, or opens a
+///        game of a PDN file for replay.
+/// @param game, file The game object to load the state into (left alone when the file is refused) and the file.
+void loadgame(Game& game, const std::string& file);
+
+/// @brief Saves the current game state and its move history to a file (see savefile.h), or as
+///        PDN when the name ends with ".pdn".
+/// @param game, file The game object whose state is to be saved and the file to save it to.
+void savegame(Game& game, const std::string& file);
+
+/// @brief Draws one frame of the help page with instructions or information.
 /// @param game the game board info
-void help_page(Game &game, Sound& click);
+/// @return true once the player is done reading
+bool help_page(const Layout& layout, const Sound& click);
 
-/// @brief Gets name for the players.
-/// @param game, the game board info.
-void player_name(Game& game, Sound& click);
+/// @brief Draws one frame of the name entry for the players.
+/// @param game, p1, p2 the game board info and the two name boxes.
+/// @return true once the names are saved or the entry is closed
+bool player_name(Game& game, TextField& p1, TextField& p2, const Layout& layout, const Sound& click);
 
-/// @brief Draws the text and box drawing on the game board.
+/// @brief Draws one frame of the box announcing the winner.
 /// @param game the game board info
-void drawings(Game& game);
+/// @return 1 when New Game is clicked, 2 for Quit, 0 otherwise
+int game_over(const Game& game, const Layout& layout, const Sound& click);
+
+/// @brief milliseconds from a time until now
+double msSince(Clock::time_point from);
+
+/// @brief starts timing a change of screen
+void screenChanging(ScreenTimes& times);
+
+/// @brief prints how long a change of screen took, once the first frame of the new screen is drawn
+/// @param times,shown the timings and the screen now shown
+void screenShown(ScreenTimes& times, int shown);
+
+/// @brief prints the totals of the changes of screen
+void reportScreens(const ScreenTimes& times);
+
+/// @brief true if the last poll of the input brought a click, a key, a change of the window or,
+///        when asked, a move of the mouse; takes the key off the queue of GetKeyPressed()
+bool inputArrived(bool mouseMoves);
+
+/// @brief CPU time the calling thread has used, in seconds
+double threadCpuSeconds();
+
+/// @brief starts counting frames from now
+void startFrameCount(FrameCount& count);
+
+/// @brief counts a frame drawn
+/// @param frames,ms the counter and the time the frame took, before it was shown
+void frameDrawn(FrameMeter& frames, double ms);
+
+/// @brief prints the counts of the last FRAME_REPORT_SECONDS once they are up, or of the whole run
+/// @param frames,final the counter and whether the game is closing
+/// @return true if it printed
+bool reportFrames(FrameMeter& frames, bool final);
 
-/// @brief checks if there is on more valid moves 
-/// @param selectedCell,targetCell,cells, game the selected cell, target cell, game board info and the game cell info array
-bool stalmate(Cell selectedCell, Cell targetCell, Cell cells[8][8], Game& game);
+/// @brief Draws what changes in the side panel: names, scores, the turn, who the computer plays and
+///        what is known about the position; the shapes first, then the text.
+/// @param game,layout the game board info and where the panel is
+void drawings(Game& game, const Layout& layout);
 
 int main(){
-    newgame:
+    ScreenTimes times;
+    times.started = Clock::now();
+    EngineWorker engine;        // searches for the computer player without holding up the frame
+    if(sharedTablebase().open(TABLEBASE_DIR, DEFAULT_TB_CACHE_MB) > 0){
+        cout << "Endgame tablebase: " << sharedTablebase().stats().slices << " slices, up to "
+             << sharedTablebase().pieces() << " pieces" << endl;
+    }
+    if(sharedBook().open(BOOK_FILE)){
+        cout << "Opening book: " << sharedBook().size() << " moves from " << sharedBook().games() << " games" << endl;
+    }
+    if(sharedPositionIndex().open(INDEX_FILE)){
+        cout << "Position index: " << sharedPositionIndex().games() << " games, "
+             << sharedPositionIndex().positions() << " positions" << endl;
+    }
+    // a game the window closed on, or that crashed, is picked up where it stopped
+    SavedGame unfinished;
+    bool resume = readJournal(JOURNAL_FILE, unfinished) && !unfinished.winner;
+    sharedJournal().open(JOURNAL_FILE);
     Game game;
-    Sound move, click;
-    restart:
     initGame(game);
     initBoard(game.board);
-    open:
-    InitWindow((game.board.boardWidth)+300, game.board.boardHeight, "DAMA");
+    if(resume){
+        restoreGame(game, unfinished);
+        cout << "Resumed the unfinished game after " << game.history.size() << " moves" << endl;
+    }
+    sharedJournal().begin(savedGame(game));
+    double dataMs = msSince(times.started);
+
+    // one window and one audio device for the whole run: help, names, the file dialog and the end
+    // of a game are screens drawn inside it, so changing screen never rebuilds the GL context
+    Clock::time_point mark = Clock::now();
+    Layout layout = makeLayout(LAYOUT_SCALE);
+    InitWindow(layout.width, layout.height, "DAMA");
+    SetTargetFPS(TARGET_FPS);
+    SetExitKey(KEY_NULL);       // ESC leaves a dialog, and only quits from the board
+    // what never changes is drawn once; without render textures it is drawn every frame instead
+    RenderTexture2D boardLayer = {};
+    if(CACHE_BOARD_LAYER)
+        boardLayer = LoadRenderTexture(layout.width, layout.height);
+    bool layerReady = IsRenderTextureReady(boardLayer);
+    if(layerReady){
+        BeginTextureMode(boardLayer);
+            ClearBackground(RAYWHITE);
+            drawStaticLayer(game.board, layout);
+        EndTextureMode();
+    }
+    double windowMs = msSince(mark);
+    mark = Clock::now();
     InitAudioDevice();
-    move = LoadSound("Game sound\\gamesound.wav");
-    click = LoadSound("Game sound\\click.mp3");
-    SetSoundVolume(move, 1.0f);
-    SetSoundVolume(click, 1.0f);
-    while (!WindowShouldClose()){ 
+    // loaded once and shared; the dialogs are handed the same click
+    const Sound& move = sharedAssets().sound(MOVE_SOUND);
+    const Sound& click = sharedAssets().sound(CLICK_SOUND);
+    double audioMs = msSince(mark);
+    AssetStats assets = sharedAssets().stats();
+    cout << TextFormat("Assets: %i loaded%s in %.1f ms, %.0f KB read, %.0f KB decoded", (int)assets.loads,
+                       AssetCache::embedded() ? " from the binary" : "", assets.loadMs,
+                       assets.bytesRead / 1024.0, assets.bytesDecoded / 1024.0) << endl;
+    if(assets.missing)
+        cerr << "Error: " << assets.missing << " sound files could not be loaded, the game plays without them." << endl;
+
+    // the game only reports what happened; the sound and the autosave listen
+    GameEvents events;
+    events.subscribe([&move](const GameEvent& event){
+        if(event.type == gameMoved)
+            PlaySound(move);
+    });
+    events.subscribe([](const GameEvent& event){
+        if(event.type == gameMoved)
+            sharedJournal().appendMove(event.before, event.move);
+    });
+    // a move of the computer changes the board without any input
+    bool redraw = true;             // the next pass draws a frame
+    bool input = true;              // ... because of input
+    events.subscribe([&redraw](const GameEvent&){
+        redraw = true;
+    });
+
+    int screen = gameScreen;        // what this frame shows
+    int next = gameScreen;          // what the next frame shows
+    bool firstFrame = true;
+    bool quitting = false;
+    std::string fileAction;         // "save" or "load" while the file dialog is up
+    TextField fileName, nameOne, nameTwo;
+    fileName.maxChars = 20;
+    nameOne.maxChars = 14;
+    nameTwo.maxChars = 14;
+    FrameMeter frames;
+    std::deque<InputEvent> inputs;  // presses and releases on their way to the board
+    MovePicker picker;
+    startFrameCount(frames.period);
+    startFrameCount(frames.total);
+    while (!quitting && !WindowShouldClose()){ 
+        if(!REDRAW_ON_EVENTS)
+            redraw = true;
+        if(screen == gameScreen)
+            computerMove(game, engine, events);
+        // waiting for the computer's move needs a tick to look for it; anything else waits for input
+        bool thinking = screen == gameScreen && computerToMove(game);
+        if(!redraw && next == screen){
+            if(thinking){
+                DisableEventWaiting();
+                std::this_thread::sleep_for(std::chrono::microseconds(1000000 / TARGET_FPS));
+            }else{
+                EnableEventWaiting();
+            }
+            PollInputEvents();      // blocks until the next event while waiting for them
+            frames.period.idle++;
+            frames.total.idle++;
+            collectInput(inputs);
+            input = inputArrived(screen != gameScreen || picker.held);
+            redraw = input;
+            if(reportFrames(frames, false))
+                reportLatency(picker, false);
+            continue;
+        }
+        Clock::time_point frameStart = Clock::now();
+        redraw = false;             // set again by a move played during the frame
+        if(next != screen){
+            screenChanging(times);
+            // every dialog opens with empty boxes
+            fileName.text.clear();
+            nameOne.text.clear();
+            nameTwo.text.clear();
+            SetMouseCursor(MOUSE_CURSOR_DEFAULT);
+            screen = next;
+        }
+        // the board only takes clicks and keys when no other screen is over it
+        bool onBoard = screen == gameScreen;
         BeginDrawing();
-            ClearBackground(RAYWHITE);
-            drawBoard(game.board); 
-            drawCellsOnBoard(game.cellInfo);
-            drawQorki(game.cellInfo);
-            updateGame(game.cellInfo, game, move);
-            drawings(game);
-             
-            Color turn;
-            if(game.turn) {
-                turn = (Color){251, 251, 238, 255};  // made the turn indicator color the same as the qorki color
-            } else {
-                turn = (Color){226, 135, 67, 255};   // made the turn indicator color the same as the qorki color
+            // the board and the panel come from the cached layer in one draw, then the pieces in one
+            // batch, then the panel's shapes and its text
+            if(layerReady){
+                DrawTextureRec(boardLayer.texture, {0, 0, (float)boardLayer.texture.width, -(float)boardLayer.texture.height}, {0, 0}, WHITE);
+            }else{
+                ClearBackground(RAYWHITE);
+                drawStaticLayer(game.board, layout);
+            }
+            drawQorki(game.position, layout, picker);
+            if(onBoard){
+                updateGame(game, layout, events, inputs, picker);
+                replayKeys(game, engine, events);
+            }else{
+                // a click on a dialog is not meant for the board
+                inputs.clear();
+                picker.putDown();
             }
+            drawings(game, layout);
 
-            DrawRectangle(BOARD_WIDTH + 120, 250, 30, 30, turn);
-            Rectangle Hshadow = {BOARD_WIDTH + 14, 724, 280, 50};
-            Button help;
-            help.rect = {BOARD_WIDTH + 10, 720, 280, 50};
-            help.color = GRAY;
-            float roundness = 0.6f;  // Adjust roundness (0.0 for sharp corners, 1.0 for fully rounded)
-            int segments = 10;       // Adjust smoothness (higher value means smoother corners)
-            DrawRectangleRounded(Hshadow, roundness,segments, BLACK);
-            DrawRectangleRounded(help.rect, roundness,segments, help.color);
-            DrawText("HELP", BOARD_WIDTH + 40, 735, 28, BLACK);
-            if((is_mouse_over_button(help)) && (IsMouseButtonPressed(MOUSE_BUTTON_LEFT))){
+            if(onBoard && clickedOn(layout.help)){
                 PlaySound(click);
-                help_page(game, click);
-                UnloadSound(move);
-                CloseAudioDevice(); 
-                goto open;
+                next = helpScreen;
             }
-
-
-            //DrawRectangle(BOARD_WIDTH + 120, 250, 30, 30, turn);
-            Button restart;
-            Rectangle Rshadow = {BOARD_WIDTH + 14, 659, 280, 50};
-            restart.rect = {BOARD_WIDTH + 10, 655, 280, 50};
-            restart.color = GRAY; 
-            DrawRectangleRounded(Rshadow, roundness,segments, BLACK);
-            DrawRectangleRounded(restart.rect, roundness,segments, restart.color);
-            DrawText("RESTART GAME", BOARD_WIDTH + 40, 670, 28, BLACK);
-            if((is_mouse_over_button(restart)) && (IsMouseButtonPressed(MOUSE_BUTTON_LEFT))){
+            if(onBoard && clickedOn(layout.restart)){
                 PlaySound(click);
-                WaitTime(0.5);
-                UnloadSound(move);
-                CloseAudioDevice(); 
-                CloseWindow();
-                goto restart;
+                engine.cancel();
+                resetGame(game);
             }
-
-            //DrawRectangle(BOARD_WIDTH + 120, 250, 30, 30, turn);
-            Button load;
-            Rectangle Lshadow = {BOARD_WIDTH + 14, 594, 280, 50};
-            load.rect = {BOARD_WIDTH + 10, 590, 280, 50};
-            load.color = GRAY;
-            roundness = 0.6f;
-            segments = 10;
-            DrawRectangleRounded(Lshadow, roundness, segments, BLACK);
-            DrawRectangleRounded(load.rect, roundness, segments, load.color);
-            DrawText("LOAD A GAME", BOARD_WIDTH + 40, 605, 28, BLACK);
-            if((is_mouse_over_button(load)) && (IsMouseButtonPressed(MOUSE_BUTTON_LEFT))){
+            if(onBoard && clickedOn(layout.load)){
                 PlaySound(click);
-                loadgame(game, click);
-                cout << "Game loaded! Player one name: " << game.playerOneName << endl;
-                cout << "Player one score: " << game.p1 << endl;
-                UnloadSound(move);
-                CloseAudioDevice(); 
-                goto open;
+                engine.cancel();
+                fileAction = "load";
+                next = fileScreen;
             }
-
-            //DrawRectangle(BOARD_WIDTH + 120, 250, 30, 30, turn);
-            Button save;
-            save.rect = {BOARD_WIDTH + 10, 525, 280, 50};
-            save.color = GRAY;
-            Rectangle Sshadow = {BOARD_WIDTH + 14, 529, 280, 50};
-            DrawRectangleRounded(Sshadow, roundness, segments, BLACK);
-            DrawRectangleRounded(save.rect, roundness, segments, save.color);
-            DrawText("SAVE GAME", BOARD_WIDTH + 40, 540, 28, BLACK);
-            if((is_mouse_over_button(save)) && (IsMouseButtonPressed(MOUSE_BUTTON_LEFT))){
+            if(onBoard && clickedOn(layout.save)){
                 PlaySound(click);
-                savegame(game, click);
-                cout << "Game saved!\n";
-                goto quit;
+                fileAction = "save";
+                next = fileScreen;
             }
-
-            //DrawRectangle(BOARD_WIDTH + 120, 250, 30, 30, turn);
-            Button name;
-            name.rect = {BOARD_WIDTH + 10, 460, 280, 50};
-            name.color = GRAY;
-            Rectangle Nshadow = {BOARD_WIDTH + 14, 464, 280, 50};
-            DrawRectangleRounded(Nshadow, roundness, segments, BLACK);
-            DrawRectangleRounded(name.rect, roundness ,segments , name.color);
-            DrawText("ADD NAMES", BOARD_WIDTH + 40, 475, 28, BLACK);
-            if((is_mouse_over_button(name)) && (IsMouseButtonPressed(MOUSE_BUTTON_LEFT))){
+            if(onBoard && clickedOn(layout.names)){
                 PlaySound(click);
-                player_name(game, click);
-                UnloadSound(move);
-                CloseAudioDevice(); 
-                goto open;
+                next = nameScreen;
+            }
+            // player one / player two: human or computer
+            if(onBoard && clickedOn(layout.cpuOne)){
+                PlaySound(click);
+                game.playerOneCpu = !game.playerOneCpu;
+                sharedJournal().begin(savedGame(game));
+            }
+            if(onBoard && clickedOn(layout.cpuTwo)){
+                PlaySound(click);
+                game.playerTwoCpu = !game.playerTwoCpu;
+                sharedJournal().begin(savedGame(game));
+            }
+            if(onBoard && game.winner){
+                next = gameOverScreen;
             }
 
-
-            if (game.winner== 1) {
-                CloseWindow();
-                InitWindow(game.board.boardWidth/2, game.board.boardHeight/4, "Game Over");
-                Button button1, button2;
-                button1.rect = {50, 100, 115, 50};
-                button2.rect = {250, 100, 100, 50};
-                button1.color = SKYBLUE;
-                button2.color = SKYBLUE;
-                
-                while (!WindowShouldClose()) {
-                    BeginDrawing();
-                    ClearBackground(RAYWHITE);
-                    DrawText("PLAYER ONE WON", game.board.boardWidth/8 + 10, 30, 20, SKYBLUE);
-                    DrawRectangle(165, 105, 4, 45, BLACK);
-                    DrawRectangle(55, 150, 114, 4, BLACK);
-                    DrawRectangle(350, 105, 4, 45, BLACK);
-                    DrawRectangle(255, 150, 99, 4, BLACK);
-                    // Draw the buttons
-                    DrawRectangleRec(button1.rect, button1.color);
-                    DrawText("New Game", 60, 115, 20, BLACK);
-
-                    DrawRectangleRec(button2.rect, button2.color);
-                    DrawText("Quit", 280, 115, 20, BLACK);
-                    if((is_mouse_over_button(button1)) && (IsMouseButtonPressed(MOUSE_BUTTON_LEFT))){
-                        PlaySound(click);
-                        resetGame(game, move, click);
-                        UnloadSound(move);
-                        CloseAudioDevice();
-                        CloseWindow();
-                        goto newgame;
-                    }else if((is_mouse_over_button(button2)) && (IsMouseButtonPressed(MOUSE_BUTTON_LEFT))){
-                        PlaySound(click);
-                        CloseWindow();
-                        goto quit;
-                    }
-
-                    EndDrawing();
+            // the other screens are drawn over the board
+            if(screen == helpScreen){
+                if(help_page(layout, click))
+                    next = gameScreen;
+            }else if(screen == nameScreen){
+                if(player_name(game, nameOne, nameTwo, layout, click)){
+                    sharedJournal().begin(savedGame(game));
+                    next = gameScreen;
                 }
-            } else if (game.winner == 2) {
-                CloseWindow();
-                InitWindow(game.board.boardWidth/2, game.board.boardHeight/4, "Game Over");
-                Button button1, button2;
-                button1.rect = {50, 100, 115, 50};
-                button2.rect = {250, 100, 100, 50};
-                button1.color = PINK;
-                button2.color = PINK;
-                while (!WindowShouldClose()) {
-                    BeginDrawing();
-                    ClearBackground(RAYWHITE);
-                    DrawText("PLAYER TWO WON", game.board.boardWidth/8 + 10, 30, 20, PINK);
-                    DrawRectangle(165, 105, 4, 45, BLACK);
-                    DrawRectangle(55, 150, 114, 4, BLACK);
-                    DrawRectangle(350, 105, 4, 45, BLACK);
-                    DrawRectangle(255, 150, 99, 4, BLACK);
-                    // Draw the buttons
-                    DrawRectangleRec(button1.rect, button1.color);
-                    DrawText("New Game", 60, 115, 20, BLACK);
-
-                    DrawRectangleRec(button2.rect, button2.color);
-                    DrawText("Quit", 280, 115, 20, BLACK);
-                    if((is_mouse_over_button(button1)) && (IsMouseButtonPressed(MOUSE_BUTTON_LEFT))){
-                        PlaySound(click);
-                        resetGame(game, move, click);
-                        UnloadSound(move);
-                        CloseAudioDevice(); 
-                        CloseWindow();
-                        goto newgame;
-                    }else if((is_mouse_over_button(button2)) && (IsMouseButtonPressed(MOUSE_BUTTON_LEFT))){
-                        PlaySound(click);
-                        CloseWindow();
-                        goto quit;
+            }else if(screen == fileScreen){
+                if(text_input(fileName, fileAction, layout, click)){
+                    if(fileAction == "save"){
+                        savegame(game, fileName.text);
+                        cout << "Game saved!\n";
+                        quitting = true;
+                    }else{
+                        loadgame(game, fileName.text);
+                        cout << "Game loaded! Player one name: " << game.playerOneName << endl;
+                        cout << "Player one score: " << game.p1 << endl;
+                        next = gameScreen;
                     }
-
-                    EndDrawing();
                 }
+            }else if(screen == gameOverScreen){
+                int choice = game_over(game, layout, click);
+                if(choice == 1){
+                    engine.cancel();
+                    resetGame(game);
+                    next = gameScreen;
+                }else if(choice == 2){
+                    quitting = true;
+                }
+            }
+            if(IsKeyPressed(KEY_ESCAPE)){
+                if(screen == gameScreen || screen == gameOverScreen)
+                    quitting = true;
+                else
+                    next = gameScreen;
             }
+
+            if(firstFrame){
+                firstFrame = false;
+                cout << TextFormat("Startup: %.1f ms to the first frame (data %.1f, window %.1f, audio %.1f)",
+                                   msSince(times.started), dataMs, windowMs, audioMs) << endl;
+            }
+            screenShown(times, screen);
+            // the board is drawn before the input is handled, so what a click changed shows on the
+            // frame after it; the text boxes blink while they are typed into
+            redraw = redraw || input || fileName.framesCounter || nameOne.framesCounter || nameTwo.framesCounter;
+            frameDrawn(frames, msSince(frameStart));
+            // EndDrawing() takes the input of the next frame: it must not wait for it while the
+            // computer thinks
+            if(REDRAW_ON_EVENTS && !redraw && next == screen && !(screen == gameScreen && computerToMove(game)))
+                EnableEventWaiting();
+            else
+                DisableEventWaiting();
         EndDrawing();
+        collectInput(inputs);
+        input = inputArrived(screen != gameScreen || picker.held);
+        redraw = redraw || input;
+        if(reportFrames(frames, false))
+            reportLatency(picker, false);
 
     }
-    quit:
-    UnloadSound(click);
-    UnloadSound(move);
+    reportScreens(times);
+    reportFrames(frames, true);
+    reportLatency(picker, true);
+    engine.cancel();
+    sharedJournal().close();
+    sharedAssets().unload();
+    if(layerReady)
+        UnloadRenderTexture(boardLayer);
     CloseAudioDevice();       
+    CloseWindow();
 
     return 0;
 }
@@ -373,17 +702,11 @@ int main(){
 void initGame(Game& game){
     game.playerOneName = "Player 1";
     game.playerTwoName = "Player 2";
-    game.p1 = 0;
-    game.p2 = 0;
-    game.turn = true;
-
-    for(int row = 0; row < 8; row++){
-        for(int col =0; col <8; col++){
-            game.cellInfo[row][col].row = row;
-            game.cellInfo[row][col].col = col;
-            game.cellInfo[row][col].cellType = initCellType(row, col);
-        }
-    }
+    game.playerOneCpu = false;
+    game.playerTwoCpu = false;
+    startGame(game, startPosition());
+    game.endgame = -1;
+    sharedPositionIndex().lookup(game.position, game.archive);
 }
 
 void initBoard(Board& board){
@@ -392,9 +715,52 @@ void initBoard(Board& board){
     board.boardColor = RAYWHITE;
 }
 
-void drawBoard(Board board){
-    DrawRectangle(0, 0, board.boardWidth, board.boardHeight, board.boardColor);
-    DrawRectangle(board.boardWidth, 0, 300, board.boardHeight, WHITE);
+Layout makeLayout(float scale){
+    Layout layout;
+    layout.scale = scale;
+    layout.cellSize = layout.px(CELL_SIZE);
+    layout.boardWidth = layout.cellSize * 8;
+    layout.boardHeight = layout.cellSize * 8;
+    layout.width = layout.boardWidth + layout.px(PANEL_WIDTH);
+    layout.height = layout.boardHeight;
+    layout.qorkiRadius = QORKI_SIZE * scale;
+    layout.names = layout.rect(BOARD_WIDTH + 10, 460, 280, 50);
+    layout.save = layout.rect(BOARD_WIDTH + 10, 525, 280, 50);
+    layout.load = layout.rect(BOARD_WIDTH + 10, 590, 280, 50);
+    layout.restart = layout.rect(BOARD_WIDTH + 10, 655, 280, 50);
+    layout.help = layout.rect(BOARD_WIDTH + 10, 720, 280, 50);
+    layout.cpuOne = layout.rect(BOARD_WIDTH + 10, 292, 135, 40);
+    layout.cpuTwo = layout.rect(BOARD_WIDTH + 155, 292, 135, 40);
+    layout.turn = layout.rect(BOARD_WIDTH + 120, 250, 30, 30);
+    return layout;
+}
+
+void drawBoard(const Board& board, const Layout& layout){
+    DrawRectangle(0, 0, layout.boardWidth, layout.boardHeight, board.boardColor);
+    DrawRectangle(layout.boardWidth, 0, layout.width - layout.boardWidth, layout.height, WHITE);
+}
+
+void drawStaticLayer(const Board& board, const Layout& layout){
+    drawBoard(board, layout);
+    drawCellsOnBoard(layout);
+    float roundness = 0.6f;  // Adjust roundness (0.0 for sharp corners, 1.0 for fully rounded)
+    int segments = 10;       // Adjust smoothness (higher value means smoother corners)
+    const Rectangle* buttons[] = {&layout.help, &layout.restart, &layout.load, &layout.save, &layout.names};
+    const char* labels[] = {"HELP", "RESTART GAME", "LOAD A GAME", "SAVE GAME", "ADD NAMES"};
+    for(const Rectangle* button : buttons){
+        Rectangle shadow = {button->x + layout.px(4), button->y + layout.px(4), button->width, button->height};
+        DrawRectangleRounded(shadow, roundness, segments, BLACK);
+        DrawRectangleRounded(*button, roundness, segments, GRAY);
+    }
+    for(int i = 0; i < 5; i++)
+        DrawText(labels[i], (int)buttons[i]->x + layout.px(30), (int)buttons[i]->y + layout.px(15), layout.px(28), BLACK);
+    DrawText("SCORES:", layout.px(BOARD_WIDTH + 20), layout.px(20), layout.px(50), BLACK);
+    DrawText("Turn:", layout.px(BOARD_WIDTH + 20), layout.px(250), layout.px(30), BLACK);
+    DrawText("DAMA", layout.px(BOARD_WIDTH + 60), layout.px(340), layout.px(60), BLACK);
+}
+
+bool clickedOn(Rectangle rect){
+    return IsMouseButtonPressed(MOUSE_BUTTON_LEFT) && CheckCollisionPointRec(GetMousePosition(), rect);
 }
 
 int initCellType(int row, int col){
@@ -411,12 +777,14 @@ int initCellType(int row, int col){
     return emptyCell;
 }
 
-void drawCellsOnBoard(Cell cell[8][8]){
+void drawCellsOnBoard(const Layout& layout){
     for(int row = 0; row < 8; row++)
         for(int col = 0; col < 8; col++){
-            Cell currentCell = cell[row][col];
-            Color cellColor = getCellColor(cell[row][col]);
-            DrawRectangle(col * currentCell.cellSize, row * currentCell.cellSize, currentCell.cellSize, currentCell.cellSize, cellColor);
+            Cell currentCell;
+            currentCell.row = row;
+            currentCell.col = col;
+            Color cellColor = getCellColor(currentCell);
+            DrawRectangle(col * layout.cellSize, row * layout.cellSize, layout.cellSize, layout.cellSize, cellColor);
         }
 }
 
@@ -432,610 +800,315 @@ Color getCellColor(Cell cell){
     return lightWood;
 }
 
-void drawQorki(Cell cells[8][8]){
-    Qorki qorki;
-    float cellCenterPos = cells[0][0].cellSize / 2;
-    for(int row = 0; row < 8; row++){
-        int rowPos = row * cells[0][0].cellSize;
-        for(int col = 0; col < 8; col++){
-            int colPos = col * cells[0][0].cellSize;
-            Cell currentCell = cells[row][col];
-            if(currentCell.cellType != emptyCell){
-                Color qorkiColor = getQorkiColor(currentCell);
-                DrawCircle(cellCenterPos + colPos, cellCenterPos + rowPos, qorki.qorkiSize,qorkiColor);
-            }
-        }
+void listQorkis(const Position& pos, const Layout& layout, QorkiList& list){
+    list.count = 0;
+    float half = layout.cellSize / 2.0f;
+    for(uint32_t pieces = pos.white | pos.black; pieces; pieces &= pieces - 1){
+        int square = firstSquare(pieces);
+        uint32_t bit = 1u << square;
+        bool king = (pos.kings & bit) != 0;
+        list.centers[list.count] = {squareCol(square) * layout.cellSize + half, squareRow(square) * layout.cellSize + half};
+        list.squares[list.count] = (uint8_t)square;
+        if(pos.white & bit)
+            list.types[list.count] = king ? player1KingQorki : player1Qorki;
+        else
+            list.types[list.count] = king ? player2KingQorki : player2Qorki;
+        list.count++;
     }
 }
 
-Color getQorkiColor(Cell cell) {
-    // Define complementary wood-like colors for the Qorki pieces
-    Color player1QorkiColor = (Color){251, 251, 238, 255};  // Light Beige for Player 1's Qorki
-    Color player1KingColor = (Color){255, 215, 0, 255};     // Gold for Player 1's King Qorki
-    Color player2QorkiColor = (Color){226, 135, 67, 255};   // Light Brown for Player 2's Qorki
-    Color player2KingColor = (Color){106, 81, 75, 255};     // Dark Brown for Player 2's King Qorki
-
-
-    switch(cell.cellType) {
-        case player1Qorki:
-            return player1QorkiColor;
-        case player1KingQorki:
-            return player1KingColor;
-        case player2Qorki:
-            return player2QorkiColor;
-        case player2KingQorki:
-            return player2KingColor;
-          
-
-        // Other cell types, if any
-        // default:
+void drawQorki(const Position& pos, const Layout& layout, const MovePicker& picker){
+    static QorkiList list;
+    listQorkis(pos, layout, list);
+    // nothing but circles in a row, so raylib sends them in one batch
+    int picked = -1;
+    for(int i = 0; i < list.count; i++){
+        if(list.squares[i] == picker.selected)
+            picked = i;
+        else
+            DrawCircleV(list.centers[i], layout.qorkiRadius, QORKI_COLORS[list.types[i]]);
     }
-
-
-} 
-
-
-void updateGame(Cell cells[8][8], Game& game, Sound& move){
-    Cell static selectedCell;
-    Cell static targetCell;
-
-    int selectedXPos;
-    int selectedYPos;
-
-    if (IsMouseButtonDown(MOUSE_BUTTON_LEFT)) {
-        selectedXPos = GetMouseX();
-        selectedYPos = GetMouseY();
-        selectedCell = getCell(selectedXPos, selectedYPos);
+    // the piece picked up goes on top, under the mouse while it is dragged
+    if(picked >= 0){
+        Vector2 center = picker.held ? GetMousePosition() : list.centers[picked];
+        DrawCircleV(center, layout.qorkiRadius + layout.px(4), GOLD);
+        DrawCircleV(center, layout.qorkiRadius, QORKI_COLORS[list.types[picked]]);
     }
-
-    if (IsMouseButtonDown(MOUSE_BUTTON_RIGHT)) {
-        selectedXPos = GetMouseX();
-        selectedYPos = GetMouseY();
-        targetCell = getCell(selectedXPos, selectedYPos);
-        winner(selectedCell,targetCell,cells, game);
-        if(cells[selectedCell.row][selectedCell.col].cellType == player1Qorki || cells[selectedCell.row][selectedCell.col].cellType == player2Qorki)
-        handleQorkiMove(selectedCell, targetCell, cells, game, move);
-        if(cells[selectedCell.row][selectedCell.col].cellType == player1KingQorki || cells[selectedCell.row][selectedCell.col].cellType == player2KingQorki)
-        handleKingQorkiMove(selectedCell, targetCell, cells, game, move);
+    // while capture routes are told apart: gold on the landings clicked, blue where the next can be
+    if(picker.choosing){
+        float half = layout.cellSize / 2.0f;
+        for(int square : picker.steps)
+            DrawCircleV({squareCol(square) * layout.cellSize + half, squareRow(square) * layout.cellSize + half},
+                        layout.px(12), GOLD);
+        for(uint32_t next = nextLandings(pos, picker); next; next &= next - 1){
+            int square = firstSquare(next);
+            DrawCircleV({squareCol(square) * layout.cellSize + half, squareRow(square) * layout.cellSize + half},
+                        layout.px(12), SKYBLUE);
+        }
     }
+}
 
+Color getQorkiColor(Cell cell) {
+    return QORKI_COLORS[cell.cellType];
 }
 
-Cell getCell(int x, int y){
-    Cell c;
-    c.row = y/c.cellSize;
-    c.col = x/c.cellSize;
-    return c;
+int cellTypeAt(const Position& pos, int row, int col){
+    int square = squareAt(row, col);
+    if(square < 0)
+        return emptyCell;
+    uint32_t bit = 1u << square;
+    bool king = (pos.kings & bit) != 0;
+    if(pos.white & bit)
+        return king ? player1KingQorki : player1Qorki;
+    if(pos.black & bit)
+        return king ? player2KingQorki : player2Qorki;
+    return emptyCell;
 }
 
-void handleQorkiMove(Cell selectedCell, Cell targetCell, Cell cells[8][8], Game& game, Sound& move) {
-    if(game.turn){
-        if(cells[selectedCell.row][selectedCell.col].cellType == player1Qorki){
-            if(isMoveValid(selectedCell,targetCell,cells, game, move)){
-                moveQorki(selectedCell,targetCell,cells,move);
-                game.turn = false;
-            }
+void updateGame(Game& game, const Layout& layout, const GameEvents& events, std::deque<InputEvent>& inputs, MovePicker& picker){
+    // a move taken back, replayed or loaded may have taken the piece away
+    uint32_t mine = game.position.whiteToMove ? game.position.white : game.position.black;
+    if(picker.selected >= 0 && !(mine & (1u << picker.selected)))
+        picker.putDown();
+    while(!inputs.empty()){
+        // clicks do not move the computer's pieces
+        if(game.winner || computerToMove(game)){
+            inputs.clear();
+            picker.putDown();
+            return;
         }
-    }else{
-        if(cells[selectedCell.row][selectedCell.col].cellType == player2Qorki){
-            if(isMoveValid(selectedCell,targetCell,cells, game, move)){
-                moveQorki(selectedCell,targetCell,cells,move);
-                game.turn = true;
+        InputEvent input = inputs.front();
+        inputs.pop_front();
+        Cell cell = getCell((int)input.at.x, (int)input.at.y, layout);
+        int square = squareAt(cell.row, cell.col);     // -1 off the board and on the light cells
+        if(input.type == inputRelease){
+            // a piece dragged to another square is dropped there
+            if(input.button == MOUSE_BUTTON_LEFT && picker.held){
+                picker.held = false;
+                if(square >= 0 && square != picker.selected)
+                    pickTarget(game, square, input, picker, events);
             }
+            continue;
+        }
+        // a press on the piece's own square may end a capture of a king that comes back to it
+        if(picker.selected >= 0 && square >= 0 && pickTarget(game, square, input, picker, events))
+            continue;
+        if(input.button == MOUSE_BUTTON_LEFT){
+            mine = game.position.whiteToMove ? game.position.white : game.position.black;
+            picker.putDown();
+            picker.selected = square >= 0 && (mine & (1u << square)) ? square : -1;
+            picker.held = picker.selected >= 0;
         }
     }
 }
-void handleKingQorkiMove(Cell selectedCell,Cell targetCell,Cell cells[8][8], Game& game, Sound& move){
-    if(game.turn){
-        if(cells[selectedCell.row][selectedCell.col].cellType == player1KingQorki){
-            if(isKingMoveValid(selectedCell,targetCell,cells, game, move)){
-                moveQorki(selectedCell,targetCell,cells,move);
-                game.turn = false;
-            }
-        }
-    }else{
-        if(cells[selectedCell.row][selectedCell.col].cellType == player2KingQorki){
-            if(isKingMoveValid(selectedCell,targetCell,cells, game,move)){
-                moveQorki(selectedCell,targetCell,cells,move);
-                game.turn = true;
-            }
-        }
+
+bool pickTarget(Game& game, int square, const InputEvent& input, MovePicker& picker, const GameEvents& events){
+    Move played;
+    switch(findMove(game.position, picker, square, played)){
+    case noTarget:
+        return false;
+    case stepTarget:
+        picker.steps.push_back(square);
+        picker.choosing = true;
+        return true;
+    case ambiguousTarget:
+        picker.choosing = true;
+        return true;
     }
+    playMove(game, played, events);
+    winner(game);
+    picker.latencyMs.push_back(msSince(input.time));
+    picker.putDown();
+    return true;
 }
 
-void moveQorki(Cell selectedCell, Cell targetCell, Cell cells[8][8], Sound& move){
-    cells[targetCell.row][targetCell.col].cellType = cells[selectedCell.row][selectedCell.col].cellType;
-    removeQorki(selectedCell, cells);
-    if (targetCell.row == 0 && cells[targetCell.row][targetCell.col].cellType == player1Qorki) {
-        cells[targetCell.row][targetCell.col].cellType = player1KingQorki;
-    }else if (targetCell.row == 7 && cells[targetCell.row][targetCell.col].cellType == player2Qorki) {
-        cells[targetCell.row][targetCell.col].cellType = player2KingQorki;
+void collectInput(std::deque<InputEvent>& inputs){
+    // raylib keeps only the state of the buttons, so an edge is seen on the one poll it happened before
+    Clock::time_point now = Clock::now();
+    Vector2 at = GetMousePosition();
+    for(int button : {MOUSE_BUTTON_LEFT, MOUSE_BUTTON_RIGHT}){
+        if(IsMouseButtonPressed(button))
+            inputs.push_back(InputEvent{inputPress, button, at, now});
+        if(IsMouseButtonReleased(button))
+            inputs.push_back(InputEvent{inputRelease, button, at, now});
     }
-    PlaySound(move);
 }
 
-void removeQorki(Cell cell, Cell cells[8][8]){
-    cells[cell.row][cell.col].cellType = emptyCell;
+void reportLatency(MovePicker& picker, bool final){
+    if(picker.latencyMs.size() == picker.reported || (final && picker.latencyMs.empty()))
+        return;
+    picker.reported = picker.latencyMs.size();
+    std::vector<double> sorted = picker.latencyMs;
+    std::sort(sorted.begin(), sorted.end());
+    size_t last = sorted.size() - 1;
+    cout << TextFormat("Input to move: %i moves, p50 %.2f ms, p99 %.2f ms, worst %.2f ms", (int)sorted.size(),
+                       sorted[last * 50 / 100], sorted[last * 99 / 100], sorted[last]) << endl;
 }
 
-bool isMoveValid(Cell selectedCell, Cell targetCell, Cell cells[8][8], Game& game, Sound& move){
-    Cell turntype;
-    //This is so that only not the selected type and the one that is being capured shouldnt be the same but also there king couter parts
-    if(game.turn){
-        turntype.cellType = player1KingQorki;
-    }else{
-        turntype.cellType = player2KingQorki;
-    }
-    // Check if the selected cell has a Qorki
-    if (cells[selectedCell.row][selectedCell.col].cellType == emptyCell)
-        return false;
-    // Check if the target cell already has a Qorki
-    if (cells[targetCell.row][targetCell.col].cellType != emptyCell){
-        return false;
-    }
-    // Check if the selected cell and the target cell are the same
-    if (selectedCell.row == targetCell.row && selectedCell.col == targetCell.col)
-        return false;
-    int rowdiff = targetCell.row - selectedCell.row;
-    int coldiff = targetCell.col - selectedCell.col;
+Cell getCell(int x, int y, const Layout& layout){
+    Cell c;
+    c.cellSize = layout.cellSize;
+    c.row = y/c.cellSize;
+    c.col = x/c.cellSize;
+    return c;
+}
 
-    // For player1Qorki, the row difference should be negative (moving upwards)
-    if (cells[selectedCell.row][selectedCell.col].cellType == player2Qorki && rowdiff <= 0) {
-        return false;
-    }
-    // For player2Qorki, the row difference should be positive (moving downwards)
-    if (cells[selectedCell.row][selectedCell.col].cellType == player1Qorki && rowdiff >= 0) {
+// Returns the landing square of a move after the given number of jumps, its end once they are done.
+static int landingAt(const Move& m, size_t step){
+    return step < m.pathLength ? m.path[step] : m.to;
+}
+
+// True if a move of the piece picked up goes through the landings clicked for it so far.
+static bool followsSteps(const Move& m, const MovePicker& picker){
+    if(m.from != picker.selected || picker.steps.size() > m.pathLength)
         return false;
+    for(size_t i = 0; i < picker.steps.size(); i++){
+        if(m.path[i] != picker.steps[i])
+            return false;
     }
-    if (abs(selectedCell.row - targetCell.row) == 1 && abs(selectedCell.col - targetCell.col) == 1) {
-        return true;
-    } else if(abs(selectedCell.row - targetCell.row) > 2){
-        if(abs(selectedCell.col - targetCell.col) == 0){
-            Cell nextcell;
-            Cell guess;
-            guess.row = selectedCell.row + 1;
-            guess.col = selectedCell.col + 1;
-            guess.cellType = cells[guess.row][guess.col].cellType;
-            int midrow;
-            int midcol;
-            int count = 1;
-
-            // Determine the direction of movement
-            int rowDirection = (targetCell.row > selectedCell.row) ? 1 : -1;
-            int colDirection = (guess.cellType != emptyCell) ? 1 : -1;
-
-            do {
-                int nextrow = selectedCell.row + 2 * rowDirection;
-                int nextcol = selectedCell.col + 2 * colDirection;
-
-                // Set the next potential cell based on direction and check for pieces
-                nextcell.row = nextrow;
-                nextcell.col = nextcol;
-                
-                // Checks if the next cell is out of the board
-                if (nextcell.col < 0) {
-                    return false;
-                }else if (nextcell.col > 7) {
-                    return false;
-                }
-                if (nextcell.row < 0) {
-                    return false;
-                }else if (nextcell.row > 7) {
-                    return false;
-                }
-
-                // Calculate the intermediate cell position (the cell being captured)
-                midrow = (selectedCell.row + nextcell.row) / 2;
-                midcol = (selectedCell.col + nextcell.col) / 2;
-
-                Cell removeCell;
-                removeCell.row = midrow;
-                removeCell.col = midcol;
-
-                // Check if the intermediate cell has an opponent's Qorki
-                if ((cells[midrow][midcol].cellType != cells[selectedCell.row][selectedCell.col].cellType) && (cells[midrow][midcol].cellType !=turntype.cellType) && (cells[midrow][midcol].cellType != emptyCell)) {
-                    
-                    // Capture the Qorki
-                    removeQorki(removeCell, cells);
-
-                    // Update scores based on which player performed the capture
-                    if((cells[selectedCell.row][selectedCell.col].cellType == player1Qorki) || 
-                    cells[selectedCell.row][selectedCell.col].cellType == player1KingQorki) {
-                        game.p1++;
-                    } else if((cells[selectedCell.row][selectedCell.col].cellType == player2Qorki) || 
-                            cells[selectedCell.row][selectedCell.col].cellType == player2KingQorki) {
-                        game.p2++;
-                    }
-                    winner(selectedCell,targetCell,cells, game);
-
-
-                    // Move the KingQorki to the next cell
-                    moveQorki(selectedCell, nextcell, cells, move);
-                    
-                } else {
-                    // No valid capture found, move is invalid
-                    return false;
-                }
-
-                // Update selectedCell to the new position for potential second capture
-                if(count == 1) {
-                    selectedCell = nextcell;
-                    nextcell = targetCell;
-                }
-                colDirection = (nextcell.col > selectedCell.col) ? 1 : -1;
+    return true;
+}
 
-                count++;
-            } while(count == 2);
-            game.turn = !game.turn;
-        }
-        else{
-            if(abs(rowdiff) != abs(coldiff)){
-                return false;
-            }
-            Cell nextcell;
-            int midrow;
-            int midcol;
-            int count = 1;
-            int repet;
-            if (abs(rowdiff) == 4){
-                repet = 2;
-            }else if(abs(rowdiff) == 6){
-                repet= 3;
+int findMove(const Position& pos, const MovePicker& picker, int square, Move& move){
+    static MoveList moves;
+    if(picker.selected < 0 || square < 0)
+        return noTarget;
+    generateMoves(pos, moves);
+    // the square is either the next landing of some routes or where some routes end; the same
+    // landings make the same captures, so a route clicked to its end is a single move
+    const Move* stepped = nullptr;
+    const Move* ended = nullptr;
+    int steps = 0, ends = 0;
+    size_t next = picker.steps.size();
+    for(const Move& m : moves){
+        if(!followsSteps(m, picker))
+            continue;
+        if(landingAt(m, next) == square){
+            if(next == m.pathLength){
+                move = m;
+                return playTarget;
             }
-
-            // Determine the direction of movement
-            int rowDirection = (targetCell.row > selectedCell.row) ? 1 : -1;
-            int colDirection = (targetCell.col > selectedCell.col) ? 1 : -1;
-
-            do {
-                int nextrow = selectedCell.row + 2 * rowDirection;
-                int nextcol = selectedCell.col + 2 * colDirection;
-
-                // Set the next potential cell based on direction and check for pieces
-                nextcell.row = nextrow;
-                nextcell.col = nextcol;
-
-                // Calculate the intermediate cell position (the cell being captured)
-                midrow = (selectedCell.row + nextcell.row) / 2;
-                midcol = (selectedCell.col + nextcell.col) / 2;
-
-                Cell removeCell;
-                removeCell.row = midrow;
-                removeCell.col = midcol;
-
-                // Check if the intermediate cell has an opponent's Qorki
-                if ((cells[midrow][midcol].cellType != cells[selectedCell.row][selectedCell.col].cellType) && (cells[midrow][midcol].cellType !=turntype.cellType) && (cells[midrow][midcol].cellType != emptyCell)) {
-                    
-                    // Capture the Qorki
-                    removeQorki(removeCell, cells);
-
-                    // Update scores based on which player performed the capture
-                    if((cells[selectedCell.row][selectedCell.col].cellType == player1Qorki) || 
-                    cells[selectedCell.row][selectedCell.col].cellType == player1KingQorki) {
-                        game.p1++;
-                    } else if((cells[selectedCell.row][selectedCell.col].cellType == player2Qorki) || 
-                            cells[selectedCell.row][selectedCell.col].cellType == player2KingQorki) {
-                        game.p2++;
-                    }
-                    winner(selectedCell,targetCell,cells, game);
-
-                    // Move the KingQorki to the next cell
-                    moveQorki(selectedCell, nextcell, cells, move);
-                    
-                } else {
-                    // No valid capture found, move is invalid
-                    return false;
-                }
-
-                // Update selectedCell to the new position for potential second capture
-                if(count == 1) {
-                    selectedCell = nextcell;
-                    nextcell = targetCell;
-                }
-
-                count++;
-            } while(count == repet);
-            game.turn = !game.turn;
+            stepped = &m;
+            steps++;
+        }else if(m.to == square){
+            ended = &m;
+            ends++;
         }
-        return false; 
-    }else if (abs(selectedCell.row - targetCell.row) == 2 && abs(selectedCell.col - targetCell.col) == 2) {
-        // Check the intermediate cell to see if there is an opponent's Qorki
-        int midRow = (selectedCell.row + targetCell.row) / 2;
-        int midCol = (selectedCell.col + targetCell.col) / 2;
-        Cell removeCell;
-        removeCell.row = midRow;
-        removeCell.col = midCol;
-
-        // Check if the intermediate cell has an opponent's Qorki
-        if ((cells[midRow][midCol].cellType != cells[selectedCell.row][selectedCell.col].cellType) && (cells[midRow][midCol].cellType !=turntype.cellType) &&(cells[midRow][midCol].cellType != emptyCell)) {
-                removeQorki(removeCell, cells);
-                if((cells[selectedCell.row][selectedCell.col].cellType == player1Qorki) || cells[selectedCell.row][selectedCell.col].cellType == player1KingQorki){
-                    game.p1++;
-                }
-                else if((cells[selectedCell.row][selectedCell.col].cellType == player2Qorki) || cells[selectedCell.row][selectedCell.col].cellType == player2KingQorki){
-                    game.p2++;
-                }
-                winner(selectedCell,targetCell,cells, game);
-                return true;   
-        }
-        else{
-            return false;
-        }
-    }else{
-        return false;
     }
-    // implement all other conditions
-    return true;
+    if(steps + ends == 1){
+        move = steps ? *stepped : *ended;
+        return playTarget;
+    }
+    if(steps)
+        return stepTarget;
+    return ends ? ambiguousTarget : noTarget;
 }
 
-bool isKingMoveValid(Cell selectedCell, Cell targetCell, Cell cells[8][8], Game& game, Sound& move){
-    Cell turntype;
-    //This is so that only not the selected type and the one that is being capured shouldnt be the same but also there normal couter parts
-    if(game.turn){
-        turntype.cellType = player1Qorki;
-    }else{
-        turntype.cellType = player2Qorki;
+uint32_t nextLandings(const Position& pos, const MovePicker& picker){
+    static MoveList moves;
+    uint32_t landings = 0;
+    if(picker.selected < 0)
+        return 0;
+    generateMoves(pos, moves);
+    for(const Move& m : moves){
+        if(followsSteps(m, picker))
+            landings |= 1u << landingAt(m, picker.steps.size());
     }
-    // Check if the selected cell has a Qorki
-    if (cells[selectedCell.row][selectedCell.col].cellType == emptyCell)
-        return false;
-    // Check if the target cell already has a Qorki
-    if (cells[targetCell.row][targetCell.col].cellType != emptyCell){
-        return false;
-    } 
-    // Check if the selected cell and the target cell are the same
-    if (selectedCell.row == targetCell.row && selectedCell.col == targetCell.col)
-        return false;
-    if (abs(selectedCell.row - targetCell.row) == 1 && abs(selectedCell.col - targetCell.col) == 1) {
-        return true;
-    } else if (abs(selectedCell.row - targetCell.row) == 2 && abs(selectedCell.col - targetCell.col) == 2) {
-        // Check the intermediate cell to see if there is an opponent's Qorki
-        int midRow = (selectedCell.row + targetCell.row) / 2;
-        int midCol = (selectedCell.col + targetCell.col) / 2;
-        Cell removeCell;
-        removeCell.row = midRow;
-        removeCell.col = midCol;
-
-        // Check if the intermediate cell has an opponent's Qorki
-        if ((cells[midRow][midCol].cellType != cells[selectedCell.row][selectedCell.col].cellType) && (cells[midRow][midCol].cellType !=turntype.cellType) &&(cells[midRow][midCol].cellType != emptyCell)) {
-                removeQorki(removeCell, cells);
-                if((cells[selectedCell.row][selectedCell.col].cellType == player1Qorki) || cells[selectedCell.row][selectedCell.col].cellType == player1KingQorki){
-                    game.p1++;
-                }
-                else if((cells[selectedCell.row][selectedCell.col].cellType == player2Qorki) || cells[selectedCell.row][selectedCell.col].cellType == player2KingQorki){
-                    game.p2++;
-                }
-                winner(selectedCell,targetCell,cells, game);
-                return true;   
-        }else if ((cells[midRow][midCol].cellType == emptyCell)){
-            return true;
-        }else{
-            return false;
-        }
-    }else if (abs(selectedCell.row - targetCell.row) > 2 ) {
-        int row, col; // The direction of the row and column
-        int rowdiff = targetCell.row - selectedCell.row;
-        int coldiff = targetCell.col - selectedCell.col;
-
-        if(abs(selectedCell.col - targetCell.col) == 0){
-            Cell nextcell;
-            Cell guess;
-            int midrow;
-            int midcol;
-            int count = 1;
-
-            // Determine the direction of movement
-            int rowDirection = (targetCell.row > selectedCell.row) ? 1 : -1;
-            if (rowDirection == 1){
-                guess.row = selectedCell.row - 1;
-                guess.col = selectedCell.col + 1;
-                guess.cellType = cells[guess.row][guess.col].cellType;
-            }
-            else{
-                guess.row = selectedCell.row + 1;
-                guess.col = selectedCell.col + 1;
-                guess.cellType = cells[guess.row][guess.col].cellType;
-            }
-            int colDirection = (guess.cellType != emptyCell) ? 1 : -1;
-
-            do {
-                int nextrow = selectedCell.row + 2 * rowDirection;
-                int nextcol = selectedCell.col + 2 * colDirection;
-
-                // Set the next potential cell based on direction and check for pieces
-                nextcell.row = nextrow;
-                nextcell.col = nextcol;
-
-                // Checks if the next cell is out of the board
-                if (nextcell.col < 0) {
-                    return false;
-                }else if (nextcell.col > 7) {
-                    return false;
-                }
-                if (nextcell.row < 0) {
-                    return false;
-                }else if (nextcell.row > 7) {
-                    return false;
-                }
-
-                if(cells[nextrow][nextcol].cellType != emptyCell){
-                    return false;
-                }
-
-                // Calculate the intermediate cell position (the cell being captured)
-                midrow = (selectedCell.row + nextcell.row) / 2;
-                midcol = (selectedCell.col + nextcell.col) / 2;
-
-                Cell removeCell;
-                removeCell.row = midrow;
-                removeCell.col = midcol;
-
-                // Check if the intermediate cell has an opponent's Qorki
-                if ((cells[midrow][midcol].cellType != cells[selectedCell.row][selectedCell.col].cellType) && (cells[midrow][midcol].cellType !=turntype.cellType) && (cells[midrow][midcol].cellType != emptyCell)) {
-                    
-                    // Capture the Qorki
-                    removeQorki(removeCell, cells);
-
-                    // Update scores based on which player performs the capture
-                    if((cells[selectedCell.row][selectedCell.col].cellType == player1Qorki) || 
-                    cells[selectedCell.row][selectedCell.col].cellType == player1KingQorki) {
-                        game.p1++;
-                    } else if((cells[selectedCell.row][selectedCell.col].cellType == player2Qorki) || 
-                            cells[selectedCell.row][selectedCell.col].cellType == player2KingQorki) {
-                        game.p2++;
-                    }
-                    winner(selectedCell,targetCell,cells, game);
-
-                    // Move the KingQorki to the next cell
-                    moveQorki(selectedCell, nextcell, cells, move);
-                    
-                } else {
-                    // No valid capture found, move is invalid
-                    return false;
-                }
+    return landings;
+}
 
-                // Update selectedCell to the new position for potential second capture
-                if(count == 1) {
-                    selectedCell = nextcell;
-                    nextcell = targetCell;
-                }
-                colDirection = (nextcell.col > selectedCell.col) ? 1 : -1;
-                count++;
-            } while(count == 2);
-            game.turn = !game.turn;
-        }else if(abs(rowdiff) != abs(coldiff)){
-                return false;
-        }else if(abs(selectedCell.col - targetCell.col) > 2){
-            Cell nextcell;
-            Cell removeCell;
-            int rowDirection = (targetCell.row > selectedCell.row) ? 1 : -1;
-            int colDirection = (targetCell.col > selectedCell.col) ? 1 : -1;
-
-            row = selectedCell.row + rowDirection;
-            col = selectedCell.col + colDirection;
-
-            while (row != targetCell.row && col != targetCell.col) {
-                if (cells[row][col].cellType != emptyCell) {
-                    removeCell.row = row;
-                    removeCell.col = col;
-                    if ((cells[row][col].cellType != cells[selectedCell.row][selectedCell.col].cellType) && (cells[row][col].cellType !=turntype.cellType)) {
-                        if(cells[row+rowDirection][col+colDirection].cellType != emptyCell){
-                            return false;
-                        }
-                        removeQorki(removeCell, cells);
-                        // Update scores based on which player performed the capture
-                        if(cells[selectedCell.row][selectedCell.col].cellType == player1KingQorki) {
-                            game.p1 = game.p1 + 1;
-                        } else if(cells[selectedCell.row][selectedCell.col].cellType == player2KingQorki) {
-                            game.p2 = game.p2 + 1;
-                        }
-                        winner(selectedCell,targetCell,cells, game);
-                    }
-                    else if ((cells[row][col].cellType == cells[selectedCell.row][selectedCell.col].cellType) || (cells[row][col].cellType ==turntype.cellType)){
-                        return false;
-                    }
-                }
-                row += rowDirection;
-                col += colDirection;
-            }
-            return true;
-        }
-        return false;
+void replayKeys(Game& game, EngineWorker& engine, const GameEvents& events){
+    if(IsKeyPressed(KEY_RIGHT) && !game.redo.empty()){
+        engine.cancel();
+        replayMove(game, events);
+        winner(game);
+    }else if(IsKeyPressed(KEY_LEFT) && !game.history.empty()){
+        engine.cancel();
+        takeBack(game, events);
+        winner(game);
+        // the journal only appends, so the shorter game starts a new one
+        sharedJournal().begin(savedGame(game));
     }
-    return false;
 }
-void winner(Cell selectedCell, Cell targetCell, Cell cells[8][8], Game& game){
-    bool playeronemove = false;
-    bool playertwomove = false;
-    if (game.p1 == 11 && game.p2 < 11) {
-        for (int row = 0; row < 8; ++row) {
-            for (int col = 0; col < 8; ++col) {
-                if (cells[row][col].cellType == player2Qorki) {
-                    selectedCell.row = row;
-                    selectedCell.col = col;
-                    selectedCell.cellType = player2Qorki;
-                }
-            }
-        }
-        targetCell.row = selectedCell.row + 1;
-        targetCell.col = selectedCell.col + 1;
-        targetCell.cellType = cells[targetCell.row][targetCell.col].cellType;
-        if(stalmate(selectedCell,targetCell,cells, game)){
-            playeronemove = true;
-        }
-        targetCell.row = selectedCell.row + 2;
-        targetCell.col = selectedCell.col + 2;
-        targetCell.cellType = cells[targetCell.row][targetCell.col].cellType;
-        if(stalmate(selectedCell,targetCell,cells, game)){
-            playeronemove = true;
-        }
-        targetCell.row = selectedCell.row + 1;
-        targetCell.col = selectedCell.col - 1;
-        targetCell.cellType = cells[targetCell.row][targetCell.col].cellType;
-        if(stalmate(selectedCell,targetCell,cells, game)){
-            playeronemove = true;
-        }
-        targetCell.row = selectedCell.row + 2;
-        targetCell.col = selectedCell.col - 2;
-        targetCell.cellType = cells[targetCell.row][targetCell.col].cellType;
-        if(stalmate(selectedCell,targetCell,cells, game)){
-            playeronemove = true;
+
+void computerMove(Game& game, EngineWorker& engine, const GameEvents& events){
+    static Position expected;           // the position the computer expects after the human's reply
+    static bool hasExpected = false;
+    bool cpuToMove = !game.winner && (game.position.whiteToMove ? game.playerOneCpu : game.playerTwoCpu);
+    if(!cpuToMove){
+        bool cpuToReply = !game.winner && (game.position.whiteToMove ? game.playerTwoCpu : game.playerOneCpu);
+        if(engine.isPondering()){
+            if(!cpuToReply)
+                engine.cancel();
+            return;
         }
-        if (!playeronemove) {
-            game.winner = 1;  // Player 1 wins
+        // the computer was switched off while thinking
+        if(engine.waiting())
+            engine.cancel();
+        if(CPU_PONDER && cpuToReply && hasExpected){
+            SearchLimits limits;
+            limits.seconds = CPU_MOVE_SECONDS;
+            limits.threads = std::thread::hardware_concurrency() ? std::thread::hardware_concurrency() : 1;
+            engine.ponder(expected, limits);
         }
-    } else if (game.p2 == 11 && game.p1 < 11) {
-        for (int row = 0; row < 8; ++row) {
-            for (int col = 0; col < 8; ++col) {
-                if (game.cellInfo[row][col].cellType == player1Qorki) {
-                    selectedCell.row = row;
-                    selectedCell.col = col;
-                    selectedCell.cellType = player1Qorki;
-                }
+        hasExpected = false;
+        return;
+    }
+    // on a hit the ponder search goes on with its time counted, on a miss it is cancelled
+    if(engine.isPondering())
+        engine.ponderHit(game.position);
+
+    EngineResponse response;
+    while(engine.poll(response)){
+        // an answer about a position that is no longer on the board is stale
+        if(!samePosition(response.position, game.position))
+            continue;
+        const SearchResult& result = response.result;
+        if(result.hasMove){
+            EngineStats stats = engine.stats();
+            if(result.bookMove){
+                cout << "CPU plays " << moveToString(result.best) << " (book)" << endl;
+            }else{
+                cout << "CPU plays " << moveToString(result.best) << " (depth " << result.depth
+                     << ", score " << result.score << ", " << result.nodes << " nodes, ponder hits "
+                     << stats.ponderHits << "/" << stats.ponders << ")" << endl;
             }
+            hasExpected = result.pvLength >= 2;
+            if(hasExpected)
+                expected = applyMove(applyMove(game.position, result.best), result.pv[1]);
+            playMove(game, result.best, events);
         }
-        targetCell.row = selectedCell.row - 1;
-        targetCell.col = selectedCell.col + 1;
-        targetCell.cellType = cells[targetCell.row][targetCell.col].cellType;
-        if(stalmate(selectedCell,targetCell,cells, game)){
-            playertwomove = true;
-        }
-        targetCell.row = selectedCell.row - 2;
-        targetCell.col = selectedCell.col + 2;
-        targetCell.cellType = cells[targetCell.row][targetCell.col].cellType;
-        if(stalmate(selectedCell,targetCell,cells, game)){
-            playertwomove = true;
-        }
-        targetCell.row = selectedCell.row - 1;
-        targetCell.col = selectedCell.col - 1;
-        targetCell.cellType = cells[targetCell.row][targetCell.col].cellType;
-        if(stalmate(selectedCell,targetCell,cells, game)){
-            playertwomove = true;
-        }
-        targetCell.row = selectedCell.row - 2;
-        targetCell.col = selectedCell.col - 2;
-        targetCell.cellType = cells[targetCell.row][targetCell.col].cellType;
-        if(stalmate(selectedCell,targetCell,cells, game)){
-            playertwomove = true;
-
-        } 
-        if (!playertwomove) {
-            game.winner = 2;  // Player 2 wins
-        }
+        winner(game);
+        return;
     }
-    if (game.p1 == 12) {
-        game.winner = 1;  // Player One won
-    } else if (game.p2 == 12) {
-        game.winner = 2;  // Player Two won
+    if(!engine.waiting()){
+        SearchLimits limits;
+        limits.seconds = CPU_MOVE_SECONDS;
+        limits.threads = std::thread::hardware_concurrency() ? std::thread::hardware_concurrency() : 1;
+        engine.submit(game.position, limits);
     }
 }
+
+void winner(Game& game){
+    game.winner = winnerOf(game.position);
+    // in a known endgame the side panel tells how it ends with best play
+    uint8_t value;
+    if(countSquares(game.position.white | game.position.black) <= sharedTablebase().pieces() &&
+       sharedTablebase().probe(game.position, value)){
+        game.endgame = value;
+    }else{
+        game.endgame = -1;
+    }
+    // a lookup is a binary search of the mapped index, cheap enough for every move
+    sharedPositionIndex().lookup(game.position, game.archive);
+}
+
 bool is_mouse_over_button(Button button){
     return CheckCollisionPointRec(GetMousePosition(), button.rect);
 }
-void resetGame(Game& game, Sound& move, Sound& click) {
+void resetGame(Game& game) {
     game.p1 = 0;
     game.p2 = 0;
-    game.turn = true;
     game.winner = 0;
 
     // Reset any other game-related variables as needed
@@ -1043,474 +1116,469 @@ void resetGame(Game& game, Sound& move, Sound& click) {
     // Reinitialize the game
     initGame(game);
     initBoard(game.board);
-
-    // Reload the sound
-    move = LoadSound("Game sound\\gamesound.wav");
-    click = LoadSound("Game sound\\click.wav");
-    SetSoundVolume(move, 1.0f);
-    SetSoundVolume(click, 1.0f);
+    sharedJournal().begin(savedGame(game));
 }
-void text_input(std::string& file, std::string type, Sound& click){
-    const int screenWidth = 800;
-    const int screenHeight = 450;
-    int MAX_INPUT_CHARS = 20;
-
-    InitWindow(screenWidth, screenHeight, "Input File Name");
-
-    char name[MAX_INPUT_CHARS + 1] = "\0";      // NOTE: One extra space required for null terminator char '\0'
-    int letterCount = 0;
-
-    Rectangle textBox = { screenWidth/2.0f - 260, 180, 520, 50 };
-    bool mouseOnText = false;
-
-    int framesCounter = 0;
-
-    SetTargetFPS(60);               // Set our game to run at 60 frames-per-second
-    //--------------------------------------------------------------------------------------
+Vector2 drawOverlay(const Layout& layout, float width, float height){
+    // the board stays under the dialog, dimmed
+    DrawRectangle(0, 0, layout.width, layout.height, (Color){0, 0, 0, 110});
+    int w = layout.px(width), h = layout.px(height);
+    Vector2 origin = {(float)((layout.width - w) / 2), (float)((layout.height - h) / 2)};
+    DrawRectangle((int)origin.x + layout.px(4), (int)origin.y + layout.px(4), w, h, BLACK);
+    DrawRectangle((int)origin.x, (int)origin.y, w, h, RAYWHITE);
+    return origin;
+}
+void typeText(TextField& field){
+    // Get char pressed (unicode character) on the queue
+    int key = GetCharPressed();
 
-    // Main game loop
-    while (!WindowShouldClose())    // Detect window close button or ESC key
+    // Check if more characters have been pressed on the same frame
+    while (key > 0)
     {
-        // Update
-        //----------------------------------------------------------------------------------
-        if (CheckCollisionPointRec(GetMousePosition(), textBox)){
-            mouseOnText = true;
-        }else{
-            mouseOnText = false;
-        }    
-
-        if (mouseOnText)
-        {
-            // Set the window's cursor to the I-Beam
-            SetMouseCursor(MOUSE_CURSOR_IBEAM);
-
-            // Get char pressed (unicode character) on the queue
-            int key = GetCharPressed();
-
-            // Check if more characters have been pressed on the same frame
-            while (key > 0)
-            {
-                // NOTE: Only allow keys in range [32..125]
-                if ((key >= 32) && (key <= 125) && (letterCount < MAX_INPUT_CHARS))
-                {
-                    name[letterCount] = (char)key;
-                    name[letterCount+1] = '\0'; // Add null terminator at the end of the string.
-                    letterCount++;
-                }
-
-                key = GetCharPressed();  // Check next character in the queue
-            }
+        // NOTE: Only allow keys in range [32..125]
+        if ((key >= 32) && (key <= 125) && ((int)field.text.size() < field.maxChars))
+            field.text += (char)key;
 
-            if (IsKeyPressed(KEY_BACKSPACE))
-            {
-                letterCount--;
-                if (letterCount < 0) letterCount = 0;
-                name[letterCount] = '\0';
-            }
-        }
-        else SetMouseCursor(MOUSE_CURSOR_DEFAULT);
+        key = GetCharPressed();  // Check next character in the queue
+    }
 
-        if (mouseOnText) {
-            framesCounter++;
-        }else {
-            framesCounter = 0;
-        }
-        bool isDatFile = (letterCount >= 4 &&
-                  name[letterCount - 4] == '.' &&
-                  name[letterCount - 3] == 'd' &&
-                  name[letterCount - 2] == 'a' &&
-                  name[letterCount - 1] == 't');
-        //----------------------------------------------------------------------------------
-
-        // Draw
-        //----------------------------------------------------------------------------------
-        BeginDrawing();
+    if (IsKeyPressed(KEY_BACKSPACE) && !field.text.empty())
+        field.text.pop_back();
+}
+void drawTextField(TextField& field, Rectangle box, bool active, const Layout& layout){
+    DrawRectangleRec(box, LIGHTGRAY);
+    DrawRectangleLines((int)box.x, (int)box.y, (int)box.width, (int)box.height, active ? RED : DARKGRAY);
+    DrawText(field.text.c_str(), (int)box.x + layout.px(5), (int)box.y + layout.px(8), layout.px(40), MAROON);
+    if (!active) {
+        field.framesCounter = 0;
+        return;
+    }
+    field.framesCounter++;
+    // Draw blinking underscore char
+    if ((int)field.text.size() < field.maxChars && ((field.framesCounter/20)%2) == 0)
+        DrawText("_", (int)box.x + layout.px(8) + MeasureText(field.text.c_str(), layout.px(40)), (int)box.y + layout.px(12), layout.px(40), MAROON);
+}
+bool text_input(TextField& file, const std::string& type, const Layout& layout, const Sound& click){
+    Vector2 o = drawOverlay(layout, 800, 450);
+    Rectangle textBox = layout.rect(o, 140, 180, 520, 50);
+    bool mouseOnText = CheckCollisionPointRec(GetMousePosition(), textBox);
 
-            ClearBackground(RAYWHITE);
+    if (mouseOnText)
+    {
+        // Set the window's cursor to the I-Beam
+        SetMouseCursor(MOUSE_CURSOR_IBEAM);
+        typeText(file);
+    }
+    else SetMouseCursor(MOUSE_CURSOR_DEFAULT);
 
-            DrawText("Enter File Name", 310, 100, 20, GRAY);
-            DrawText("Needs to be .dat format", 270, 140, 20, GRAY);
+    // a save file or a PDN file; a PDN game to load may be picked with "#N"
+    std::string plain = type == "load" ? file.text.substr(0, file.text.rfind('#')) : file.text;
+    bool isGameFile = hasExtension(plain, ".dat") || hasExtension(plain, ".pdn");
 
-            DrawRectangleRec(textBox, LIGHTGRAY);
-            if (mouseOnText) DrawRectangleLines((int)textBox.x, (int)textBox.y, (int)textBox.width, (int)textBox.height, RED);
-            else DrawRectangleLines((int)textBox.x, (int)textBox.y, (int)textBox.width, (int)textBox.height, DARKGRAY);
+    DrawText("Enter File Name", (int)o.x + layout.px(310), (int)o.y + layout.px(100), layout.px(20), GRAY);
+    DrawText("Needs to be .dat or .pdn format", (int)o.x + layout.px(245), (int)o.y + layout.px(140), layout.px(20), GRAY);
 
-            DrawText(name, (int)textBox.x + 5, (int)textBox.y + 8, 40, MAROON);
+    drawTextField(file, textBox, mouseOnText, layout);
 
-            DrawText(TextFormat("INPUT CHARS: %i/%i", letterCount, MAX_INPUT_CHARS), 290, 250, 20, DARKGRAY);
+    DrawText(TextFormat("INPUT CHARS: %i/%i", (int)file.text.size(), file.maxChars), (int)o.x + layout.px(290), (int)o.y + layout.px(250), layout.px(20), DARKGRAY);
 
-            if (mouseOnText)
-            {
-                if (letterCount < MAX_INPUT_CHARS)
-                {
-                    // Draw blinking underscore char
-                    if (((framesCounter/20)%2) == 0) DrawText("_", (int)textBox.x + 8 + MeasureText(name, 40), (int)textBox.y + 12, 40, MAROON);
-                }
-                else DrawText("Press BACKSPACE to delete chars...", 230, 300, 20, GRAY);
-            }
-            file = std::string(name);
-            Button button1, button2;
-            button1.rect = {320, 320, 115, 50};
-            button2.rect = {320, 320, 120, 50};
-            button1.color = SKYBLUE;
-            button2.color = PINK;
-            if(type == "save"){
-                DrawRectangle(435, 325, 4, 45, BLACK);
-                DrawRectangle(325, 370, 114, 4, BLACK);
-                DrawRectangleRec(button1.rect, button1.color);
-                DrawText("Save", 355, 335, 20, BLACK);
-                if (isDatFile && (is_mouse_over_button(button1)) && (IsMouseButtonPressed(MOUSE_BUTTON_LEFT))) {
-                    PlaySound(click);
-                    break;
-                }else if (isDatFile && (IsKeyPressed(KEY_ENTER))) {
-                    break; 
-                }
-            }else if(type == "load"){
-                DrawRectangle(440, 325, 4, 45, BLACK);
-                DrawRectangle(325, 370, 119, 4, BLACK);
-                DrawRectangleRec(button2.rect, button2.color);
-                DrawText("Load", 355, 335, 20, BLACK);
-                if (isDatFile && (is_mouse_over_button(button2)) && (IsMouseButtonPressed(MOUSE_BUTTON_LEFT))) {
-                    PlaySound(click);
-                    break;
-                }else if (isDatFile && (IsKeyPressed(KEY_ENTER))) {
-                    break; 
-                }
-            }
+    if (mouseOnText && (int)file.text.size() >= file.maxChars)
+        DrawText("Press BACKSPACE to delete chars...", (int)o.x + layout.px(230), (int)o.y + layout.px(300), layout.px(20), GRAY);
+    DrawText("ESC to go back", (int)o.x + layout.px(315), (int)o.y + layout.px(395), layout.px(20), GRAY);
 
-        EndDrawing();
-        //----------------------------------------------------------------------------------
+    Button button;
+    button.rect = layout.rect(o, 320, 320, 115, 50);
+    button.color = type == "save" ? SKYBLUE : PINK;
+    DrawRectangle((int)o.x + layout.px(435), (int)o.y + layout.px(325), layout.px(4), layout.px(45), BLACK);
+    DrawRectangle((int)o.x + layout.px(325), (int)o.y + layout.px(370), layout.px(114), layout.px(4), BLACK);
+    DrawRectangleRec(button.rect, button.color);
+    DrawText(type == "save" ? "Save" : "Load", (int)o.x + layout.px(355), (int)o.y + layout.px(335), layout.px(20), BLACK);
+    if (isGameFile && (is_mouse_over_button(button)) && (IsMouseButtonPressed(MOUSE_BUTTON_LEFT))) {
+        PlaySound(click);
+        SetMouseCursor(MOUSE_CURSOR_DEFAULT);
+        return true;
     }
-    // De-Initialization
-    //--------------------------------------------------------------------------------------
-    CloseWindow();    // Close window and OpenGL context
-    //--------------------------------------------------------------------------------------
+    if (isGameFile && (IsKeyPressed(KEY_ENTER))) {
+        SetMouseCursor(MOUSE_CURSOR_DEFAULT);
+        return true;
+    }
+    return false;
 }
 // Save game state to a file
-void savegame(Game &game, Sound& click) {
-    std::string type ="save";
-    std::string file;
-    text_input(file, type, click);
-    ofstream save(file, ios::binary);
-
-    // Check if the file opened successfully
-    if (!save.is_open()) {
-        cout << "Error: Unable to open file for saving." << endl;
-        return;  // Avoid exit(1); just return and handle the error in calling function
+void savegame(Game &game, const std::string& file) {
+    if (hasExtension(file, ".pdn")) {
+        PdnGame pdn;
+        pdn.setTag("Event", "DAMA game");
+        // player one moves first, which is Black in PDN
+        pdn.setTag("Black", game.playerOneName);
+        pdn.setTag("White", game.playerTwoName);
+        pdn.start = game.firstPosition;
+        pdn.moves = game.history;
+        pdn.result = game.winner == 1 ? pdnPlayerOneWins : game.winner == 2 ? pdnPlayerTwoWins : pdnUnfinished;
+        std::string text;
+        writePdnGame(text, pdn);
+        ofstream save(file, ios::binary);
+        if (!save.write(text.data(), text.size())) {
+            cerr << "Error: Unable to save the game to " << file << "." << endl;
+        } else {
+            cout << "Game saved as PDN!" << endl;
+        }
+        return;
     }
-
-    // Attempt to write to the file
-    save.write(reinterpret_cast<char *>(&game), sizeof(game));
-    if (!save) {  // Check if the write operation failed
-        cerr << "Error: Failed to save game data." << endl;
+    if (writeSaveFile(file, savedGame(game)) != saveOk) {
+        cerr << "Error: Unable to save the game to " << file << "." << endl;
     } else {
         cout << "Game saved successfully!" << endl;
     }
-
-    // Close the file
-    save.close();
 }
 
 // Load game state from a file
-void loadgame(Game& game, Sound& click) {
-    std::string type ="load";
-    std::string file;
-    text_input(file, type, click);
-    ifstream load(file, ios::binary);
-
-    // Check if the file opened successfully
-    if (!load.is_open()) {
-        cerr << "Error: Unable to open file for loading." << endl;
-        return;  // Avoid exit(1); just return and handle the error in calling function
+void loadgame(Game& game, const std::string& file) {
+    // the game is only touched once the whole file has been checked
+    SavedGame saved;
+    if (hasExtension(file.substr(0, file.rfind('#')), ".pdn")) {
+        if (loadPdnGame(file, saved)) {
+            std::vector<Move> moves = saved.history;
+            saved.history.clear();
+            restoreGame(game, saved);
+            game.redo.assign(moves.rbegin(), moves.rend());
+            sharedJournal().begin(saved);
+        }
+        return;
     }
-
-    // Attempt to read from the file
-    load.read(reinterpret_cast<char *>(&game), sizeof(game));
-    if (!load) {  // Check if the read operation failed
-        cerr << "Error: Failed to load game data." << endl;
-    } else {
-        cout << "Game loaded successfully!" << endl;
+    int status = readSaveFile(file, saved);
+    if (status != saveOk && status != saveLegacyConverted) {
+        cerr << "Error: " << saveStatusText(status) << "." << endl;
+        return;
     }
-
-    // Close the file
-    load.close();
+    cout << "Game loaded successfully! (" << saveStatusText(status) << ")" << endl;
+    restoreGame(game, saved);
+    sharedJournal().begin(saved);
 }
-void help_page(Game &game, Sound& click) {
-    // Create a new window for the help page
-    InitWindow((game.board.boardWidth / 2) + 90, game.board.boardHeight / (3 / 2) - 60, "Help - Checkers Game");
-     
-    while (!WindowShouldClose()) {
-        BeginDrawing();
-        ClearBackground(RAYWHITE);
-        // Draw game instructions
-        DrawText( "How To Play:",20 , 30, 35, BLACK);
-        DrawText("--> Two players take turns moving their", 13, 100, 20, BLACK);
-        DrawText("pieces diagonally across an 8x8 board.", 13, 120, 20, BLACK);
-        DrawText("--> Each player has 12 pieces to start.", 13, 140, 20, BLACK);
-        DrawText("--> Regular Pieces can only move forward ", 13, 160, 20, BLACK);
-        DrawText("diagonally.", 13, 180, 20, BLACK);
-        DrawText("--> king pieces can move both forward and", 13, 200, 20, BLACK);
-        DrawText("backward.", 13, 220, 20, BLACK);
-        DrawText("--> Kings are promoted when regular pieces", 13, 240, 20, BLACK);
-        DrawText(" reach the opponent's back row.", 13 , 260 , 20 , BLACK);
-        DrawText("--> To capture opponent's piece, jump over it", 13, 280, 20, BLACK);
-        DrawText("diagonally into an empty space. and ", 13, 300, 20, BLACK);
-        DrawText("--> Its mandatory when its possible.", 13, 320, 20, BLACK); 
-        DrawText("-->The game ends when a player captures all ", 13, 340, 20, BLACK);
-        DrawText("of the other pieces or blocks them from", 13, 360, 20, BLACK);
-        DrawText(" making any moves.", 13, 380, 20, BLACK);
-      
-        
-
-        // Draw a button to return to the game
-        Button CONTINUE;
-        CONTINUE.rect = { 150, 480, 150, 50 };
-        CONTINUE.color = DARKGRAY;
-        int segment = 10;
-        float roundness = 0.6f;
-        Rectangle Gshadow = {154, 484, 150, 50};
-        DrawRectangleRounded(Gshadow, roundness, segment, BLACK);
-        DrawRectangleRounded(CONTINUE.rect, roundness , segment, CONTINUE.color);
-        DrawText("GOT IT!", 175, 495, 20, WHITE);
-
-        // Check for mouse input to return to the game
-        if (IsMouseButtonPressed(MOUSE_LEFT_BUTTON) && is_mouse_over_button(CONTINUE)) {
-            PlaySound(click);
-            CloseWindow();  // Close the help window
-            return;         // Exit the help page function
-            
-        }
 
-        EndDrawing();
+bool hasExtension(const std::string& file, const char* extension) {
+    size_t length = strlen(extension);
+    if (file.size() < length)
+        return false;
+    for (size_t i = 0; i < length; i++) {
+        if (tolower((unsigned char)file[file.size() - length + i]) != extension[i])
+            return false;
     }
-       
-       
-     // Close the help window when done
+    return true;
 }
-void player_name(Game& game, Sound& click){
-    const int screenWidth = 800;
-    const int screenHeight = 450;
-    int MAX_INPUT_CHARS = 14;
 
-    InitWindow(screenWidth, screenHeight, "Enter player name");
+bool loadPdnGame(const std::string& file, SavedGame& saved) {
+    std::string path = file;
+    long wanted = 1;
+    size_t hash = file.rfind('#');
+    if (hash != std::string::npos) {
+        path = file.substr(0, hash);
+        wanted = atol(file.c_str() + hash + 1);
+    }
+    PdnReader reader;
+    if (!reader.open(path)) {
+        cerr << "Error: Unable to open " << path << "." << endl;
+        return false;
+    }
+    PdnGame pdn;
+    long number = 0;
+    while (number < wanted && reader.next(pdn))
+        number++;
+    if (number < wanted || wanted < 1) {
+        cerr << "Error: " << path << " has no game " << wanted << "." << endl;
+        return false;
+    }
+    if (!pdn.error.empty()) {
+        cerr << "Error: game " << wanted << " of " << path << ": " << pdn.error << "." << endl;
+        return false;
+    }
+    saved = SavedGame();
+    saved.start = pdn.start;
+    saved.position = pdn.start;
+    saved.history = pdn.moves;
+    const std::string* black = pdn.tag("Black");
+    const std::string* white = pdn.tag("White");
+    saved.playerOneName = black && !black->empty() ? *black : "Player 1";
+    saved.playerTwoName = white && !white->empty() ? *white : "Player 2";
+    cout << "Loaded game " << wanted << " of " << path << ": " << pdn.moves.size()
+         << " moves, step through them with the arrow keys" << endl;
+    return true;
+}
 
-    char p1[MAX_INPUT_CHARS + 1] = "\0"; 
-    char p2[MAX_INPUT_CHARS + 1] = "\0";     // NOTE: One extra space required for null terminator char '\0'
-    int p1letterCount = 0;
-    int p2letterCount = 0;
+SavedGame savedGame(const Game& game) {
+    SavedGame saved;
+    saved.start = game.firstPosition;
+    saved.history = game.history;
+    saved.position = game.position;
+    saved.playerOneName = game.playerOneName;
+    saved.playerTwoName = game.playerTwoName;
+    saved.p1 = game.p1;
+    saved.p2 = game.p2;
+    saved.winner = game.winner;
+    saved.playerOneCpu = game.playerOneCpu;
+    saved.playerTwoCpu = game.playerTwoCpu;
+    return saved;
+}
 
-    Rectangle textBox = { screenWidth/2.0f - 260, 120, 520, 50 };
-    Rectangle textBox2 = { screenWidth/2.0f - 260, 220, 520, 50 };
+void restoreGame(Game& game, const SavedGame& saved) {
+    game.firstPosition = saved.start;
+    game.history = saved.history;
+    game.position = saved.position;
+    game.playerOneName = saved.playerOneName;
+    game.playerTwoName = saved.playerTwoName;
+    game.p1 = saved.p1;
+    game.p2 = saved.p2;
+    game.winner = saved.winner;
+    game.playerOneCpu = saved.playerOneCpu;
+    game.playerTwoCpu = saved.playerTwoCpu;
+    game.redo.clear();
+    game.endgame = -1;
+    winner(game);
+}
+bool help_page(const Layout& layout, const Sound& click) {
+    Vector2 o = drawOverlay(layout, 490, 740);
+    // Draw game instructions
+    DrawText( "How To Play:", (int)o.x + layout.px(20) , (int)o.y + layout.px(30), layout.px(35), BLACK);
+    const char* lines[] = {
+        "--> Two players take turns moving their",
+        "pieces diagonally across an 8x8 board.",
+        "--> Each player has 12 pieces to start.",
+        "--> Regular Pieces can only move forward ",
+        "diagonally.",
+        "--> king pieces can move both forward and",
+        "backward.",
+        "--> Kings are promoted when regular pieces",
+        " reach the opponent's back row.",
+        "--> To capture opponent's piece, jump over it",
+        "diagonally into an empty space. and ",
+        "--> Its mandatory when its possible.",
+        "-->The game ends when a player captures all ",
+        "of the other pieces or blocks them from",
+        " making any moves."
+    };
+    for (int i = 0; i < (int)(sizeof(lines) / sizeof(lines[0])); i++)
+        DrawText(lines[i], (int)o.x + layout.px(13), (int)o.y + layout.px(100 + 20 * i), layout.px(20), BLACK);
+
+    // Draw a button to return to the game
+    Button CONTINUE;
+    CONTINUE.rect = layout.rect(o, 150, 480, 150, 50);
+    CONTINUE.color = DARKGRAY;
+    int segment = 10;
+    float roundness = 0.6f;
+    Rectangle Gshadow = layout.rect(o, 154, 484, 150, 50);
+    DrawRectangleRounded(Gshadow, roundness, segment, BLACK);
+    DrawRectangleRounded(CONTINUE.rect, roundness , segment, CONTINUE.color);
+    DrawText("GOT IT!", (int)o.x + layout.px(175), (int)o.y + layout.px(495), layout.px(20), WHITE);
+
+    // Check for mouse input to return to the game
+    if (IsMouseButtonPressed(MOUSE_LEFT_BUTTON) && is_mouse_over_button(CONTINUE)) {
+        PlaySound(click);
+        return true;
+    }
+    return false;
+}
+bool player_name(Game& game, TextField& p1, TextField& p2, const Layout& layout, const Sound& click){
+    Vector2 o = drawOverlay(layout, 800, 450);
+    Rectangle textBox = layout.rect(o, 140, 120, 520, 50);
+    Rectangle textBox2 = layout.rect(o, 140, 220, 520, 50);
     int mouseOnText = 0;
 
-    int p1framesCounter = 0;
-    int p2framesCounter = 0;
-
-    SetTargetFPS(60);               // Set our game to run at 60 frames-per-second
-    //--------------------------------------------------------------------------------------
-
-    // Main game loop
-    while (!WindowShouldClose())    // Detect window close button or ESC key
-    {
-        // Update
-        //----------------------------------------------------------------------------------
-        if (CheckCollisionPointRec(GetMousePosition(), textBox)){
-            // Set the window's cursor to the I-Beam
-            SetMouseCursor(MOUSE_CURSOR_IBEAM);
-
-            // Get char pressed (unicode character) on the queue
-            int key = GetCharPressed();
-
-            
-            // Check if more characters have been pressed on the same frame
-                while (key > 0)
-                {
-                    // NOTE: Only allow keys in range [32..125]
-                    if ((key >= 32) && (key <= 125) && (p1letterCount < MAX_INPUT_CHARS))
-                    {
-                        p1[p1letterCount] = (char)key;
-                        p1[p1letterCount+1] = '\0'; // Add null terminator at the end of the string.
-                        p1letterCount++;
-                    }
-
-                    key = GetCharPressed();  // Check next character in the queue
-                }
-
-                if (IsKeyPressed(KEY_BACKSPACE))
-                {
-                    p1letterCount--;
-                    if (p1letterCount < 0) p1letterCount = 0;
-                    p1[p1letterCount] = '\0';
-                }
-                mouseOnText = 1;
-        }else if(CheckCollisionPointRec(GetMousePosition(), textBox2)){
-            // Set the window's cursor to the I-Beam
-                SetMouseCursor(MOUSE_CURSOR_IBEAM);
-
-                // Get char pressed (unicode character) on the queue
-                int key = GetCharPressed();
-                while (key > 0)
-                {
-                    // NOTE: Only allow keys in range [32..125]
-                    if ((key >= 32) && (key <= 125) && (p2letterCount < MAX_INPUT_CHARS))
-                    {
-                        p2[p2letterCount] = (char)key;
-                        p2[p2letterCount+1] = '\0'; // Add null terminator at the end of the string.
-                        p2letterCount++;
-                    }
-
-                    key = GetCharPressed();  // Check next character in the queue
-                }
-
-                if (IsKeyPressed(KEY_BACKSPACE))
-                {
-                    p2letterCount--;
-                    if (p2letterCount < 0) p2letterCount = 0;
-                    p2[p2letterCount] = '\0';
-                }
-                mouseOnText = 2;
-        }else {
-            SetMouseCursor(MOUSE_CURSOR_DEFAULT);   
-            mouseOnText = 0;
-        }
-
-
-        if (mouseOnText == 1) {
-            p1framesCounter++;
-        }else if(mouseOnText == 2) {
-            p2framesCounter++;
-        }else{
-            p1framesCounter = 0;
-            p2framesCounter = 0;
-        }
-        //----------------------------------------------------------------------------------
-
-        // Draw
-        //----------------------------------------------------------------------------------
-        BeginDrawing();
-
-            ClearBackground(RAYWHITE);
-
-            DrawText("PLAYER 1 NAME", 310, 95, 20, GRAY);
-            DrawText("PLAYER 2 NAME", 310, 195, 20, GRAY);
-
-            DrawRectangleRec(textBox, LIGHTGRAY);
-            DrawRectangleRec(textBox2, LIGHTGRAY);
-            if (mouseOnText == 1) DrawRectangleLines((int)textBox.x, (int)textBox.y, (int)textBox.width, (int)textBox.height, RED);
-            else DrawRectangleLines((int)textBox.x, (int)textBox.y, (int)textBox.width, (int)textBox.height, DARKGRAY);
-
-            if (mouseOnText == 2) DrawRectangleLines((int)textBox2.x, (int)textBox2.y, (int)textBox2.width, (int)textBox2.height, RED);
-            else DrawRectangleLines((int)textBox2.x, (int)textBox2.y, (int)textBox2.width, (int)textBox2.height, DARKGRAY);
+    if (CheckCollisionPointRec(GetMousePosition(), textBox)){
+        // Set the window's cursor to the I-Beam
+        SetMouseCursor(MOUSE_CURSOR_IBEAM);
+        typeText(p1);
+        mouseOnText = 1;
+    }else if(CheckCollisionPointRec(GetMousePosition(), textBox2)){
+        SetMouseCursor(MOUSE_CURSOR_IBEAM);
+        typeText(p2);
+        mouseOnText = 2;
+    }else {
+        SetMouseCursor(MOUSE_CURSOR_DEFAULT);   
+    }
 
-            if (mouseOnText == 1){
-                DrawText(p1, (int)textBox.x + 5, (int)textBox.y + 8, 40, MAROON);
-            }else if(mouseOnText == 2){
-                DrawText(p2, (int)textBox2.x + 5, (int)textBox2.y + 8, 40, MAROON);
-            }
+    DrawText("PLAYER 1 NAME", (int)o.x + layout.px(310), (int)o.y + layout.px(95), layout.px(20), GRAY);
+    DrawText("PLAYER 2 NAME", (int)o.x + layout.px(310), (int)o.y + layout.px(195), layout.px(20), GRAY);
 
-            if (mouseOnText == 1){
-                DrawText(TextFormat("INPUT CHARS: %i/%i", p1letterCount, MAX_INPUT_CHARS), 290, 275, 20, DARKGRAY);
-            }else if(mouseOnText == 2){
-                DrawText(TextFormat("INPUT CHARS: %i/%i", p2letterCount, MAX_INPUT_CHARS), 290, 275, 20, DARKGRAY);
-            }
+    drawTextField(p1, textBox, mouseOnText == 1, layout);
+    drawTextField(p2, textBox2, mouseOnText == 2, layout);
 
-            if (mouseOnText == 1 && p1letterCount < MAX_INPUT_CHARS) {
-                if (((p1framesCounter/20) % 2) == 0) {
-                    DrawText("_", (int)textBox.x + 8 + MeasureText(p1, 40), (int)textBox.y + 12, 40, MAROON);
-                }
-            }else if (mouseOnText == 2 && p2letterCount < MAX_INPUT_CHARS) {
-                if (((p2framesCounter/20) % 2) == 0) {
-                    DrawText("_", (int)textBox2.x + 8 + MeasureText(p2, 40), (int)textBox2.y + 12, 40, MAROON);
-                }
-            }
-            if (mouseOnText && p1letterCount == MAX_INPUT_CHARS && p2letterCount == MAX_INPUT_CHARS) {
-                DrawText("Press BACKSPACE to delete chars...", 230, 315, 20, GRAY);
-            }
-            Button close, save;
-            save.rect = {200, 350, 115, 50};
-            close.rect = {480, 350, 115, 50};
-            save.color = SKYBLUE;
-            close.color = PINK;
-            DrawRectangle(315, 355, 4, 45, BLACK);
-            DrawRectangle(205, 400, 114, 4, BLACK);
-            DrawRectangle(595, 355, 4, 45, BLACK);
-            DrawRectangle(485, 400, 114, 4, BLACK);
-            DrawRectangleRec(save.rect, save.color);
-            DrawText("Save", 232, 365, 20, BLACK);
-            DrawRectangleRec(close.rect, close.color);
-            DrawText("Close", 510, 365, 20, BLACK);
-            DrawText("Press close if you do not want names", 205, 415, 20, GRAY);
-            if ((is_mouse_over_button(save)) && (IsMouseButtonPressed(MOUSE_BUTTON_LEFT))) {
-                PlaySound(click);
-                game.playerOneName = std::string(p1);
-                game.playerTwoName = std::string(p2);
-                break;
-            }else if ((is_mouse_over_button(close)) && (IsMouseButtonPressed(MOUSE_BUTTON_LEFT))) {
-                PlaySound(click);
-                game.playerOneName = "Player 1";
-                game.playerTwoName = "Player 2";
-                break; 
-            }
-        EndDrawing();
-        //----------------------------------------------------------------------------------
+    if (mouseOnText){
+        TextField& typing = mouseOnText == 1 ? p1 : p2;
+        DrawText(TextFormat("INPUT CHARS: %i/%i", (int)typing.text.size(), typing.maxChars), (int)o.x + layout.px(290), (int)o.y + layout.px(275), layout.px(20), DARKGRAY);
+        if ((int)typing.text.size() >= typing.maxChars)
+            DrawText("Press BACKSPACE to delete chars...", (int)o.x + layout.px(230), (int)o.y + layout.px(315), layout.px(20), GRAY);
     }
-    // De-Initialization
-    //--------------------------------------------------------------------------------------
-    CloseWindow(); 
-}
-void drawings(Game& game){
-    DrawText(TextFormat("SCORES:"), BOARD_WIDTH + 20, 20, 50, BLACK);
-    DrawText(TextFormat("%s",game.playerOneName.c_str()), BOARD_WIDTH + 20, 70, 35, SKYBLUE);
-    DrawText(TextFormat("%i",game.p1), BOARD_WIDTH + 20, 110, 35, PINK);
-    DrawText(TextFormat("%s",game.playerTwoName.c_str()), BOARD_WIDTH + 20, 150, 35, PINK);
-    DrawText(TextFormat("%i",game.p2), BOARD_WIDTH + 20, 190, 35, SKYBLUE);
-    DrawText(TextFormat("Turn:"), BOARD_WIDTH + 20, 250, 30, BLACK);
-    DrawText(TextFormat("DAMA"), BOARD_WIDTH + 60, 340, 60, BLACK);
-}
-bool stalmate(Cell selectedCell, Cell targetCell, Cell cells[8][8], Game& game){
-    // Check if the selected cell has a Qorki
-    if (cells[selectedCell.row][selectedCell.col].cellType == emptyCell)
-        return false;
-    // Check if the target cell already has a Qorki
-    if (cells[targetCell.row][targetCell.col].cellType != emptyCell){
+    Button close, save;
+    save.rect = layout.rect(o, 200, 350, 115, 50);
+    close.rect = layout.rect(o, 480, 350, 115, 50);
+    save.color = SKYBLUE;
+    close.color = PINK;
+    DrawRectangle((int)o.x + layout.px(315), (int)o.y + layout.px(355), layout.px(4), layout.px(45), BLACK);
+    DrawRectangle((int)o.x + layout.px(205), (int)o.y + layout.px(400), layout.px(114), layout.px(4), BLACK);
+    DrawRectangle((int)o.x + layout.px(595), (int)o.y + layout.px(355), layout.px(4), layout.px(45), BLACK);
+    DrawRectangle((int)o.x + layout.px(485), (int)o.y + layout.px(400), layout.px(114), layout.px(4), BLACK);
+    DrawRectangleRec(save.rect, save.color);
+    DrawText("Save", (int)o.x + layout.px(232), (int)o.y + layout.px(365), layout.px(20), BLACK);
+    DrawRectangleRec(close.rect, close.color);
+    DrawText("Close", (int)o.x + layout.px(510), (int)o.y + layout.px(365), layout.px(20), BLACK);
+    DrawText("Press close if you do not want names", (int)o.x + layout.px(205), (int)o.y + layout.px(415), layout.px(20), GRAY);
+    if ((is_mouse_over_button(save)) && (IsMouseButtonPressed(MOUSE_BUTTON_LEFT))) {
+        PlaySound(click);
+        game.playerOneName = p1.text.empty() ? "Player 1" : p1.text;
+        game.playerTwoName = p2.text.empty() ? "Player 2" : p2.text;
+    }else if ((is_mouse_over_button(close)) && (IsMouseButtonPressed(MOUSE_BUTTON_LEFT))) {
+        PlaySound(click);
+        game.playerOneName = "Player 1";
+        game.playerTwoName = "Player 2";
+    }else {
         return false;
     }
-    // Check if the selected cell and the target cell are the same
-    if (selectedCell.row == targetCell.row && selectedCell.col == targetCell.col)
-        return false;
-    int rowdiff = targetCell.row - selectedCell.row;
-    int coldiff = targetCell.col - selectedCell.col;
-    // To check if it is diagonal
-    if(abs(rowdiff) != abs(coldiff)){
-        return false;
+    SetMouseCursor(MOUSE_CURSOR_DEFAULT);
+    return true;
+}
+int game_over(const Game& game, const Layout& layout, const Sound& click){
+    Vector2 o = drawOverlay(layout, 400, 200);
+    Color color = game.winner == 1 ? SKYBLUE : PINK;
+    Button button1, button2;
+    button1.rect = layout.rect(o, 50, 100, 115, 50);
+    button2.rect = layout.rect(o, 250, 100, 100, 50);
+    button1.color = color;
+    button2.color = color;
+    DrawText(game.winner == 1 ? "PLAYER ONE WON" : "PLAYER TWO WON", (int)o.x + layout.px(110), (int)o.y + layout.px(30), layout.px(20), color);
+    DrawRectangle((int)o.x + layout.px(165), (int)o.y + layout.px(105), layout.px(4), layout.px(45), BLACK);
+    DrawRectangle((int)o.x + layout.px(55), (int)o.y + layout.px(150), layout.px(114), layout.px(4), BLACK);
+    DrawRectangle((int)o.x + layout.px(350), (int)o.y + layout.px(105), layout.px(4), layout.px(45), BLACK);
+    DrawRectangle((int)o.x + layout.px(255), (int)o.y + layout.px(150), layout.px(99), layout.px(4), BLACK);
+    // Draw the buttons
+    DrawRectangleRec(button1.rect, button1.color);
+    DrawText("New Game", (int)o.x + layout.px(60), (int)o.y + layout.px(115), layout.px(20), BLACK);
+
+    DrawRectangleRec(button2.rect, button2.color);
+    DrawText("Quit", (int)o.x + layout.px(280), (int)o.y + layout.px(115), layout.px(20), BLACK);
+    if((is_mouse_over_button(button1)) && (IsMouseButtonPressed(MOUSE_BUTTON_LEFT))){
+        PlaySound(click);
+        return 1;
+    }else if((is_mouse_over_button(button2)) && (IsMouseButtonPressed(MOUSE_BUTTON_LEFT))){
+        PlaySound(click);
+        return 2;
     }
-
-    // For player1Qorki, the row difference should be negative (moving upwards)
-    if (cells[selectedCell.row][selectedCell.col].cellType == player2Qorki && rowdiff <= 0) {
-        return false;
+    return 0;
+}
+bool computerToMove(const Game& game){
+    return !game.winner && (game.position.whiteToMove ? game.playerOneCpu : game.playerTwoCpu);
+}
+bool inputArrived(bool mouseMoves){
+    static bool focused = true;
+    bool changed = IsWindowFocused() != focused;
+    focused = IsWindowFocused();
+    if(mouseMoves){
+        Vector2 delta = GetMouseDelta();
+        changed = changed || delta.x != 0 || delta.y != 0;
     }
-    // For player2Qorki, the row difference should be positive (moving downwards)
-    if (cells[selectedCell.row][selectedCell.col].cellType == player1Qorki && rowdiff >= 0) {
+    return changed || GetKeyPressed() != 0 || IsWindowResized() ||
+           IsMouseButtonPressed(MOUSE_BUTTON_LEFT) || IsMouseButtonReleased(MOUSE_BUTTON_LEFT) ||
+           IsMouseButtonPressed(MOUSE_BUTTON_RIGHT) || IsMouseButtonReleased(MOUSE_BUTTON_RIGHT);
+}
+double threadCpuSeconds(){
+#if defined(__unix__) || defined(__APPLE__)
+    timespec now;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &now);
+    return now.tv_sec + now.tv_nsec / 1e9;
+#else
+    // without a per-thread clock the whole process is counted, the search threads as well
+    return (double)clock() / CLOCKS_PER_SEC;
+#endif
+}
+void startFrameCount(FrameCount& count){
+    count = FrameCount();
+    count.since = Clock::now();
+    count.cpuSince = threadCpuSeconds();
+}
+void frameDrawn(FrameMeter& frames, double ms){
+    frames.period.drawn++;
+    frames.period.drawMs += ms;
+    frames.total.drawn++;
+    frames.total.drawMs += ms;
+}
+bool reportFrames(FrameMeter& frames, bool final){
+    FrameCount& count = final ? frames.total : frames.period;
+    double seconds = msSince(count.since) / 1000;
+    if(!final && seconds < FRAME_REPORT_SECONDS)
         return false;
-    }
-    if (abs(selectedCell.row - targetCell.row) == 1 && abs(selectedCell.col - targetCell.col) == 1) {
-        return true;
-    }else if (abs(selectedCell.row - targetCell.row) == 2 && abs(selectedCell.col - targetCell.col) == 2) {
-        // Check the intermediate cell to see if there is an opponent's Qorki
-        int midRow = (selectedCell.row + targetCell.row) / 2;
-        int midCol = (selectedCell.col + targetCell.col) / 2;
-        Cell removeCell;
-        removeCell.row = midRow;
-        removeCell.col = midCol;
-
-        // Check if the intermediate cell has an opponent's Qorki
-        if ((cells[midRow][midCol].cellType != cells[selectedCell.row][selectedCell.col].cellType)&&(cells[midRow][midCol].cellType != emptyCell)) {
-                return true;   
+    double cpu = threadCpuSeconds() - count.cpuSince;
+    cout << TextFormat("Frames%s: %i drawn and %i idle passes in %.1f s, %.2f ms a frame, frame loop CPU %.1f%%",
+                       final ? " in all" : "", count.drawn, count.idle, seconds,
+                       count.drawn ? count.drawMs / count.drawn : 0.0, seconds > 0 ? 100 * cpu / seconds : 0.0) << endl;
+    if(!final)
+        startFrameCount(count);
+    return true;
+}
+double msSince(Clock::time_point from){
+    return chrono::duration<double, milli>(Clock::now() - from).count();
+}
+void screenChanging(ScreenTimes& times){
+    times.changed = Clock::now();
+    times.timing = true;
+}
+void screenShown(ScreenTimes& times, int shown){
+    if(!times.timing)
+        return;
+    static const char* names[] = {"game", "help", "names", "file", "game over"};
+    double ms = msSince(times.changed);
+    times.timing = false;
+    times.changes++;
+    times.totalMs += ms;
+    times.worstMs = max(times.worstMs, ms);
+    cout << TextFormat("Screen %s: %.2f ms to draw (a frame is %.1f ms)", names[shown], ms, 1000.0 / TARGET_FPS) << endl;
+}
+void reportScreens(const ScreenTimes& times){
+    if(!times.changes)
+        return;
+    cout << TextFormat("Screen changes: %i, %.2f ms on average, %.2f ms at worst, each shown on the next frame",
+                       times.changes, times.totalMs / times.changes, times.worstMs) << endl;
+}
+void drawings(Game& game, const Layout& layout){
+    // the shapes, all in one batch
+    Color turn = QORKI_COLORS[game.position.whiteToMove ? player1Qorki : player2Qorki];  // made the turn indicator color the same as the qorki color
+    DrawRectangleRec(layout.turn, turn);
+    float roundness = 0.6f;
+    int segments = 10;
+    DrawRectangleRounded(layout.cpuOne, roundness, segments, game.playerOneCpu ? SKYBLUE : LIGHTGRAY);
+    DrawRectangleRounded(layout.cpuTwo, roundness, segments, game.playerTwoCpu ? PINK : LIGHTGRAY);
+
+    // then the text, in another
+    int x = layout.px(BOARD_WIDTH + 20);
+    DrawText(TextFormat("%s",game.playerOneName.c_str()), x, layout.px(70), layout.px(35), SKYBLUE);
+    DrawText(TextFormat("%i",game.p1), x, layout.px(110), layout.px(35), PINK);
+    DrawText(TextFormat("%s",game.playerTwoName.c_str()), x, layout.px(150), layout.px(35), PINK);
+    DrawText(TextFormat("%i",game.p2), x, layout.px(190), layout.px(35), SKYBLUE);
+    DrawText(game.playerOneCpu ? "P1: CPU" : "P1: HUMAN", (int)layout.cpuOne.x + layout.px(10), (int)layout.cpuOne.y + layout.px(10), layout.px(20), BLACK);
+    DrawText(game.playerTwoCpu ? "P2: CPU" : "P2: HUMAN", (int)layout.cpuTwo.x + layout.px(10), (int)layout.cpuTwo.y + layout.px(10), layout.px(20), BLACK);
+    if(sharedPositionIndex().isOpen()){
+        // how the archive games that reached this position ended, for the side to move
+        if(game.archive.games == 0){
+            DrawText("NOT IN ARCHIVE", layout.px(BOARD_WIDTH + 160), layout.px(250), layout.px(15), DARKGRAY);
+        }else{
+            DrawText(TextFormat("IN %u GAMES", game.archive.games), layout.px(BOARD_WIDTH + 160), layout.px(250), layout.px(15), DARKGRAY);
+            DrawText(TextFormat("W%.0f%% D%.0f%% L%.0f%%", game.archive.percent(game.archive.wins),
+                                game.archive.percent(game.archive.draws), game.archive.percent(game.archive.losses)),
+                     layout.px(BOARD_WIDTH + 160), layout.px(266), layout.px(15), DARKGRAY);
         }
-        else{
-            return false;
+    }
+    if(!game.redo.empty()){
+        DrawText(TextFormat("REPLAY: MOVE %i OF %i  <- ->", (int)game.history.size(), (int)(game.history.size() + game.redo.size())),
+                 x, layout.px(438), layout.px(20), DARKGRAY);
+    }
+    if(game.endgame == TB_DRAW){
+        DrawText("ENDGAME: DRAWN", x, layout.px(415), layout.px(20), DARKGRAY);
+    }else if(game.endgame > 0){
+        // the value is for the side to move
+        bool playerOneWins = tbIsWin((uint8_t)game.endgame) == game.position.whiteToMove;
+        if(sharedTablebase().hasDistances()){
+            DrawText(TextFormat("ENDGAME: %s WINS IN %i", playerOneWins ? "P1" : "P2", tbPlies((uint8_t)game.endgame)),
+                     x, layout.px(415), layout.px(20), DARKGRAY);
+        }else{
+            DrawText(TextFormat("ENDGAME: %s WINS", playerOneWins ? "P1" : "P2"), x, layout.px(415), layout.px(20), DARKGRAY);
         }
     }
-return false;
 }
 // besebebu 1500 line enargew 
@@ -0,0 +1,254 @@
+// @file engine.cpp
+// @brief background search thread with a request queue and a response queue, and the pool of them
+
+#include "engine.h"
+
+#include <algorithm>
+
+#ifdef __linux__
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+using namespace std;
+
+EngineWorker::EngineWorker() : worker(&EngineWorker::run, this){
+}
+
+EngineWorker::~EngineWorker(){
+    {
+        lock_guard<mutex> guard(lock);
+        quit = true;
+        generation++;
+        requests.clear();
+        abort.store(true);
+    }
+    wake.notify_one();
+    worker.join();
+}
+
+uint64_t EngineWorker::submit(const Position& pos, const SearchLimits& limits){
+    uint64_t id;
+    {
+        lock_guard<mutex> guard(lock);
+        id = nextId++;
+        EngineRequest request;
+        request.id = id;
+        request.generation = generation;
+        request.ponder = false;
+        request.position = pos;
+        request.limits = limits;
+        request.limits.stop = &abort;
+        request.limits.pondering = nullptr;
+        requests.push_back(request);
+    }
+    wake.notify_one();
+    return id;
+}
+
+void EngineWorker::ponder(const Position& pos, const SearchLimits& limits){
+    {
+        lock_guard<mutex> guard(lock);
+        EngineRequest request;
+        request.id = nextId++;
+        request.generation = generation;
+        request.ponder = true;
+        request.position = pos;
+        request.limits = limits;
+        request.limits.stop = &abort;
+        request.limits.pondering = &pondering;
+        requests.push_back(request);
+        ponderActive = true;
+        ponderPosition = pos;
+    }
+    wake.notify_one();
+}
+
+bool EngineWorker::ponderHit(const Position& pos){
+    {
+        lock_guard<mutex> guard(lock);
+        if(!ponderActive)
+            return false;
+        ponderActive = false;
+        counters.ponders++;
+        if(samePosition(pos, ponderPosition)){
+            counters.ponderHits++;
+            // a queued request has not raised the flag yet: the worker checks ponderActive first
+            pondering.store(false);
+            return true;
+        }
+    }
+    cancel();
+    return false;
+}
+
+bool EngineWorker::isPondering(){
+    lock_guard<mutex> guard(lock);
+    return ponderActive;
+}
+
+EngineStats EngineWorker::stats(){
+    lock_guard<mutex> guard(lock);
+    return counters;
+}
+
+void EngineWorker::cancel(){
+    lock_guard<mutex> guard(lock);
+    // the worker only lowers abort for a request of the current generation, under this lock
+    generation++;
+    requests.clear();
+    responses.clear();
+    ponderActive = false;
+    abort.store(true);
+}
+
+bool EngineWorker::poll(EngineResponse& response){
+    lock_guard<mutex> guard(lock);
+    if(responses.empty())
+        return false;
+    response = responses.front();
+    responses.pop_front();
+    return true;
+}
+
+bool EngineWorker::waiting(){
+    lock_guard<mutex> guard(lock);
+    return searching || !requests.empty() || !responses.empty();
+}
+
+void EngineWorker::run(){
+    unique_lock<mutex> guard(lock);
+    while(true){
+        wake.wait(guard, [this]{ return quit || !requests.empty(); });
+        if(quit)
+            return;
+        EngineRequest request = requests.front();
+        requests.pop_front();
+        searching = true;
+        abort.store(false);
+        pondering.store(request.ponder && ponderActive);
+        guard.unlock();
+
+        EngineResponse response;
+        response.id = request.id;
+        response.position = request.position;
+        response.result = searchPosition(request.position, request.limits);
+
+        guard.lock();
+        searching = false;
+        if(request.generation == generation)
+            responses.push_back(response);
+    }
+}
+
+EnginePool::EnginePool(int threads, size_t hashMb, const function<void()>& answered) : onAnswer(answered){
+    for(int i = 0; i < max(threads, 1); i++){
+        slots.emplace_back(new Slot);
+        slots.back()->table.resize(hashMb);
+    }
+    for(unique_ptr<Slot>& slot : slots)
+        workers.emplace_back(&EnginePool::run, this, ref(*slot));
+}
+
+EnginePool::~EnginePool(){
+    {
+        lock_guard<mutex> guard(lock);
+        quit = true;
+        requests.clear();
+        for(unique_ptr<Slot>& slot : slots)
+            slot->stop.store(true);
+    }
+    wake.notify_all();
+    for(thread& worker : workers)
+        worker.join();
+}
+
+void EnginePool::submit(uint64_t id, const Position& pos, const SearchLimits& limits){
+    {
+        lock_guard<mutex> guard(lock);
+        EngineRequest request;
+        request.id = id;
+        request.generation = 0;
+        request.ponder = false;
+        request.position = pos;
+        request.limits = limits;
+        request.limits.pondering = nullptr;
+        requests.push_back(request);
+    }
+    wake.notify_one();
+}
+
+void EnginePool::cancel(uint64_t id){
+    lock_guard<mutex> guard(lock);
+    for(size_t i = 0; i < requests.size(); ){
+        if(requests[i].id == id)
+            requests.erase(requests.begin() + i);
+        else
+            i++;
+    }
+    for(size_t i = 0; i < responses.size(); ){
+        if(responses[i].id == id)
+            responses.erase(responses.begin() + i);
+        else
+            i++;
+    }
+    // the thread drops the answer of a search whose id was cleared under this lock
+    for(unique_ptr<Slot>& slot : slots){
+        if(slot->id == id){
+            slot->id = 0;
+            slot->stop.store(true);
+        }
+    }
+}
+
+bool EnginePool::poll(EngineResponse& response){
+    lock_guard<mutex> guard(lock);
+    if(responses.empty())
+        return false;
+    response = responses.front();
+    responses.pop_front();
+    return true;
+}
+
+size_t EnginePool::queued(){
+    lock_guard<mutex> guard(lock);
+    return requests.size();
+}
+
+void EnginePool::run(Slot& slot){
+#ifdef __linux__
+    // searches give way to the thread that serves the clients, so a move is never acknowledged late
+    // because every core is busy thinking
+    setpriority(PRIO_PROCESS, (id_t)syscall(SYS_gettid), 19);
+#endif
+    unique_lock<mutex> guard(lock);
+    while(true){
+        wake.wait(guard, [this]{ return quit || !requests.empty(); });
+        if(quit)
+            return;
+        EngineRequest request = requests.front();
+        requests.pop_front();
+        slot.id = request.id;
+        slot.stop.store(false);
+        request.limits.stop = &slot.stop;
+        guard.unlock();
+
+        EngineResponse response;
+        response.id = request.id;
+        response.position = request.position;
+        response.result = searchPosition(request.position, request.limits, slot.table);
+
+        guard.lock();
+        bool answered = slot.id == request.id;
+        slot.id = 0;
+        if(answered){
+            responses.push_back(response);
+            if(onAnswer){
+                guard.unlock();
+                onAnswer();
+                guard.lock();
+            }
+        }
+    }
+}
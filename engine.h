@@ -0,0 +1,152 @@
+// @file engine.h
+// @brief runs searches on a background thread so the window keeps drawing while the computer thinks,
+//        and on a pool of threads for a server with many games
+
+#ifndef ENGINE_H
+#define ENGINE_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "rules.h"
+#include "search.h"
+#include "tt.h"
+
+/// @brief a search to run: the position is copied, so the game may change while it runs
+struct EngineRequest{
+    uint64_t id;
+    uint64_t generation;        // requests from before the last cancel() are dropped
+    bool ponder;                // searched with the clock stopped until ponderHit()
+    Position position;
+    SearchLimits limits;
+};
+
+/// @brief a finished search, with the position it was asked about
+struct EngineResponse{
+    uint64_t id;
+    Position position;
+    SearchResult result;
+};
+
+/// @brief how well pondering guesses the opponent's reply
+struct EngineStats{
+    uint64_t ponders = 0;       // ponder searches that ended with the opponent's move (hit or miss)
+    uint64_t ponderHits = 0;    // ... where the opponent played the expected reply
+
+    double ponderHitRate() const { return ponders ? (double)ponderHits / ponders : 0; }
+};
+
+class EngineWorker{
+public:
+    EngineWorker();
+    ~EngineWorker();
+    EngineWorker(const EngineWorker&) = delete;
+    EngineWorker& operator=(const EngineWorker&) = delete;
+
+    /// @brief queues a search; the answer comes back through poll()
+    /// @param pos,limits the position to search and how long to search it (limits.stop is replaced)
+    /// @return the id of the request, repeated in its response
+    uint64_t submit(const Position& pos, const SearchLimits& limits);
+
+    /// @brief searches the position expected after the opponent's reply while the opponent thinks;
+    ///        the clock only starts at ponderHit()
+    /// @param pos,limits the expected position and how long to search it once the reply is played
+    void ponder(const Position& pos, const SearchLimits& limits);
+
+    /// @brief called when the opponent has moved: if the ponder search was about this position it
+    ///        carries on as a normal search with the time already spent counted, otherwise it is cancelled
+    /// @param pos the position now on the board
+    /// @return true on a ponder hit, the answer then comes through poll()
+    bool ponderHit(const Position& pos);
+
+    /// @brief true from ponder() until ponderHit() or cancel()
+    bool isPondering();
+
+    EngineStats stats();
+
+    /// @brief stops the running search, drops the queued ones and forgets unread answers;
+    ///        returns at once, the search notices within 256 nodes
+    void cancel();
+
+    /// @brief takes a finished search without waiting
+    /// @param response filled in when one was ready
+    /// @return true if a response was taken
+    bool poll(EngineResponse& response);
+
+    /// @brief true while a request is queued or running or an answer is unread
+    bool waiting();
+
+private:
+    void run();
+
+    std::mutex lock;
+    std::condition_variable wake;
+    std::deque<EngineRequest> requests;
+    std::deque<EngineResponse> responses;
+    std::atomic<bool> abort{false};     // handed to the search as SearchLimits::stop
+    std::atomic<bool> pondering{false}; // handed to ponder searches as SearchLimits::pondering
+    bool ponderActive = false;          // a ponder request is queued, running or answered
+    Position ponderPosition;
+    EngineStats counters;
+    uint64_t nextId = 1;
+    uint64_t generation = 0;
+    bool searching = false;
+    bool quit = false;
+    std::thread worker;                 // last, so it starts after everything above
+};
+
+/// @brief several searches at once for a server playing many games: every thread takes the oldest
+///        queued request and searches it with a transposition table of its own
+class EnginePool{
+public:
+    /// @param threads,hashMb,onAnswer the search threads, the table size of each and what to call
+    ///        (from a search thread) once an answer is queued, e.g. to wake an event loop
+    EnginePool(int threads, size_t hashMb, const std::function<void()>& onAnswer);
+    ~EnginePool();
+    EnginePool(const EnginePool&) = delete;
+    EnginePool& operator=(const EnginePool&) = delete;
+
+    /// @brief queues a search
+    /// @param id,pos,limits who asks (repeated in the response), the position and how long to search
+    ///        it (limits.stop is replaced)
+    void submit(uint64_t id, const Position& pos, const SearchLimits& limits);
+
+    /// @brief drops the queued searches of an id and stops its running one; no answer comes for them
+    void cancel(uint64_t id);
+
+    /// @brief takes a finished search without waiting
+    /// @return true if a response was taken
+    bool poll(EngineResponse& response);
+
+    /// @brief searches queued and not started yet
+    size_t queued();
+
+    int threads() const { return (int)slots.size(); }
+
+private:
+    /// @brief what one search thread owns
+    struct Slot{
+        TranspositionTable table;
+        std::atomic<bool> stop{false};
+        uint64_t id = 0;                // the request it is searching, 0 when idle or cancelled
+    };
+
+    void run(Slot& slot);
+
+    std::mutex lock;
+    std::condition_variable wake;
+    std::deque<EngineRequest> requests;
+    std::deque<EngineResponse> responses;
+    std::function<void()> onAnswer;
+    bool quit = false;
+    std::vector<std::unique_ptr<Slot>> slots;
+    std::vector<std::thread> workers;   // last, so they start after everything above
+};
+
+#endif
@@ -0,0 +1,103 @@
+// @file gamecore.cpp
+// @brief playing and taking back moves, and the events they send
+
+#include "gamecore.h"
+
+using namespace std;
+
+int winnerOf(const Position& pos){
+    // the side to move loses when it has no piece left or every piece is blocked
+    if(!isGameOver(pos))
+        return 0;
+    return pos.whiteToMove ? 2 : 1;
+}
+
+void startGame(GameState& game, const Position& start){
+    game.position = start;
+    game.firstPosition = start;
+    game.history.clear();
+    game.redo.clear();
+    game.p1 = 0;
+    game.p2 = 0;
+    game.winner = winnerOf(start);
+}
+
+void playMove(GameState& game, const Move& played, const GameEvents& events){
+    Position before = game.position;
+    int player = before.whiteToMove ? 1 : 2;
+    int taken = countSquares(played.captures);
+    if(player == 1){
+        game.p1 += taken;
+    }else{
+        game.p2 += taken;
+    }
+    game.position = applyMove(before, played);
+    game.history.push_back(played);
+    // playing the next move of the replay keeps following it, any other move leaves it
+    if(!game.redo.empty() && sameMove(game.redo.back(), played)){
+        game.redo.pop_back();
+    }else{
+        game.redo.clear();
+    }
+    game.winner = winnerOf(game.position);
+    if(events.empty())
+        return;
+
+    GameEvent event;
+    event.type = gameMoved;
+    event.player = player;
+    event.move = played;
+    event.before = before;
+    events.emit(event);
+    event.type = gameCaptured;
+    for(uint32_t captures = played.captures; captures; captures &= captures - 1){
+        event.square = firstSquare(captures);
+        events.emit(event);
+    }
+    uint32_t to = 1u << played.to;
+    if((game.position.kings & to) && !(before.kings & (1u << played.from))){
+        event.type = gamePromoted;
+        event.square = played.to;
+        events.emit(event);
+    }
+    if(game.winner){
+        event.type = gameWon;
+        event.player = game.winner;
+        event.square = -1;
+        events.emit(event);
+    }
+}
+
+bool takeBack(GameState& game, const GameEvents& events){
+    if(game.history.empty())
+        return false;
+    Move last = game.history.back();
+    game.redo.push_back(last);
+    game.history.pop_back();
+    // the scores are recounted while the shorter game is replayed
+    game.position = game.firstPosition;
+    game.p1 = game.p2 = 0;
+    for(const Move& played : game.history){
+        int taken = countSquares(played.captures);
+        (game.position.whiteToMove ? game.p1 : game.p2) += taken;
+        game.position = applyMove(game.position, played);
+    }
+    game.winner = winnerOf(game.position);
+    if(!events.empty()){
+        GameEvent event;
+        event.type = gameTakenBack;
+        event.player = game.position.whiteToMove ? 1 : 2;
+        event.move = last;
+        event.before = game.position;
+        events.emit(event);
+    }
+    return true;
+}
+
+bool replayMove(GameState& game, const GameEvents& events){
+    if(game.redo.empty())
+        return false;
+    Move next = game.redo.back();
+    playMove(game, next, events);
+    return true;
+}
@@ -0,0 +1,79 @@
+// @file gamecore.h
+// @brief the game itself without a window or sound: the position, the moves played and taken back,
+//        the scores and the winner, with events ("moved", "captured", "promoted", ...) that a front
+//        end subscribes to for its sounds and drawing
+
+#ifndef GAMECORE_H
+#define GAMECORE_H
+
+#include <functional>
+#include <vector>
+#include "rules.h"
+
+/// @brief a game in progress; player one is white and moves first
+struct GameState{
+    Position position;          // the pieces on the board and the side to move (whiteToMove = player one)
+    Position firstPosition;     // the position the game started from
+    std::vector<Move> history;  // every move played since, kept for the save file
+    std::vector<Move> redo;     // moves taken back or still to replay, the next one last
+    int p1 = 0;                 // pieces player one has taken
+    int p2 = 0;
+    int winner = 0;             // 1 or 2 once the side to move has no legal move
+};
+
+enum gameEventType{
+    gameMoved,          // a move was played (sent first, then its captures and promotion)
+    gameCaptured,       // a piece was taken, once per piece
+    gamePromoted,       // a man reached the far row and became a king
+    gameTakenBack,      // the last move was taken back
+    gameWon             // the side to move has no legal move left
+};
+
+/// @brief what happened; sent once the game has been updated
+struct GameEvent{
+    int type;
+    int player;         // 1 or 2: who moved (or took back the move), or who won
+    int square = -1;    // the square of the piece taken, or of the new king
+    Move move;          // the move played or taken back
+    Position before;    // the position the move was played in
+};
+
+/// @brief the listeners of a game; a game without any runs just as well
+class GameEvents{
+public:
+    typedef std::function<void(const GameEvent&)> Listener;
+
+    void subscribe(const Listener& listener){ listeners.push_back(listener); }
+
+    void emit(const GameEvent& event) const{
+        for(const Listener& listener : listeners)
+            listener(event);
+    }
+
+    bool empty() const { return listeners.empty(); }
+
+private:
+    std::vector<Listener> listeners;
+};
+
+/// @brief returns the winner of a position: 1 or 2 when the side to move has lost, 0 otherwise
+int winnerOf(const Position& pos);
+
+/// @brief starts a game over from a position
+void startGame(GameState& game, const Position& start);
+
+/// @brief plays a legal move: counts its captures, records it and keeps following the replay if it
+///        is the next move of it (any other move drops the replay)
+/// @param game,played,events the game, the move and who to tell
+void playMove(GameState& game, const Move& played, const GameEvents& events = GameEvents());
+
+/// @brief takes the last move back onto the replay; the position and scores are rebuilt from the
+///        first position
+/// @return false if no move has been played
+bool takeBack(GameState& game, const GameEvents& events = GameEvents());
+
+/// @brief plays the next move of the replay
+/// @return false if there is none
+bool replayMove(GameState& game, const GameEvents& events = GameEvents());
+
+#endif
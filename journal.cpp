@@ -0,0 +1,310 @@
+// @file journal.cpp
+// @brief the move journal: record framing, the group-commit writer thread and the replay
+
+#include "journal.h"
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#include <fcntl.h>
+#include <io.h>
+#include <sys/stat.h>
+#else
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+using namespace std;
+
+static int openForAppend(const string& path, bool truncate){
+#ifdef _WIN32
+    return _open(path.c_str(), _O_WRONLY | _O_CREAT | _O_BINARY | (truncate ? _O_TRUNC : _O_APPEND), _S_IREAD | _S_IWRITE);
+#else
+    return ::open(path.c_str(), O_WRONLY | O_CREAT | (truncate ? O_TRUNC : O_APPEND), 0644);
+#endif
+}
+
+static bool writeAll(int file, const uint8_t* data, size_t size){
+    while(size > 0){
+#ifdef _WIN32
+        int done = _write(file, data, (unsigned)size);
+#else
+        ssize_t done = ::write(file, data, size);
+#endif
+        if(done <= 0)
+            return false;
+        data += done;
+        size -= (size_t)done;
+    }
+    return true;
+}
+
+static bool syncFile(int file){
+#ifdef _WIN32
+    return _commit(file) == 0;
+#elif defined(__linux__)
+    return fdatasync(file) == 0;
+#else
+    return fsync(file) == 0;
+#endif
+}
+
+static void closeFile(int file){
+#ifdef _WIN32
+    _close(file);
+#else
+    ::close(file);
+#endif
+}
+
+// the new journal is written and synced under another name, then renamed over the old one
+static bool replaceJournal(const string& path, const vector<uint8_t>& bytes){
+    string temporary = path + ".tmp";
+    int file = openForAppend(temporary, true);
+    if(file < 0)
+        return false;
+    bool ok = writeAll(file, bytes.data(), bytes.size()) && syncFile(file);
+    closeFile(file);
+#ifdef _WIN32
+    ok = ok && MoveFileExA(temporary.c_str(), path.c_str(), MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH);
+#else
+    ok = ok && rename(temporary.c_str(), path.c_str()) == 0;
+    if(ok){
+        // the rename itself only lasts once the directory is synced
+        size_t slash = path.find_last_of('/');
+        string dir = slash == string::npos ? "." : path.substr(0, slash + 1);
+        int handle = ::open(dir.c_str(), O_RDONLY);
+        if(handle >= 0){
+            fsync(handle);
+            ::close(handle);
+        }
+    }
+#endif
+    if(!ok)
+        remove(temporary.c_str());
+    return ok;
+}
+
+static size_t encodeVarint(uint8_t* out, uint64_t value){
+    size_t size = 0;
+    while(value >= 0x80){
+        out[size++] = (uint8_t)(value | 0x80);
+        value >>= 7;
+    }
+    out[size++] = (uint8_t)value;
+    return size;
+}
+
+static bool decodeVarint(const uint8_t* data, size_t size, size_t& at, uint64_t& value){
+    value = 0;
+    for(int shift = 0; shift < 64 && at < size; shift += 7){
+        uint8_t b = data[at++];
+        value |= (uint64_t)(b & 0x7F) << shift;
+        if(!(b & 0x80))
+            return true;
+    }
+    return false;
+}
+
+static void putRecord(vector<uint8_t>& out, int type, const uint8_t* payload, size_t size){
+    size_t start = out.size();
+    uint8_t length[10];
+    out.push_back((uint8_t)type);
+    out.insert(out.end(), length, length + encodeVarint(length, size));
+    out.insert(out.end(), payload, payload + size);
+    uint32_t crc = crc32(out.data() + start, out.size() - start);
+    for(int i = 0; i < 4; i++)
+        out.push_back((uint8_t)(crc >> (8 * i)));
+}
+
+MoveJournal::MoveJournal() : writer(&MoveJournal::run, this){
+}
+
+MoveJournal::~MoveJournal(){
+    close();
+    {
+        lock_guard<mutex> guard(lock);
+        quit = true;
+    }
+    wake.notify_one();
+    writer.join();
+    if(file >= 0)
+        closeFile(file);
+}
+
+void MoveJournal::open(const string& journalPath){
+    close();
+    lock_guard<mutex> guard(lock);
+    path = journalPath;
+}
+
+void MoveJournal::close(){
+    flush();
+    lock_guard<mutex> guard(lock);
+    started = false;
+}
+
+void MoveJournal::begin(const SavedGame& game){
+    vector<uint8_t> snapshot = encodeSave(game);
+    const uint8_t header[JOURNAL_HEADER_SIZE] = {'D', 'J', 'N', 'L', (uint8_t)JOURNAL_VERSION, (uint8_t)(JOURNAL_VERSION >> 8), 0, 0};
+    {
+        lock_guard<mutex> guard(lock);
+        if(path.empty())
+            return;
+        // moves of the previous game still waiting are part of the journal being replaced
+        pending.assign(header, header + JOURNAL_HEADER_SIZE);
+        putRecord(pending, journalSnapshot, snapshot.data(), snapshot.size());
+        pendingRecords = 1;
+        replace = true;
+        started = true;
+        appended++;
+    }
+    wake.notify_one();
+}
+
+void MoveJournal::appendMove(const Position& before, const Move& played){
+    MoveList moves;
+    generateMoves(before, moves);
+    int index = 0;
+    while(index < moves.size() && !sameMove(moves[index], played))
+        index++;
+    uint8_t payload[10];
+    size_t size = encodeVarint(payload, (uint64_t)index);
+    {
+        lock_guard<mutex> guard(lock);
+        if(!started)
+            return;
+        putRecord(pending, journalMove, payload, size);
+        pendingRecords++;
+        appended++;
+    }
+    wake.notify_one();
+}
+
+void MoveJournal::flush(){
+    unique_lock<mutex> guard(lock);
+    uint64_t target = appended;
+    synced.wait(guard, [&]{ return written >= target; });
+}
+
+JournalStats MoveJournal::stats(){
+    lock_guard<mutex> guard(lock);
+    return counters;
+}
+
+void MoveJournal::run(){
+    vector<uint8_t> batch;
+    unique_lock<mutex> guard(lock);
+    while(true){
+        wake.wait(guard, [&]{ return quit || !pending.empty(); });
+        if(pending.empty())
+            break;
+        batch.swap(pending);
+        pending.clear();
+        bool whole = replace;
+        replace = false;
+        uint64_t records = pendingRecords;
+        pendingRecords = 0;
+        uint64_t upTo = appended;
+        string target = path;
+        guard.unlock();
+
+        // everything appended while this batch is on its way to the disk goes out with the next sync
+        bool ok;
+        if(whole){
+            if(file >= 0)
+                closeFile(file);
+            ok = replaceJournal(target, batch);
+            file = ok ? openForAppend(target, false) : -1;
+        }else{
+            ok = file >= 0 && writeAll(file, batch.data(), batch.size()) && syncFile(file);
+        }
+
+        guard.lock();
+        if(ok){
+            counters.syncs++;
+            counters.records += records;
+            counters.bytes += batch.size();
+            if(records > counters.largestBatch)
+                counters.largestBatch = records;
+        }else if(counters.failures++ == 0){
+            cerr << "Journal: unable to write " << target << ", moves are not being autosaved" << endl;
+        }
+        written = upTo;
+        synced.notify_all();
+    }
+}
+
+bool readJournal(const string& path, SavedGame& game){
+    ifstream in(path, ios::binary | ios::ate);
+    if(!in.is_open())
+        return false;
+    streamoff length = in.tellg();
+    if(length < (streamoff)JOURNAL_HEADER_SIZE)
+        return false;
+    vector<uint8_t> bytes((size_t)length);
+    in.seekg(0);
+    if(!in.read(reinterpret_cast<char*>(bytes.data()), length))
+        return false;
+    if(memcmp(bytes.data(), "DJNL", 4) != 0 || (bytes[4] | bytes[5] << 8) > JOURNAL_VERSION)
+        return false;
+
+    SavedGame replayed;
+    bool haveSnapshot = false;
+    size_t at = JOURNAL_HEADER_SIZE;
+    while(at < bytes.size()){
+        // a record that does not fit or fails its check is where the writing stopped
+        size_t start = at;
+        int type = bytes[at++];
+        uint64_t size;
+        if(!decodeVarint(bytes.data(), bytes.size(), at, size) || size + 4 > bytes.size() - at)
+            break;
+        const uint8_t* payload = bytes.data() + at;
+        at += (size_t)size;
+        uint32_t stored = bytes[at] | bytes[at + 1] << 8 | bytes[at + 2] << 16 | (uint32_t)bytes[at + 3] << 24;
+        at += 4;
+        if(crc32(bytes.data() + start, at - 4 - start) != stored)
+            break;
+
+        if(type == journalSnapshot){
+            if(decodeSave(payload, (size_t)size, replayed) != saveOk)
+                break;
+            haveSnapshot = true;
+        }else if(type == journalMove && haveSnapshot){
+            uint64_t index;
+            size_t used = 0;
+            MoveList moves;
+            generateMoves(replayed.position, moves);
+            if(!decodeVarint(payload, (size_t)size, used, index) || index >= (uint64_t)moves.size())
+                break;
+            const Move& played = moves[(int)index];
+            int taken = countSquares(played.captures);
+            if(replayed.position.whiteToMove)
+                replayed.p1 += taken;
+            else
+                replayed.p2 += taken;
+            replayed.history.push_back(played);
+            replayed.position = applyMove(replayed.position, played);
+        }else{
+            break;
+        }
+    }
+    if(!haveSnapshot)
+        return false;
+    if(isGameOver(replayed.position))
+        replayed.winner = replayed.position.whiteToMove ? 2 : 1;
+    game = replayed;
+    return true;
+}
+
+MoveJournal& sharedJournal(){
+    static MoveJournal journal;
+    return journal;
+}
@@ -0,0 +1,96 @@
+// @file journal.h
+// @brief crash-safe autosave: every move played is appended to a journal file that a background
+//        thread writes and syncs in batches, so the game can be rebuilt after a crash
+
+#ifndef JOURNAL_H
+#define JOURNAL_H
+
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "rules.h"
+#include "savefile.h"
+
+const uint16_t JOURNAL_VERSION = 1;
+const size_t JOURNAL_HEADER_SIZE = 8;   // "DJNL", version, reserved
+
+// A journal is its header followed by records: a type byte, the payload length as a varint, the
+// payload and a CRC-32 of all of that. The first record is a snapshot of the game (a save file,
+// see savefile.h), every later one a move, stored as its place in the generateMoves() list.
+enum journalRecord{
+    journalSnapshot = 1,
+    journalMove = 2
+};
+
+/// @brief what the writer has done
+struct JournalStats{
+    uint64_t records = 0;       // records on disk (moves dropped by begin() never get there)
+    uint64_t bytes = 0;         // bytes written
+    uint64_t syncs = 0;         // batches written and synced to disk
+    uint64_t largestBatch = 0;  // most records made durable by one sync
+    uint64_t failures = 0;      // batches that could not be written
+
+    double recordsPerSync() const { return syncs ? (double)records / syncs : 0; }
+};
+
+/// @brief an append-only move journal. The calls only copy a few bytes into a buffer; a background
+///        thread writes what has piled up and syncs it, so one sync covers every move made meanwhile
+///        and the frame loop never waits on the disk.
+class MoveJournal{
+public:
+    MoveJournal();
+    ~MoveJournal();
+    MoveJournal(const MoveJournal&) = delete;
+    MoveJournal& operator=(const MoveJournal&) = delete;
+
+    /// @brief sets the file to write; nothing is written before begin()
+    void open(const std::string& path);
+
+    /// @brief writes what is pending and stops journaling
+    void close();
+
+    /// @brief starts the journal over with a snapshot of a game: the old file is replaced in one
+    ///        step, through a synced temporary file, so a crash leaves either journal whole
+    void begin(const SavedGame& game);
+
+    /// @brief appends a move; ignored before begin()
+    /// @param before,played the position the move is played in and the move
+    void appendMove(const Position& before, const Move& played);
+
+    /// @brief waits until everything appended so far is on disk
+    void flush();
+
+    JournalStats stats();
+
+private:
+    void run();
+
+    std::mutex lock;
+    std::condition_variable wake;       // work for the writer
+    std::condition_variable synced;     // a batch reached the disk
+    std::string path;
+    std::vector<uint8_t> pending;       // records not handed to the writer yet
+    bool replace = false;               // pending holds a whole new journal
+    bool started = false;               // begin() was called since open()
+    uint64_t appended = 0;              // records handed over so far
+    uint64_t written = 0;               // ... of which are on disk
+    uint64_t pendingRecords = 0;
+    JournalStats counters;
+    int file = -1;
+    bool quit = false;
+    std::thread writer;                 // last, so it starts after everything above
+};
+
+/// @brief rebuilds the game of a journal: the snapshot with every move after it replayed. A torn
+///        record at the end (the crash hit while it was written) and everything after it is ignored
+/// @param path,game the journal and the game that receives it; winner is set if the game is over
+/// @return false if there is no readable journal
+bool readJournal(const std::string& path, SavedGame& game);
+
+/// @brief the process-wide journal the game appends its moves to (a GameEvents listener in checkers.cpp)
+MoveJournal& sharedJournal();
+
+#endif
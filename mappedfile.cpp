@@ -0,0 +1,79 @@
+// @file mappedfile.cpp
+// @brief MappedFile on Windows (file mapping objects) and POSIX (mmap)
+
+#include "mappedfile.h"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+using namespace std;
+
+MappedFile::~MappedFile(){
+    unmap();
+}
+
+void MappedFile::unmap(){
+#ifdef _WIN32
+    if(bytes)
+        UnmapViewOfFile(bytes);
+    if(mapping)
+        CloseHandle(mapping);
+    if(file)
+        CloseHandle(file);
+    file = nullptr;
+    mapping = nullptr;
+#else
+    if(bytes)
+        munmap(const_cast<uint8_t*>(bytes), length);
+#endif
+    bytes = nullptr;
+    length = 0;
+}
+
+bool MappedFile::map(const string& path){
+    unmap();
+#ifdef _WIN32
+    HANDLE handle = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if(handle == INVALID_HANDLE_VALUE)
+        return false;
+    file = handle;
+    LARGE_INTEGER fileSize;
+    if(!GetFileSizeEx(handle, &fileSize) || fileSize.QuadPart == 0){
+        unmap();
+        return false;
+    }
+    mapping = CreateFileMappingA(handle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if(!mapping){
+        unmap();
+        return false;
+    }
+    bytes = static_cast<const uint8_t*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+    length = bytes ? (size_t)fileSize.QuadPart : 0;
+#else
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if(fd < 0)
+        return false;
+    struct stat info;
+    if(fstat(fd, &info) != 0 || info.st_size == 0){
+        ::close(fd);
+        return false;
+    }
+    void* address = mmap(nullptr, (size_t)info.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if(address == MAP_FAILED)
+        return false;
+    bytes = static_cast<const uint8_t*>(address);
+    length = (size_t)info.st_size;
+#endif
+    if(!bytes)
+        unmap();
+    return bytes != nullptr;
+}
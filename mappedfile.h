@@ -0,0 +1,40 @@
+// @file mappedfile.h
+// @brief read-only memory mapping of a whole file, shared by the tablebase, the position index and
+//        the opening book
+
+#ifndef MAPPEDFILE_H
+#define MAPPEDFILE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+/// @brief a file mapped read-only into memory; the pages are loaded by the OS as they are touched
+///        and shared with every other process that maps the same file
+class MappedFile{
+public:
+    MappedFile() = default;
+    ~MappedFile();
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    /// @brief maps a file, unmapping the one mapped before
+    /// @return false if the file cannot be opened, is empty or cannot be mapped
+    bool map(const std::string& path);
+
+    /// @brief unmaps the file
+    void unmap();
+
+    const uint8_t* data() const { return bytes; }
+    size_t size() const { return length; }
+
+private:
+    const uint8_t* bytes = nullptr;
+    size_t length = 0;
+#ifdef _WIN32
+    void* file = nullptr;       // HANDLE
+    void* mapping = nullptr;    // HANDLE
+#endif
+};
+
+#endif
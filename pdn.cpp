@@ -0,0 +1,497 @@
+// @file pdn.cpp
+// @brief PDN parsing, writing and file splitting
+
+#include "pdn.h"
+
+#include <cctype>
+#include <cstdlib>
+#include <cstring>
+
+using namespace std;
+
+enum parseOutcome{
+    parsedGame,
+    parseNeedMore,          // the game runs past the data read so far
+    parseNothing            // only whitespace left
+};
+
+static bool isSpace(char c){
+    return c == ' ' || c == '\n' || c == '\r' || c == '\t' || c == '\f' || c == '\v';
+}
+
+static bool isDigit(char c){
+    return c >= '0' && c <= '9';
+}
+
+const string* PdnGame::tag(const char* name) const{
+    for(const PdnTag& t : tags){
+        if(t.name == name)
+            return &t.value;
+    }
+    return nullptr;
+}
+
+void PdnGame::setTag(const string& name, const string& value){
+    for(PdnTag& t : tags){
+        if(t.name == name){
+            t.value = value;
+            return;
+        }
+    }
+    tags.push_back({name, value});
+}
+
+const char* pdnResultText(int result){
+    // player one is Black in the file
+    switch(result){
+        case pdnPlayerOneWins: return "0-1";
+        case pdnPlayerTwoWins: return "1-0";
+        case pdnDraw: return "1/2-1/2";
+    }
+    return "*";
+}
+
+// The board of a file turned around with the colours swapped: square n of the file is square
+// 33 - n of the engine, Black there is player one here. Turning twice gives the position back.
+static uint32_t turnSquares(uint32_t squares){
+    uint32_t turned = 0;
+    for(; squares; squares &= squares - 1)
+        turned |= 1u << (SQUARE_COUNT - 1 - firstSquare(squares));
+    return turned;
+}
+
+static Position turnBoard(const Position& pos){
+    Position turned;
+    turned.white = turnSquares(pos.black);
+    turned.black = turnSquares(pos.white);
+    turned.kings = turnSquares(pos.kings);
+    turned.whiteToMove = !pos.whiteToMove;
+    turned.hash = computeHash(turned);
+    return turned;
+}
+
+// The engine's index (0..31) of a square number of the file (1..32), and back.
+static int engineSquare(int square){ return SQUARE_COUNT - square; }
+static int fileSquare(int square){ return SQUARE_COUNT - square; }
+
+// Returns a move in the square numbers of the file, with its full capture path.
+static string fileMoveText(const Move& move){
+    string text = to_string(fileSquare(move.from));
+    if(!move.captures)
+        return text + "-" + to_string(fileSquare(move.to));
+    for(int i = 0; i < move.pathLength; i++)
+        text += "x" + to_string(fileSquare(move.path[i]));
+    return text + "x" + to_string(fileSquare(move.to));
+}
+
+// Plays a move given as the squares of the file (from, the landing squares of a multi-jump, to). A
+// move that lists every landing square must match exactly; "from-to" alone may also name a
+// multi-jump, as long as only one legal move goes from there to there.
+static void playMove(const int* fileSquares, int count, Position& pos, MoveList& legal, PdnGame& game){
+    int squares[16];
+    for(int i = 0; i < count; i++){
+        if(fileSquares[i] < 1 || fileSquares[i] > SQUARE_COUNT){
+            game.error = "no square " + to_string(fileSquares[i]);
+            return;
+        }
+        squares[i] = engineSquare(fileSquares[i]);
+    }
+    // a quiet move is checked on the board, much faster than listing every legal move
+    if(count == 2 && !hasCapture(pos)){
+        uint32_t own = pos.whiteToMove ? pos.white : pos.black;
+        uint32_t empty = ~(pos.white | pos.black);
+        uint32_t from = 1u << squares[0];
+        uint32_t to = 1u << squares[1];
+        bool legalStep = false;
+        if((own & from) && (pos.kings & from)){
+            for(int dir = upLeft; dir <= downRight && !legalStep; dir++){
+                for(uint32_t ray = shiftSquares(from, dir) & empty; ray && !legalStep; ray = shiftSquares(ray, dir) & empty)
+                    legalStep = (ray & to) != 0;
+            }
+        }else if(own & from){
+            int left = pos.whiteToMove ? upLeft : downLeft;
+            int right = pos.whiteToMove ? upRight : downRight;
+            legalStep = ((shiftSquares(from, left) | shiftSquares(from, right)) & empty & to) != 0;
+        }
+        if(!legalStep){
+            game.error = "illegal move " + to_string(fileSquares[0]) + "-" + to_string(fileSquares[1]) + " at ply " + to_string(game.moves.size() + 1);
+            return;
+        }
+        Move quiet = {};
+        quiet.from = (uint8_t)squares[0];
+        quiet.to = (uint8_t)squares[1];
+        game.moves.push_back(quiet);
+        pos = applyMove(pos, quiet);
+        return;
+    }
+
+    generateMoves(pos, legal);
+    const Move* found = nullptr;
+    const Move* shortened = nullptr;
+    int matches = 0;
+    int shortMatches = 0;
+    for(int i = 0; i < legal.size(); i++){
+        const Move& move = legal[i];
+        if(move.from != squares[0] || move.to != squares[count - 1])
+            continue;
+        shortened = &move;
+        shortMatches++;
+        bool same = move.pathLength == count - 2;
+        for(int j = 0; j < move.pathLength && same; j++)
+            same = move.path[j] == squares[j + 1];
+        if(same){
+            found = &move;
+            matches++;
+        }
+    }
+    if(!matches && count == 2){
+        found = shortened;
+        matches = shortMatches;
+    }
+    if(matches != 1){
+        string text = to_string(fileSquares[0]);
+        for(int i = 1; i < count; i++)
+            text += (count > 2 ? "x" : "-") + to_string(fileSquares[i]);
+        game.error = (matches ? "ambiguous move " : "illegal move ") + text + " at ply " + to_string(game.moves.size() + 1);
+        return;
+    }
+    game.moves.push_back(*found);
+    pos = applyMove(pos, *found);
+}
+
+// Reads a tag such as [White "Abebe"] starting at the '['. The strings of the tags of the previous
+// game are reused, so reading a file does not allocate for every tag.
+static int parseTag(const char* text, size_t size, bool last, size_t& p, PdnGame& game, size_t& tagCount){
+    size_t q = p + 1;
+    while(q < size && isSpace(text[q]))
+        q++;
+    size_t nameStart = q;
+    while(q < size && (isalnum((unsigned char)text[q]) || text[q] == '_'))
+        q++;
+    size_t nameEnd = q;
+    while(q < size && isSpace(text[q]) && text[q] != '\n')
+        q++;
+    if(tagCount == game.tags.size())
+        game.tags.push_back(PdnTag());
+    PdnTag& tag = game.tags[tagCount];
+    tag.name.assign(text + nameStart, nameEnd - nameStart);
+    tag.value.clear();
+    bool ok = q < size && text[q] == '"' && nameEnd > nameStart;
+    if(ok){
+        q++;
+        while(q < size && text[q] != '"' && text[q] != '\n'){
+            size_t run = q;
+            while(run < size && text[run] != '"' && text[run] != '\n' && text[run] != '\\')
+                run++;
+            tag.value.append(text + q, run - q);
+            q = run;
+            if(q + 1 < size && text[q] == '\\'){
+                tag.value += text[q + 1];
+                q += 2;
+            }
+        }
+        ok = q < size && text[q] == '"';
+        q++;
+        while(q < size && isSpace(text[q]) && text[q] != '\n')
+            q++;
+        ok = ok && q < size && text[q] == ']';
+    }
+    if(q >= size && !last)
+        return parseNeedMore;
+    if(!ok){
+        if(game.error.empty())
+            game.error = "unreadable tag";
+        while(q < size && text[q] != '\n')
+            q++;
+        p = q;
+        return parsedGame;
+    }
+    p = q + 1;
+    tagCount++;
+    if(tag.name == "FEN" && game.error.empty()){
+        Position start;
+        if(parseFen(tag.value, start))
+            game.start = turnBoard(start);
+        else
+            game.error = "bad FEN " + tag.value;
+    }
+    // "21" (checkers) may be followed by the board description
+    if(tag.name == "GameType" && game.error.empty() && atoi(tag.value.c_str()) != PDN_GAME_TYPE)
+        game.error = "GameType " + tag.value + " is not read, only " + to_string(PDN_GAME_TYPE) + " (checkers)";
+    return parsedGame;
+}
+
+// Parses the game starting at text[at]: tags, then movetext up to the result, the next game's tags
+// or the end of the data (when last is set, there is no more).
+static int parseGame(const char* text, size_t size, bool last, size_t& at, PdnGame& game, size_t& first){
+    size_t tagCount = 0;
+    game.moves.clear();
+    game.error.clear();
+    game.result = pdnUnfinished;
+    game.start = startPosition();
+    Position pos = game.start;
+    MoveList legal;
+    bool begun = false;
+    bool inMoves = false;
+    size_t p = at;
+    while(true){
+        while(p < size && isSpace(text[p]))
+            p++;
+        if(p >= size){
+            if(!last)
+                return parseNeedMore;
+            break;
+        }
+        if(!begun){
+            begun = true;
+            first = p;
+        }
+        char c = text[p];
+        if(c == '['){
+            if(inMoves)
+                break;
+            if(parseTag(text, size, last, p, game, tagCount) == parseNeedMore)
+                return parseNeedMore;
+            pos = game.start;
+            continue;
+        }
+        if(c == '{' || c == ';' || c == '%'){
+            // comments, and escaped lines
+            const void* close = memchr(text + p, c == '{' ? '}' : '\n', size - p);
+            if(!close){
+                if(!last)
+                    return parseNeedMore;
+                if(c == '{' && game.error.empty())
+                    game.error = "unterminated comment";
+                p = size;
+                break;
+            }
+            p = (const char*)close - text + 1;
+            continue;
+        }
+        if(c == '('){
+            // variations are skipped
+            int depth = 0;
+            size_t q = p;
+            for(; q < size; q++){
+                if(text[q] == '(')
+                    depth++;
+                else if(text[q] == ')' && --depth == 0)
+                    break;
+            }
+            if(q >= size && !last)
+                return parseNeedMore;
+            if(q >= size && game.error.empty())
+                game.error = "unterminated variation";
+            p = q + 1;
+            continue;
+        }
+
+        size_t end = p;
+        while(end < size && !isSpace(text[end]) && text[end] != '[' && text[end] != '{' && text[end] != '(' && text[end] != ';')
+            end++;
+        if(end >= size && !last)
+            return parseNeedMore;
+        inMoves = true;
+        size_t token = p;
+        size_t q = p;
+        p = end;
+        if(text[q] == '*'){
+            game.result = pdnUnfinished;
+            break;
+        }
+        if(text[q] == '$')
+            continue;
+        if(end - q == 7 && memcmp(text + q, "1/2-1/2", 7) == 0){
+            game.result = pdnDraw;
+            break;
+        }
+
+        // a move number ("12." or "12...") may run straight into the move
+        size_t digits = q;
+        while(digits < end && isDigit(text[digits]))
+            digits++;
+        if(digits > q && digits < end && text[digits] == '.'){
+            q = digits;
+            while(q < end && text[q] == '.')
+                q++;
+            if(q == end)
+                continue;
+        }
+
+        int squares[16];
+        int count = 0;
+        bool readable = true;
+        while(readable && q < end && isDigit(text[q])){
+            int square = 0;
+            while(q < end && isDigit(text[q]) && square < 1000)
+                square = square * 10 + (text[q++] - '0');
+            if(count < 16)
+                squares[count++] = square;
+            else
+                readable = false;
+            if(q < end && (text[q] == '-' || text[q] == 'x' || text[q] == 'X' || text[q] == ':'))
+                q++;
+            else
+                break;
+        }
+        while(q < end && (text[q] == '!' || text[q] == '?'))
+            q++;
+        readable = readable && q == end && count >= 2;
+        if(readable && count == 2 && (squares[0] == 0 || squares[1] == 0 || (squares[0] == 1 && squares[1] == 1))){
+            // 1-0, 2-0, 0-1, 0-2 and 1-1
+            // White, player two, wins 1-0
+            game.result = squares[1] == 0 ? pdnPlayerTwoWins : squares[0] == 0 ? pdnPlayerOneWins : pdnDraw;
+            break;
+        }
+        if(!game.error.empty())
+            continue;
+        if(readable)
+            playMove(squares, count, pos, legal, game);
+        else
+            game.error = "unexpected '" + string(text + token, end - token) + "'";
+    }
+    game.tags.resize(tagCount);
+    if(!begun)
+        return parseNothing;
+    at = p;
+    return parsedGame;
+}
+
+bool PdnReader::open(const string& path, uint64_t begin, uint64_t last){
+    file.close();
+    file.clear();
+    file.open(path, ios::binary);
+    if(!file.is_open())
+        return false;
+    file.seekg((streamoff)begin);
+    buffer.resize(PDN_BUFFER_BYTES);
+    at = filled = 0;
+    bufferOffset = begin;
+    end = last;
+    eof = false;
+    return true;
+}
+
+bool PdnReader::refill(){
+    // keep the unparsed tail, then read behind it; a game longer than the buffer makes it grow
+    memmove(buffer.data(), buffer.data() + at, filled - at);
+    bufferOffset += at;
+    filled -= at;
+    at = 0;
+    if(filled == buffer.size())
+        buffer.resize(buffer.size() * 2);
+    file.read(buffer.data() + filled, buffer.size() - filled);
+    streamsize got = file.gcount();
+    filled += (size_t)got;
+    if(got == 0 || !file)
+        eof = true;
+    return true;
+}
+
+bool PdnReader::next(PdnGame& game){
+    while(true){
+        size_t position = at;
+        size_t first = at;
+        int outcome = parseGame(buffer.data(), filled, eof, position, game, first);
+        if(outcome == parseNeedMore){
+            refill();
+            continue;
+        }
+        if(outcome == parseNothing)
+            return false;
+        game.offset = bufferOffset + first;
+        if(game.offset >= end)
+            return false;
+        at = position;
+        return true;
+    }
+}
+
+vector<uint64_t> splitPdnFile(const string& path, int parts){
+    vector<uint64_t> starts(1, 0);
+    ifstream file(path, ios::binary | ios::ate);
+    uint64_t size = file.is_open() ? (uint64_t)file.tellg() : 0;
+    string line;
+    for(int part = 1; part < parts; part++){
+        uint64_t target = size * part / parts;
+        if(target <= starts.back())
+            continue;
+        // from the next full line, the first tag line that follows movetext starts a game
+        file.clear();
+        file.seekg((streamoff)target);
+        uint64_t offset = target;
+        if(getline(file, line))
+            offset += line.size() + 1;
+        bool sawMoves = false;
+        bool found = false;
+        while(!found && getline(file, line)){
+            size_t first = line.find_first_not_of(" \t\r");
+            if(first != string::npos){
+                if(line[first] != '[')
+                    sawMoves = true;
+                else if(sawMoves)
+                    found = true;
+            }
+            if(!found)
+                offset += line.size() + 1;
+        }
+        if(!found)
+            break;
+        starts.push_back(offset);
+    }
+    starts.push_back(size);
+    return starts;
+}
+
+static void appendEscaped(string& out, const string& value){
+    for(char c : value){
+        if(c == '"' || c == '\\')
+            out += '\\';
+        out += c;
+    }
+}
+
+void writePdnGame(string& out, const PdnGame& game){
+    for(const PdnTag& t : game.tags){
+        if(t.name == "Result" || t.name == "FEN")
+            continue;
+        out += '[';
+        out += t.name;
+        out += " \"";
+        appendEscaped(out, t.value);
+        out += "\"]\n";
+    }
+    if(!samePosition(game.start, startPosition()))
+        out += "[FEN \"" + toFen(turnBoard(game.start)) + "\"]\n";
+    out += "[Result \"";
+    out += pdnResultText(game.result);
+    out += "\"]\n\n";
+
+    // movetext, wrapped before 80 columns
+    Position pos = game.start;
+    size_t lineStart = out.size();
+    int number = 1;
+    for(size_t i = 0; i < game.moves.size(); i++){
+        string text;
+        if(pos.whiteToMove)
+            text = to_string(number) + ". ";
+        else if(i == 0)
+            text = to_string(number) + "... ";
+        text += fileMoveText(game.moves[i]);
+        if(!pos.whiteToMove)
+            number++;
+        if(out.size() - lineStart + text.size() + 1 > 79){
+            out += '\n';
+            lineStart = out.size();
+        }else if(out.size() > lineStart){
+            out += ' ';
+        }
+        out += text;
+        pos = applyMove(pos, game.moves[i]);
+    }
+    if(out.size() > lineStart)
+        out += ' ';
+    out += pdnResultText(game.result);
+    out += "\n\n";
+}
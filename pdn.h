@@ -0,0 +1,90 @@
+// @file pdn.h
+// @brief Portable Draughts Notation: a streaming reader that checks every move against the rules
+//        engine, a writer, and the splitting of large files at game boundaries for parallel reading
+
+#ifndef PDN_H
+#define PDN_H
+
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+#include "rules.h"
+
+// Files follow the checkers convention: Black starts on 1..12 and moves first, White on 21..32, and
+// 1-0 (or 2-0) is a win for White. Here player one (white in rules.h) starts on 21..32 of toFen(),
+// so the reader and the writer turn the board around and swap the colours: square n of a file is
+// square 33 - n of the engine, the Black tag names player one and 0-1 is player one's win. The rules
+// are those of rules.h, whose kings fly, so a game of English checkers in which a king could have
+// captured from a distance reads as an illegal move.
+const size_t PDN_BUFFER_BYTES = 1 << 20;    // the reader's window on the file; a longer game grows it
+const int PDN_GAME_TYPE = 21;               // checkers; a game with another GameType tag is rejected
+
+enum pdnResult{
+    pdnUnfinished,          // "*" or no result
+    pdnPlayerOneWins,       // Black in the file, "0-1"
+    pdnPlayerTwoWins,       // White, "1-0"
+    pdnDraw
+};
+
+struct PdnTag{
+    std::string name;
+    std::string value;
+};
+
+/// @brief one game of a PDN file
+struct PdnGame{
+    std::vector<PdnTag> tags;   // in file order; FEN and Result are kept here too
+    Position start;             // startPosition() or the FEN tag, turned to the engine's board
+    std::vector<Move> moves;    // the legal moves read, up to the first bad one
+    int result = pdnUnfinished;
+    uint64_t offset = 0;        // byte offset of the game in its file
+    std::string error;          // why the game was rejected, empty when it was read whole
+
+    /// @brief returns the value of a tag, nullptr if the game does not have it
+    const std::string* tag(const char* name) const;
+
+    /// @brief sets a tag, replacing its value if the game already has it
+    void setTag(const std::string& name, const std::string& value);
+};
+
+/// @brief reads the games of a file, or of a byte range of it, one at a time through a fixed buffer,
+///        so a file of any size is read in the same memory
+class PdnReader{
+public:
+    /// @brief opens a file
+    /// @param path,begin,end the file and the range of game offsets to read; begin must be a game
+    ///        boundary (0, or from splitPdnFile) and the games that start at or after end are left out
+    /// @return false if the file cannot be read
+    bool open(const std::string& path, uint64_t begin = 0, uint64_t end = UINT64_MAX);
+
+    /// @brief reads the next game; a game with an illegal or unreadable move comes back with error set
+    /// @return false when there are no more games
+    bool next(PdnGame& game);
+
+private:
+    bool refill();
+
+    std::ifstream file;
+    std::vector<char> buffer;
+    size_t at = 0;              // next byte to parse
+    size_t filled = 0;          // bytes of the buffer holding data
+    uint64_t bufferOffset = 0;  // file offset of buffer[0]
+    uint64_t end = UINT64_MAX;
+    bool eof = true;
+};
+
+/// @brief finds where to cut a file so each part starts with a game (at its first tag line)
+/// @param path,parts the file and how many parts are wanted
+/// @return the part starts, ascending, beginning with 0 and ending with the file size; fewer parts
+///         than asked if the file has fewer games
+std::vector<uint64_t> splitPdnFile(const std::string& path, int parts);
+
+/// @brief appends a game in PDN: its tags (Result and, unless it starts from the opening, FEN are
+///        written from the game), then the moves with full capture paths, then the result
+void writePdnGame(std::string& out, const PdnGame& game);
+
+/// @brief returns the PDN token of a result ("1-0", "0-1", "1/2-1/2" or "*")
+const char* pdnResultText(int result);
+
+#endif
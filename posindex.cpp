@@ -0,0 +1,307 @@
+// @file posindex.cpp
+// @brief the position index: building it from PDN archives and looking positions up
+
+#include "posindex.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <queue>
+#include <thread>
+#include "pdn.h"
+
+using namespace std;
+
+// a thread sums up its records whenever it holds this many (48 MB), and writes them to a run file
+// when that leaves more than half of them
+const size_t POSITION_INDEX_RUN = 1 << 21;
+const size_t POSITION_INDEX_READ = 4096;    // records read from a run file at a time while merging
+
+static bool keyLess(const PositionRecord& a, const PositionRecord& b){
+    return a.key < b.key;
+}
+
+/// @brief sorts records and adds up those with the same key, in place
+static void compactRecords(vector<PositionRecord>& records){
+    sort(records.begin(), records.end(), keyLess);
+    size_t kept = 0;
+    for(size_t i = 0; i < records.size(); i++){
+        if(kept > 0 && records[kept - 1].key == records[i].key){
+            PositionRecord& total = records[kept - 1];
+            total.games += records[i].games;
+            total.whiteWins += records[i].whiteWins;
+            total.blackWins += records[i].blackWins;
+            total.draws += records[i].draws;
+        }else{
+            records[kept++] = records[i];
+        }
+    }
+    records.resize(kept);
+}
+
+/// @brief a byte range of one archive, read by one thread
+struct IndexPart{
+    const string* path;
+    uint64_t begin;
+    uint64_t end;
+};
+
+/// @brief what one thread gathered: the sorted runs it wrote to files, and its last records, sorted
+///        and summed up once it is done
+struct IndexRun{
+    vector<string> files;
+    vector<PositionRecord> records;
+    uint64_t games = 0;
+    uint64_t rejected = 0;
+    uint64_t positions = 0;
+    bool failed = false;        // a run file could not be written
+};
+
+/// @brief the run files of an index being built, named after it
+struct RunFiles{
+    string prefix;
+    atomic<int> count{0};
+};
+
+/// @brief writes sorted records to a new run file and empties them
+static bool spillRun(vector<PositionRecord>& records, RunFiles& runFiles, IndexRun& run){
+    string path = runFiles.prefix + to_string(runFiles.count++);
+    run.files.push_back(path);
+    ofstream file(path, ios::binary | ios::trunc);
+    file.write(reinterpret_cast<const char*>(records.data()), records.size() * sizeof(PositionRecord));
+    file.close();
+    records.clear();
+    return !file.fail();
+}
+
+static void indexParts(const vector<IndexPart>& parts, atomic<size_t>& nextPart, RunFiles& runFiles, IndexRun& run){
+    PdnGame game;
+    vector<uint64_t> keys;
+    run.records.reserve(POSITION_INDEX_RUN);
+    for(size_t part = nextPart++; part < parts.size(); part = nextPart++){
+        PdnReader reader;
+        if(!reader.open(*parts[part].path, parts[part].begin, parts[part].end))
+            continue;
+        while(reader.next(game)){
+            run.games++;
+            if(!game.error.empty())
+                run.rejected++;
+            // a game counts once for a position it went through more than once
+            keys.clear();
+            Position pos = game.start;
+            keys.push_back(pos.hash);
+            for(const Move& played : game.moves){
+                pos = applyMove(pos, played);
+                keys.push_back(pos.hash);
+            }
+            sort(keys.begin(), keys.end());
+            keys.erase(unique(keys.begin(), keys.end()), keys.end());
+
+            PositionRecord record;
+            record.games = 1;
+            record.whiteWins = game.result == pdnPlayerOneWins;
+            record.blackWins = game.result == pdnPlayerTwoWins;
+            record.draws = game.result == pdnDraw;
+            for(uint64_t key : keys){
+                record.key = key;
+                run.records.push_back(record);
+            }
+            run.positions += keys.size();
+            if(run.records.size() >= POSITION_INDEX_RUN){
+                compactRecords(run.records);
+                if(run.records.size() > POSITION_INDEX_RUN / 2 && !spillRun(run.records, runFiles, run)){
+                    run.failed = true;
+                    return;
+                }
+            }
+        }
+    }
+    compactRecords(run.records);
+}
+
+/// @brief one sorted run being merged: a run file read a block at a time, or a thread's last records
+struct RunReader{
+    ifstream file;
+    vector<PositionRecord> records;
+    size_t at = 0;
+
+    /// @brief the next record of the run
+    /// @return false when the run is used up
+    bool next(PositionRecord& record){
+        if(at == records.size() && file.is_open()){
+            records.resize(POSITION_INDEX_READ);
+            file.read(reinterpret_cast<char*>(records.data()), records.size() * sizeof(PositionRecord));
+            records.resize((size_t)file.gcount() / sizeof(PositionRecord));
+            at = 0;
+        }
+        if(at == records.size())
+            return false;
+        record = records[at++];
+        return true;
+    }
+};
+
+/// @brief removes the run files of every thread
+static void removeRuns(const vector<IndexRun>& runs){
+    for(const IndexRun& run : runs){
+        for(const string& path : run.files)
+            remove(path.c_str());
+    }
+}
+
+bool buildPositionIndex(const vector<string>& pdnFiles, const string& out, int threads, PositionIndexBuild& build){
+    build = PositionIndexBuild();
+    threads = max(threads, 1);
+    // every file is cut at game boundaries so the threads share a single big archive as well
+    vector<IndexPart> parts;
+    for(const string& path : pdnFiles){
+        vector<uint64_t> starts = splitPdnFile(path, threads);
+        for(size_t i = 0; i + 1 < starts.size(); i++)
+            parts.push_back({&path, starts[i], starts[i + 1]});
+    }
+    vector<IndexRun> runs(threads);
+    RunFiles runFiles;
+    runFiles.prefix = out + ".run";
+    atomic<size_t> nextPart(0);
+    vector<thread> workers;
+    for(int i = 0; i < threads; i++)
+        workers.emplace_back(indexParts, cref(parts), ref(nextPart), ref(runFiles), ref(runs[i]));
+    for(thread& worker : workers)
+        worker.join();
+
+    string temporary = out + ".tmp";
+    ofstream file(temporary, ios::binary | ios::trunc);
+    bool failed = !file.is_open();
+    for(const IndexRun& run : runs)
+        failed = failed || run.failed;
+    if(failed){
+        removeRuns(runs);
+        return false;
+    }
+    PositionIndexHeader header;
+    memcpy(header.magic, "DPX1", 4);
+    header.version = POSITION_INDEX_VERSION;
+    header.recordSize = sizeof(PositionRecord);
+    header.records = 0;
+    header.games = 0;
+    for(const IndexRun& run : runs){
+        header.games += run.games;
+        build.rejected += run.rejected;
+        build.positions += run.positions;
+    }
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+
+    // the runs are sorted: merging them writes the records in order, adding up equal keys
+    vector<unique_ptr<RunReader>> readers;
+    for(IndexRun& run : runs){
+        for(const string& path : run.files){
+            readers.emplace_back(new RunReader());
+            readers.back()->file.open(path, ios::binary);
+            if(!readers.back()->file.is_open()){
+                readers.clear();
+                removeRuns(runs);
+                return false;
+            }
+        }
+        readers.emplace_back(new RunReader());
+        readers.back()->records.swap(run.records);
+    }
+    // the smallest key on top, with the reader it came from
+    typedef pair<PositionRecord, size_t> Head;
+    auto later = [](const Head& a, const Head& b){ return b.first.key < a.first.key; };
+    priority_queue<Head, vector<Head>, decltype(later)> heads(later);
+    for(size_t i = 0; i < readers.size(); i++){
+        PositionRecord first;
+        if(readers[i]->next(first))
+            heads.push(make_pair(first, i));
+    }
+    vector<PositionRecord> block;
+    block.reserve(4096);
+    while(!heads.empty()){
+        Head head = heads.top();
+        heads.pop();
+        const PositionRecord& next = head.first;
+        PositionRecord following;
+        if(readers[head.second]->next(following))
+            heads.push(make_pair(following, head.second));
+        if(!block.empty() && block.back().key == next.key){
+            block.back().games += next.games;
+            block.back().whiteWins += next.whiteWins;
+            block.back().blackWins += next.blackWins;
+            block.back().draws += next.draws;
+            continue;
+        }
+        if(block.size() == block.capacity()){
+            // the last record stays: the next run may still add to it
+            file.write(reinterpret_cast<const char*>(block.data()), (block.size() - 1) * sizeof(PositionRecord));
+            header.records += block.size() - 1;
+            block.front() = block.back();
+            block.resize(1);
+        }
+        block.push_back(next);
+    }
+    readers.clear();
+    removeRuns(runs);
+    file.write(reinterpret_cast<const char*>(block.data()), block.size() * sizeof(PositionRecord));
+    header.records += block.size();
+    file.seekp(0);
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    file.close();
+    if(!file)
+        return false;
+    remove(out.c_str());
+    if(rename(temporary.c_str(), out.c_str()) != 0)
+        return false;
+    build.games = header.games;
+    build.records = header.records;
+    build.bytes = sizeof(header) + header.records * sizeof(PositionRecord);
+    return true;
+}
+
+bool PositionIndex::open(const string& path){
+    close();
+    if(!file.map(path) || file.size() < sizeof(PositionIndexHeader))
+        return false;
+    const PositionIndexHeader* header = reinterpret_cast<const PositionIndexHeader*>(file.data());
+    if(memcmp(header->magic, "DPX1", 4) != 0 || header->version > POSITION_INDEX_VERSION ||
+       header->recordSize != sizeof(PositionRecord) ||
+       file.size() != sizeof(PositionIndexHeader) + header->records * sizeof(PositionRecord)){
+        file.unmap();
+        return false;
+    }
+    records = reinterpret_cast<const PositionRecord*>(file.data() + sizeof(PositionIndexHeader));
+    count = header->records;
+    gameCount = header->games;
+    return true;
+}
+
+void PositionIndex::close(){
+    file.unmap();
+    records = nullptr;
+    count = 0;
+    gameCount = 0;
+}
+
+bool PositionIndex::lookup(const Position& pos, PositionStats& stats) const{
+    stats = PositionStats();
+    if(!records)
+        return false;
+    PositionRecord wanted;
+    wanted.key = pos.hash;
+    const PositionRecord* found = lower_bound(records, records + count, wanted, keyLess);
+    if(found == records + count || found->key != pos.hash)
+        return false;
+    stats.games = found->games;
+    stats.wins = pos.whiteToMove ? found->whiteWins : found->blackWins;
+    stats.losses = pos.whiteToMove ? found->blackWins : found->whiteWins;
+    stats.draws = found->draws;
+    return true;
+}
+
+PositionIndex& sharedPositionIndex(){
+    static PositionIndex index;
+    return index;
+}
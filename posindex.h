@@ -0,0 +1,93 @@
+// @file posindex.h
+// @brief position index of a game archive: how many games reached a position and how they ended,
+//        built offline from PDN files into a sorted file that is memory-mapped and binary-searched
+
+#ifndef POSINDEX_H
+#define POSINDEX_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "mappedfile.h"
+#include "rules.h"
+
+const uint16_t POSITION_INDEX_VERSION = 1;
+
+// The file is its header followed by one record per distinct position, sorted by key (the position's
+// Zobrist hash, see computeHash). A game counts once for every position it reached, however often.
+struct PositionIndexHeader{
+    char magic[4];          // "DPX1"
+    uint16_t version;
+    uint16_t recordSize;    // sizeof(PositionRecord)
+    uint64_t records;
+    uint64_t games;         // games indexed
+};
+
+struct PositionRecord{
+    uint64_t key;
+    uint32_t games;         // games that reached the position
+    uint32_t whiteWins;     // ... of which white (player one) won
+    uint32_t blackWins;
+    uint32_t draws;         // ... that were drawn (unfinished games count in games only)
+};
+
+/// @brief how the games that reached a position ended, from the point of view of the side to move
+struct PositionStats{
+    uint32_t games = 0;
+    uint32_t wins = 0;
+    uint32_t draws = 0;
+    uint32_t losses = 0;
+
+    uint32_t finished() const { return wins + draws + losses; }
+    /// @brief percentage of the finished games, 0 when there are none
+    double percent(uint32_t count) const { return finished() ? 100.0 * count / finished() : 0; }
+};
+
+/// @brief what building an index did
+struct PositionIndexBuild{
+    uint64_t games = 0;         // games indexed
+    uint64_t rejected = 0;      // games with an illegal move, indexed up to it
+    uint64_t positions = 0;     // positions counted, once per game
+    uint64_t records = 0;       // distinct positions written
+    uint64_t bytes = 0;
+};
+
+/// @brief a memory-mapped index; open() reads nothing but the header, so opening is instant and a
+///        lookup touches only the few pages of its binary search
+class PositionIndex{
+public:
+    /// @brief maps an index file
+    /// @return false if there is no readable index there
+    bool open(const std::string& path);
+
+    void close();
+
+    bool isOpen() const { return records != nullptr; }
+    uint64_t positions() const { return count; }
+    uint64_t games() const { return gameCount; }
+
+    /// @brief finds a position
+    /// @param pos,stats the position and what receives its games (zeroed when it is not in the index)
+    /// @return true if a game of the archive reached the position
+    bool lookup(const Position& pos, PositionStats& stats) const;
+
+private:
+    MappedFile file;
+    const PositionRecord* records = nullptr;
+    uint64_t count = 0;
+    uint64_t gameCount = 0;
+};
+
+/// @brief indexes PDN files: every thread reads its share of the games and sorts and sums up its own
+///        records, writing them to a run file next to the index whenever it holds too many, so memory
+///        does not grow with the archive; then the sorted runs are merged straight into the file
+/// @param pdnFiles,out,threads the archives, the index to write and how many threads read them
+/// @param build receives the counts
+/// @return false if the index could not be written
+bool buildPositionIndex(const std::vector<std::string>& pdnFiles, const std::string& out, int threads,
+                        PositionIndexBuild& build);
+
+/// @brief the process-wide index the side panel reads
+PositionIndex& sharedPositionIndex();
+
+#endif
@@ -0,0 +1,461 @@
+// @file rules.cpp
+// @brief bitboard move generation and move application for the checkers game
+
+#include "rules.h"
+
+#include <cctype>
+#include <cstdlib>
+#include <iostream>
+
+static const int FORWARD_DIRS[2][2] = {{upLeft, upRight}, {downLeft, downRight}};
+static const int ALL_DIRS[4] = {upLeft, upRight, downLeft, downRight};
+
+static int opposite(int dir){
+    return 3 - dir;
+}
+
+// NEIGHBOR[square][dir] is the square one diagonal step away, or -1 off the board.
+static int8_t NEIGHBOR[SQUARE_COUNT][4];
+
+static bool initNeighbors(){
+    for(int square = 0; square < SQUARE_COUNT; square++){
+        for(int dir = 0; dir < 4; dir++){
+            uint32_t step = shiftSquares(1u << square, dir);
+            NEIGHBOR[square][dir] = step ? (int8_t)firstSquare(step) : -1;
+        }
+    }
+    return true;
+}
+static const bool neighborsReady = initNeighbors();
+
+// Zobrist keys: ZOBRIST[kind][square] with kind 0 white man, 1 black man, 2 white king, 3 black king.
+static uint64_t ZOBRIST[4][SQUARE_COUNT];
+static uint64_t ZOBRIST_BLACK_TO_MOVE;
+
+static bool initZobrist(){
+    uint64_t seed = 0x243F6A8885A308D3ull;
+    auto next = [&seed](){
+        // splitmix64: fixed seed so keys (and saved tables) are the same on every run
+        uint64_t z = (seed += 0x9E3779B97F4A7C15ull);
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+        return z ^ (z >> 31);
+    };
+    for(int kind = 0; kind < 4; kind++){
+        for(int square = 0; square < SQUARE_COUNT; square++)
+            ZOBRIST[kind][square] = next();
+    }
+    ZOBRIST_BLACK_TO_MOVE = next();
+    return true;
+}
+static const bool zobristReady = initZobrist();
+
+static int pieceKind(const Position& pos, uint32_t bit){
+    return ((pos.black & bit) ? 1 : 0) + ((pos.kings & bit) ? 2 : 0);
+}
+
+uint64_t computeHash(const Position& pos){
+    uint64_t hash = pos.whiteToMove ? 0 : ZOBRIST_BLACK_TO_MOVE;
+    for(uint32_t pieces = pos.white | pos.black; pieces; pieces &= pieces - 1){
+        int square = firstSquare(pieces);
+        hash ^= ZOBRIST[pieceKind(pos, 1u << square)][square];
+    }
+    return hash;
+}
+
+Position startPosition(){
+    Position pos;
+    pos.black = 0x00000FFFu;    // rows 0..2
+    pos.white = 0xFFF00000u;    // rows 5..7
+    pos.kings = 0;
+    pos.whiteToMove = true;
+    pos.hash = computeHash(pos);
+    return pos;
+}
+
+int squareAt(int row, int col){
+    if(row < 0 || row > 7 || col < 0 || col > 7)
+        return -1;
+    if((row + col) % 2 == 0)
+        return -1;
+    return row * 4 + col / 2;
+}
+
+int squareRow(int square){
+    return square / 4;
+}
+
+int squareCol(int square){
+    int row = square / 4;
+    return 2 * (square % 4) + (row % 2 == 0 ? 1 : 0);
+}
+
+void moveListOverflow(){
+    std::cerr << "Rules: a position has more than " << MAX_MOVES << " legal moves, raise MAX_MOVES" << std::endl;
+    abort();
+}
+
+// Adds a finished capture unless the same piece already reaches the same square taking the same pieces.
+static void addCapture(MoveList& moves, const Move& move){
+    for(const Move& other : moves){
+        if(other.from == move.from && other.to == move.to && other.captures == move.captures)
+            return;
+    }
+    moves.add(move);
+}
+
+// Extends a capture of a man standing on `square`. Captured pieces stay on the board until the
+// move ends, so they can neither be jumped twice nor passed through.
+static void manCaptures(const Position& pos, int square, Move& move, uint32_t empty, MoveList& moves){
+    uint32_t opponents = pos.whiteToMove ? pos.black : pos.white;
+    const int* dirs = FORWARD_DIRS[pos.whiteToMove ? 0 : 1];
+    bool extended = false;
+    for(int i = 0; i < 2; i++){
+        uint32_t over = shiftSquares(1u << square, dirs[i]) & opponents & ~move.captures;
+        uint32_t land = shiftSquares(over, dirs[i]) & empty;
+        if(!land)
+            continue;
+        extended = true;
+        int next = firstSquare(land);
+        move.captures |= over;
+        move.path[move.pathLength++] = (uint8_t)next;
+        manCaptures(pos, next, move, empty, moves);
+        move.pathLength--;
+        move.captures &= ~over;
+    }
+    if(!extended && move.captures){
+        Move done = move;
+        done.to = (uint8_t)square;
+        done.pathLength--;
+        addCapture(moves, done);
+    }
+}
+
+// Same as manCaptures for a flying king: it may jump a piece from any distance and land on any
+// empty square behind it.
+static void kingCaptures(const Position& pos, int square, Move& move, uint32_t empty, MoveList& moves){
+    uint32_t opponents = pos.whiteToMove ? pos.black : pos.white;
+    bool extended = false;
+    for(int dir : ALL_DIRS){
+        uint32_t step = shiftSquares(1u << square, dir);
+        while(step & empty)
+            step = shiftSquares(step, dir);
+        if(!(step & opponents & ~move.captures))
+            continue;
+        uint32_t over = step;
+        uint32_t land = shiftSquares(over, dir) & empty;
+        while(land){
+            extended = true;
+            int next = firstSquare(land);
+            move.captures |= over;
+            move.path[move.pathLength++] = (uint8_t)next;
+            kingCaptures(pos, next, move, empty, moves);
+            move.pathLength--;
+            move.captures &= ~over;
+            land = shiftSquares(land, dir) & empty;
+        }
+    }
+    if(!extended && move.captures){
+        Move done = move;
+        done.to = (uint8_t)square;
+        done.pathLength--;
+        addCapture(moves, done);
+    }
+}
+
+// Returns the pieces of the side to move that can start a capture, computed for all of them at once.
+static uint32_t capturers(const Position& pos){
+    uint32_t own = pos.whiteToMove ? pos.white : pos.black;
+    uint32_t opponents = pos.whiteToMove ? pos.black : pos.white;
+    uint32_t empty = ~(pos.white | pos.black);
+    uint32_t men = own & ~pos.kings;
+    uint32_t kings = own & pos.kings;
+    uint32_t found = 0;
+
+    const int* dirs = FORWARD_DIRS[pos.whiteToMove ? 0 : 1];
+    for(int i = 0; i < 2; i++){
+        // walk back from the empty landing square over an opponent to the man
+        uint32_t over = shiftSquares(empty, opposite(dirs[i])) & opponents;
+        found |= shiftSquares(over, opposite(dirs[i])) & men;
+    }
+    if(!kings)
+        return found;
+    for(int dir : ALL_DIRS){
+        uint32_t over = shiftSquares(empty, opposite(dir)) & opponents;
+        // slide back from the jumped piece through empty squares to a king
+        uint32_t ray = shiftSquares(over, opposite(dir));
+        while(ray){
+            found |= ray & kings;
+            ray &= empty;
+            ray = shiftSquares(ray, opposite(dir));
+        }
+    }
+    return found;
+}
+
+bool hasCapture(const Position& pos){
+    return capturers(pos) != 0;
+}
+
+int countMoves(const Position& pos){
+    uint32_t own = pos.whiteToMove ? pos.white : pos.black;
+    if(capturers(pos)){
+        MoveList moves;
+        generateMoves(pos, moves);
+        return moves.size();
+    }
+    uint32_t empty = ~(pos.white | pos.black);
+    uint32_t men = own & ~pos.kings;
+    int count = 0;
+    const int* dirs = FORWARD_DIRS[pos.whiteToMove ? 0 : 1];
+    for(int i = 0; i < 2; i++)
+        count += countSquares(shiftSquares(men, dirs[i]) & empty);
+    for(int dir : ALL_DIRS){
+        uint32_t ray = shiftSquares(own & pos.kings, dir) & empty;
+        while(ray){
+            count += countSquares(ray);
+            ray = shiftSquares(ray, dir) & empty;
+        }
+    }
+    return count;
+}
+
+void generateMoves(const Position& pos, MoveList& moves){
+    moves.clear();
+    uint32_t own = pos.whiteToMove ? pos.white : pos.black;
+    uint32_t empty = ~(pos.white | pos.black);
+    uint32_t men = own & ~pos.kings;
+    uint32_t kings = own & pos.kings;
+
+    // captures first: when one exists it is mandatory
+    Move move;
+    for(uint32_t pieces = capturers(pos); pieces; pieces &= pieces - 1){
+        int square = firstSquare(pieces);
+        move.captures = 0;
+        move.from = (uint8_t)square;
+        move.pathLength = 0;
+        // the capturing piece leaves its square, so a king may fly back over it
+        if(men & (1u << square))
+            manCaptures(pos, square, move, empty, moves);
+        else
+            kingCaptures(pos, square, move, empty | (1u << square), moves);
+    }
+    if(!moves.empty())
+        return;
+
+    move.captures = 0;
+    move.pathLength = 0;
+    const int* dirs = FORWARD_DIRS[pos.whiteToMove ? 0 : 1];
+    for(int i = 0; i < 2; i++){
+        int back = opposite(dirs[i]);
+        for(uint32_t targets = shiftSquares(men, dirs[i]) & empty; targets; targets &= targets - 1){
+            int to = firstSquare(targets);
+            move.from = (uint8_t)NEIGHBOR[to][back];
+            move.to = (uint8_t)to;
+            moves.add(move);
+        }
+    }
+    for(uint32_t pieces = kings; pieces; pieces &= pieces - 1){
+        int square = firstSquare(pieces);
+        move.from = (uint8_t)square;
+        for(int dir : ALL_DIRS){
+            for(uint32_t step = shiftSquares(1u << square, dir) & empty; step; step = shiftSquares(step, dir) & empty){
+                move.to = (uint8_t)firstSquare(step);
+                moves.add(move);
+            }
+        }
+    }
+}
+
+Position applyMove(const Position& pos, const Move& move){
+    Position next = pos;
+    uint32_t fromBit = 1u << move.from;
+    uint32_t toBit = 1u << move.to;
+    uint32_t& own = next.whiteToMove ? next.white : next.black;
+    uint32_t& opponents = next.whiteToMove ? next.black : next.white;
+
+    int mover = pieceKind(pos, fromBit);
+    next.hash ^= ZOBRIST[mover][move.from] ^ ZOBRIST_BLACK_TO_MOVE;
+    for(uint32_t taken = move.captures; taken; taken &= taken - 1){
+        int square = firstSquare(taken);
+        next.hash ^= ZOBRIST[pieceKind(pos, 1u << square)][square];
+    }
+
+    // clear before set: a king may finish a capture on the square it started from
+    own = (own & ~fromBit) | toBit;
+    opponents &= ~move.captures;
+    if(pos.kings & fromBit){
+        next.kings = (next.kings & ~(fromBit | move.captures)) | toBit;
+    }else{
+        next.kings &= ~move.captures;
+        if(toBit & (pos.whiteToMove ? TOP_ROW : BOTTOM_ROW)){
+            next.kings |= toBit;
+            mover += 2;
+        }
+    }
+    next.hash ^= ZOBRIST[mover][move.to];
+    next.whiteToMove = !pos.whiteToMove;
+    return next;
+}
+
+bool isGameOver(const Position& pos){
+    uint32_t own = pos.whiteToMove ? pos.white : pos.black;
+    uint32_t empty = ~(pos.white | pos.black);
+    uint32_t men = own & ~pos.kings;
+    const int* dirs = FORWARD_DIRS[pos.whiteToMove ? 0 : 1];
+    for(int i = 0; i < 2; i++){
+        if(shiftSquares(men, dirs[i]) & empty)
+            return false;
+    }
+    for(int dir : ALL_DIRS){
+        if(shiftSquares(own & pos.kings, dir) & empty)
+            return false;
+    }
+    return !hasCapture(pos);
+}
+
+// Reads a square list such as "21,22,K30" or "1-12" into the masks of one side.
+static bool parseSquares(const std::string& list, uint32_t& pieces, uint32_t& kings){
+    size_t i = 0;
+    while(i < list.size()){
+        bool king = false;
+        if(list[i] == 'K'){
+            king = true;
+            i++;
+        }
+        if(i >= list.size() || !isdigit((unsigned char)list[i]))
+            return false;
+        int first = atoi(list.c_str() + i);
+        while(i < list.size() && isdigit((unsigned char)list[i]))
+            i++;
+        int last = first;
+        if(i < list.size() && list[i] == '-'){
+            i++;
+            last = atoi(list.c_str() + i);
+            while(i < list.size() && isdigit((unsigned char)list[i]))
+                i++;
+        }
+        if(first < 1 || last > SQUARE_COUNT || first > last)
+            return false;
+        for(int square = first; square <= last; square++){
+            pieces |= 1u << (square - 1);
+            if(king)
+                kings |= 1u << (square - 1);
+        }
+        if(i < list.size() && list[i] == ',')
+            i++;
+        else if(i < list.size())
+            return false;
+    }
+    return true;
+}
+
+bool parseFen(const std::string& text, Position& pos){
+    std::string fen;
+    for(char c : text){
+        if(!isspace((unsigned char)c) && c != '"' && c != '.')
+            fen += (char)toupper((unsigned char)c);
+    }
+    if(fen.size() < 1 || (fen[0] != 'W' && fen[0] != 'B'))
+        return false;
+    Position result;
+    result.white = result.black = result.kings = 0;
+    result.whiteToMove = fen[0] == 'W';
+
+    size_t start = 1;
+    while(start < fen.size()){
+        if(fen[start] != ':' || start + 1 >= fen.size())
+            return false;
+        size_t end = fen.find(':', start + 1);
+        if(end == std::string::npos)
+            end = fen.size();
+        char color = fen[start + 1];
+        std::string list = fen.substr(start + 2, end - start - 2);
+        uint32_t pieces = 0;
+        if(color != 'W' && color != 'B')
+            return false;
+        if(!parseSquares(list, pieces, result.kings))
+            return false;
+        (color == 'W' ? result.white : result.black) |= pieces;
+        start = end;
+    }
+    if(result.white & result.black)
+        return false;
+    result.hash = computeHash(result);
+    pos = result;
+    return true;
+}
+
+static std::string squareList(uint32_t pieces, uint32_t kings){
+    std::string list;
+    for(; pieces; pieces &= pieces - 1){
+        int square = firstSquare(pieces);
+        if(!list.empty())
+            list += ',';
+        if(kings & (1u << square))
+            list += 'K';
+        list += std::to_string(square + 1);
+    }
+    return list;
+}
+
+std::string toFen(const Position& pos){
+    return std::string(pos.whiteToMove ? "W" : "B") + ":W" + squareList(pos.white, pos.kings)
+        + ":B" + squareList(pos.black, pos.kings);
+}
+
+std::string moveToString(const Move& move){
+    std::string text = std::to_string(move.from + 1);
+    if(!move.captures)
+        return text + "-" + std::to_string(move.to + 1);
+    for(int i = 0; i < move.pathLength; i++)
+        text += "x" + std::to_string(move.path[i] + 1);
+    return text + "x" + std::to_string(move.to + 1);
+}
+
+bool parseMove(const Position& pos, const std::string& text, Move& move){
+    int squares[14];
+    int count = 0;
+    size_t at = 0;
+    while(at < text.size()){
+        if(count == 14 || !isdigit((unsigned char)text[at]))
+            return false;
+        int square = 0;
+        while(at < text.size() && isdigit((unsigned char)text[at]) && square <= SQUARE_COUNT)
+            square = square * 10 + (text[at++] - '0');
+        if(square < 1 || square > SQUARE_COUNT)
+            return false;
+        squares[count++] = square - 1;
+        if(at < text.size() && (text[at] == '-' || text[at] == 'x' || text[at] == 'X') && at + 1 < text.size())
+            at++;
+        else if(at < text.size())
+            return false;
+    }
+    if(count < 2)
+        return false;
+    MoveList moves;
+    generateMoves(pos, moves);
+    // a full capture path names one move; first and last square alone may fit several
+    const Move* found = nullptr;
+    int matches = 0;
+    for(const Move& m : moves){
+        if(m.from != squares[0] || m.to != squares[count - 1])
+            continue;
+        if(count > 2){
+            if(m.pathLength != count - 2)
+                continue;
+            bool same = true;
+            for(int i = 0; i < m.pathLength; i++)
+                same = same && m.path[i] == squares[i + 1];
+            if(!same)
+                continue;
+        }
+        if(!found || !sameMove(*found, m))
+            matches++;
+        found = &m;
+    }
+    if(matches != 1)
+        return false;
+    move = *found;
+    return true;
+}
@@ -0,0 +1,161 @@
+// @file rules.h
+// @brief bitboard rules engine for the checkers game (positions, legal moves, game end)
+// @rules men move and capture forward only, kings fly along the diagonals, capturing is mandatory
+//        and a capture may continue with more jumps from the landing square
+
+#ifndef RULES_H
+#define RULES_H
+
+#include <cstdint>
+#include <string>
+
+// The 32 dark squares are numbered 0..31, four per row, starting at the top-left of the board
+// (row 0, where player two starts). Bit n of a mask is set when square n is occupied.
+const int SQUARE_COUNT = 32;
+
+// Upper bound on the legal moves of one position. Quiet moves are bounded: twelve flying kings reach
+// at most 13 squares each, 156 in all. Captures are listed once per piece, landing square and set of
+// pieces taken, and no bound short of that is proven for flying kings, so a position with more moves
+// stops the program (moveListOverflow) rather than be searched with some of them missing.
+const int MAX_MOVES = 256;
+
+const uint32_t EVEN_ROWS   = 0x0F0F0F0Fu;    // rows 0,2,4,6 (dark squares on odd columns)
+const uint32_t ODD_ROWS    = 0xF0F0F0F0u;    // rows 1,3,5,7 (dark squares on even columns)
+const uint32_t LEFT_EDGE   = 0x10101010u;    // dark squares on column 0
+const uint32_t RIGHT_EDGE  = 0x08080808u;    // dark squares on column 7
+const uint32_t TOP_ROW     = 0x0000000Fu;    // player one (white) promotes here
+const uint32_t BOTTOM_ROW  = 0xF0000000u;    // player two (black) promotes here
+
+enum direction{
+    upLeft,
+    upRight,
+    downLeft,
+    downRight
+};
+
+/// @brief a position: white is player one (bottom, moves first), black is player two (top)
+struct Position{
+    uint32_t white;
+    uint32_t black;
+    uint32_t kings;
+    bool whiteToMove;
+    uint64_t hash;          // Zobrist key, kept up to date by applyMove
+};
+
+/// @brief true if both positions have the same pieces and side to move
+inline bool samePosition(const Position& a, const Position& b){
+    return a.white == b.white && a.black == b.black && a.kings == b.kings && a.whiteToMove == b.whiteToMove;
+}
+
+/// @brief a move as the squares it touches: the landing squares of a multi-jump are kept in path
+struct Move{
+    uint32_t captures;      // mask of the pieces taken by the move
+    uint8_t from;
+    uint8_t to;
+    uint8_t pathLength;     // number of intermediate landing squares
+    uint8_t path[12];
+};
+
+/// @brief true if both moves are the same move (same piece, destination and captures)
+inline bool sameMove(const Move& a, const Move& b){
+    return a.from == b.from && a.to == b.to && a.captures == b.captures;
+}
+
+/// @brief reports a position with more than MAX_MOVES legal moves and aborts
+[[noreturn]] void moveListOverflow();
+
+/// @brief a fixed-capacity move list that lives on the stack, so generating moves never allocates
+struct MoveList{
+    Move moves[MAX_MOVES];
+    int count = 0;
+
+    void clear(){ count = 0; }
+    bool empty() const { return count == 0; }
+    int size() const { return count; }
+    void add(const Move& move){
+        if(count == MAX_MOVES)
+            moveListOverflow();
+        moves[count++] = move;
+    }
+    const Move& operator[](int i) const { return moves[i]; }
+    const Move* begin() const { return moves; }
+    const Move* end() const { return moves + count; }
+};
+
+/// @brief returns the position the game starts from (twelve men each, white to move)
+Position startPosition();
+
+/// @brief computes the Zobrist key of a position from scratch (applyMove updates it incrementally)
+uint64_t computeHash(const Position& pos);
+
+/// @brief returns the square index of a board cell, or -1 for a light cell
+/// @param row,col the board coordinates of the cell
+int squareAt(int row, int col);
+
+/// @brief returns the board row / column of a square index
+int squareRow(int square);
+int squareCol(int square);
+
+/// @brief shifts every square of a mask one step in a direction, dropping squares that leave the board
+/// @param squares,dir the squares to shift and the direction to shift them in
+inline uint32_t shiftSquares(uint32_t squares, int dir){
+    // even rows hold the dark squares of the odd columns, so a diagonal step is
+    // 3, 4 or 5 squares depending on the parity of the row it starts from
+    switch(dir){
+        case upLeft:
+            return ((squares & EVEN_ROWS) >> 4) | ((squares & ODD_ROWS & ~LEFT_EDGE) >> 5);
+        case upRight:
+            return ((squares & EVEN_ROWS & ~RIGHT_EDGE) >> 3) | ((squares & ODD_ROWS) >> 4);
+        case downLeft:
+            return ((squares & EVEN_ROWS) << 4) | ((squares & ODD_ROWS & ~LEFT_EDGE) << 3);
+        case downRight:
+            return ((squares & EVEN_ROWS & ~RIGHT_EDGE) << 5) | ((squares & ODD_ROWS) << 4);
+    }
+    return 0;
+}
+
+/// @brief lists every legal move of the side to move, including every branch of a multi-jump;
+///        the position is only read
+/// @param pos,moves the position and the list that receives the moves
+void generateMoves(const Position& pos, MoveList& moves);
+
+/// @brief counts the legal moves of the side to move without listing them when no capture exists
+int countMoves(const Position& pos);
+
+/// @brief true if the side to move has a capture (and therefore must capture)
+bool hasCapture(const Position& pos);
+
+/// @brief returns the position after a move has been played
+/// @param pos,move the position and a legal move in it
+Position applyMove(const Position& pos, const Move& move);
+
+/// @brief true if the side to move has no legal move (it has lost)
+bool isGameOver(const Position& pos);
+
+/// @brief reads a FEN-style position such as "W:W21-32:B1-12" (squares numbered 1..32, K marks a king)
+/// @param text,pos the text to read and the position that receives it
+/// @return false if the text is not a valid position
+bool parseFen(const std::string& text, Position& pos);
+
+/// @brief writes a position in the format parseFen reads
+std::string toFen(const Position& pos);
+
+/// @brief writes a move as "11-15" or, for a capture, every landing square "22x15x6"
+std::string moveToString(const Move& move);
+
+/// @brief reads a move written by moveToString, or a capture with only its first and last square
+/// @param pos,text,move the position it is played in, the text and the legal move that receives it
+/// @return false if the text is not a legal move, or names more than one
+bool parseMove(const Position& pos, const std::string& text, Move& move);
+
+/// @brief returns the number of pieces in a mask
+inline int countSquares(uint32_t squares){
+    return __builtin_popcount(squares);
+}
+
+/// @brief returns the lowest square in a non-empty mask
+inline int firstSquare(uint32_t squares){
+    return __builtin_ctz(squares);
+}
+
+#endif
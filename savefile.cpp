@@ -0,0 +1,340 @@
+// @file savefile.cpp
+// @brief encoding and decoding of save files
+
+#include "savefile.h"
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+
+using namespace std;
+
+static uint32_t CRC_TABLE[256];
+
+static bool crcReady = [](){
+    for(uint32_t i = 0; i < 256; i++){
+        uint32_t crc = i;
+        for(int bit = 0; bit < 8; bit++)
+            crc = crc & 1 ? (crc >> 1) ^ 0xEDB88320u : crc >> 1;
+        CRC_TABLE[i] = crc;
+    }
+    return true;
+}();
+
+uint32_t crc32(const uint8_t* data, size_t size){
+    uint32_t crc = 0xFFFFFFFFu;
+    for(size_t i = 0; i < size; i++)
+        crc = CRC_TABLE[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+    return ~crc;
+}
+
+// Everything is written byte by byte, little-endian, so files move between machines.
+static void putFixed(vector<uint8_t>& out, uint64_t value, int bytes){
+    for(int i = 0; i < bytes; i++)
+        out.push_back((uint8_t)(value >> (8 * i)));
+}
+
+static void putVarint(vector<uint8_t>& out, uint64_t value){
+    while(value >= 0x80){
+        out.push_back((uint8_t)(value | 0x80));
+        value >>= 7;
+    }
+    out.push_back((uint8_t)value);
+}
+
+static void putString(vector<uint8_t>& out, const string& text){
+    putVarint(out, text.size());
+    out.insert(out.end(), text.begin(), text.end());
+}
+
+// A position is the occupied squares, then two bits per piece from square 0 up (1: black, 2: king),
+// then the side to move: at most 11 bytes.
+void encodePosition(vector<uint8_t>& out, const Position& pos){
+    uint32_t occupied = pos.white | pos.black;
+    putFixed(out, occupied, 4);
+    uint8_t bits = 0;
+    int used = 0;
+    for(uint32_t pieces = occupied; pieces; pieces &= pieces - 1){
+        uint32_t square = pieces & (0u - pieces);
+        bits |= (uint8_t)(((pos.black & square) ? 1 : 0) | ((pos.kings & square) ? 2 : 0)) << used;
+        used += 2;
+        if(used == 8){
+            out.push_back(bits);
+            bits = 0;
+            used = 0;
+        }
+    }
+    if(used)
+        out.push_back(bits);
+    out.push_back(pos.whiteToMove ? 1 : 0);
+}
+
+bool decodePosition(const uint8_t* data, size_t size, size_t& at, Position& pos){
+    if(size < at + 5)
+        return false;
+    uint32_t occupied = 0;
+    for(int i = 0; i < 4; i++)
+        occupied |= (uint32_t)data[at++] << (8 * i);
+    if(size - at < (size_t)(countSquares(occupied) + 3) / 4 + 1)
+        return false;
+    pos.white = pos.black = pos.kings = 0;
+    int used = 8;
+    uint8_t bits = 0;
+    for(uint32_t pieces = occupied; pieces; pieces &= pieces - 1){
+        if(used == 8){
+            bits = data[at++];
+            used = 0;
+        }
+        uint32_t square = pieces & (0u - pieces);
+        int kind = (bits >> used) & 3;
+        used += 2;
+        if(kind & 1)
+            pos.black |= square;
+        else
+            pos.white |= square;
+        if(kind & 2)
+            pos.kings |= square;
+    }
+    pos.whiteToMove = data[at++] != 0;
+    pos.hash = computeHash(pos);
+    return true;
+}
+
+/// @brief reads the payload; every get checks the bounds and clears ok past the end
+struct SaveReader{
+    const uint8_t* data;
+    size_t size;
+    size_t at = 0;
+    bool ok = true;
+
+    uint8_t byte(){
+        if(at >= size){
+            ok = false;
+            return 0;
+        }
+        return data[at++];
+    }
+    uint64_t fixed(int bytes){
+        uint64_t value = 0;
+        for(int i = 0; i < bytes; i++)
+            value |= (uint64_t)byte() << (8 * i);
+        return value;
+    }
+    uint64_t varint(){
+        uint64_t value = 0;
+        for(int shift = 0; shift < 64; shift += 7){
+            uint8_t b = byte();
+            value |= (uint64_t)(b & 0x7F) << shift;
+            if(!(b & 0x80))
+                return value;
+        }
+        ok = false;
+        return 0;
+    }
+    string text(){
+        uint64_t length = varint();
+        if(!ok || length > size - at){
+            ok = false;
+            return string();
+        }
+        string value(reinterpret_cast<const char*>(data + at), (size_t)length);
+        at += (size_t)length;
+        return value;
+    }
+    Position position(){
+        Position pos = {0, 0, 0, true, 0};
+        if(ok && !decodePosition(data, size, at, pos))
+            ok = false;
+        return pos;
+    }
+};
+
+const char* saveStatusText(int status){
+    switch(status){
+        case saveOk: return "game loaded";
+        case saveCannotOpen: return "unable to open the file";
+        case saveNotASave: return "not a DAMA save file";
+        case saveNewerVersion: return "saved by a newer version of the game";
+        case saveDamaged: return "the save file is damaged";
+        case saveLegacyConverted: return "converted an old-style save (no move history)";
+    }
+    return "unknown error";
+}
+
+vector<uint8_t> encodeSave(const SavedGame& game){
+    vector<uint8_t> payload;
+    encodePosition(payload, game.start);
+    encodePosition(payload, game.position);
+    putVarint(payload, (uint64_t)game.p1);
+    putVarint(payload, (uint64_t)game.p2);
+    payload.push_back((uint8_t)game.winner);
+    payload.push_back((uint8_t)((game.playerOneCpu ? 1 : 0) | (game.playerTwoCpu ? 2 : 0)));
+    putString(payload, game.playerOneName);
+    putString(payload, game.playerTwoName);
+
+    // a move is its place in generateMoves order, which almost always fits in one byte
+    putVarint(payload, game.history.size());
+    Position pos = game.start;
+    MoveList moves;
+    for(const Move& played : game.history){
+        generateMoves(pos, moves);
+        int index = 0;
+        while(index < moves.size() && !(sameMove(moves[index], played)))
+            index++;
+        putVarint(payload, (uint64_t)index);
+        pos = applyMove(pos, played);
+    }
+
+    vector<uint8_t> file;
+    file.reserve(SAVE_HEADER_SIZE + payload.size());
+    for(int i = 0; i < 4; i++)
+        file.push_back((uint8_t)"DAMA"[i]);
+    putFixed(file, SAVE_VERSION, 2);
+    putFixed(file, 0, 2);
+    putFixed(file, payload.size(), 4);
+    putFixed(file, crc32(payload.data(), payload.size()), 4);
+    file.insert(file.end(), payload.begin(), payload.end());
+    return file;
+}
+
+int decodeSave(const uint8_t* data, size_t size, SavedGame& game){
+    if(size < SAVE_HEADER_SIZE || memcmp(data, "DAMA", 4) != 0)
+        return convertLegacySave(data, size, game) ? saveLegacyConverted : saveNotASave;
+    SaveReader header = {data, SAVE_HEADER_SIZE};
+    header.at = 4;
+    uint16_t version = (uint16_t)header.fixed(2);
+    header.fixed(2);
+    uint32_t payloadSize = (uint32_t)header.fixed(4);
+    uint32_t checksum = (uint32_t)header.fixed(4);
+    if(version > SAVE_VERSION)
+        return saveNewerVersion;
+    if(payloadSize != size - SAVE_HEADER_SIZE || crc32(data + SAVE_HEADER_SIZE, payloadSize) != checksum)
+        return saveDamaged;
+
+    SaveReader in = {data + SAVE_HEADER_SIZE, payloadSize};
+    SavedGame loaded;
+    loaded.start = in.position();
+    loaded.position = in.position();
+    loaded.p1 = (int)in.varint();
+    loaded.p2 = (int)in.varint();
+    loaded.winner = in.byte();
+    uint8_t flags = in.byte();
+    loaded.playerOneCpu = flags & 1;
+    loaded.playerTwoCpu = (flags & 2) != 0;
+    loaded.playerOneName = in.text();
+    loaded.playerTwoName = in.text();
+    uint64_t count = in.varint();
+    if(!in.ok || count > payloadSize)
+        return saveDamaged;
+
+    // replaying the history checks every move and must end on the saved position
+    Position pos = loaded.start;
+    MoveList moves;
+    loaded.history.reserve((size_t)count);
+    for(uint64_t i = 0; i < count; i++){
+        uint64_t index = in.varint();
+        generateMoves(pos, moves);
+        if(!in.ok || index >= (uint64_t)moves.size())
+            return saveDamaged;
+        loaded.history.push_back(moves[(int)index]);
+        pos = applyMove(pos, moves[(int)index]);
+    }
+    if(!in.ok || !samePosition(pos, loaded.position) || loaded.winner > 2)
+        return saveDamaged;
+    game = loaded;
+    return saveOk;
+}
+
+// Layout of the 1.0 Game struct on 64-bit libstdc++: Board (12 bytes), Cell cellInfo[8][8] of
+// {row, col, cellType, cellSize} ints, padding to 8, two 32-byte std::string (pointer, size, then a
+// 16-byte buffer holding names of up to 15 characters), int p1, int p2, bool turn, int winner.
+const size_t LEGACY_CELLS = 12;
+const size_t LEGACY_NAMES = 1040;
+const size_t LEGACY_SCORES = 1104;
+
+static string legacyName(const uint8_t* field, const string& fallback){
+    uint64_t length = 0;
+    memcpy(&length, field + 8, 8);
+    // longer names were on the heap of the program that saved them
+    if(length > 15)
+        return fallback;
+    return string(reinterpret_cast<const char*>(field + 16), (size_t)length);
+}
+
+bool convertLegacySave(const uint8_t* data, size_t size, SavedGame& game){
+    if(size != LEGACY_SAVE_SIZE)
+        return false;
+    SavedGame converted;
+    Position pos;
+    pos.white = pos.black = pos.kings = 0;
+    for(int row = 0; row < 8; row++){
+        for(int col = 0; col < 8; col++){
+            int32_t cell[4];
+            memcpy(cell, data + LEGACY_CELLS + (row * 8 + col) * sizeof(cell), sizeof(cell));
+            if(cell[0] != row || cell[1] != col || cell[2] < 0 || cell[2] > 4)
+                return false;
+            int square = squareAt(row, col);
+            if(cell[2] == 0)
+                continue;
+            if(square < 0)
+                return false;
+            uint32_t bit = 1u << square;
+            // 1: player one man, 2: player two man, 3: player one king, 4: player two king
+            if(cell[2] == 1 || cell[2] == 3)
+                pos.white |= bit;
+            else
+                pos.black |= bit;
+            if(cell[2] >= 3)
+                pos.kings |= bit;
+        }
+    }
+    int32_t scores[2];
+    memcpy(scores, data + LEGACY_SCORES, sizeof(scores));
+    pos.whiteToMove = data[LEGACY_SCORES + 8] != 0;
+    pos.hash = computeHash(pos);
+
+    converted.start = pos;
+    converted.position = pos;
+    converted.playerOneName = legacyName(data + LEGACY_NAMES, "Player 1");
+    converted.playerTwoName = legacyName(data + LEGACY_NAMES + 32, "Player 2");
+    converted.p1 = scores[0] >= 0 && scores[0] <= 12 ? scores[0] : 0;
+    converted.p2 = scores[1] >= 0 && scores[1] <= 12 ? scores[1] : 0;
+    // the winner field was never written by 1.0 and holds whatever was in memory
+    converted.winner = 0;
+    game = converted;
+    return true;
+}
+
+int writeSaveFile(const string& path, const SavedGame& game){
+    vector<uint8_t> bytes = encodeSave(game);
+    string temporary = path + ".tmp";
+    ofstream file(temporary, ios::binary | ios::trunc);
+    if(!file.is_open())
+        return saveCannotOpen;
+    file.write(reinterpret_cast<const char*>(bytes.data()), bytes.size());
+    file.close();
+#ifdef _WIN32
+    // rename does not replace an existing file there
+    if(file)
+        remove(path.c_str());
+#endif
+    if(!file || rename(temporary.c_str(), path.c_str()) != 0){
+        remove(temporary.c_str());
+        return saveCannotOpen;
+    }
+    return saveOk;
+}
+
+int readSaveFile(const string& path, SavedGame& game){
+    ifstream file(path, ios::binary | ios::ate);
+    if(!file.is_open())
+        return saveCannotOpen;
+    streamoff size = file.tellg();
+    if(size < 0)
+        return saveCannotOpen;
+    vector<uint8_t> bytes((size_t)size);
+    file.seekg(0);
+    if(!file.read(reinterpret_cast<char*>(bytes.data()), size))
+        return saveCannotOpen;
+    return decodeSave(bytes.data(), bytes.size(), game);
+}
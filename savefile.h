@@ -0,0 +1,78 @@
+// @file savefile.h
+// @brief versioned binary save files: a checked header, the positions packed into a few bytes, the move
+//        history as varints and length-prefixed names; reads the raw Game dumps of version 1.0 too
+
+#ifndef SAVEFILE_H
+#define SAVEFILE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "rules.h"
+
+const uint16_t SAVE_VERSION = 1;
+const size_t SAVE_HEADER_SIZE = 16;     // "DAMA", version, flags, payload size, CRC-32 of the payload
+const size_t LEGACY_SAVE_SIZE = 1120;   // sizeof(Game) of the 1.0 release built with 64-bit libstdc++
+
+/// @brief everything a save file holds
+struct SavedGame{
+    Position start;                     // the position the history starts from
+    std::vector<Move> history;          // every move played since
+    Position position;                  // the position on the board (start with the history played)
+    std::string playerOneName;
+    std::string playerTwoName;
+    int p1 = 0;
+    int p2 = 0;
+    int winner = 0;
+    bool playerOneCpu = false;
+    bool playerTwoCpu = false;
+};
+
+enum saveStatus{
+    saveOk,
+    saveCannotOpen,
+    saveNotASave,           // no magic number and not a legacy dump either
+    saveNewerVersion,       // written by a later version of the game
+    saveDamaged,            // checksum or contents do not add up
+    saveLegacyConverted     // a 1.0 dump, converted (it has no history)
+};
+
+/// @brief returns the CRC-32 (IEEE) of some bytes; also guards the records of the move journal
+uint32_t crc32(const uint8_t* data, size_t size);
+
+/// @brief returns a sentence describing a status, for the console
+const char* saveStatusText(int status);
+
+/// @brief appends a position packed as in a save file: the occupied squares, two bits per piece and
+///        the side to move, at most 11 bytes
+void encodePosition(std::vector<uint8_t>& out, const Position& pos);
+
+/// @brief reads a position written by encodePosition
+/// @param data,size,at,pos the bytes, their size, where the position starts (moved past it) and the
+///        position that receives it
+/// @return false if the bytes end first
+bool decodePosition(const uint8_t* data, size_t size, size_t& at, Position& pos);
+
+/// @brief encodes a game into the bytes of a save file
+std::vector<uint8_t> encodeSave(const SavedGame& game);
+
+/// @brief decodes the bytes of a save file, or of a legacy dump
+/// @param data,size,game the file contents and the game that receives them
+/// @return saveOk, saveLegacyConverted or the reason it failed
+int decodeSave(const uint8_t* data, size_t size, SavedGame& game);
+
+/// @brief converts a raw Game dump of the 1.0 release (like test.dat): the board, the scores, the side
+///        to move and names short enough to have been stored inside the dump
+/// @return false if the data is not such a dump
+bool convertLegacySave(const uint8_t* data, size_t size, SavedGame& game);
+
+/// @brief writes a save file in one write, through a temporary file
+/// @return saveOk or saveCannotOpen
+int writeSaveFile(const std::string& path, const SavedGame& game);
+
+/// @brief reads a save file in one read and decodes it
+/// @return as decodeSave, or saveCannotOpen
+int readSaveFile(const std::string& path, SavedGame& game);
+
+#endif
@@ -0,0 +1,386 @@
+// @file search.cpp
+// @brief alpha-beta (principal variation search) with iterative deepening and a per-move time budget
+
+#include "search.h"
+#include "book.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <memory>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+typedef chrono::steady_clock Clock;
+
+// Everything one search needs besides the position; kept out of the recursion's arguments.
+struct SearchState{
+    Clock::time_point start;
+    double budget;
+    int threadId = 0;                   // 0 is the main thread, the others are helpers
+    atomic<bool>* stop;                 // raised by the main thread when it is done
+    const atomic<bool>* cancel;         // raised by the caller, may be null
+    const atomic<bool>* pondering;      // the clock does not run while it is raised, may be null
+    bool stopped = false;
+    uint64_t nodes = 0;
+    atomic<uint64_t>* nodesSoFar;       // every thread's nodes, added in steps of 256 for progress reports
+    TranspositionTable* tt;
+    uint64_t ttProbes = 0;
+    uint64_t ttHits = 0;
+    uint64_t ttStores = 0;
+    Tablebase* tb;
+    int tbPieces = 0;                   // positions with more pieces are not probed
+    bool tbDistances = false;
+    uint64_t tbHits = 0;
+    Move killers[MAX_PLY][2];
+    int history[SQUARE_COUNT][SQUARE_COUNT];
+    Move pv[MAX_PLY][MAX_PLY];
+    int pvLength[MAX_PLY];
+    Move previousPv[MAX_PLY];
+    int previousPvLength = 0;
+};
+
+static const uint32_t ROW_MASK[8] = {
+    0x0000000Fu, 0x000000F0u, 0x00000F00u, 0x0000F000u,
+    0x000F0000u, 0x00F00000u, 0x0F000000u, 0xF0000000u
+};
+static const uint32_t CENTER = 0x00066000u;      // the four middle squares of rows 3 and 4
+
+int evaluate(const Position& pos){
+    uint32_t whiteMen = pos.white & ~pos.kings;
+    uint32_t blackMen = pos.black & ~pos.kings;
+    int score = MAN_VALUE * (countSquares(whiteMen) - countSquares(blackMen))
+              + KING_VALUE * (countSquares(pos.white & pos.kings) - countSquares(pos.black & pos.kings));
+
+    // men are worth more the closer they are to promotion
+    for(int row = 1; row < 7; row++){
+        score += 3 * (7 - row) * countSquares(whiteMen & ROW_MASK[row]);
+        score -= 3 * row * countSquares(blackMen & ROW_MASK[row]);
+    }
+    // an unbroken back row keeps the opponent from promoting
+    score += 6 * countSquares(whiteMen & ROW_MASK[7]);
+    score -= 6 * countSquares(blackMen & ROW_MASK[0]);
+    score += 8 * (countSquares(pos.white & CENTER) - countSquares(pos.black & CENTER));
+
+    return pos.whiteToMove ? score : -score;
+}
+
+int tablebaseScore(uint8_t value, int ply, bool distances){
+    if(value == TB_DRAW)
+        return 0;
+    if(distances)
+        return tbIsWin(value) ? SCORE_WIN - ply - tbPlies(value) : -SCORE_WIN + ply + tbPlies(value);
+    return tbIsWin(value) ? SCORE_TB_WIN - ply : -SCORE_TB_WIN + ply;
+}
+
+static double elapsed(const SearchState& s){
+    return chrono::duration<double>(Clock::now() - s.start).count();
+}
+
+static bool pondering(const SearchState& s){
+    return s.pondering && s.pondering->load(memory_order_relaxed);
+}
+
+// Win scores are stored relative to the node, not the root, so they stay right at any ply.
+static int scoreToTable(int score, int ply){
+    if(score > SCORE_WIN_THRESHOLD)
+        return score + ply;
+    if(score < -SCORE_WIN_THRESHOLD)
+        return score - ply;
+    return score;
+}
+
+static int scoreFromTable(int score, int ply){
+    if(score > SCORE_WIN_THRESHOLD)
+        return score - ply;
+    if(score < -SCORE_WIN_THRESHOLD)
+        return score + ply;
+    return score;
+}
+
+// Scores the moves for ordering: table move, previous principal variation, then bigger captures,
+// killers and history.
+static void scoreMoves(const SearchState& s, const MoveList& moves, int ply, int ttMove, int scores[]){
+    for(int i = 0; i < moves.size(); i++){
+        const Move& m = moves[i];
+        if(i == ttMove)
+            scores[i] = 1 << 30;
+        else if(ply < s.previousPvLength && sameMove(m, s.previousPv[ply]))
+            scores[i] = 1 << 29;
+        else if(m.captures)
+            scores[i] = (1 << 24) + countSquares(m.captures) * 1000;
+        else if(sameMove(m, s.killers[ply][0]))
+            scores[i] = 1 << 22;
+        else if(sameMove(m, s.killers[ply][1]))
+            scores[i] = (1 << 22) - 1;
+        else
+            scores[i] = s.history[m.from][m.to];
+        // helpers break ties among quiet moves differently so the threads spread over the tree
+        if(s.threadId && !m.captures && scores[i] < (1 << 22))
+            scores[i] += (m.from * 7 + m.to * 13 + s.threadId * 31) & 15;
+    }
+}
+
+// Moves the best scoring of the remaining moves to position i; index[] follows the moves so the
+// table can remember a move by its place in generation order.
+static void pickMove(Move moves[], int scores[], uint8_t index[], int count, int i){
+    int best = i;
+    for(int j = i + 1; j < count; j++){
+        if(scores[j] > scores[best])
+            best = j;
+    }
+    if(best != i){
+        Move m = moves[i];
+        moves[i] = moves[best];
+        moves[best] = m;
+        int score = scores[i];
+        scores[i] = scores[best];
+        scores[best] = score;
+        uint8_t place = index[i];
+        index[i] = index[best];
+        index[best] = place;
+    }
+}
+
+static int search(SearchState& s, const Position& pos, int alpha, int beta, int depth, int ply){
+    s.pvLength[ply] = ply;
+    // the flags are cheap enough to read often, which keeps cancelling under a millisecond;
+    // the clock is read less often
+    if((s.nodes & 255) == 0){
+        s.nodesSoFar->fetch_add(256, memory_order_relaxed);
+        if(s.stop->load(memory_order_relaxed) || (s.cancel && s.cancel->load(memory_order_relaxed)) ||
+           ((s.nodes & 1023) == 0 && elapsed(s) >= s.budget && !pondering(s)))
+            s.stopped = true;
+    }
+    if(s.stopped)
+        return 0;
+    s.nodes++;
+
+    // endgames in the tablebase are known exactly; the root still needs a move
+    if(ply > 0 && countSquares(pos.white | pos.black) <= s.tbPieces){
+        uint8_t value;
+        if(s.tb->probe(pos, value)){
+            s.tbHits++;
+            return tablebaseScore(value, ply, s.tbDistances);
+        }
+    }
+
+    // at the horizon, forced captures are still played out so the evaluation sees a quiet position
+    if((depth <= 0 || ply >= MAX_PLY - 1) && !hasCapture(pos))
+        return isGameOver(pos) ? -SCORE_WIN + ply : evaluate(pos);
+
+    bool pvNode = beta - alpha > 1;
+    int alphaOriginal = alpha;
+    int ttMove = -1;
+    TTHit hit;
+    // capture sequences at the horizon are cheaper to replay than to look up
+    bool useTable = depth > 0;
+    if(useTable && (s.ttProbes++, s.tt->probe(pos.hash, hit))){
+        s.ttHits++;
+        ttMove = hit.moveIndex;
+        if(!pvNode && hit.depth >= depth){
+            int score = scoreFromTable(hit.score, ply);
+            if(hit.bound == boundExact || (hit.bound == boundLower && score >= beta) ||
+               (hit.bound == boundUpper && score <= alpha))
+                return score;
+        }
+    }
+
+    MoveList moves;
+    generateMoves(pos, moves);
+    if(moves.empty())
+        return -SCORE_WIN + ply;
+    if(ply >= MAX_PLY - 1)
+        return evaluate(pos);
+    if(ttMove >= moves.size() || (ttMove >= 0 && (moves[ttMove].from != hit.moveFrom || moves[ttMove].to != hit.moveTo)))
+        ttMove = -1;
+
+    int scores[MAX_MOVES];
+    uint8_t index[MAX_MOVES];
+    for(int i = 0; i < moves.size(); i++)
+        index[i] = (uint8_t)i;
+    scoreMoves(s, moves, ply, ttMove, scores);
+    int bestScore = -SCORE_INFINITE;
+    int bestIndex = -1;
+    int bestFrom = 0, bestTo = 0;
+    for(int i = 0; i < moves.size(); i++){
+        pickMove(moves.moves, scores, index, moves.size(), i);
+        const Move& m = moves[i];
+        Position child = applyMove(pos, m);
+        // a single reply costs nothing to search one ply deeper
+        int nextDepth = moves.size() == 1 ? depth : depth - 1;
+        int score;
+        if(i == 0){
+            score = -search(s, child, -beta, -alpha, nextDepth, ply + 1);
+        }else{
+            // late quiet moves rarely turn out best: look at them shallower first
+            int reduction = 0;
+            if(depth >= 3 && i >= 3 && !m.captures && scores[i] < (1 << 22))
+                reduction = i >= 8 ? 2 : 1;
+            score = -search(s, child, -alpha - 1, -alpha, nextDepth - reduction, ply + 1);
+            if(reduction && score > alpha && !s.stopped)
+                score = -search(s, child, -alpha - 1, -alpha, nextDepth, ply + 1);
+            if(score > alpha && score < beta)
+                score = -search(s, child, -beta, -alpha, nextDepth, ply + 1);
+        }
+        if(s.stopped)
+            return 0;
+        if(score > bestScore){
+            bestScore = score;
+            bestIndex = index[i];
+            bestFrom = m.from;
+            bestTo = m.to;
+            if(score > alpha){
+                alpha = score;
+                s.pv[ply][ply] = m;
+                for(int j = ply + 1; j < s.pvLength[ply + 1]; j++)
+                    s.pv[ply][j] = s.pv[ply + 1][j];
+                s.pvLength[ply] = s.pvLength[ply + 1];
+                if(alpha >= beta){
+                    if(!m.captures){
+                        if(!sameMove(m, s.killers[ply][0])){
+                            s.killers[ply][1] = s.killers[ply][0];
+                            s.killers[ply][0] = m;
+                        }
+                        s.history[m.from][m.to] += depth * depth;
+                    }
+                    break;
+                }
+            }
+        }
+    }
+
+    if(useTable){
+        int bound = bestScore >= beta ? boundLower : (bestScore > alphaOriginal ? boundExact : boundUpper);
+        s.tt->store(pos.hash, scoreToTable(bestScore, ply), depth, bound, bestIndex, bestFrom, bestTo);
+        s.ttStores++;
+    }
+    return bestScore;
+}
+
+TranspositionTable& sharedTable(){
+    static TranspositionTable table;
+    return table;
+}
+
+/// @brief answers from the opening book without searching
+/// @return false if the book is not used or does not have the position
+static bool playBook(const Position& pos, const SearchLimits& limits, SearchResult& result){
+    if(!limits.useBook || !sharedBook().probe(pos, result.best))
+        return false;
+    result.hasMove = true;
+    result.bookMove = true;
+    result.score = evaluate(pos);
+    result.pv[0] = result.best;
+    result.pvLength = 1;
+    return true;
+}
+
+SearchResult searchPosition(const Position& pos, const SearchLimits& limits){
+    return searchPosition(pos, limits, sharedTable());
+}
+
+// Iterative deepening for one thread. Helpers start at different depths and skip some, so at any
+// time the threads are working on several depths and fill the shared table for each other.
+static void iterate(SearchState& s, const Position& pos, const SearchLimits& limits, SearchResult& result){
+    memset(s.killers, 0, sizeof(s.killers));
+    memset(s.history, 0, sizeof(s.history));
+    bool main = s.threadId == 0;
+    for(int depth = 1 + s.threadId % 2; depth <= limits.maxDepth; depth++){
+        if(!main && s.threadId >= 4 && depth % 3 == s.threadId % 3 && depth > 2)
+            continue;
+        double iterationStart = elapsed(s);
+        int score = search(s, pos, -SCORE_INFINITE, SCORE_INFINITE, depth, 0);
+        if(s.stopped)
+            break;
+        result.score = score;
+        result.depth = depth;
+        result.pvLength = s.pvLength[0];
+        for(int i = 0; i < s.pvLength[0]; i++){
+            result.pv[i] = s.pv[0][i];
+            s.previousPv[i] = s.pv[0][i];
+        }
+        s.previousPvLength = s.pvLength[0];
+        if(result.pvLength > 0)
+            result.best = result.pv[0];
+        if(!main)
+            continue;
+        if(limits.onIteration){
+            SearchResult progress = result;
+            progress.nodes = s.nodesSoFar->load(memory_order_relaxed);
+            progress.seconds = elapsed(s);
+            limits.onIteration(progress);
+        }
+        // a forced win or loss will not change with more depth
+        if(score > SCORE_WIN_THRESHOLD || score < -SCORE_WIN_THRESHOLD)
+            break;
+        // the next iteration costs a few times this one, do not start what cannot finish
+        double now = elapsed(s);
+        if(now + 2.0 * (now - iterationStart) > limits.seconds && !pondering(s))
+            break;
+    }
+}
+
+SearchResult searchPosition(const Position& pos, const SearchLimits& limits, TranspositionTable& tt){
+    SearchResult result;
+    MoveList moves;
+    generateMoves(pos, moves);
+    if(moves.empty()){
+        result.score = -SCORE_WIN;
+        return result;
+    }
+    result.best = moves[0];
+    result.hasMove = true;
+    if(playBook(pos, limits, result))
+        return result;
+    if(moves.size() == 1){
+        result.score = evaluate(pos);
+        return result;
+    }
+
+    atomic<bool> stop(false);
+    atomic<uint64_t> nodesSoFar(0);
+    int threadCount = limits.threads < 1 ? 1 : limits.threads;
+    Clock::time_point start = Clock::now();
+    tt.newSearch();
+
+    // the search tables are too big for the stack of a UI thread
+    vector<unique_ptr<SearchState>> states;
+    vector<SearchResult> helperResults(threadCount - 1);
+    for(int i = 0; i < threadCount; i++){
+        states.emplace_back(new SearchState());
+        states[i]->start = start;
+        states[i]->budget = limits.seconds;
+        states[i]->threadId = i;
+        states[i]->stop = &stop;
+        states[i]->nodesSoFar = &nodesSoFar;
+        states[i]->cancel = limits.stop;
+        states[i]->pondering = limits.pondering;
+        states[i]->tt = &tt;
+        states[i]->tb = &sharedTablebase();
+        states[i]->tbPieces = sharedTablebase().pieces();
+        states[i]->tbDistances = sharedTablebase().hasDistances();
+    }
+    vector<thread> helpers;
+    for(int i = 1; i < threadCount; i++){
+        helperResults[i - 1] = result;
+        helpers.emplace_back(iterate, std::ref(*states[i]), std::cref(pos), std::cref(limits), std::ref(helperResults[i - 1]));
+    }
+    iterate(*states[0], pos, limits, result);
+    // the main thread decides: once it is done every helper stops
+    stop.store(true);
+    for(thread& helper : helpers)
+        helper.join();
+
+    result.seconds = chrono::duration<double>(Clock::now() - start).count();
+    result.nodes = 0;
+    for(auto& state : states){
+        result.nodes += state->nodes;
+        result.tbHits += state->tbHits;
+        tt.addCounts(state->ttProbes, state->ttHits, state->ttStores);
+    }
+    result.threads = threadCount;
+    return result;
+}
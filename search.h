@@ -0,0 +1,71 @@
+// @file search.h
+// @brief the computer opponent: iterative-deepening principal variation search over the rules engine
+
+#ifndef SEARCH_H
+#define SEARCH_H
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include "rules.h"
+#include "tt.h"
+#include "tablebase.h"
+
+const int MAX_PLY = 128;
+const int SCORE_INFINITE = 32000;
+const int SCORE_WIN = 30000;            // a win found at ply n scores SCORE_WIN - n
+const int SCORE_WIN_THRESHOLD = SCORE_WIN - MAX_PLY;
+const int SCORE_TB_WIN = SCORE_WIN_THRESHOLD - MAX_PLY;     // a tablebase win without a distance
+
+const int MAN_VALUE = 100;
+const int KING_VALUE = 300;
+
+struct SearchResult;
+
+/// @brief how long a search may run and with how many threads
+struct SearchLimits{
+    double seconds = 1.0;       // time budget for the move
+    int maxDepth = MAX_PLY - 1;
+    int threads = 1;            // 1 main thread plus helpers sharing the transposition table
+    bool useBook = true;        // play the move of the opening book (sharedBook) when it has one
+    const std::atomic<bool>* stop = nullptr;    // optional: raise it from any thread to end the search now
+    const std::atomic<bool>* pondering = nullptr;   // optional: while raised the clock is ignored; lowering it
+                                                    // (a ponder hit) starts the budget, counted from the start
+    std::function<void(const SearchResult&)> onIteration;  // optional: called by the main thread after
+                                                           // each finished depth, with the nodes of every thread
+};
+
+/// @brief what a search found
+struct SearchResult{
+    Move best;
+    bool hasMove = false;       // false when the side to move has already lost
+    int score = 0;              // from the point of view of the side to move
+    int depth = 0;              // last fully searched depth
+    uint64_t nodes = 0;         // summed over every thread
+    uint64_t tbHits = 0;        // positions the tablebase answered
+    bool bookMove = false;      // best came from the opening book, nothing was searched
+    double seconds = 0;
+    int threads = 1;
+    Move pv[MAX_PLY];           // principal variation of the last finished iteration
+    int pvLength = 0;
+};
+
+/// @brief static evaluation of a quiet position, from the point of view of the side to move
+/// @param pos the position to evaluate
+int evaluate(const Position& pos);
+
+/// @brief picks a move for the side to move
+/// @param pos,limits,tt the position to search, how long to search it and the table to share
+SearchResult searchPosition(const Position& pos, const SearchLimits& limits, TranspositionTable& tt);
+
+/// @brief same as above with the process-wide table (DEFAULT_HASH_MB), kept warm between moves
+SearchResult searchPosition(const Position& pos, const SearchLimits& limits);
+
+/// @brief the process-wide transposition table
+TranspositionTable& sharedTable();
+
+/// @brief the search score of a tablebase value
+/// @param value,ply,distances the value, the ply it was found at and whether it holds a distance
+int tablebaseScore(uint8_t value, int ply, bool distances);
+
+#endif
@@ -0,0 +1,633 @@
+// @file server.cpp
+// @brief the game server: the event loop, the protocol commands, the computer's moves and the
+//        spectators
+
+#include "server.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <utility>
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include "engine.h"
+#include "gamecore.h"
+#include "search.h"
+
+using namespace std;
+
+typedef vector<pair<string, string>> ServerArgs;
+
+// epoll tags: the waker is 0, listener i is i + 1, and a connection is its handle (generation above bit 32)
+const uint64_t WAKER_TAG = 0;
+
+/// @brief splits a line into its command and its name=value (or bare name) arguments
+static string parseCommand(const string& line, ServerArgs& args){
+    args.clear();
+    string command;
+    size_t at = 0;
+    while(true){
+        while(at < line.size() && isspace((unsigned char)line[at]))
+            at++;
+        size_t start = at;
+        while(at < line.size() && !isspace((unsigned char)line[at]))
+            at++;
+        if(at == start)
+            return command;
+        if(command.empty()){
+            command = line.substr(start, at - start);
+            continue;
+        }
+        size_t equals = line.find('=', start);
+        if(equals < at)
+            args.push_back(make_pair(line.substr(start, equals - start), line.substr(equals + 1, at - equals - 1)));
+        else
+            args.push_back(make_pair(line.substr(start, at - start), string()));
+    }
+}
+
+static const string* findArg(const ServerArgs& args, const char* name){
+    for(const auto& arg : args){
+        if(arg.first == name)
+            return &arg.second;
+    }
+    return nullptr;
+}
+
+static const char* sideName(int player){
+    return player == 1 ? "white" : "black";
+}
+
+static bool watch(int poller, int op, int fd, uint64_t tag, uint32_t events){
+    epoll_event event;
+    memset(&event, 0, sizeof(event));
+    event.events = events;
+    event.data.u64 = tag;
+    return epoll_ctl(poller, op, fd, &event) == 0;
+}
+
+static void wake(int waker){
+    uint64_t one = 1;
+    ssize_t written = ::write(waker, &one, sizeof(one));
+    (void)written;      // a full counter already wakes the loop
+}
+
+GameServer::GameServer(const ServerOptions& serverOptions) : options(serverOptions){
+    poller = epoll_create1(EPOLL_CLOEXEC);
+    waker = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    spare = ::open("/dev/null", O_RDONLY | O_CLOEXEC);
+    watch(poller, EPOLL_CTL_ADD, waker, WAKER_TAG, EPOLLIN);
+    int fd = waker;
+    pool.reset(new EnginePool(options.workers, options.hashMb, [fd]{ wake(fd); }));
+}
+
+GameServer::~GameServer(){
+    // the search threads go first, they may still wake the loop
+    pool.reset();
+    connections.forEach([](ConnectionHandle, ServerConnection& connection){ ::close(connection.fd); });
+    for(int listener : listeners)
+        ::close(listener);
+    for(const string& path : unixPaths)
+        unlink(path.c_str());
+    ::close(spare);
+    ::close(waker);
+    ::close(poller);
+}
+
+bool GameServer::listenTcp(const string& host, int port){
+    sockaddr_in address;
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_port = htons((uint16_t)port);
+    int fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    int one = 1;
+    if(fd < 0 || inet_pton(AF_INET, host.c_str(), &address.sin_addr) != 1 ||
+       setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one)) != 0 ||
+       bind(fd, (sockaddr*)&address, sizeof(address)) != 0 || ::listen(fd, SOMAXCONN) != 0 ||
+       !watch(poller, EPOLL_CTL_ADD, fd, listeners.size() + 1, EPOLLIN)){
+        cerr << "Server: cannot listen on " << host << ":" << port << ": " << strerror(errno) << endl;
+        if(fd >= 0)
+            ::close(fd);
+        return false;
+    }
+    listeners.push_back(fd);
+    return true;
+}
+
+bool GameServer::listenUnix(const string& path){
+    sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if(path.size() >= sizeof(address.sun_path)){
+        cerr << "Server: socket path too long: " << path << endl;
+        return false;
+    }
+    strcpy(address.sun_path, path.c_str());
+    unlink(path.c_str());
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if(fd < 0 || bind(fd, (sockaddr*)&address, sizeof(address)) != 0 || ::listen(fd, SOMAXCONN) != 0 ||
+       !watch(poller, EPOLL_CTL_ADD, fd, listeners.size() + 1, EPOLLIN)){
+        cerr << "Server: cannot listen on " << path << ": " << strerror(errno) << endl;
+        if(fd >= 0)
+            ::close(fd);
+        return false;
+    }
+    listeners.push_back(fd);
+    unixPaths.push_back(path);
+    return true;
+}
+
+void GameServer::run(){
+    epoll_event events[256];
+    while(!quit){
+        int count = epoll_wait(poller, events, 256, -1);
+        if(count < 0){
+            if(errno == EINTR)
+                continue;
+            cerr << "Server: epoll_wait: " << strerror(errno) << endl;
+            return;
+        }
+        for(int i = 0; i < count; i++){
+            uint64_t tag = events[i].data.u64;
+            if(tag == WAKER_TAG){
+                uint64_t value;
+                while(::read(waker, &value, sizeof(value)) > 0)
+                    ;
+                answers();
+            }else if(tag >> 32 == 0){
+                accept(listeners[tag - 1]);
+            }else{
+                if(events[i].events & EPOLLOUT)
+                    flush(tag);
+                if(events[i].events & (EPOLLIN | EPOLLERR | EPOLLHUP))
+                    readFrom(tag);
+            }
+        }
+        // everything said to a client in this round goes out in one write
+        for(ConnectionHandle handle : pending)
+            flush(handle);
+        pending.clear();
+    }
+}
+
+void GameServer::stop(){
+    quit = true;
+    wake(waker);
+}
+
+ServerStats GameServer::stats(){
+    ServerStats result = counters;
+    result.connections = connections.size();
+    result.sessions = sessions.size();
+    result.sessionBytes = sessions.bytes();
+    return result;
+}
+
+void GameServer::accept(int listener){
+    while(true){
+        int fd = accept4(listener, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if(fd < 0){
+            if(errno == EINTR)
+                continue;
+            if((errno == EMFILE || errno == ENFILE) && spare >= 0){
+                // out of descriptors: turn the client away rather than leave it to wake us forever
+                ::close(spare);
+                fd = accept4(listener, nullptr, nullptr, SOCK_CLOEXEC);
+                if(fd >= 0)
+                    ::close(fd);
+                spare = ::open("/dev/null", O_RDONLY | O_CLOEXEC);
+                if(counters.refused++ == 0)
+                    cerr << "Server: out of file descriptors, refusing clients" << endl;
+                continue;
+            }
+            return;
+        }
+        int one = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));   // fails harmlessly on a Unix socket
+        ConnectionHandle handle = connections.create();
+        connections.get(handle)->fd = fd;
+        if(!watch(poller, EPOLL_CTL_ADD, fd, handle, EPOLLIN)){
+            ::close(fd);
+            connections.destroy(handle);
+        }
+    }
+}
+
+void GameServer::readFrom(ConnectionHandle handle){
+    ServerConnection* connection = connections.get(handle);
+    if(!connection)
+        return;
+    char buffer[1 << 16];
+    while(true){
+        ssize_t got = ::read(connection->fd, buffer, sizeof(buffer));
+        if(got > 0){
+            counters.bytesIn += (uint64_t)got;
+            connection->in.append(buffer, (size_t)got);
+            if((size_t)got < sizeof(buffer))
+                break;
+        }else if(got < 0 && errno == EINTR){
+            continue;
+        }else if(got < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)){
+            break;
+        }else{
+            close(handle);
+            return;
+        }
+    }
+
+    size_t start = 0, end;
+    while((end = connection->in.find('\n', start)) != string::npos){
+        size_t length = end - start;
+        if(length && connection->in[end - 1] == '\r')
+            length--;
+        string line = connection->in.substr(start, length);
+        start = end + 1;
+        command(handle, line);
+    }
+    connection->in.erase(0, start);
+    if(connection->in.size() > SERVER_MAX_LINE)
+        close(handle);
+}
+
+void GameServer::flush(ConnectionHandle handle){
+    ServerConnection* connection = connections.get(handle);
+    if(!connection)
+        return;
+    connection->flushing = false;
+    // the lines and the shared frames go out in one gather write, without being copied together
+    size_t written = 0;
+    while(!connection->out.empty() || !connection->frames.empty()){
+        iovec parts[64];
+        int count = 0;
+        if(!connection->out.empty()){
+            parts[count].iov_base = const_cast<char*>(connection->out.data());
+            parts[count++].iov_len = connection->out.size();
+        }
+        for(size_t i = 0; i < connection->frames.size() && count < 64; i++){
+            size_t skip = i ? 0 : connection->frameAt;
+            parts[count].iov_base = const_cast<uint8_t*>(connection->frames[i]->data() + skip);
+            parts[count++].iov_len = connection->frames[i]->size() - skip;
+        }
+        msghdr message;
+        memset(&message, 0, sizeof(message));
+        message.msg_iov = parts;
+        message.msg_iovlen = count;
+        ssize_t sent = sendmsg(connection->fd, &message, MSG_NOSIGNAL);
+        if(sent < 0 && errno == EINTR)
+            continue;
+        if(sent < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+            break;
+        if(sent <= 0){
+            close(handle);
+            return;
+        }
+        size_t done = (size_t)sent;
+        written += done;
+        size_t lines = min(done, connection->out.size());
+        connection->out.erase(0, lines);
+        done -= lines;
+        connection->frameBytes -= done;
+        while(done){
+            size_t left = connection->frames.front()->size() - connection->frameAt;
+            if(done < left){
+                connection->frameAt += done;
+                break;
+            }
+            done -= left;
+            connection->frames.pop_front();
+            connection->frameAt = 0;
+        }
+    }
+    counters.bytesOut += written;
+    size_t unsent = connection->out.size() + connection->frameBytes;
+    if(unsent > SERVER_MAX_OUTPUT){
+        close(handle);
+        return;
+    }
+    bool waiting = unsent > 0;
+    if(waiting != connection->waitingOutput){
+        watch(poller, EPOLL_CTL_MOD, connection->fd, handle, EPOLLIN | (waiting ? EPOLLOUT : 0));
+        connection->waitingOutput = waiting;
+    }
+}
+
+void GameServer::close(ConnectionHandle handle){
+    ServerConnection* connection = connections.get(handle);
+    if(!connection)
+        return;
+    vector<uint64_t> seated;
+    seated.swap(connection->sessions);
+    for(SessionHandle id : seated)
+        leave(id, handle);
+    vector<uint64_t> watched;
+    watched.swap(connection->watching);
+    for(SessionHandle id : watched)
+        unwatch(id, handle);
+    epoll_ctl(poller, EPOLL_CTL_DEL, connection->fd, nullptr);
+    ::close(connection->fd);
+    connections.destroy(handle);
+}
+
+void GameServer::send(ConnectionHandle handle, const string& line){
+    ServerConnection* connection = connections.get(handle);
+    if(!connection)
+        return;
+    if(!connection->flushing){
+        connection->flushing = true;
+        pending.push_back(handle);
+    }
+    connection->out += line;
+    connection->out += '\n';
+}
+
+void GameServer::send(ConnectionHandle handle, const SpectateFrame& frame){
+    ServerConnection* connection = connections.get(handle);
+    if(!connection)
+        return;
+    if(!connection->flushing){
+        connection->flushing = true;
+        pending.push_back(handle);
+    }
+    connection->frames.push_back(frame);
+    connection->frameBytes += frame->size();
+}
+
+void GameServer::broadcast(SessionHandle id, const SpectateFrame& frame){
+    auto audience = audiences.find(id);
+    if(audience == audiences.end())
+        return;
+    counters.frames++;
+    counters.frameBytes += frame->size();
+    counters.framesQueued += audience->second.size();
+    for(ConnectionHandle watcher : audience->second)
+        send(watcher, frame);
+}
+
+void GameServer::tellSeats(const GameSession& session, ConnectionHandle except, const string& line){
+    for(int i = 0; i < 2; i++){
+        ConnectionHandle seat = session.seats[i];
+        if(seat && seat != except && (i == 0 || seat != session.seats[0]))
+            send(seat, line);
+    }
+}
+
+void GameServer::command(ConnectionHandle handle, const string& line){
+    if(connections.get(handle)->spectating){
+        spectatorCommand(handle, line);
+        return;
+    }
+    ServerArgs args;
+    string name = parseCommand(line, args);
+    if(name.empty())
+        return;
+    if(name == "ping"){
+        send(handle, "pong");
+        return;
+    }
+    if(name == "spectate"){
+        send(handle, "spectating");
+        connections.get(handle)->spectating = true;
+        return;
+    }
+    if(name == "new"){
+        Position start = startPosition();
+        const string* fen = findArg(args, "pos");
+        const string* ai = findArg(args, "ai");
+        const string* moveMs = findArg(args, "move-ms");
+        const string* clockMs = findArg(args, "clock-ms");
+        int computer = 2;
+        if(ai)
+            computer = *ai == "white" ? 1 : *ai == "black" ? 2 : *ai == "none" ? 0 : -1;
+        if(computer < 0){
+            send(handle, "error message=\"ai is white, black or none\"");
+            return;
+        }
+        if(fen && !parseFen(*fen, start)){
+            send(handle, "error message=\"bad position\"");
+            return;
+        }
+        if(sessions.size() >= options.maxSessions){
+            send(handle, "error message=\"server full\"");
+            return;
+        }
+        SessionHandle id = sessions.create();
+        GameSession& session = *sessions.get(id);
+        session.position = start;
+        session.moveMs = moveMs ? (uint32_t)max(atoi(moveMs->c_str()), 1) : options.moveMs;
+        session.clockMs = clockMs ? (uint32_t)max(atoi(clockMs->c_str()), 1) : options.clockMs;
+        session.computer = (uint8_t)computer;
+        session.winner = (uint8_t)winnerOf(start);
+        int side = computer == 1 ? 2 : 1;
+        session.seats[side - 1] = handle;
+        connections.get(handle)->sessions.push_back(id);
+        counters.gamesStarted++;
+        send(handle, "game id=" + to_string(id) + " side=" + sideName(side) + " pos=" + toFen(start));
+        if(session.winner)
+            send(handle, "over id=" + to_string(id) + " winner=" + to_string(session.winner));
+        think(id, session);
+        return;
+    }
+    if(name != "join" && name != "move" && name != "state" && name != "leave"){
+        send(handle, "error message=\"unknown command " + name + "\"");
+        return;
+    }
+
+    // the other commands are about one game
+    const string* idText = findArg(args, "id");
+    SessionHandle id = idText ? strtoull(idText->c_str(), nullptr, 10) : 0;
+    GameSession* session = sessions.get(id);
+    string tag = "id=" + to_string(id);
+    if(!session){
+        send(handle, "error " + tag + " message=\"no such game\"");
+        return;
+    }
+    if(name == "join"){
+        int side = 0;
+        for(int player = 1; player <= 2 && !side; player++){
+            if(!session->seats[player - 1] && session->computer != player)
+                side = player;
+        }
+        if(!side){
+            send(handle, "error " + tag + " message=\"no free seat\"");
+            return;
+        }
+        session->seats[side - 1] = handle;
+        vector<uint64_t>& seated = connections.get(handle)->sessions;
+        if(find(seated.begin(), seated.end(), id) == seated.end())
+            seated.push_back(id);
+        send(handle, "game " + tag + " side=" + sideName(side) + " pos=" + toFen(session->position));
+        tellSeats(*session, handle, "joined " + tag);
+    }else if(name == "move"){
+        int player = session->position.whiteToMove ? 1 : 2;
+        const string* text = findArg(args, "m");
+        Move move;
+        if(session->winner)
+            send(handle, "error " + tag + " message=\"the game is over\"");
+        else if(session->seats[player - 1] != handle)
+            send(handle, "error " + tag + " message=\"not your move\"");
+        else if(!text || !parseMove(session->position, *text, move))
+            send(handle, "error " + tag + " message=\"illegal move\"");
+        else
+            play(id, *session, move, handle);
+    }else if(name == "state"){
+        send(handle, "state " + tag + " pos=" + toFen(session->position) + " ply=" + to_string(session->ply) +
+             " p1=" + to_string(session->p1) + " p2=" + to_string(session->p2) + " winner=" + to_string(session->winner));
+    }else{
+        leave(id, handle);
+    }
+}
+
+void GameServer::play(SessionHandle id, GameSession& session, const Move& move, ConnectionHandle mover){
+    Position before = session.position;
+    int taken = countSquares(move.captures);
+    if(session.position.whiteToMove)
+        session.p1 += taken;
+    else
+        session.p2 += taken;
+    session.position = applyMove(session.position, move);
+    session.ply++;
+    session.winner = (uint8_t)winnerOf(session.position);
+
+    // the mover hears first, before anyone else is told or anything is searched
+    string tag = "id=" + to_string(id);
+    string played = "played " + tag + " m=" + moveToString(move) + " ply=" + to_string(session.ply);
+    if(mover){
+        counters.moves++;
+        send(mover, "ok " + tag + " ply=" + to_string(session.ply));
+        tellSeats(session, mover, played);
+    }else{
+        counters.computerMoves++;
+        tellSeats(session, 0, played + " ai");
+    }
+    if(!audiences.empty())
+        broadcast(id, moveFrame(id, session.ply, before, move));
+    if(session.winner){
+        tellSeats(session, 0, "over " + tag + " winner=" + to_string(session.winner));
+        if(!audiences.empty())
+            broadcast(id, eventFrame(spectateOver, id, session.winner));
+    }else{
+        think(id, session);
+    }
+}
+
+void GameServer::think(SessionHandle id, GameSession& session){
+    int player = session.position.whiteToMove ? 1 : 2;
+    if(session.computer != player || session.winner || session.thinking)
+        return;
+    // a move may take its own budget, but never more than a sixteenth of what the game has left
+    uint32_t budget = min(session.moveMs, max(session.clockMs / 16, 1u));
+    SearchLimits limits;
+    limits.seconds = budget / 1000.0;
+    limits.threads = 1;
+    session.thinking = true;
+    pool->submit(id, session.position, limits);
+}
+
+void GameServer::leave(SessionHandle id, ConnectionHandle handle){
+    GameSession* session = sessions.get(id);
+    if(!session)
+        return;
+    bool seated = false;
+    for(int i = 0; i < 2; i++){
+        if(session->seats[i] == handle){
+            session->seats[i] = 0;
+            seated = true;
+        }
+    }
+    if(!seated)
+        return;
+    ServerConnection* connection = connections.get(handle);
+    if(connection)
+        connection->sessions.erase(remove(connection->sessions.begin(), connection->sessions.end(), id), connection->sessions.end());
+    if(session->seats[0] || session->seats[1]){
+        tellSeats(*session, handle, "left id=" + to_string(id));
+        return;
+    }
+    // nobody is left to play it
+    if(session->thinking)
+        pool->cancel(id);
+    sessions.destroy(id);
+    auto audience = audiences.find(id);
+    if(audience != audiences.end()){
+        broadcast(id, eventFrame(spectateClosed, id));
+        for(ConnectionHandle watcher : audience->second){
+            vector<uint64_t>& watching = connections.get(watcher)->watching;
+            watching.erase(remove(watching.begin(), watching.end(), id), watching.end());
+        }
+        counters.watchers -= audience->second.size();
+        audiences.erase(audience);
+    }
+}
+
+void GameServer::spectatorCommand(ConnectionHandle handle, const string& line){
+    ServerArgs args;
+    string name = parseCommand(line, args);
+    if(name.empty())
+        return;
+    if(name == "ping"){
+        send(handle, eventFrame(spectatePong, 0));
+        return;
+    }
+    const string* idText = findArg(args, "id");
+    SessionHandle id = idText ? strtoull(idText->c_str(), nullptr, 10) : 0;
+    GameSession* session = sessions.get(id);
+    vector<uint64_t>& watching = connections.get(handle)->watching;
+    bool watched = find(watching.begin(), watching.end(), id) != watching.end();
+    if(name == "watch" && session){
+        if(!watched){
+            audiences[id].push_back(handle);
+            watching.push_back(id);
+            counters.watchers++;
+        }
+        send(handle, snapshotFrame(id, session->position, session->ply, session->p1, session->p2, session->winner));
+    }else if(name == "unwatch" && watched){
+        unwatch(id, handle);
+    }else if(name == "watch" || name == "unwatch"){
+        send(handle, errorFrame(id, session ? "not watching" : "no such game"));
+    }else{
+        send(handle, errorFrame(0, "unknown command " + name));
+    }
+}
+
+void GameServer::unwatch(SessionHandle id, ConnectionHandle handle){
+    ServerConnection* connection = connections.get(handle);
+    if(connection)
+        connection->watching.erase(remove(connection->watching.begin(), connection->watching.end(), id), connection->watching.end());
+    auto audience = audiences.find(id);
+    if(audience == audiences.end())
+        return;
+    vector<ConnectionHandle>& watchers = audience->second;
+    auto found = find(watchers.begin(), watchers.end(), handle);
+    if(found == watchers.end())
+        return;
+    // the order of the watchers does not matter
+    *found = watchers.back();
+    watchers.pop_back();
+    counters.watchers--;
+    if(watchers.empty())
+        audiences.erase(audience);
+}
+
+void GameServer::answers(){
+    EngineResponse response;
+    while(pool->poll(response)){
+        GameSession* session = sessions.get(response.id);
+        if(!session || !session->thinking || !samePosition(session->position, response.position))
+            continue;
+        session->thinking = false;
+        uint32_t spent = (uint32_t)(response.result.seconds * 1000 + 0.5);
+        session->clockMs -= min(spent, session->clockMs);
+        if(response.result.hasMove)
+            play(response.id, *session, response.result.best, 0);
+    }
+}
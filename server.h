@@ -0,0 +1,157 @@
+// @file server.h
+// @brief one process hosting many games at once: an epoll event loop serving a line protocol over TCP
+//        and Unix sockets, compact sessions in a slab pool and the computer's moves on a pool of search
+//        threads (Linux)
+
+#ifndef SERVER_H
+#define SERVER_H
+
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "rules.h"
+#include "slab.h"
+#include "spectate.h"
+
+class EnginePool;
+
+const size_t SERVER_MAX_LINE = 4096;            // a client sending a longer line is disconnected
+const size_t SERVER_MAX_OUTPUT = 1 << 20;       // ... and so is one that lets this much pile up unread
+
+// One command per line, answers and news the same way; a connection may sit in any number of games:
+//   new [ai=white|black|none] [move-ms=N] [clock-ms=N] [pos=FEN]
+//                          -> game id=N side=white|black pos=FEN (the other seat is the computer's, or open)
+//   join id=N              -> game id=N side=... pos=FEN, and joined id=N to the other player
+//   move id=N m=11-15      -> ok id=N ply=P, and played id=N m=11-15 ply=P to the other player
+//   state id=N             -> state id=N pos=FEN ply=P p1=N p2=N winner=W
+//   leave id=N             -> the other player gets left id=N; a game nobody sits in is closed
+//   ping                   -> pong
+//   spectate               -> spectating; from then on the connection only watches, and everything it
+//                             is sent is a binary frame of spectate.h
+// The computer's moves come as played id=N m=... ply=P ai, the end of a game as over id=N winner=W,
+// and a refused command as error [id=N] message="...".
+// A spectating connection may send:
+//   watch id=N             -> a snapshot frame, then a move frame for every move and an over frame
+//   unwatch id=N
+//   ping                   -> a pong frame
+
+/// @brief how the server runs its games
+struct ServerOptions{
+    int workers = 1;                // search threads, shared by every game
+    size_t hashMb = 8;              // transposition table of each
+    uint32_t moveMs = 100;          // the computer's budget for one move, unless the game sets its own
+    uint32_t clockMs = 60000;       // ... and for the whole game; a move gets at most 1/16 of what is left
+    size_t maxSessions = 1 << 20;
+};
+
+/// @brief a game on the server: the position and its counts, with no history, so ten thousand of
+///        them fit in well under a megabyte
+struct GameSession{
+    Position position;
+    uint64_t seats[2] = {0, 0};     // connections of player one (white) and player two, 0 when empty
+    uint32_t moveMs = 0;            // the computer's budget for one move
+    uint32_t clockMs = 0;           // ... and what is left of its budget for the game
+    uint16_t ply = 0;
+    uint8_t p1 = 0;                 // pieces player one has taken
+    uint8_t p2 = 0;
+    uint8_t winner = 0;
+    uint8_t computer = 0;           // the player the computer plays, 0 for none
+    bool thinking = false;          // a search for the position is queued or running
+};
+
+/// @brief a client: what it sent that is not a whole line yet and what it has not read yet
+struct ServerConnection{
+    int fd = -1;
+    bool waitingOutput = false;     // watching for the socket to take more
+    bool flushing = false;          // in the list of connections to write to
+    bool spectating = false;
+    std::string in;
+    std::string out;                // lines, written before the frames
+    std::deque<SpectateFrame> frames;   // shared with every other watcher, never copied
+    size_t frameAt = 0;             // bytes of the first frame already written
+    size_t frameBytes = 0;          // bytes of the frames not written yet
+    std::vector<uint64_t> sessions; // the games it has a seat in
+    std::vector<uint64_t> watching; // the games it watches
+};
+
+/// @brief what the server has done so far
+struct ServerStats{
+    uint64_t connections = 0;       // open now
+    uint64_t sessions = 0;          // open now
+    uint64_t gamesStarted = 0;
+    uint64_t moves = 0;             // played by clients
+    uint64_t computerMoves = 0;
+    uint64_t bytesIn = 0;
+    uint64_t bytesOut = 0;
+    uint64_t refused = 0;           // clients turned away for want of file descriptors
+    uint64_t watchers = 0;          // watches open now, over every game
+    uint64_t frames = 0;            // frames built for watchers (each sent to all of a game's watchers)
+    uint64_t frameBytes = 0;        // ... and their size
+    uint64_t framesQueued = 0;      // frames handed to watchers
+    uint64_t sessionBytes = 0;      // memory of the session pool
+};
+
+class GameServer{
+public:
+    explicit GameServer(const ServerOptions& options = ServerOptions());
+    ~GameServer();
+    GameServer(const GameServer&) = delete;
+    GameServer& operator=(const GameServer&) = delete;
+
+    /// @brief accepts TCP clients
+    /// @param host,port the address to listen on ("0.0.0.0" for every one) and the port
+    /// @return false if the socket cannot be bound
+    bool listenTcp(const std::string& host, int port);
+
+    /// @brief accepts clients on a Unix socket, replacing a stale socket file
+    bool listenUnix(const std::string& path);
+
+    /// @brief serves until stop(); every socket is handled on the calling thread
+    void run();
+
+    /// @brief makes run() return; may be called from any thread
+    void stop();
+
+    /// @brief the counters; call it from the thread of run(), or once run() has returned
+    ServerStats stats();
+
+private:
+    typedef SlabPool<GameSession>::Handle SessionHandle;
+    typedef SlabPool<ServerConnection>::Handle ConnectionHandle;
+
+    void accept(int listener);
+    void readFrom(ConnectionHandle handle);
+    void flush(ConnectionHandle handle);
+    void close(ConnectionHandle handle);
+    void command(ConnectionHandle handle, const std::string& line);
+    void send(ConnectionHandle handle, const std::string& line);
+    void send(ConnectionHandle handle, const SpectateFrame& frame);
+    void broadcast(SessionHandle id, const SpectateFrame& frame);
+    void spectatorCommand(ConnectionHandle handle, const std::string& line);
+    void unwatch(SessionHandle id, ConnectionHandle handle);
+    void tellSeats(const GameSession& session, ConnectionHandle except, const std::string& line);
+    void play(SessionHandle id, GameSession& session, const Move& move, ConnectionHandle mover);
+    void think(SessionHandle id, GameSession& session);
+    void leave(SessionHandle id, ConnectionHandle handle);
+    void answers();
+
+    ServerOptions options;
+    SlabPool<GameSession> sessions;
+    SlabPool<ServerConnection> connections;
+    std::vector<int> listeners;
+    std::vector<std::string> unixPaths;         // removed when the server goes
+    std::vector<ConnectionHandle> pending;      // connections with output to write
+    std::unordered_map<SessionHandle, std::vector<ConnectionHandle>> audiences;    // watchers of the games that have any
+    ServerStats counters;
+    int poller = -1;                            // the epoll instance
+    int waker = -1;                             // eventfd: an answer is ready, or stop()
+    int spare = -1;                             // a descriptor given up to refuse a client when out of them
+    std::atomic<bool> quit{false};
+    std::unique_ptr<EnginePool> pool;
+};
+
+#endif
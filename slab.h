@@ -0,0 +1,89 @@
+// @file slab.h
+// @brief a pool of fixed-size objects allocated a slab at a time, addressed by handles that go stale
+//        when their object is freed
+
+#ifndef SLAB_H
+#define SLAB_H
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+/// @brief Objects live in slabs of SLAB_ITEMS that are never moved or freed while the pool lives, so
+///        a pointer stays valid until its object is destroyed and creating one never copies the others.
+///        Freed slots are reused first. A handle holds the slot and the slot's generation, which goes up
+///        every time the slot is freed: a handle kept after destroy() finds nothing instead of the next
+///        object in the slot. Not thread-safe, the owner's thread does everything.
+template<typename T>
+class SlabPool{
+public:
+    typedef uint64_t Handle;                    // generation << 32 | slot; never 0
+    static const size_t SLAB_ITEMS = 1024;
+
+    SlabPool() = default;
+    SlabPool(const SlabPool&) = delete;
+    SlabPool& operator=(const SlabPool&) = delete;
+
+    /// @brief takes a slot holding a default-constructed T
+    Handle create(){
+        uint32_t slot;
+        if(!freeSlots.empty()){
+            slot = freeSlots.back();
+            freeSlots.pop_back();
+        }else{
+            slot = (uint32_t)generations.size();
+            if(slot % SLAB_ITEMS == 0)
+                slabs.emplace_back(new T[SLAB_ITEMS]);
+            generations.push_back(1);
+        }
+        live++;
+        return (Handle)generations[slot] << 32 | slot;
+    }
+
+    /// @brief frees the object of a handle; the slot's object is reset to T() at once, so whatever
+    ///        it owned is released. A stale handle is ignored
+    void destroy(Handle handle){
+        if(!get(handle))
+            return;
+        uint32_t slot = (uint32_t)handle;
+        at(slot) = T();
+        generations[slot]++;
+        freeSlots.push_back(slot);
+        live--;
+    }
+
+    /// @brief returns the object of a handle, nullptr if it was destroyed (or never existed)
+    T* get(Handle handle){
+        uint32_t slot = (uint32_t)handle;
+        if(slot >= generations.size() || generations[slot] != (uint32_t)(handle >> 32))
+            return nullptr;
+        return &at(slot);
+    }
+
+    /// @brief calls f(handle, object) for every live object
+    template<typename F>
+    void forEach(F f){
+        std::vector<bool> dead(generations.size());
+        for(uint32_t slot : freeSlots)
+            dead[slot] = true;
+        for(uint32_t slot = 0; slot < generations.size(); slot++){
+            if(!dead[slot])
+                f((Handle)generations[slot] << 32 | slot, at(slot));
+        }
+    }
+
+    size_t size() const { return live; }
+    size_t capacity() const { return slabs.size() * SLAB_ITEMS; }
+    size_t bytes() const { return capacity() * sizeof(T) + generations.capacity() * 4 + freeSlots.capacity() * 4; }
+
+private:
+    T& at(uint32_t slot){ return slabs[slot / SLAB_ITEMS][slot % SLAB_ITEMS]; }
+
+    std::vector<std::unique_ptr<T[]>> slabs;
+    std::vector<uint32_t> generations;          // per slot; they start at 1 so no handle is 0
+    std::vector<uint32_t> freeSlots;
+    size_t live = 0;
+};
+
+#endif
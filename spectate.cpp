@@ -0,0 +1,178 @@
+// @file spectate.cpp
+// @brief building and reading the frames of the spectator stream
+
+#include "spectate.h"
+
+#include "savefile.h"
+
+using namespace std;
+
+static void putVarint(vector<uint8_t>& out, uint64_t value){
+    while(value >= 0x80){
+        out.push_back((uint8_t)(value | 0x80));
+        value >>= 7;
+    }
+    out.push_back((uint8_t)value);
+}
+
+static bool getVarint(const uint8_t* data, size_t size, size_t& at, uint64_t& value){
+    value = 0;
+    for(int shift = 0; shift < 64 && at < size; shift += 7){
+        uint8_t b = data[at++];
+        value |= (uint64_t)(b & 0x7F) << shift;
+        if(!(b & 0x80))
+            return true;
+    }
+    return false;
+}
+
+/// @brief puts the length in front of a frame's body and freezes it
+static SpectateFrame finish(const vector<uint8_t>& body){
+    vector<uint8_t>* frame = new vector<uint8_t>;
+    frame->reserve(body.size() + 2);
+    putVarint(*frame, body.size());
+    frame->insert(frame->end(), body.begin(), body.end());
+    return SpectateFrame(frame);
+}
+
+static vector<uint8_t> startBody(int type, uint64_t id){
+    vector<uint8_t> body;
+    body.reserve(32);
+    body.push_back((uint8_t)type);
+    putVarint(body, id);
+    return body;
+}
+
+SpectateFrame snapshotFrame(uint64_t id, const Position& pos, int ply, int p1, int p2, int winner){
+    vector<uint8_t> body = startBody(spectateSnapshot, id);
+    putVarint(body, (uint64_t)ply);
+    body.push_back((uint8_t)p1);
+    body.push_back((uint8_t)p2);
+    body.push_back((uint8_t)winner);
+    encodePosition(body, pos);
+    return finish(body);
+}
+
+SpectateFrame moveFrame(uint64_t id, int ply, const Position& before, const Move& move){
+    vector<uint8_t> body = startBody(spectateMove, id);
+    putVarint(body, (uint64_t)ply);
+    body.push_back(move.from);
+    body.push_back(move.to);
+    bool promoted = !(before.kings & (1u << move.from)) && (applyMove(before, move).kings & (1u << move.to));
+    body.push_back((uint8_t)((promoted ? 1 : 0) | countSquares(move.captures) << 1));
+    for(uint32_t captures = move.captures; captures; captures &= captures - 1)
+        body.push_back((uint8_t)firstSquare(captures));
+    return finish(body);
+}
+
+SpectateFrame eventFrame(int type, uint64_t id, int winner){
+    vector<uint8_t> body = startBody(type, id);
+    if(type == spectateOver)
+        body.push_back((uint8_t)winner);
+    return finish(body);
+}
+
+SpectateFrame errorFrame(uint64_t id, const string& message){
+    vector<uint8_t> body = startBody(spectateError, id);
+    body.insert(body.end(), message.begin(), message.end());
+    return finish(body);
+}
+
+int readSpectateFrame(const uint8_t* data, size_t size, SpectateEvent& event){
+    size_t at = 0;
+    uint64_t length;
+    if(!getVarint(data, size, at, length))
+        return at < 10 && at == size ? 0 : -1;
+    if(length > size - at)
+        return 0;
+    size_t end = at + (size_t)length;
+    if(length == 0)
+        return -1;
+    event = SpectateEvent();
+    event.type = data[at++];
+    uint64_t value;
+    if(!getVarint(data, end, at, event.id))
+        return -1;
+    switch(event.type){
+        case spectateSnapshot:
+            if(!getVarint(data, end, at, value) || end - at < 3)
+                return -1;
+            event.ply = (int)value;
+            event.p1 = data[at++];
+            event.p2 = data[at++];
+            event.winner = data[at++];
+            if(!decodePosition(data, end, at, event.position))
+                return -1;
+            break;
+        case spectateMove:{
+            if(!getVarint(data, end, at, value) || end - at < 3)
+                return -1;
+            event.ply = (int)value;
+            event.from = data[at++];
+            event.to = data[at++];
+            uint8_t flags = data[at++];
+            event.promoted = flags & 1;
+            int taken = flags >> 1;
+            if(event.from >= SQUARE_COUNT || event.to >= SQUARE_COUNT || end - at < (size_t)taken)
+                return -1;
+            for(int i = 0; i < taken; i++){
+                if(data[at] >= SQUARE_COUNT)
+                    return -1;
+                event.captures |= 1u << data[at++];
+            }
+            break;
+        }
+        case spectateOver:
+            if(at >= end)
+                return -1;
+            event.winner = data[at++];
+            break;
+        case spectateError:
+            event.message.assign(reinterpret_cast<const char*>(data + at), end - at);
+            break;
+    }
+    return (int)end;
+}
+
+bool WatchedGame::apply(const SpectateEvent& event){
+    if(event.type == spectateSnapshot){
+        position = event.position;
+        ply = event.ply;
+        p1 = event.p1;
+        p2 = event.p2;
+        winner = event.winner;
+        synced = true;
+        return true;
+    }
+    if(event.type == spectateOver){
+        winner = event.winner;
+        return synced;
+    }
+    if(event.type == spectateClosed){
+        synced = false;
+        return true;
+    }
+    if(event.type != spectateMove)
+        return true;
+
+    uint32_t from = 1u << event.from, to = 1u << event.to;
+    bool white = position.whiteToMove;
+    uint32_t& mine = white ? position.white : position.black;
+    uint32_t& theirs = white ? position.black : position.white;
+    if(!synced || event.ply != ply + 1 || !(mine & from) || (event.captures & ~theirs)){
+        synced = false;
+        return false;
+    }
+    bool king = (position.kings & from) || event.promoted;
+    mine &= ~from;
+    mine |= to;
+    theirs &= ~event.captures;
+    position.kings &= ~(from | event.captures);
+    if(king)
+        position.kings |= to;
+    position.whiteToMove = !white;
+    position.hash = computeHash(position);
+    (white ? p1 : p2) += countSquares(event.captures);
+    ply = event.ply;
+    return true;
+}
@@ -0,0 +1,85 @@
+// @file spectate.h
+// @brief the spectator stream of the game server: a compact snapshot of a game, then one small delta
+//        frame per move, so a remote board follows a game for about a dozen bytes a move
+
+#ifndef SPECTATE_H
+#define SPECTATE_H
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+#include "rules.h"
+
+// Every frame is its length (a varint, counting the bytes after it), a type byte and the game id (a
+// varint), then:
+//   spectateSnapshot  ply (varint), p1, p2, winner, the position packed as in a save file (encodePosition)
+//   spectateMove      ply after the move (varint), from, to, flags (bit 0: the man was promoted, bits
+//                     1..4: pieces taken, which is also what the mover's score goes up by), the squares taken
+//   spectateOver      winner
+//   spectateClosed    nothing: every player left and the game is gone
+//   spectatePong      nothing (id 0)
+//   spectateError     the message, as text to the end of the frame
+// A reader skips a frame of a type it does not know, so frames can be added.
+enum spectateFrameType{
+    spectateSnapshot = 'S',
+    spectateMove = 'M',
+    spectateOver = 'O',
+    spectateClosed = 'C',
+    spectatePong = 'P',
+    spectateError = 'E'
+};
+
+/// @brief a frame is built once and the same bytes are queued to every watcher
+typedef std::shared_ptr<const std::vector<uint8_t>> SpectateFrame;
+
+/// @brief what a frame says, once read
+struct SpectateEvent{
+    int type = 0;
+    uint64_t id = 0;
+    int ply = 0;
+    int p1 = 0;
+    int p2 = 0;
+    int winner = 0;
+    Position position;          // spectateSnapshot
+    int from = 0;               // spectateMove
+    int to = 0;
+    uint32_t captures = 0;
+    bool promoted = false;
+    std::string message;        // spectateError
+};
+
+/// @brief builds the frame that starts a watcher off
+SpectateFrame snapshotFrame(uint64_t id, const Position& pos, int ply, int p1, int p2, int winner);
+
+/// @brief builds the frame of a move
+/// @param id,ply,before,move the game, its ply after the move, the position it was played in and the move
+SpectateFrame moveFrame(uint64_t id, int ply, const Position& before, const Move& move);
+
+/// @brief builds a frame of one of the other types (winner is the byte of spectateOver)
+SpectateFrame eventFrame(int type, uint64_t id, int winner = 0);
+
+/// @brief builds an error frame
+SpectateFrame errorFrame(uint64_t id, const std::string& message);
+
+/// @brief reads the frame at the start of some bytes
+/// @param data,size,event the bytes received and what the frame says
+/// @return the size of the frame, 0 if it has not all arrived yet, -1 if the bytes are not a frame
+int readSpectateFrame(const uint8_t* data, size_t size, SpectateEvent& event);
+
+/// @brief a game as a watcher sees it, kept up to date from its frames
+struct WatchedGame{
+    Position position;
+    int ply = 0;
+    int p1 = 0;
+    int p2 = 0;
+    int winner = 0;
+    bool synced = false;        // a snapshot was read and no move has been missed since
+
+    /// @brief applies a frame of this game
+    /// @return false if it does not follow on (a move without a snapshot, or one skipping a ply):
+    ///        the watcher should watch again for a new snapshot
+    bool apply(const SpectateEvent& event);
+};
+
+#endif
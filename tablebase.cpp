@@ -0,0 +1,548 @@
+// @file tablebase.cpp
+// @brief perfect indexing of tablebase slices, the slice files and probing the compressed files
+
+#include "tablebase.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <list>
+#include <mutex>
+#include <unordered_map>
+#include "mappedfile.h"
+
+using namespace std;
+
+// White men never stand on the top row (they would have promoted), black men never on the bottom row.
+// Only the 24 squares in between can hold a man of either colour.
+const uint32_t WHITE_MEN_SQUARES = ~TOP_ROW;
+const uint32_t BLACK_MEN_SQUARES = ~BOTTOM_ROW;
+const uint32_t SHARED_MEN_SQUARES = WHITE_MEN_SQUARES & BLACK_MEN_SQUARES;
+
+static uint64_t BINOMIAL[SQUARE_COUNT + 1][SQUARE_COUNT + 1];
+
+static bool binomialReady = [](){
+    for(int n = 0; n <= SQUARE_COUNT; n++){
+        BINOMIAL[n][0] = 1;
+        for(int k = 1; k <= n; k++)
+            BINOMIAL[n][k] = BINOMIAL[n - 1][k - 1] + (k <= n - 1 ? BINOMIAL[n - 1][k] : 0);
+    }
+    return true;
+}();
+
+static uint64_t choose(int n, int k){
+    if(k < 0 || n < 0 || k > n)
+        return 0;
+    return BINOMIAL[n][k];
+}
+
+// Colex rank of a set of squares among the allowed squares: each square counts as its place in
+// the allowed mask, and the i-th smallest place p adds choose(p, i).
+static uint64_t rankSquares(uint32_t squares, uint32_t allowed){
+    uint64_t rank = 0;
+    int i = 1;
+    for(; squares; squares &= squares - 1, i++){
+        int square = firstSquare(squares);
+        rank += choose(countSquares(allowed & ((1u << square) - 1)), i);
+    }
+    return rank;
+}
+
+// Inverse of rankSquares for a set of count squares.
+static uint32_t unrankSquares(uint64_t rank, int count, uint32_t allowed){
+    uint32_t squares = 0;
+    int place = countSquares(allowed);
+    for(int i = count; i >= 1; i--){
+        place--;
+        while(choose(place, i) > rank)
+            place--;
+        rank -= choose(place, i);
+        // the place-th allowed square
+        uint32_t rest = allowed;
+        for(int skip = 0; skip < place; skip++)
+            rest &= rest - 1;
+        squares |= 1u << firstSquare(rest);
+    }
+    return squares;
+}
+
+// Men are counted by how many white men stand on the bottom row (j), which black men cannot use:
+// the other white men share the middle 24 squares with the black men.
+static uint64_t menGroupSize(int whiteMen, int blackMen, int j){
+    int shared = whiteMen - j;
+    return choose(4, j) * choose(24, shared) * choose(28 - shared, blackMen);
+}
+
+static uint64_t kingsSize(const TBSlice& slice){
+    int free = SQUARE_COUNT - slice.whiteMen - slice.blackMen;
+    return choose(free, slice.whiteKings) * choose(free - slice.whiteKings, slice.blackKings);
+}
+
+TBSlice sliceOf(const Position& pos){
+    TBSlice slice;
+    slice.whiteMen = countSquares(pos.white & ~pos.kings);
+    slice.whiteKings = countSquares(pos.white & pos.kings);
+    slice.blackMen = countSquares(pos.black & ~pos.kings);
+    slice.blackKings = countSquares(pos.black & pos.kings);
+    return slice;
+}
+
+TBSlice swapColours(const TBSlice& slice){
+    TBSlice swapped;
+    swapped.whiteMen = slice.blackMen;
+    swapped.whiteKings = slice.blackKings;
+    swapped.blackMen = slice.whiteMen;
+    swapped.blackKings = slice.whiteKings;
+    return swapped;
+}
+
+string sliceName(const TBSlice& slice){
+    return "w" + to_string(slice.whiteMen) + to_string(slice.whiteKings) +
+           "b" + to_string(slice.blackMen) + to_string(slice.blackKings);
+}
+
+uint64_t sliceSize(const TBSlice& slice){
+    uint64_t men = 0;
+    for(int j = 0; j <= 4 && j <= slice.whiteMen; j++)
+        men += menGroupSize(slice.whiteMen, slice.blackMen, j);
+    return men * kingsSize(slice);
+}
+
+uint64_t positionIndex(const TBSlice& slice, const Position& pos){
+    uint32_t whiteMen = pos.white & ~pos.kings;
+    uint32_t blackMen = pos.black & ~pos.kings;
+    uint32_t men = whiteMen | blackMen;
+    int j = countSquares(whiteMen & BOTTOM_ROW);
+    int shared = slice.whiteMen - j;
+
+    uint64_t menIndex = 0;
+    for(int g = 0; g < j; g++)
+        menIndex += menGroupSize(slice.whiteMen, slice.blackMen, g);
+    uint64_t whiteRank = rankSquares(whiteMen & BOTTOM_ROW, BOTTOM_ROW) * choose(24, shared) +
+                         rankSquares(whiteMen & SHARED_MEN_SQUARES, SHARED_MEN_SQUARES);
+    menIndex += whiteRank * choose(28 - shared, slice.blackMen) +
+                rankSquares(blackMen, BLACK_MEN_SQUARES & ~whiteMen);
+
+    int free = SQUARE_COUNT - slice.whiteMen - slice.blackMen;
+    uint64_t kingIndex = rankSquares(pos.white & pos.kings, ~men) * choose(free - slice.whiteKings, slice.blackKings) +
+                         rankSquares(pos.black & pos.kings, ~(men | pos.white));
+    return menIndex * kingsSize(slice) + kingIndex;
+}
+
+Position positionAt(const TBSlice& slice, uint64_t index){
+    uint64_t kings = kingsSize(slice);
+    uint64_t menIndex = index / kings;
+    uint64_t kingIndex = index % kings;
+
+    int j = 0;
+    while(menIndex >= menGroupSize(slice.whiteMen, slice.blackMen, j)){
+        menIndex -= menGroupSize(slice.whiteMen, slice.blackMen, j);
+        j++;
+    }
+    int shared = slice.whiteMen - j;
+    uint64_t blackCount = choose(28 - shared, slice.blackMen);
+    uint64_t whiteRank = menIndex / blackCount;
+    uint32_t whiteMen = unrankSquares(whiteRank / choose(24, shared), j, BOTTOM_ROW) |
+                        unrankSquares(whiteRank % choose(24, shared), shared, SHARED_MEN_SQUARES);
+    uint32_t blackMen = unrankSquares(menIndex % blackCount, slice.blackMen, BLACK_MEN_SQUARES & ~whiteMen);
+
+    int free = SQUARE_COUNT - slice.whiteMen - slice.blackMen;
+    uint64_t blackKingCount = choose(free - slice.whiteKings, slice.blackKings);
+    uint32_t men = whiteMen | blackMen;
+    uint32_t whiteKings = unrankSquares(kingIndex / blackKingCount, slice.whiteKings, ~men);
+    uint32_t blackKings = unrankSquares(kingIndex % blackKingCount, slice.blackKings, ~(men | whiteKings));
+
+    Position pos;
+    pos.white = whiteMen | whiteKings;
+    pos.black = blackMen | blackKings;
+    pos.kings = whiteKings | blackKings;
+    pos.whiteToMove = true;
+    pos.hash = computeHash(pos);
+    return pos;
+}
+
+// square n becomes square 31 - n: the board turned half a turn
+static uint32_t reverseSquares(uint32_t squares){
+    squares = ((squares >> 1) & 0x55555555u) | ((squares & 0x55555555u) << 1);
+    squares = ((squares >> 2) & 0x33333333u) | ((squares & 0x33333333u) << 2);
+    squares = ((squares >> 4) & 0x0F0F0F0Fu) | ((squares & 0x0F0F0F0Fu) << 4);
+    squares = ((squares >> 8) & 0x00FF00FFu) | ((squares & 0x00FF00FFu) << 8);
+    return (squares >> 16) | (squares << 16);
+}
+
+Position flipPosition(const Position& pos){
+    Position flipped;
+    flipped.white = reverseSquares(pos.black);
+    flipped.black = reverseSquares(pos.white);
+    flipped.kings = reverseSquares(pos.kings);
+    flipped.whiteToMove = !pos.whiteToMove;
+    flipped.hash = computeHash(flipped);
+    return flipped;
+}
+
+vector<TBSlice> listSlices(int pieces){
+    vector<TBSlice> slices;
+    for(int total = 2; total <= pieces; total++){
+        for(int men = 0; men <= total; men++){
+            for(int whiteMen = 0; whiteMen <= men; whiteMen++){
+                for(int whiteKings = 0; whiteKings <= total - men; whiteKings++){
+                    TBSlice slice;
+                    slice.whiteMen = whiteMen;
+                    slice.whiteKings = whiteKings;
+                    slice.blackMen = men - whiteMen;
+                    slice.blackKings = total - men - whiteKings;
+                    if(slice.whiteMen + slice.whiteKings == 0 || slice.blackMen + slice.blackKings == 0)
+                        continue;
+                    if(slice.whiteMen + slice.whiteKings > 12 || slice.blackMen + slice.blackKings > 12)
+                        continue;
+                    bool listed = false;
+                    for(const TBSlice& other : slices)
+                        listed = listed || other == slice;
+                    if(listed)
+                        continue;
+                    slices.push_back(slice);
+                    if(swapColours(slice) != slice)
+                        slices.push_back(swapColours(slice));
+                }
+            }
+        }
+    }
+    return slices;
+}
+
+bool readSliceFile(const string& path, const TBSlice& slice, vector<uint8_t>& values, bool& distances){
+    ifstream file(path, ios::binary);
+    if(!file.is_open())
+        return false;
+    TBFileHeader header;
+    file.read(reinterpret_cast<char*>(&header), sizeof(header));
+    if(!file || memcmp(header.magic, "DTB1", 4) != 0)
+        return false;
+    if(header.counts[0] != slice.whiteMen || header.counts[1] != slice.whiteKings ||
+       header.counts[2] != slice.blackMen || header.counts[3] != slice.blackKings ||
+       header.size != sliceSize(slice))
+        return false;
+    values.resize(header.size);
+    file.read(reinterpret_cast<char*>(values.data()), header.size);
+    if(!file)
+        return false;
+    distances = header.distances != 0;
+    return true;
+}
+
+bool writeSliceFile(const string& path, const TBSlice& slice, const uint8_t* values, uint64_t size, bool distances){
+    TBFileHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, "DTB1", 4);
+    header.counts[0] = (uint8_t)slice.whiteMen;
+    header.counts[1] = (uint8_t)slice.whiteKings;
+    header.counts[2] = (uint8_t)slice.blackMen;
+    header.counts[3] = (uint8_t)slice.blackKings;
+    header.distances = distances ? 1 : 0;
+    header.size = size;
+
+    string temporary = path + ".tmp";
+    ofstream file(temporary, ios::binary | ios::trunc);
+    if(!file.is_open())
+        return false;
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    file.write(reinterpret_cast<const char*>(values), size);
+    file.close();
+    if(!file)
+        return false;
+    return rename(temporary.c_str(), path.c_str()) == 0;
+}
+
+// Appends a token to the block being filled, or starts a new block when it does not fit.
+static void putToken(vector<uint8_t>& blocks, vector<uint64_t>& firstIndex, uint64_t index,
+                     const uint8_t* token, size_t length){
+    size_t used = blocks.size() % TB_BLOCK_BYTES;
+    if(blocks.empty() || used == 0 || used + length > TB_BLOCK_BYTES){
+        if(used)
+            blocks.resize(blocks.size() + TB_BLOCK_BYTES - used, 0);
+        firstIndex.push_back(index);
+    }
+    blocks.insert(blocks.end(), token, token + length);
+}
+
+uint64_t writeCompressedSlice(const string& path, const TBSlice& slice, const uint8_t* values, uint64_t size, bool distances){
+    vector<uint8_t> blocks;
+    vector<uint64_t> firstIndex;
+    uint8_t token[TB_BLOCK_BYTES];
+    // win / loss / draw values fit in two bits: literals are packed four to a byte, which makes
+    // short runs cheaper to leave in a literal
+    bool packed = !distances;
+    uint64_t shortestRun = packed ? 12 : 3;
+    uint64_t i = 0;
+    while(i < size){
+        uint64_t run = 1;
+        while(i + run < size && values[i + run] == values[i])
+            run++;
+        size_t length = 0;
+        if(run >= shortestRun){
+            if(run <= 0xFE - 0x80 + 3){
+                token[length++] = (uint8_t)(0x80 + run - 3);
+                token[length++] = values[i];
+            }else{
+                token[length++] = 0xFF;
+                token[length++] = values[i];
+                for(uint64_t rest = run; ; rest >>= 7){
+                    token[length++] = (uint8_t)((rest & 0x7F) | (rest >= 0x80 ? 0x80 : 0));
+                    if(rest < 0x80)
+                        break;
+                }
+            }
+            putToken(blocks, firstIndex, i, token, length);
+            i += run;
+            continue;
+        }
+        // literal values up to the next long run, at most 128 and at most what the block has left
+        size_t used = blocks.size() % TB_BLOCK_BYTES;
+        size_t room = used == 0 || TB_BLOCK_BYTES - used < 2 ? TB_BLOCK_BYTES : TB_BLOCK_BYTES - used;
+        uint64_t count = 0;
+        while(i + count < size && count < 128 && 1 + (packed ? (count + 4) / 4 : count + 1) <= room){
+            uint64_t ahead = 1;
+            while(ahead < shortestRun && i + count + ahead < size && values[i + count + ahead] == values[i + count])
+                ahead++;
+            if(count && ahead == shortestRun)
+                break;
+            count++;
+        }
+        token[length++] = (uint8_t)(count - 1);
+        if(packed){
+            memset(token + length, 0, (count + 3) / 4);
+            for(uint64_t k = 0; k < count; k++)
+                token[length + k / 4] |= (uint8_t)(values[i + k] << (2 * (k % 4)));
+            length += (count + 3) / 4;
+        }else{
+            memcpy(token + length, values + i, count);
+            length += count;
+        }
+        putToken(blocks, firstIndex, i, token, length);
+        i += count;
+    }
+    if(blocks.size() % TB_BLOCK_BYTES)
+        blocks.resize(blocks.size() + TB_BLOCK_BYTES - blocks.size() % TB_BLOCK_BYTES, 0);
+
+    TBCompressedHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, "DCB1", 4);
+    header.counts[0] = (uint8_t)slice.whiteMen;
+    header.counts[1] = (uint8_t)slice.whiteKings;
+    header.counts[2] = (uint8_t)slice.blackMen;
+    header.counts[3] = (uint8_t)slice.blackKings;
+    header.distances = distances ? 1 : 0;
+    header.blockBytes = TB_BLOCK_BYTES;
+    header.size = size;
+    header.blockCount = firstIndex.size();
+
+    string temporary = path + ".tmp";
+    ofstream file(temporary, ios::binary | ios::trunc);
+    if(!file.is_open())
+        return 0;
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    file.write(reinterpret_cast<const char*>(firstIndex.data()), firstIndex.size() * sizeof(uint64_t));
+    file.write(reinterpret_cast<const char*>(blocks.data()), blocks.size());
+    file.close();
+    if(!file || rename(temporary.c_str(), path.c_str()) != 0)
+        return 0;
+    return sizeof(header) + firstIndex.size() * sizeof(uint64_t) + blocks.size();
+}
+
+/// @brief a .cdb file mapped into memory
+struct TBMappedSlice{
+    TBSlice slice;
+    MappedFile file;
+    const TBCompressedHeader* header = nullptr;
+    const uint64_t* firstIndex = nullptr;
+    const uint8_t* blocks = nullptr;
+};
+
+/// @brief a block decoded into its runs: value j covers the positions up to (not including) end j
+struct TBDecodedBlock{
+    vector<uint64_t> ends;
+    vector<uint8_t> values;
+
+    size_t bytes() const { return ends.size() * (sizeof(uint64_t) + 1) + sizeof(*this); }
+};
+
+typedef shared_ptr<const TBDecodedBlock> TBBlockPointer;
+typedef list<pair<uint64_t, TBBlockPointer>> TBBlockList;
+
+/// @brief one part of the decoded-block cache: most recently used blocks at the front
+struct TBCacheShard{
+    mutex lock;
+    TBBlockList order;
+    unordered_map<uint64_t, TBBlockList::iterator> entries;
+    size_t bytes = 0;
+    uint64_t probes = 0;
+    uint64_t hits = 0;
+};
+
+static TBBlockPointer decodeBlock(const TBMappedSlice& mapped, uint64_t block){
+    shared_ptr<TBDecodedBlock> decoded(new TBDecodedBlock());
+    decoded->ends.reserve(TB_BLOCK_BYTES);
+    decoded->values.reserve(TB_BLOCK_BYTES);
+    uint64_t first = mapped.firstIndex[block];
+    uint64_t last = block + 1 < mapped.header->blockCount ? mapped.firstIndex[block + 1] : mapped.header->size;
+    const uint8_t* in = mapped.blocks + block * TB_BLOCK_BYTES;
+    bool packed = !mapped.header->distances;
+    uint64_t at = 0;
+    while(first + at < last){
+        uint8_t token = *in++;
+        if(token < 0x80){
+            for(int k = 0; k <= token; k++){
+                at++;
+                decoded->ends.push_back(at);
+                decoded->values.push_back(packed ? (in[k / 4] >> (2 * (k % 4))) & 3 : in[k]);
+            }
+            in += packed ? (token + 4) / 4 : token + 1;
+            continue;
+        }
+        uint8_t value = *in++;
+        uint64_t run = token - 0x80 + 3;
+        if(token == 0xFF){
+            run = 0;
+            for(int shift = 0; ; shift += 7){
+                uint8_t byte = *in++;
+                run |= (uint64_t)(byte & 0x7F) << shift;
+                if(!(byte & 0x80))
+                    break;
+            }
+        }
+        at += run;
+        decoded->ends.push_back(at);
+        decoded->values.push_back(value);
+    }
+    return decoded;
+}
+
+Tablebase::Tablebase() : shards(new TBCacheShard[TB_CACHE_SHARDS]){
+    memset(sliceNumber, -1, sizeof(sliceNumber));
+}
+
+Tablebase::~Tablebase(){
+}
+
+void Tablebase::close(){
+    for(int i = 0; i < TB_CACHE_SHARDS; i++){
+        lock_guard<mutex> guard(shards[i].lock);
+        shards[i].order.clear();
+        shards[i].entries.clear();
+        shards[i].bytes = 0;
+    }
+    slices.clear();
+    memset(sliceNumber, -1, sizeof(sliceNumber));
+    maxPieces = 0;
+    distances = true;
+}
+
+int Tablebase::open(const string& dir, size_t cacheMegabytes){
+    close();
+    shardCapacity = cacheMegabytes * 1024 * 1024 / TB_CACHE_SHARDS;
+    for(const TBSlice& slice : listSlices(TB_MAX_PIECES)){
+        unique_ptr<TBMappedSlice> mapped(new TBMappedSlice());
+        mapped->slice = slice;
+        if(!mapped->file.map(dir + "/" + sliceName(slice) + ".cdb"))
+            continue;
+        if(mapped->file.size() < sizeof(TBCompressedHeader))
+            continue;
+        const TBCompressedHeader* header = reinterpret_cast<const TBCompressedHeader*>(mapped->file.data());
+        if(memcmp(header->magic, "DCB1", 4) != 0 || header->blockBytes != TB_BLOCK_BYTES ||
+           header->counts[0] != slice.whiteMen || header->counts[1] != slice.whiteKings ||
+           header->counts[2] != slice.blackMen || header->counts[3] != slice.blackKings ||
+           header->size != sliceSize(slice) ||
+           mapped->file.size() != sizeof(TBCompressedHeader) + header->blockCount * (sizeof(uint64_t) + TB_BLOCK_BYTES))
+            continue;
+        mapped->header = header;
+        mapped->firstIndex = reinterpret_cast<const uint64_t*>(mapped->file.data() + sizeof(TBCompressedHeader));
+        mapped->blocks = mapped->file.data() + sizeof(TBCompressedHeader) + header->blockCount * sizeof(uint64_t);
+        distances = distances && header->distances;
+        sliceNumber[slice.whiteMen][slice.whiteKings][slice.blackMen][slice.blackKings] = (int)slices.size();
+        slices.push_back(move(mapped));
+    }
+    // a position is only probed when every slice with its number of pieces is there
+    maxPieces = 0;
+    for(int pieces = 2; pieces <= TB_MAX_PIECES; pieces++){
+        bool complete = true;
+        for(const TBSlice& slice : listSlices(pieces)){
+            if(slicePieces(slice) == pieces)
+                complete = complete && sliceNumber[slice.whiteMen][slice.whiteKings][slice.blackMen][slice.blackKings] >= 0;
+        }
+        if(!complete)
+            break;
+        maxPieces = pieces;
+    }
+    return (int)slices.size();
+}
+
+bool Tablebase::probe(const Position& pos, uint8_t& value){
+    Position white = pos.whiteToMove ? pos : flipPosition(pos);
+    if(!white.white){
+        value = TB_LOSS;
+        return true;
+    }
+    TBSlice slice = sliceOf(white);
+    if(slicePieces(slice) > TB_MAX_PIECES || slice.whiteMen + slice.whiteKings > TB_MAX_PIECES)
+        return false;
+    int number = sliceNumber[slice.whiteMen][slice.whiteKings][slice.blackMen][slice.blackKings];
+    if(number < 0)
+        return false;
+    const TBMappedSlice& mapped = *slices[number];
+    uint64_t index = positionIndex(slice, white);
+    const uint64_t* firstIndex = mapped.firstIndex;
+    uint64_t block = upper_bound(firstIndex, firstIndex + mapped.header->blockCount, index) - firstIndex - 1;
+
+    uint64_t key = (uint64_t)number << 40 | block;
+    TBCacheShard& shard = shards[(key * 0x9E3779B97F4A7C15ull) >> 60];
+    TBBlockPointer decoded;
+    {
+        lock_guard<mutex> guard(shard.lock);
+        shard.probes++;
+        auto found = shard.entries.find(key);
+        if(found != shard.entries.end()){
+            shard.hits++;
+            shard.order.splice(shard.order.begin(), shard.order, found->second);
+            decoded = found->second->second;
+        }
+    }
+    if(!decoded){
+        // decoded outside the lock; two threads may decode the same block, the second copy is dropped
+        decoded = decodeBlock(mapped, block);
+        lock_guard<mutex> guard(shard.lock);
+        if(shard.entries.find(key) == shard.entries.end()){
+            shard.order.push_front(make_pair(key, decoded));
+            shard.entries[key] = shard.order.begin();
+            shard.bytes += decoded->bytes();
+            while(shard.bytes > shardCapacity && shard.order.size() > 1){
+                shard.bytes -= shard.order.back().second->bytes();
+                shard.entries.erase(shard.order.back().first);
+                shard.order.pop_back();
+            }
+        }
+    }
+    uint64_t offset = index - firstIndex[block];
+    size_t run = upper_bound(decoded->ends.begin(), decoded->ends.end(), offset) - decoded->ends.begin();
+    value = decoded->values[run];
+    return true;
+}
+
+TBStats Tablebase::stats() const{
+    TBStats stats;
+    stats.probes = 0;
+    stats.cacheHits = 0;
+    for(int i = 0; i < TB_CACHE_SHARDS; i++){
+        lock_guard<mutex> guard(shards[i].lock);
+        stats.probes += shards[i].probes;
+        stats.cacheHits += shards[i].hits;
+    }
+    stats.cacheMisses = stats.probes - stats.cacheHits;
+    stats.slices = (int)slices.size();
+    return stats;
+}
+
+Tablebase& sharedTablebase(){
+    static Tablebase tablebase;
+    return tablebase;
+}
@@ -0,0 +1,172 @@
+// @file tablebase.h
+// @brief endgame tablebase slices: perfect indexing of the positions with given piece counts, the
+//        slice files the tbgen tool writes and the compressed, memory-mapped files the game probes
+
+#ifndef TABLEBASE_H
+#define TABLEBASE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+#include "rules.h"
+
+const int TB_MAX_PIECES = 8;
+const uint32_t TB_BLOCK_BYTES = 4096;       // size of a compressed block
+const int TB_CACHE_SHARDS = 16;
+const int DEFAULT_TB_CACHE_MB = 16;
+
+// A slice holds every position with the same piece counts and white to move. Black-to-move positions
+// are looked up in the colour-swapped slice after turning the board around (flipPosition).
+struct TBSlice{
+    int whiteMen;
+    int whiteKings;
+    int blackMen;
+    int blackKings;
+};
+
+// One byte per position: 0 is a draw, otherwise plies to the end of the game + 1. An odd byte (even
+// plies) is a loss for the side to move, an even byte a win. Without distances every win is stored
+// as 2 and every loss as 1.
+const uint8_t TB_DRAW = 0;
+const uint8_t TB_LOSS = 1;
+const uint8_t TB_WIN = 2;
+
+inline bool tbIsWin(uint8_t value){ return value && value % 2 == 0; }
+inline bool tbIsLoss(uint8_t value){ return value % 2 == 1; }
+inline int tbPlies(uint8_t value){ return value - 1; }
+
+/// @brief header of a slice file, followed by one value byte per index
+struct TBFileHeader{
+    char magic[4];              // "DTB1"
+    uint8_t counts[4];          // white men, white kings, black men, black kings
+    uint8_t distances;          // 1 if the values hold exact distances, 0 for win / loss / draw only
+    uint8_t reserved[7];
+    uint64_t size;              // number of positions
+};
+
+/// @brief header of a compressed slice file (.cdb). It is followed by the index of the first
+///        position of each block (blockCount uint64_t) and the blocks, TB_BLOCK_BYTES each. A block
+///        is a run of tokens: 0x00..0x7F is followed by that many + 1 literal values (packed four to
+///        a byte, low bits first, in a file without distances), 0x80..0xFE by one value repeated
+///        token - 0x80 + 3 times, 0xFF by a value and its repeat count as a varint.
+struct TBCompressedHeader{
+    char magic[4];              // "DCB1"
+    uint8_t counts[4];
+    uint8_t distances;
+    uint8_t reserved[3];
+    uint32_t blockBytes;
+    uint64_t size;
+    uint64_t blockCount;
+};
+
+inline bool operator==(const TBSlice& a, const TBSlice& b){
+    return a.whiteMen == b.whiteMen && a.whiteKings == b.whiteKings &&
+           a.blackMen == b.blackMen && a.blackKings == b.blackKings;
+}
+inline bool operator!=(const TBSlice& a, const TBSlice& b){ return !(a == b); }
+
+/// @brief returns the piece counts of a position, read as if white were to move
+TBSlice sliceOf(const Position& pos);
+
+/// @brief returns the slice with the colours swapped, where the black-to-move positions of a slice live
+TBSlice swapColours(const TBSlice& slice);
+
+/// @brief returns the number of pieces of a slice
+inline int slicePieces(const TBSlice& slice){
+    return slice.whiteMen + slice.whiteKings + slice.blackMen + slice.blackKings;
+}
+
+/// @brief returns a file name for a slice, e.g. "w21b03" for two white men and a white king
+///        against three black kings
+std::string sliceName(const TBSlice& slice);
+
+/// @brief returns the number of positions in a slice
+uint64_t sliceSize(const TBSlice& slice);
+
+/// @brief returns the index of a white-to-move position in its slice (sliceOf(pos))
+uint64_t positionIndex(const TBSlice& slice, const Position& pos);
+
+/// @brief returns the position at an index of a slice, the inverse of positionIndex
+Position positionAt(const TBSlice& slice, uint64_t index);
+
+/// @brief turns the board around and swaps the colours and the side to move; the result is the same
+///        game seen from the other side, so a black-to-move position becomes a white-to-move one
+Position flipPosition(const Position& pos);
+
+/// @brief lists every slice of up to a number of pieces in which both sides have a piece, in the
+///        order they can be solved: fewer pieces first, then fewer men (promotion turns a man into
+///        a king), a slice next to its colour-swapped twin
+/// @param pieces the largest number of pieces
+std::vector<TBSlice> listSlices(int pieces);
+
+/// @brief reads a slice file written by tbgen
+/// @param path,slice,values,distances the file, the slice it must hold, and what it holds
+/// @return false if the file is missing, damaged or holds another slice
+bool readSliceFile(const std::string& path, const TBSlice& slice, std::vector<uint8_t>& values, bool& distances);
+
+/// @brief writes a slice file through a temporary file, so an interrupted run never leaves half a file
+bool writeSliceFile(const std::string& path, const TBSlice& slice, const uint8_t* values, uint64_t size, bool distances);
+
+/// @brief compresses slice values into a .cdb file, through a temporary file like writeSliceFile
+/// @return the size of the file, 0 if it could not be written
+uint64_t writeCompressedSlice(const std::string& path, const TBSlice& slice, const uint8_t* values, uint64_t size, bool distances);
+
+/// @brief probe counters; every probe of a loaded slice is answered, from the cache or by decoding
+struct TBStats{
+    uint64_t probes;
+    uint64_t cacheHits;
+    uint64_t cacheMisses;       // blocks decoded
+    int slices;                 // slice files open
+
+    double cacheHitRate() const { return probes ? (double)cacheHits / probes : 0; }
+};
+
+struct TBMappedSlice;           // tablebase.cpp
+struct TBCacheShard;
+
+/// @brief the compressed slices of a directory, memory-mapped so nothing is read until it is probed.
+///        Decoded blocks are kept in a cache split into shards by block, each with its own lock and
+///        least-recently-used order, so search threads rarely wait for each other.
+class Tablebase{
+public:
+    Tablebase();
+    ~Tablebase();
+    Tablebase(const Tablebase&) = delete;
+    Tablebase& operator=(const Tablebase&) = delete;
+
+    /// @brief maps every .cdb file of a directory; opening again replaces what was open
+    /// @param dir,cacheMegabytes the directory and the memory decoded blocks may use
+    /// @return the number of slices found
+    int open(const std::string& dir, size_t cacheMegabytes);
+
+    /// @brief unmaps every slice and empties the cache; not to be called while a search runs
+    void close();
+
+    /// @brief the most pieces of a position that may be in the tablebase, 0 when nothing is open
+    int pieces() const { return maxPieces; }
+
+    /// @brief true if every open slice stores exact distances
+    bool hasDistances() const { return distances; }
+
+    /// @brief looks a position up; safe to call from many threads
+    /// @param pos,value the position and its value for the side to move (TB_DRAW, or see tbIsWin)
+    /// @return false if its slice is not open
+    bool probe(const Position& pos, uint8_t& value);
+
+    TBStats stats() const;
+
+private:
+    std::vector<std::unique_ptr<TBMappedSlice>> slices;
+    int sliceNumber[TB_MAX_PIECES + 1][TB_MAX_PIECES + 1][TB_MAX_PIECES + 1][TB_MAX_PIECES + 1];
+    std::unique_ptr<TBCacheShard[]> shards;
+    size_t shardCapacity = 0;   // bytes of decoded blocks per shard
+    int maxPieces = 0;
+    bool distances = true;
+};
+
+/// @brief the process-wide tablebase the search probes
+Tablebase& sharedTablebase();
+
+#endif
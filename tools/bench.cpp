@@ -0,0 +1,310 @@
+// @file bench.cpp
+// @brief headless benchmarks of the rules engine and the computer opponent
+// @usage bench [depth]            positions per second of the move generator
+//        bench search [seconds] [tbdir]   depth and nodes per second the search reaches per move,
+//                                         probing the tablebase in tbdir if one is given
+//        bench smp [threads] [depth]  time-to-depth with 1 thread and with N threads, and the scaling
+//        bench cancel [rounds]    how long the engine worker takes to go idle after cancel()
+//        bench journal [moves]    how fast moves can be journaled and how many each sync covers
+//        bench games [count]      random games played through the headless game core, with its events
+//        bench book [file]        how long the engine takes to answer along the book line from the opening
+
+#include <iostream>
+#include <cstdlib>
+#include <cstring>
+#include <chrono>
+#include <cmath>
+#include <thread>
+#include <vector>
+#include <algorithm>
+#include "rules.h"
+#include "search.h"
+#include "engine.h"
+#include "journal.h"
+#include "book.h"
+#include "gamecore.h"
+
+using namespace std;
+
+// middle-game and endgame positions the search benchmark thinks about
+static const char* BENCH_POSITIONS[] = {
+    "W:W21-32:B1-12",
+    "W:W18,21,22,23,24,25,26,27,28,30,31:B1,2,3,5,6,7,9,10,11,12,14",
+    "B:W17,19,21,22,24,26,27,29,30,31:B1,2,3,6,7,9,10,11,13,15",
+    "W:W14,18,23,27,K31:B2,5,11,K20",
+    "B:WK3,22,26:B9,K17,19",
+};
+
+/// @brief visits every position up to a depth, generating and playing every legal move
+/// @param pos,depth the position to start from and the number of plies to go
+/// @return the number of positions visited
+static long long walk(const Position& pos, int depth){
+    MoveList moves;
+    generateMoves(pos, moves);
+    long long visited = 1;
+    if(depth == 0)
+        return visited;
+    for(const Move& m : moves)
+        visited += walk(applyMove(pos, m), depth - 1);
+    return visited;
+}
+
+static int benchMovegen(int depth){
+    auto start = chrono::steady_clock::now();
+    long long visited = walk(startPosition(), depth);
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+    cout << "movegen depth " << depth << ": " << visited << " positions in " << seconds << " s, "
+         << (long long)(visited / (seconds > 0 ? seconds : 1e-9)) << " positions/s" << endl;
+    return 0;
+}
+
+static int benchSearch(double seconds, const char* tbDir){
+    if(tbDir){
+        sharedTablebase().open(tbDir, DEFAULT_TB_CACHE_MB);
+        cout << "tablebase " << tbDir << ": " << sharedTablebase().stats().slices << " slices, up to "
+             << sharedTablebase().pieces() << " pieces" << endl;
+    }
+    SearchLimits limits;
+    limits.seconds = seconds;
+    uint64_t nodes = 0;
+    double time = 0;
+    int depths = 0, count = 0;
+    for(const char* fen : BENCH_POSITIONS){
+        Position pos;
+        if(!parseFen(fen, pos)){
+            cerr << "Error: bad bench position " << fen << endl;
+            return 1;
+        }
+        SearchResult result = searchPosition(pos, limits);
+        cout << fen << "  " << moveToString(result.best) << "  depth " << result.depth << "  score "
+             << result.score << "  nodes " << result.nodes << "  " << result.seconds << " s";
+        if(result.tbHits)
+            cout << "  tb hits " << result.tbHits;
+        cout << endl;
+        nodes += result.nodes;
+        time += result.seconds;
+        depths += result.depth;
+        count++;
+    }
+    cout << "average depth " << (double)depths / count << ", " << (uint64_t)(nodes / (time > 0 ? time : 1e-9))
+         << " nodes/s" << endl;
+    TTStats table = sharedTable().stats();
+    cout << "hash " << sharedTable().sizeMb() << " MB: " << table.probes << " probes, "
+         << (table.probes ? 100.0 * table.hits / table.probes : 0.0) << "% hits, "
+         << table.fillPermille / 10.0 << "% full" << endl;
+    if(tbDir){
+        TBStats tb = sharedTablebase().stats();
+        cout << "tablebase: " << tb.probes << " probes, " << 100.0 * tb.cacheHitRate() << "% from the block cache, "
+             << tb.cacheMisses << " blocks decoded" << endl;
+    }
+    return 0;
+}
+
+/// @brief searches every bench position to a fixed depth with a cleared table and returns the seconds
+static double timeToDepth(const Position& pos, int depth, int threads, SearchResult& result){
+    SearchLimits limits;
+    limits.seconds = 1e9;
+    limits.maxDepth = depth;
+    limits.threads = threads;
+    sharedTable().clear();
+    result = searchPosition(pos, limits);
+    return result.seconds;
+}
+
+static int benchSmp(int threads, int depth){
+    double logSpeedup = 0;
+    int count = 0;
+    cout << "time to depth " << depth << ", 1 thread vs " << threads << " threads" << endl;
+    for(const char* fen : BENCH_POSITIONS){
+        Position pos;
+        parseFen(fen, pos);
+        SearchResult single, multi;
+        double one = timeToDepth(pos, depth, 1, single);
+        double many = timeToDepth(pos, depth, threads, multi);
+        // forced wins end the search before the depth: they say nothing about scaling
+        if(single.depth < depth || one < 0.01)
+            continue;
+        double speedup = one / (many > 0 ? many : 1e-9);
+        cout << fen << "  " << one << " s -> " << many << " s  x" << speedup
+             << "  nps " << (uint64_t)(single.nodes / one) << " -> " << (uint64_t)(multi.nodes / many) << endl;
+        logSpeedup += log(speedup);
+        count++;
+    }
+    if(count == 0){
+        cout << "no position reached the depth, try a higher one" << endl;
+        return 1;
+    }
+    double speedup = exp(logSpeedup / count);
+    cout << "speedup x" << speedup << " (geometric mean), efficiency " << 100.0 * speedup / threads << "%" << endl;
+    return 0;
+}
+
+/// @brief cancels searches at varying points and measures how long the worker takes to go idle
+static int benchCancel(int rounds){
+    typedef chrono::steady_clock Clock;
+    EngineWorker engine;
+    vector<double> latencies;
+    for(int i = 0; i < rounds; i++){
+        Position pos;
+        parseFen(BENCH_POSITIONS[i % (sizeof(BENCH_POSITIONS) / sizeof(BENCH_POSITIONS[0]))], pos);
+        SearchLimits limits;
+        limits.seconds = 60;
+        limits.threads = (int)thread::hardware_concurrency();
+        engine.submit(pos, limits);
+        this_thread::sleep_for(chrono::milliseconds(20 + (i * 37) % 80));
+        Clock::time_point start = Clock::now();
+        engine.cancel();
+        while(engine.waiting())
+            this_thread::yield();
+        latencies.push_back(chrono::duration<double, milli>(Clock::now() - start).count());
+    }
+    sort(latencies.begin(), latencies.end());
+    cout << "cancel latency over " << rounds << " searches: median " << latencies[rounds / 2]
+         << " ms, p99 " << latencies[rounds * 99 / 100] << " ms, worst " << latencies.back() << " ms" << endl;
+    return 0;
+}
+
+/// @brief plays random games as fast as the rules allow, journaling every move like the game does
+static int benchJournal(int moves){
+    typedef chrono::steady_clock Clock;
+    const char* path = "bench.journal";
+    MoveJournal journal;
+    journal.open(path);
+    SavedGame game;
+    game.start = game.position = startPosition();
+    journal.begin(game);
+
+    uint64_t seed = 0x9E3779B97F4A7C15ull;
+    vector<float> latencies;
+    latencies.reserve(moves);
+    MoveList list;
+    Clock::time_point start = Clock::now();
+    for(int i = 0; i < moves; i++){
+        generateMoves(game.position, list);
+        if(list.empty()){
+            game.start = game.position = startPosition();
+            game.history.clear();
+            journal.begin(game);
+            generateMoves(game.position, list);
+        }
+        seed ^= seed << 13;
+        seed ^= seed >> 7;
+        seed ^= seed << 17;
+        const Move& played = list[(int)(seed % (uint64_t)list.size())];
+        Clock::time_point before = Clock::now();
+        journal.appendMove(game.position, played);
+        latencies.push_back(chrono::duration<float, micro>(Clock::now() - before).count());
+        game.position = applyMove(game.position, played);
+        game.history.push_back(played);
+    }
+    double appending = chrono::duration<double>(Clock::now() - start).count();
+    journal.flush();
+    double total = chrono::duration<double>(Clock::now() - start).count();
+    JournalStats stats = journal.stats();
+    sort(latencies.begin(), latencies.end());
+
+    SavedGame replayed;
+    bool same = readJournal(path, replayed) && samePosition(replayed.position, game.position) &&
+                replayed.history.size() == game.history.size();
+    remove(path);
+    cout << moves << " moves journaled in " << appending << " s (" << (uint64_t)(moves / appending)
+         << " moves/sec), on disk after " << total << " s" << endl;
+    cout << "append latency: median " << latencies[moves / 2] << " us, p99 " << latencies[(size_t)moves * 99 / 100]
+         << " us, worst " << latencies.back() << " us" << endl;
+    cout << stats.syncs << " syncs, " << stats.recordsPerSync() << " records per sync (largest batch "
+         << stats.largestBatch << "), " << stats.bytes << " bytes written" << endl;
+    cout << "replay of the last game: " << (same ? "matches" : "DIFFERS") << endl;
+    return same ? 0 : 1;
+}
+
+/// @brief plays random games through the game core, the way a front end would with a listener
+///        counting the events, to show how fast games run without a window or sound
+static int benchGames(int count){
+    typedef chrono::steady_clock Clock;
+    uint64_t counts[gameWon + 1] = {};
+    GameEvents events;
+    events.subscribe([&counts](const GameEvent& event){
+        counts[event.type]++;
+    });
+    uint64_t seed = 0x2545F4914F6CDD1Dull;
+    uint64_t unfinished = 0;
+    MoveList list;
+    GameState game;
+    Clock::time_point start = Clock::now();
+    for(int i = 0; i < count; i++){
+        startGame(game, startPosition());
+        for(int ply = 0; ply < 200 && !game.winner; ply++){
+            generateMoves(game.position, list);
+            seed ^= seed << 13;
+            seed ^= seed >> 7;
+            seed ^= seed << 17;
+            playMove(game, list[(int)(seed % (uint64_t)list.size())], events);
+        }
+        unfinished += !game.winner;
+    }
+    double seconds = chrono::duration<double>(Clock::now() - start).count();
+    cout << count << " games (" << unfinished << " stopped at 200 plies) in " << seconds << " s: "
+         << (uint64_t)(count / seconds) << " games/sec, " << (uint64_t)(counts[gameMoved] / seconds) << " moves/sec" << endl;
+    cout << "events: " << counts[gameMoved] << " moved, " << counts[gameCaptured] << " captured, "
+         << counts[gamePromoted] << " promoted, " << counts[gameWon] << " won" << endl;
+    return 0;
+}
+
+/// @brief asks the engine worker for a move from the opening on, the way the game does, as long as
+///        the book answers, and times each answer from submit() to poll()
+static int benchBook(const char* path){
+    typedef chrono::steady_clock Clock;
+    if(!sharedBook().open(path)){
+        cerr << "no opening book in " << path << endl;
+        return 1;
+    }
+    cout << "book " << path << ": " << sharedBook().size() << " moves from " << sharedBook().games() << " games" << endl;
+    EngineWorker engine;
+    vector<double> latencies;
+    for(int round = 0; round < 100; round++){
+        Position pos = startPosition();
+        while(true){
+            SearchLimits limits;
+            limits.seconds = 1;
+            Clock::time_point start = Clock::now();
+            engine.submit(pos, limits);
+            EngineResponse response;
+            while(!engine.poll(response))
+                this_thread::yield();
+            double ms = chrono::duration<double, milli>(Clock::now() - start).count();
+            if(!response.result.bookMove)
+                break;
+            latencies.push_back(ms);
+            if(round == 0)
+                cout << moveToString(response.result.best) << " ";
+            pos = applyMove(pos, response.result.best);
+        }
+    }
+    if(latencies.empty()){
+        cout << "the opening is not in the book" << endl;
+        return 1;
+    }
+    sort(latencies.begin(), latencies.end());
+    cout << endl << latencies.size() / 100 << " book moves a game, answered in: median " << latencies[latencies.size() / 2]
+         << " ms, p99 " << latencies[latencies.size() * 99 / 100] << " ms, worst " << latencies.back() << " ms" << endl;
+    return 0;
+}
+
+int main(int argc, char** argv){
+    if(argc > 1 && strcmp(argv[1], "cancel") == 0)
+        return benchCancel(argc > 2 && atoi(argv[2]) > 0 ? atoi(argv[2]) : 50);
+    if(argc > 1 && strcmp(argv[1], "smp") == 0){
+        int threads = argc > 2 ? atoi(argv[2]) : (int)thread::hardware_concurrency();
+        return benchSmp(threads > 0 ? threads : 1, argc > 3 ? atoi(argv[3]) : 14);
+    }
+    if(argc > 1 && strcmp(argv[1], "journal") == 0)
+        return benchJournal(argc > 2 && atoi(argv[2]) > 0 ? atoi(argv[2]) : 100000);
+    if(argc > 1 && strcmp(argv[1], "games") == 0)
+        return benchGames(argc > 2 && atoi(argv[2]) > 0 ? atoi(argv[2]) : 100000);
+    if(argc > 1 && strcmp(argv[1], "book") == 0)
+        return benchBook(argc > 2 ? argv[2] : "opening.book");
+    if(argc > 1 && strcmp(argv[1], "search") == 0)
+        return benchSearch(argc > 2 ? atof(argv[2]) : 1.0, argc > 3 ? argv[3] : nullptr);
+    return benchMovegen(argc > 1 ? atoi(argv[1]) : 9);
+}
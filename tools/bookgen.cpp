@@ -0,0 +1,218 @@
+// @file bookgen.cpp
+// @brief headless opening book generator: counts how the moves of the first plies of finished games
+//        did, from PDN archives or self-play logs, and writes the book the engine maps
+// @usage bookgen OUT FILE... [--plies N] [--min-games N] [--threads N]
+//        every thread reads its share of the games into its own hash maps, one per range of keys;
+//        the maps of a range are then merged and sorted, and the ranges written one after another
+
+#include <iostream>
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <chrono>
+#include <fstream>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include "rules.h"
+#include "pdn.h"
+#include "book.h"
+
+using namespace std;
+
+typedef chrono::steady_clock Clock;
+
+struct BookKey{
+    uint64_t key;
+    uint32_t captures;
+    uint8_t from;
+    uint8_t to;
+
+    bool operator==(const BookKey& other) const{
+        return key == other.key && captures == other.captures && from == other.from && to == other.to;
+    }
+};
+
+struct BookKeyHash{
+    size_t operator()(const BookKey& k) const{
+        // the Zobrist key is random already; the move only has to tell the moves of a position apart
+        return (size_t)(k.key ^ ((uint64_t)k.from << 40 | (uint64_t)k.to << 32 | k.captures) * 0x9E3779B97F4A7C15ull);
+    }
+};
+
+struct BookCounts{
+    uint32_t games = 0;
+    uint32_t wins = 0;
+    uint32_t draws = 0;
+    uint32_t losses = 0;
+};
+
+typedef unordered_map<BookKey, BookCounts, BookKeyHash> BookShard;
+
+/// @brief a byte range of one archive, read by one thread
+struct BookPart{
+    const string* path;
+    uint64_t begin;
+    uint64_t end;
+};
+
+/// @brief what one thread gathered, in BOOK_SHARDS maps so the merge can be split by key range
+struct BookWorker{
+    vector<BookShard> shards = vector<BookShard>(BOOK_SHARDS);
+    uint64_t games = 0;
+    uint64_t skipped = 0;       // unfinished games, they say nothing about the moves
+};
+
+static int shardOf(uint64_t key){
+    return (int)(key >> 58);
+}
+
+static void countParts(const vector<BookPart>& parts, atomic<size_t>& nextPart, int plies, BookWorker& worker){
+    PdnGame game;
+    for(size_t part = nextPart++; part < parts.size(); part = nextPart++){
+        PdnReader reader;
+        if(!reader.open(*parts[part].path, parts[part].begin, parts[part].end))
+            continue;
+        while(reader.next(game)){
+            if(game.result == pdnUnfinished){
+                worker.skipped++;
+                continue;
+            }
+            worker.games++;
+            Position pos = game.start;
+            int counted = min((int)game.moves.size(), plies);
+            for(int ply = 0; ply < counted; ply++){
+                const Move& played = game.moves[ply];
+                BookCounts& counts = worker.shards[shardOf(pos.hash)][{pos.hash, played.captures, played.from, played.to}];
+                counts.games++;
+                if(game.result == pdnDraw)
+                    counts.draws++;
+                else if((game.result == pdnPlayerOneWins) == pos.whiteToMove)
+                    counts.wins++;
+                else
+                    counts.losses++;
+                pos = applyMove(pos, played);
+            }
+        }
+    }
+}
+
+/// @brief merges one key range of every worker into sorted records
+static void mergeShards(vector<BookWorker>& workers, atomic<int>& nextShard, uint32_t minGames,
+                        vector<vector<BookRecord>>& sorted){
+    for(int shard = nextShard++; shard < BOOK_SHARDS; shard = nextShard++){
+        BookShard& total = workers[0].shards[shard];
+        for(size_t i = 1; i < workers.size(); i++){
+            for(const auto& entry : workers[i].shards[shard]){
+                BookCounts& counts = total[entry.first];
+                counts.games += entry.second.games;
+                counts.wins += entry.second.wins;
+                counts.draws += entry.second.draws;
+                counts.losses += entry.second.losses;
+            }
+            BookShard().swap(workers[i].shards[shard]);
+        }
+        vector<BookRecord>& records = sorted[shard];
+        for(const auto& entry : total){
+            if(entry.second.games < minGames)
+                continue;
+            BookRecord record;
+            record.key = entry.first.key;
+            record.captures = entry.first.captures;
+            record.from = entry.first.from;
+            record.to = entry.first.to;
+            record.reserved = 0;
+            record.games = entry.second.games;
+            record.wins = entry.second.wins;
+            record.draws = entry.second.draws;
+            record.losses = entry.second.losses;
+            records.push_back(record);
+        }
+        BookShard().swap(total);
+        sort(records.begin(), records.end(), bookRecordLess);
+    }
+}
+
+int main(int argc, char** argv){
+    vector<string> args;
+    int threads = 1;
+    int plies = 20;
+    uint32_t minGames = 2;
+    for(int i = 1; i < argc; i++){
+        if(strcmp(argv[i], "--threads") == 0 && i + 1 < argc)
+            threads = max(1, atoi(argv[++i]));
+        else if(strcmp(argv[i], "--plies") == 0 && i + 1 < argc)
+            plies = max(1, atoi(argv[++i]));
+        else if(strcmp(argv[i], "--min-games") == 0 && i + 1 < argc)
+            minGames = (uint32_t)max(1, atoi(argv[++i]));
+        else
+            args.push_back(argv[i]);
+    }
+    if(args.size() < 2){
+        cerr << "usage: bookgen OUT FILE... [--plies N] [--min-games N] [--threads N]" << endl;
+        return 2;
+    }
+    const string& out = args[0];
+    Clock::time_point start = Clock::now();
+
+    // every file is cut at game boundaries so the threads share a single big archive as well
+    vector<BookPart> parts;
+    for(size_t i = 1; i < args.size(); i++){
+        vector<uint64_t> starts = splitPdnFile(args[i], threads);
+        for(size_t j = 0; j + 1 < starts.size(); j++)
+            parts.push_back({&args[i], starts[j], starts[j + 1]});
+    }
+    vector<BookWorker> workers(threads);
+    vector<thread> pool;
+    atomic<size_t> nextPart(0);
+    for(int i = 0; i < threads; i++)
+        pool.emplace_back(countParts, cref(parts), ref(nextPart), plies, ref(workers[i]));
+    for(thread& worker : pool)
+        worker.join();
+    double counting = chrono::duration<double>(Clock::now() - start).count();
+
+    vector<vector<BookRecord>> sorted(BOOK_SHARDS);
+    pool.clear();
+    atomic<int> nextShard(0);
+    for(int i = 0; i < threads; i++)
+        pool.emplace_back(mergeShards, ref(workers), ref(nextShard), minGames, ref(sorted));
+    for(thread& worker : pool)
+        worker.join();
+
+    // a shard holds one range of the top bits of the key, so the shards in order are the book in order
+    BookHeader header;
+    memcpy(header.magic, "DBK1", 4);
+    header.version = BOOK_VERSION;
+    header.recordSize = sizeof(BookRecord);
+    header.records = 0;
+    header.games = 0;
+    header.plies = (uint32_t)plies;
+    header.minGames = minGames;
+    uint64_t skipped = 0;
+    for(const BookWorker& worker : workers){
+        header.games += worker.games;
+        skipped += worker.skipped;
+    }
+    for(const vector<BookRecord>& records : sorted)
+        header.records += records.size();
+    string temporary = out + ".tmp";
+    ofstream file(temporary, ios::binary | ios::trunc);
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    for(const vector<BookRecord>& records : sorted)
+        file.write(reinterpret_cast<const char*>(records.data()), records.size() * sizeof(BookRecord));
+    file.close();
+    remove(out.c_str());
+    if(!file || rename(temporary.c_str(), out.c_str()) != 0){
+        cerr << "cannot write " << out << endl;
+        return 1;
+    }
+    double seconds = chrono::duration<double>(Clock::now() - start).count();
+    cout << header.games << " games (" << skipped << " unfinished skipped), first " << plies << " plies: "
+         << header.records << " moves played in at least " << minGames << " games" << endl;
+    cout << out << ": " << sizeof(header) + header.records * sizeof(BookRecord) << " bytes in " << seconds
+         << " s (counting " << counting << " s) on " << threads << " thread(s)" << endl;
+    return 0;
+}
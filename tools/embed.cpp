@@ -0,0 +1,56 @@
+// @file embed.cpp
+// @brief writes the header that compiles asset files into the game (EMBED_ASSETS=TRUE in the
+//        Makefile): one byte array per file and the EMBEDDED_ASSETS table that assets.cpp looks in
+// @usage embed OUT.h FILE...
+
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+int main(int argc, char** argv){
+    if(argc < 3){
+        cerr << "usage: embed OUT.h FILE..." << endl;
+        return 2;
+    }
+    string text = "// @file " + string(argv[1]) + "\n// @brief written by tools/embed.cpp, do not edit\n\n";
+    string table = "static const EmbeddedAsset EMBEDDED_ASSETS[] = {\n";
+    size_t total = 0;
+    for(int i = 2; i < argc; i++){
+        ifstream in(argv[i], ios::binary);
+        vector<char> bytes((istreambuf_iterator<char>(in)), istreambuf_iterator<char>());
+        if(bytes.empty()){
+            cerr << argv[i] << ": cannot read, or empty" << endl;
+            return 1;
+        }
+        string array = "embeddedAsset" + to_string(i - 2);
+        text += "static const unsigned char " + array + "[] = {";
+        for(size_t at = 0; at < bytes.size(); at++){
+            if(at)
+                text += ",";
+            if(at % 20 == 0)
+                text += "\n    ";
+            text += to_string((unsigned char)bytes[at]);
+        }
+        text += "\n};\n\n";
+        // the name is looked up with forward slashes on every system
+        string name = argv[i];
+        for(char& c : name){
+            if(c == '\\')
+                c = '/';
+        }
+        table += "    {\"" + name + "\", " + array + ", " + to_string(bytes.size()) + "},\n";
+        total += bytes.size();
+    }
+    text += table + "};\n";
+    ofstream out(argv[1], ios::binary);
+    if(!out.write(text.data(), text.size())){
+        cerr << argv[1] << ": cannot write" << endl;
+        return 1;
+    }
+    cout << "embedded " << argc - 2 << " files, " << total << " bytes, in " << argv[1] << endl;
+    return 0;
+}
@@ -0,0 +1,317 @@
+// @file hub.cpp
+// @brief headless engine speaking a Hub-style line protocol on stdin/stdout, for draughts GUIs,
+//        testers and scripts that run many engines at once
+// @usage hub    then, one command per line (values with spaces are quoted):
+//        hub                               -> id ..., param ..., wait
+//        init                              -> ready
+//        set-param name=N value=V          threads, hash (MB), book (file), tb (directory)
+//        new-game                          forgets what the transposition table learned, back to the start
+//        pos [pos=FEN] [moves="11-15 ..."] the start position (the opening without pos) and moves
+//        the opening is standard checkers: Black, on 1..12, moves first
+//        level [depth=N] [move-time=S] [time=S] [inc=S] [moves=N] [infinite]
+//        go [think|ponder|analyze]         -> info depth=... score=... nodes=... time=... nps=... pv="..."
+//                                             then done move=M [ponder=M]
+//        ponder-hit, stop                  the ponder move was played / answer now
+//        ping                              -> pong, at once, even while searching
+//        quit
+
+#include <iostream>
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+#include "rules.h"
+#include "search.h"
+#include "tt.h"
+#include "tablebase.h"
+#include "book.h"
+
+using namespace std;
+
+typedef vector<pair<string, string>> HubArgs;
+
+/// @brief the opening as standard checkers GUIs know it: the men of startPosition(), Black (1..12) to move
+static Position standardStart(){
+    Position pos = startPosition();
+    pos.whiteToMove = false;
+    pos.hash = computeHash(pos);
+    return pos;
+}
+
+/// @brief writes a line at once: a GUI must see an answer without waiting for a buffer to fill
+static void send(const string& line){
+    static mutex output;
+    lock_guard<mutex> guard(output);
+    fwrite(line.data(), 1, line.size(), stdout);
+    fputc('\n', stdout);
+    fflush(stdout);
+}
+
+static void sendError(const string& message){
+    send("error message=\"" + message + "\"");
+}
+
+/// @brief splits a line into its command and its name=value (or bare name) arguments
+static string parseLine(const string& line, HubArgs& args){
+    args.clear();
+    size_t at = 0;
+    auto skipSpaces = [&]{ while(at < line.size() && isspace((unsigned char)line[at])) at++; };
+    skipSpaces();
+    size_t start = at;
+    while(at < line.size() && !isspace((unsigned char)line[at]))
+        at++;
+    string command = line.substr(start, at - start);
+    while(skipSpaces(), at < line.size()){
+        start = at;
+        while(at < line.size() && line[at] != '=' && !isspace((unsigned char)line[at]))
+            at++;
+        string name = line.substr(start, at - start), value;
+        if(at < line.size() && line[at] == '='){
+            at++;
+            if(at < line.size() && line[at] == '"'){
+                size_t close = line.find('"', at + 1);
+                if(close == string::npos)
+                    close = line.size();
+                value = line.substr(at + 1, close - at - 1);
+                at = min(close + 1, line.size());
+            }else{
+                start = at;
+                while(at < line.size() && !isspace((unsigned char)line[at]))
+                    at++;
+                value = line.substr(start, at - start);
+            }
+        }
+        args.push_back(make_pair(name, value));
+    }
+    return command;
+}
+
+static const string* findArg(const HubArgs& args, const char* name){
+    for(const auto& arg : args){
+        if(arg.first == name)
+            return &arg.second;
+    }
+    return nullptr;
+}
+
+/// @brief what "level" set: how the next searches are limited
+struct HubLevel{
+    int depth = MAX_PLY - 1;
+    double moveTime = 0;        // seconds for each move, 0 to use the clock
+    double time = 0;            // time left on the clock
+    double increment = 0;
+    int moves = 0;              // moves to the next time control, 0 for the rest of the game
+    bool infinite = false;
+};
+
+/// @brief the one search that runs at a time, on its own thread so stdin is always read
+struct HubSearch{
+    thread worker;
+    atomic<bool> stop{false};
+    atomic<bool> pondering{false};
+    mutex lock;
+    condition_variable ponderDone;      // the answer of a ponder search waits for ponder-hit or stop
+    bool running = false;               // a search was started and not joined yet
+    atomic<bool> done{true};            // ... and it has sent its answer
+};
+
+static void finishSearch(HubSearch& search){
+    search.stop = true;
+    {
+        lock_guard<mutex> guard(search.lock);
+        search.pondering = false;
+    }
+    search.ponderDone.notify_all();
+    if(search.worker.joinable())
+        search.worker.join();
+    search.running = false;
+}
+
+static string pvText(const SearchResult& result){
+    string text;
+    for(int i = 0; i < result.pvLength; i++)
+        text += (i ? " " : "") + moveToString(result.pv[i]);
+    return text;
+}
+
+static void runSearch(HubSearch& search, Position pos, SearchLimits limits, TranspositionTable& table, bool ponder){
+    limits.stop = &search.stop;
+    limits.pondering = ponder ? &search.pondering : nullptr;
+    limits.onIteration = [](const SearchResult& progress){
+        char line[160];
+        snprintf(line, sizeof(line), "info depth=%d score=%d nodes=%llu time=%.3f nps=%.0f pv=\"", progress.depth,
+                 progress.score, (unsigned long long)progress.nodes, progress.seconds,
+                 progress.seconds > 0 ? progress.nodes / progress.seconds : 0.0);
+        send(line + pvText(progress) + "\"");
+    };
+    SearchResult result = searchPosition(pos, limits, table);
+    {
+        // a ponder search that ends by itself keeps its answer until the GUI wants it
+        unique_lock<mutex> guard(search.lock);
+        search.ponderDone.wait(guard, [&]{ return !search.pondering || search.stop; });
+    }
+    if(!result.hasMove){
+        send("done");
+        search.done = true;
+        return;
+    }
+    string done = "done move=" + moveToString(result.best);
+    if(result.pvLength >= 2 && sameMove(result.pv[0], result.best))
+        done += " ponder=" + moveToString(result.pv[1]);
+    send(done);
+    search.done = true;
+}
+
+/// @brief the seconds a move may take under the current level
+static double moveSeconds(const HubLevel& level, bool analyze){
+    if(level.infinite || analyze)
+        return 1e9;
+    if(level.moveTime > 0)
+        return level.moveTime;
+    if(level.time > 0){
+        // an even share of the clock, some of the increment, and never most of what is left
+        int movesLeft = level.moves > 0 ? level.moves : 30;
+        return min(level.time / movesLeft + 0.8 * level.increment, level.time * 0.5);
+    }
+    return 1.0;
+}
+
+int main(){
+    TranspositionTable table;
+    int threads = 1;
+    Position pos = standardStart();
+    HubLevel level;
+    HubSearch search;
+    HubArgs args;
+    string line;
+    while(getline(cin, line)){
+        string command = parseLine(line, args);
+        if(command.empty())
+            continue;
+        if(command == "hub"){
+            send("id name=dama version=1.0 author=\"DAMA developers\"");
+            send("param name=threads value=1 type=int min=1 max=64");
+            send("param name=hash value=" + to_string(DEFAULT_HASH_MB) + " type=int min=1 max=4096");
+            send("param name=book value=\"\" type=string");
+            send("param name=tb value=\"\" type=string");
+            send("wait");
+        }else if(command == "init"){
+            send("ready");
+        }else if(command == "ping"){
+            send("pong");
+        }else if(command == "quit"){
+            break;
+        }else if(command == "stop"){
+            finishSearch(search);
+        }else if(command == "ponder-hit"){
+            // the clock of the ponder search starts now, counted from when it began
+            lock_guard<mutex> guard(search.lock);
+            search.pondering = false;
+            search.ponderDone.notify_all();
+        }else if(search.running && command != "go"){
+            // the position and settings of a running search stay as they are
+            finishSearch(search);
+        }
+        if(command == "set-param"){
+            const string* name = findArg(args, "name");
+            const string* value = findArg(args, "value");
+            if(!name || !value)
+                sendError("set-param needs name and value");
+            else if(*name == "threads")
+                threads = min(max(atoi(value->c_str()), 1), 64);
+            else if(*name == "hash")
+                table.resize((size_t)min(max(atoi(value->c_str()), 1), 4096));
+            else if(*name == "book"){
+                if(value->empty())
+                    sharedBook().close();
+                else if(!sharedBook().open(*value))
+                    sendError("no opening book in " + *value);
+            }else if(*name == "tb"){
+                if(value->empty())
+                    sharedTablebase().close();
+                else if(sharedTablebase().open(*value, DEFAULT_TB_CACHE_MB) == 0)
+                    sendError("no tablebase in " + *value);
+            }else
+                sendError("unknown param " + *name);
+        }else if(command == "new-game"){
+            table.clear();
+            pos = standardStart();
+        }else if(command == "pos"){
+            const string* fen = findArg(args, "pos");
+            const string* moves = findArg(args, "moves");
+            Position next = standardStart();
+            if(fen && !parseFen(*fen, next)){
+                sendError("bad position " + *fen);
+                continue;
+            }
+            // a bad move leaves the position as it was
+            bool parsed = true;
+            if(moves){
+                size_t at = 0;
+                while(parsed && at < moves->size()){
+                    size_t end = moves->find(' ', at);
+                    if(end == string::npos)
+                        end = moves->size();
+                    string text = moves->substr(at, end - at);
+                    at = end + 1;
+                    Move move;
+                    if(text.empty())
+                        continue;
+                    if(!parseMove(next, text, move)){
+                        sendError("illegal move " + text);
+                        parsed = false;
+                        break;
+                    }
+                    next = applyMove(next, move);
+                }
+            }
+            if(parsed)
+                pos = next;
+        }else if(command == "level"){
+            level = HubLevel();
+            for(const auto& arg : args){
+                if(arg.first == "depth")
+                    level.depth = min(max(atoi(arg.second.c_str()), 1), MAX_PLY - 1);
+                else if(arg.first == "move-time")
+                    level.moveTime = atof(arg.second.c_str());
+                else if(arg.first == "time")
+                    level.time = atof(arg.second.c_str());
+                else if(arg.first == "inc")
+                    level.increment = atof(arg.second.c_str());
+                else if(arg.first == "moves")
+                    level.moves = atoi(arg.second.c_str());
+                else if(arg.first == "infinite")
+                    level.infinite = true;
+            }
+        }else if(command == "go"){
+            if(!search.done){
+                sendError("already searching");
+                continue;
+            }
+            finishSearch(search);
+            bool ponder = !args.empty() && args[0].first == "ponder";
+            bool analyze = !args.empty() && args[0].first == "analyze";
+            SearchLimits limits;
+            limits.seconds = moveSeconds(level, analyze);
+            limits.maxDepth = level.depth;
+            limits.threads = threads;
+            limits.useBook = !analyze;
+            search.stop = false;
+            search.pondering = ponder;
+            search.running = true;
+            search.done = false;
+            search.worker = thread(runSearch, ref(search), pos, limits, ref(table), ponder);
+        }else if(command != "hub" && command != "init" && command != "ping" && command != "stop" &&
+                 command != "ponder-hit"){
+            sendError("unknown command " + command);
+        }
+    }
+    finishSearch(search);
+    return 0;
+}
@@ -0,0 +1,350 @@
+// @file match.cpp
+// @brief headless engine-vs-engine matches: two search configurations play balanced pairs of games
+//        from a set of openings on every core, with a running Elo estimate and an SPRT
+// @usage match --a SPEC --b SPEC [--games N] [--concurrency N] [--openings FILE] [--pdn OUT]
+//              [--max-plies N] [--elo0 E] [--elo1 E] [--alpha A] [--beta B] [--book FILE] [--tb DIR]
+//        SPEC is a comma-separated list of name=..., time=SECONDS (per move), depth=N, hash=MB and
+//        book=0|1, e.g. "name=fast,time=0.02,hash=8". Every opening (a FEN per line, the positions
+//        two plies from the start without a file) is played twice, each configuration white once.
+
+#include <iostream>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include "rules.h"
+#include "search.h"
+#include "tt.h"
+#include "tablebase.h"
+#include "book.h"
+#include "gamecore.h"
+#include "pdn.h"
+
+using namespace std;
+
+typedef chrono::steady_clock Clock;
+
+/// @brief one side of the match
+struct EngineConfig{
+    string name;
+    double seconds = 0.05;
+    int maxDepth = MAX_PLY - 1;
+    int hashMb = 8;
+    bool useBook = true;
+};
+
+/// @brief the match so far, from the point of view of configuration A
+struct MatchScore{
+    int wins = 0;
+    int draws = 0;
+    int losses = 0;
+
+    int games() const { return wins + draws + losses; }
+    double score() const { return games() ? (wins + 0.5 * draws) / games() : 0.5; }
+    /// @brief variance of the result of one game
+    double variance() const{
+        if(!games())
+            return 0;
+        double s = score();
+        return (wins * (1 - s) * (1 - s) + draws * (0.5 - s) * (0.5 - s) + losses * s * s) / games();
+    }
+};
+
+static double eloOf(double score){
+    score = min(max(score, 1e-6), 1 - 1e-6);
+    return -400 * log10(1 / score - 1);
+}
+
+static double scoreOf(double elo){
+    return 1 / (1 + pow(10, -elo / 400));
+}
+
+/// @brief log-likelihood ratio of elo1 against elo0, in the usual normal approximation of the
+///        trinomial model: n/2 * (s1 - s0) * (2s - s0 - s1) / variance
+static double sprtLlr(const MatchScore& score, double elo0, double elo1){
+    double variance = score.variance();
+    if(variance <= 0)
+        return 0;
+    double s0 = scoreOf(elo0), s1 = scoreOf(elo1);
+    return 0.5 * score.games() * (s1 - s0) * (2 * score.score() - s0 - s1) / variance;
+}
+
+static bool parseConfig(const string& spec, EngineConfig& config){
+    stringstream items(spec);
+    string item;
+    while(getline(items, item, ',')){
+        size_t equals = item.find('=');
+        if(equals == string::npos)
+            return false;
+        string key = item.substr(0, equals), value = item.substr(equals + 1);
+        if(key == "name")
+            config.name = value;
+        else if(key == "time")
+            config.seconds = atof(value.c_str());
+        else if(key == "depth")
+            config.maxDepth = min(max(atoi(value.c_str()), 1), MAX_PLY - 1);
+        else if(key == "hash")
+            config.hashMb = max(atoi(value.c_str()), 1);
+        else if(key == "book")
+            config.useBook = value != "0";
+        else
+            return false;
+    }
+    return true;
+}
+
+/// @brief reads one FEN per line; empty lines and lines starting with # are skipped
+static bool readOpenings(const string& path, vector<Position>& openings){
+    ifstream in(path);
+    if(!in.is_open())
+        return false;
+    string line;
+    while(getline(in, line)){
+        while(!line.empty() && (line.back() == '\r' || line.back() == ' '))
+            line.pop_back();
+        if(line.empty() || line[0] == '#')
+            continue;
+        Position pos;
+        if(!parseFen(line, pos)){
+            cerr << "not a position: " << line << endl;
+            return false;
+        }
+        openings.push_back(pos);
+    }
+    return !openings.empty();
+}
+
+/// @brief every position two plies from the start, for a match without an openings file
+static void defaultOpenings(vector<Position>& openings){
+    MoveList first, second;
+    Position start = startPosition();
+    generateMoves(start, first);
+    for(const Move& a : first){
+        Position after = applyMove(start, a);
+        generateMoves(after, second);
+        for(const Move& b : second)
+            openings.push_back(applyMove(after, b));
+    }
+}
+
+/// @brief true once the position has come back for the third time since the last capture or man
+///        move; the keys of the game so far are in seen, the current one last
+static bool thirdRepetition(const vector<uint64_t>& seen){
+    int count = 0;
+    for(uint64_t key : seen)
+        count += key == seen.back();
+    return count >= 3;
+}
+
+/// @brief plays one game; a game that reaches maxPlies or repeats a position three times is a draw
+static int playGame(const Position& opening, const EngineConfig& white, const EngineConfig& black,
+                    TranspositionTable& whiteTable, TranspositionTable& blackTable, int maxPlies, GameState& game){
+    startGame(game, opening);
+    whiteTable.clear();
+    blackTable.clear();
+    vector<uint64_t> seen(1, opening.hash);
+    for(int ply = 0; !game.winner; ply++){
+        if(ply >= maxPlies || thirdRepetition(seen))
+            return pdnDraw;
+        bool whiteToMove = game.position.whiteToMove;
+        const EngineConfig& config = whiteToMove ? white : black;
+        SearchLimits limits;
+        limits.seconds = config.seconds;
+        limits.maxDepth = config.maxDepth;
+        limits.useBook = config.useBook;
+        SearchResult result = searchPosition(game.position, limits, whiteToMove ? whiteTable : blackTable);
+        if(!result.hasMove)
+            break;
+        bool irreversible = result.best.captures || !(game.position.kings & (1u << result.best.from));
+        playMove(game, result.best);
+        if(irreversible)
+            seen.clear();
+        seen.push_back(game.position.hash);
+    }
+    return game.winner == 1 ? pdnPlayerOneWins : pdnPlayerTwoWins;
+}
+
+/// @brief what the workers share: the next game to play and the running score
+struct Match{
+    EngineConfig a, b;
+    vector<Position> openings;
+    int games = 0;
+    int maxPlies = 200;
+    double elo0 = 0, elo1 = 10, alpha = 0.05, beta = 0.05;
+
+    atomic<int> nextGame{0};
+    atomic<bool> decided{false};
+    mutex lock;                 // guards everything below
+    MatchScore score;
+    FILE* pdn = nullptr;
+    string text;
+    Clock::time_point start;
+    Clock::time_point lastReport;
+    uint64_t plies = 0;
+};
+
+static void report(Match& match, bool last){
+    const MatchScore& score = match.score;
+    double seconds = chrono::duration<double>(Clock::now() - match.start).count();
+    double elo = eloOf(score.score());
+    double margin = 0;
+    if(score.games() > 1){
+        double error = 1.96 * sqrt(score.variance() / score.games());
+        margin = (eloOf(score.score() + error) - eloOf(score.score() - error)) / 2;
+    }
+    double llr = sprtLlr(score, match.elo0, match.elo1);
+    double lower = log(match.beta / (1 - match.alpha)), upper = log((1 - match.beta) / match.alpha);
+    printf("%s%d/%d games, %s vs %s: +%d =%d -%d  Elo %+.1f +/- %.1f  LLR %.2f (%.2f, %.2f)  %.0f games/min\n",
+           last ? "final: " : "", score.games(), match.games, match.a.name.c_str(), match.b.name.c_str(),
+           score.wins, score.draws, score.losses, elo, margin, llr, lower, upper, score.games() * 60 / max(seconds, 1e-9));
+    fflush(stdout);
+}
+
+/// @brief a worker of the pool: takes the next game until there are none left or the SPRT has decided
+static void playGames(Match& match){
+    TranspositionTable tableA, tableB;
+    tableA.resize(match.a.hashMb);
+    tableB.resize(match.b.hashMb);
+    GameState game;
+    PdnGame record;
+    for(int number = match.nextGame++; number < match.games && !match.decided; number = match.nextGame++){
+        // a pair of games shares its opening, each configuration white once
+        const Position& opening = match.openings[(number / 2) % match.openings.size()];
+        bool aWhite = number % 2 == 0;
+        const EngineConfig& white = aWhite ? match.a : match.b;
+        const EngineConfig& black = aWhite ? match.b : match.a;
+        int result = playGame(opening, white, black, aWhite ? tableA : tableB, aWhite ? tableB : tableA, match.maxPlies, game);
+
+        record.tags.clear();
+        record.setTag("Event", "match " + match.a.name + " vs " + match.b.name);
+        record.setTag("Round", to_string(number + 1));
+        // the engine's white moves first, which is Black in PDN
+        record.setTag("Black", white.name);
+        record.setTag("White", black.name);
+        record.start = opening;
+        record.moves = game.history;
+        record.result = result;
+
+        lock_guard<mutex> guard(match.lock);
+        if(result == pdnDraw)
+            match.score.draws++;
+        else if((result == pdnPlayerOneWins) == aWhite)
+            match.score.wins++;
+        else
+            match.score.losses++;
+        match.plies += game.history.size();
+        if(match.pdn){
+            match.text.clear();
+            writePdnGame(match.text, record);
+            fwrite(match.text.data(), 1, match.text.size(), match.pdn);
+        }
+        double llr = sprtLlr(match.score, match.elo0, match.elo1);
+        if(llr >= log((1 - match.beta) / match.alpha) || llr <= log(match.beta / (1 - match.alpha)))
+            match.decided = true;
+        if(Clock::now() - match.lastReport >= chrono::seconds(1)){
+            match.lastReport = Clock::now();
+            report(match, false);
+        }
+    }
+}
+
+int main(int argc, char** argv){
+    Match match;
+    match.a.name = "A";
+    match.b.name = "B";
+    match.games = 1000;
+    int concurrency = thread::hardware_concurrency() ? (int)thread::hardware_concurrency() : 1;
+    string openingsFile, pdnFile;
+    bool ok = argc > 1;
+    for(int i = 1; i < argc && ok; i++){
+        string arg = argv[i];
+        if(i + 1 >= argc){
+            ok = false;
+            break;
+        }
+        const char* value = argv[++i];
+        if(arg == "--a")
+            ok = parseConfig(value, match.a);
+        else if(arg == "--b")
+            ok = parseConfig(value, match.b);
+        else if(arg == "--games")
+            match.games = max(atoi(value), 1);
+        else if(arg == "--concurrency")
+            concurrency = max(atoi(value), 1);
+        else if(arg == "--openings")
+            openingsFile = value;
+        else if(arg == "--pdn")
+            pdnFile = value;
+        else if(arg == "--max-plies")
+            match.maxPlies = max(atoi(value), 1);
+        else if(arg == "--elo0")
+            match.elo0 = atof(value);
+        else if(arg == "--elo1")
+            match.elo1 = atof(value);
+        else if(arg == "--alpha")
+            match.alpha = atof(value);
+        else if(arg == "--beta")
+            match.beta = atof(value);
+        else if(arg == "--book")
+            ok = sharedBook().open(value);
+        else if(arg == "--tb")
+            ok = sharedTablebase().open(value, DEFAULT_TB_CACHE_MB) > 0;
+        else
+            ok = false;
+    }
+    if(!ok || match.elo1 <= match.elo0 || match.alpha <= 0 || match.beta <= 0){
+        cerr << "usage: match --a SPEC --b SPEC [--games N] [--concurrency N] [--openings FILE] [--pdn OUT]" << endl
+             << "             [--max-plies N] [--elo0 E] [--elo1 E] [--alpha A] [--beta B] [--book FILE] [--tb DIR]" << endl
+             << "SPEC: name=NAME,time=SECONDS,depth=N,hash=MB,book=0|1" << endl;
+        return 2;
+    }
+    if(!openingsFile.empty()){
+        if(!readOpenings(openingsFile, match.openings)){
+            cerr << "no openings in " << openingsFile << endl;
+            return 1;
+        }
+    }else{
+        defaultOpenings(match.openings);
+    }
+    match.games += match.games % 2;
+    if(!pdnFile.empty()){
+        match.pdn = fopen(pdnFile.c_str(), "wb");
+        if(!match.pdn){
+            cerr << "cannot write " << pdnFile << endl;
+            return 1;
+        }
+    }
+    cout << match.a.name << " vs " << match.b.name << ": " << match.games << " games from " << match.openings.size()
+         << " openings on " << concurrency << " thread(s), SPRT elo0 " << match.elo0 << " elo1 " << match.elo1
+         << " alpha " << match.alpha << " beta " << match.beta << endl;
+
+    match.start = match.lastReport = Clock::now();
+    vector<thread> pool;
+    for(int i = 0; i < concurrency; i++)
+        pool.emplace_back(playGames, ref(match));
+    for(thread& worker : pool)
+        worker.join();
+    if(match.pdn)
+        fclose(match.pdn);
+
+    report(match, true);
+    double llr = sprtLlr(match.score, match.elo0, match.elo1);
+    if(llr >= log((1 - match.beta) / match.alpha))
+        cout << "SPRT: H1 accepted, " << match.a.name << " is stronger by at least " << match.elo1 << " Elo" << endl;
+    else if(llr <= log(match.beta / (1 - match.alpha)))
+        cout << "SPRT: H0 accepted, " << match.a.name << " is not stronger by " << match.elo1 << " Elo" << endl;
+    else
+        cout << "SPRT: no decision after " << match.score.games() << " games" << endl;
+    cout << "average game " << (match.score.games() ? match.plies / match.score.games() : 0) << " plies" << endl;
+    return 0;
+}
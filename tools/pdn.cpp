@@ -0,0 +1,165 @@
+// @file pdn.cpp
+// @brief headless PDN tool: checks and rewrites game archives, in parallel over parts of the file
+// @usage pdn check FILE [--threads N]       reads every game, checking each move against the rules
+//        pdn convert IN OUT [--threads N]   rewrites the games that read whole in the game's PDN
+//        pdn random COUNT OUT               writes random legal games, to test and time the reader
+
+#include <iostream>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <chrono>
+#include <thread>
+#include <vector>
+#include <string>
+#include "rules.h"
+#include "pdn.h"
+
+using namespace std;
+
+/// @brief what one thread found in its part of the file
+struct PartResult{
+    uint64_t games = 0;
+    uint64_t moves = 0;
+    uint64_t rejected = 0;
+    vector<string> errors;      // the first few, with their offsets
+};
+
+static void readPart(const string& path, uint64_t begin, uint64_t end, const string& out, PartResult& result){
+    PdnReader reader;
+    if(!reader.open(path, begin, end))
+        return;
+    FILE* file = out.empty() ? nullptr : fopen(out.c_str(), "wb");
+    PdnGame game;
+    string text;
+    while(reader.next(game)){
+        result.games++;
+        result.moves += game.moves.size();
+        if(!game.error.empty()){
+            if(result.rejected++ < 10)
+                result.errors.push_back("offset " + to_string(game.offset) + ": " + game.error);
+            continue;
+        }
+        if(file){
+            writePdnGame(text, game);
+            if(text.size() >= PDN_BUFFER_BYTES){
+                fwrite(text.data(), 1, text.size(), file);
+                text.clear();
+            }
+        }
+    }
+    if(file){
+        fwrite(text.data(), 1, text.size(), file);
+        fclose(file);
+    }
+}
+
+/// @brief reads a file on several threads, each from a game boundary, and joins the parts in order
+static int readArchive(const string& path, const string& out, int threads){
+    typedef chrono::steady_clock Clock;
+    Clock::time_point start = Clock::now();
+    vector<uint64_t> starts = splitPdnFile(path, threads);
+    int parts = (int)starts.size() - 1;
+    vector<PartResult> results(parts);
+    vector<string> partFiles(parts);
+    vector<thread> workers;
+    for(int i = 0; i < parts; i++){
+        if(!out.empty())
+            partFiles[i] = parts == 1 ? out : out + ".part" + to_string(i);
+        workers.emplace_back(readPart, path, starts[i], starts[i + 1], partFiles[i], ref(results[i]));
+    }
+    for(thread& worker : workers)
+        worker.join();
+    double seconds = chrono::duration<double>(Clock::now() - start).count();
+
+    if(!out.empty() && parts > 1){
+        FILE* file = fopen(out.c_str(), "wb");
+        vector<char> block(PDN_BUFFER_BYTES);
+        for(const string& part : partFiles){
+            FILE* in = fopen(part.c_str(), "rb");
+            size_t got;
+            while(in && file && (got = fread(block.data(), 1, block.size(), in)) > 0)
+                fwrite(block.data(), 1, got, file);
+            if(in)
+                fclose(in);
+            remove(part.c_str());
+        }
+        if(file)
+            fclose(file);
+    }
+
+    PartResult total;
+    for(const PartResult& part : results){
+        total.games += part.games;
+        total.moves += part.moves;
+        total.rejected += part.rejected;
+        for(const string& error : part.errors)
+            cout << error << endl;
+    }
+    cout << total.games << " games (" << total.rejected << " rejected), " << total.moves << " moves in "
+         << seconds << " s: " << (uint64_t)(total.games / seconds) << " games/sec on " << parts << " thread(s)" << endl;
+    return total.rejected ? 1 : 0;
+}
+
+/// @brief plays random games and writes them
+static int randomGames(int count, const string& out){
+    FILE* file = fopen(out.c_str(), "wb");
+    if(!file){
+        cerr << "cannot write " << out << endl;
+        return 1;
+    }
+    uint64_t seed = 0x2545F4914F6CDD1Dull;
+    MoveList list;
+    PdnGame game;
+    string text;
+    for(int i = 0; i < count; i++){
+        game.tags.clear();
+        game.moves.clear();
+        game.setTag("Event", "random game " + to_string(i + 1));
+        game.setTag("White", "random");
+        game.setTag("Black", "random");
+        game.start = startPosition();
+        game.result = pdnDraw;
+        Position pos = game.start;
+        for(int ply = 0; ply < 200; ply++){
+            generateMoves(pos, list);
+            if(list.empty()){
+                game.result = pos.whiteToMove ? pdnPlayerTwoWins : pdnPlayerOneWins;
+                break;
+            }
+            seed ^= seed << 13;
+            seed ^= seed >> 7;
+            seed ^= seed << 17;
+            const Move& played = list[(int)(seed % (uint64_t)list.size())];
+            game.moves.push_back(played);
+            pos = applyMove(pos, played);
+        }
+        writePdnGame(text, game);
+        if(text.size() >= PDN_BUFFER_BYTES){
+            fwrite(text.data(), 1, text.size(), file);
+            text.clear();
+        }
+    }
+    fwrite(text.data(), 1, text.size(), file);
+    fclose(file);
+    return 0;
+}
+
+int main(int argc, char** argv){
+    vector<string> args;
+    int threads = 1;
+    for(int i = 1; i < argc; i++){
+        if(strcmp(argv[i], "--threads") == 0 && i + 1 < argc)
+            threads = max(1, atoi(argv[++i]));
+        else
+            args.push_back(argv[i]);
+    }
+    if(args.size() == 2 && args[0] == "check")
+        return readArchive(args[1], "", threads);
+    if(args.size() == 3 && args[0] == "convert")
+        return readArchive(args[1], args[2], threads);
+    if(args.size() == 3 && args[0] == "random")
+        return randomGames(atoi(args[1].c_str()), args[2]);
+    cerr << "usage: pdn check FILE [--threads N] | pdn convert IN OUT [--threads N] | pdn random COUNT OUT" << endl;
+    return 2;
+}
@@ -0,0 +1,137 @@
+// @file perft.cpp
+// @brief headless perft: counts the leaf positions of the move tree to check the rules and measure speed
+// @usage perft [depth] [fen] [--no-bulk] [--hash MB]
+
+#include <iostream>
+#include <iomanip>
+#include <cstdlib>
+#include <cstring>
+#include <chrono>
+#include <vector>
+#include <string>
+#include "rules.h"
+
+using namespace std;
+
+/// @brief one cached subtree count; the full position is kept so a hit is never a collision
+struct PerftEntry{
+    uint32_t white;
+    uint32_t black;
+    uint32_t kings;
+    uint32_t depthAndSide;      // depth * 2 + side to move, 0 marks an empty slot
+    uint64_t count;
+};
+
+struct PerftOptions{
+    bool bulk = true;
+    vector<PerftEntry> table;
+    uint64_t mask = 0;
+    uint64_t hits = 0;
+};
+
+static uint64_t positionKey(const Position& pos){
+    uint64_t key = ((uint64_t)pos.white << 32 | pos.black) ^ ((uint64_t)pos.kings * 0x9E3779B97F4A7C15ull);
+    key ^= pos.whiteToMove ? 0x2545F4914F6CDD1Dull : 0;
+    key ^= key >> 31;
+    key *= 0xBF58476D1CE4E5B9ull;
+    key ^= key >> 29;
+    return key;
+}
+
+/// @brief counts the leaf positions of the tree below a position
+/// @param pos,depth,options the position, the remaining plies and the counting options
+static uint64_t perft(const Position& pos, int depth, PerftOptions& options){
+    if(depth == 0)
+        return 1;
+    if(depth == 1 && options.bulk)
+        return countMoves(pos);
+
+    PerftEntry* entry = nullptr;
+    uint32_t depthAndSide = (uint32_t)depth * 2 + (pos.whiteToMove ? 1 : 0);
+    if(!options.table.empty()){
+        entry = &options.table[positionKey(pos) & options.mask];
+        if(entry->depthAndSide == depthAndSide && entry->white == pos.white &&
+           entry->black == pos.black && entry->kings == pos.kings){
+            options.hits++;
+            return entry->count;
+        }
+    }
+
+    MoveList moves;
+    generateMoves(pos, moves);
+    uint64_t count = 0;
+    for(const Move& m : moves)
+        count += perft(applyMove(pos, m), depth - 1, options);
+
+    if(entry){
+        entry->white = pos.white;
+        entry->black = pos.black;
+        entry->kings = pos.kings;
+        entry->depthAndSide = depthAndSide;
+        entry->count = count;
+    }
+    return count;
+}
+
+int main(int argc, char** argv){
+    int depth = 8;
+    Position pos = startPosition();
+    PerftOptions options;
+    size_t hashMb = 0;
+
+    for(int i = 1; i < argc; i++){
+        if(strcmp(argv[i], "--no-bulk") == 0){
+            options.bulk = false;
+        }else if(strcmp(argv[i], "--hash") == 0 && i + 1 < argc){
+            hashMb = strtoul(argv[++i], nullptr, 10);
+        }else if(argv[i][0] == 'W' || argv[i][0] == 'B' || argv[i][0] == 'w' || argv[i][0] == 'b'){
+            if(!parseFen(argv[i], pos)){
+                cerr << "Error: invalid position \"" << argv[i] << "\"" << endl;
+                return 1;
+            }
+        }else{
+            char* end;
+            long value = strtol(argv[i], &end, 10);
+            if(end == argv[i] || *end){
+                cerr << "Error: not a position or depth: " << argv[i] << endl;
+                return 1;
+            }
+            depth = (int)value;
+        }
+    }
+    if(depth < 1){
+        cerr << "Error: depth must be at least 1" << endl;
+        return 1;
+    }
+    if(hashMb > 0){
+        // round down to a power of two so the slot is key & mask
+        size_t slots = 1;
+        while(slots * 2 * sizeof(PerftEntry) <= hashMb * 1024 * 1024)
+            slots *= 2;
+        options.table.assign(slots, PerftEntry());
+        options.mask = slots - 1;
+    }
+
+    cout << "position " << toFen(pos) << endl;
+    cout << "depth " << depth << (options.bulk ? " (bulk counting)" : "")
+         << (hashMb ? ", hash " + to_string(hashMb) + " MB" : string()) << endl;
+
+    auto start = chrono::steady_clock::now();
+    MoveList moves;
+    generateMoves(pos, moves);
+    uint64_t total = 0;
+    for(const Move& m : moves){
+        uint64_t count = perft(applyMove(pos, m), depth - 1, options);
+        cout << setw(10) << moveToString(m) << "  " << count << endl;
+        total += count;
+    }
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+    cout << "moves  " << moves.size() << endl;
+    cout << "nodes  " << total << endl;
+    cout << "time   " << fixed << setprecision(3) << seconds << " s" << endl;
+    cout << "nps    " << (uint64_t)(total / (seconds > 0 ? seconds : 1e-9)) << endl;
+    if(hashMb)
+        cout << "hash hits " << options.hits << endl;
+    return 0;
+}
@@ -0,0 +1,87 @@
+// @file posindex.cpp
+// @brief headless position index tool: indexes PDN archives and queries the index
+// @usage posindex build OUT FILE... [--threads N]   indexes every position of every game of the files
+//        posindex query INDEX [FEN]                 games that reached a position (the opening if no
+//                                                   FEN is given) and how long a lookup takes
+
+#include <iostream>
+#include <cstdlib>
+#include <cstring>
+#include <chrono>
+#include <string>
+#include <vector>
+#include "rules.h"
+#include "posindex.h"
+
+using namespace std;
+
+typedef chrono::steady_clock Clock;
+
+static int build(const string& out, const vector<string>& files, int threads){
+    Clock::time_point start = Clock::now();
+    PositionIndexBuild build;
+    if(!buildPositionIndex(files, out, threads, build)){
+        cerr << "cannot write " << out << endl;
+        return 1;
+    }
+    double seconds = chrono::duration<double>(Clock::now() - start).count();
+    cout << build.games << " games (" << build.rejected << " with an illegal move, indexed up to it), "
+         << build.positions << " positions, " << build.records << " distinct" << endl;
+    cout << out << ": " << build.bytes << " bytes in " << seconds << " s, "
+         << (uint64_t)(build.games / seconds) << " games/sec on " << threads << " thread(s)" << endl;
+    return 0;
+}
+
+static int query(const string& path, const string& fen){
+    Position pos = startPosition();
+    if(!fen.empty() && !parseFen(fen, pos)){
+        cerr << "not a position: " << fen << endl;
+        return 2;
+    }
+    PositionIndex index;
+    Clock::time_point start = Clock::now();
+    if(!index.open(path)){
+        cerr << "no position index in " << path << endl;
+        return 1;
+    }
+    PositionStats stats;
+    index.lookup(pos, stats);
+    double first = chrono::duration<double, micro>(Clock::now() - start).count();
+
+    const int repeats = 1000000;
+    start = Clock::now();
+    uint32_t found = 0;
+    for(int i = 0; i < repeats; i++){
+        PositionStats again;
+        found += index.lookup(pos, again);
+    }
+    double each = chrono::duration<double, nano>(Clock::now() - start).count() / repeats;
+
+    cout << toFen(pos) << ": " << stats.games << " of " << index.games() << " games";
+    if(stats.finished()){
+        cout.precision(3);
+        cout << ", side to move wins " << stats.percent(stats.wins) << "%, draws " << stats.percent(stats.draws)
+             << "%, loses " << stats.percent(stats.losses) << "%";
+    }
+    cout << endl;
+    cout << index.positions() << " positions; open and first lookup " << first << " us, then "
+         << each << " ns a lookup" << (found ? "" : " (not found)") << endl;
+    return 0;
+}
+
+int main(int argc, char** argv){
+    vector<string> args;
+    int threads = 1;
+    for(int i = 1; i < argc; i++){
+        if(strcmp(argv[i], "--threads") == 0 && i + 1 < argc)
+            threads = max(1, atoi(argv[++i]));
+        else
+            args.push_back(argv[i]);
+    }
+    if(args.size() >= 3 && args[0] == "build")
+        return build(args[1], vector<string>(args.begin() + 2, args.end()), threads);
+    if((args.size() == 2 || args.size() == 3) && args[0] == "query")
+        return query(args[1], args.size() == 3 ? args[2] : "");
+    cerr << "usage: posindex build OUT FILE... [--threads N] | posindex query INDEX [FEN]" << endl;
+    return 2;
+}
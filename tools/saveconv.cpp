@@ -0,0 +1,46 @@
+// @file saveconv.cpp
+// @brief converts save files to the current format: raw Game dumps of version 1.0, or saves of an
+//        older format version, and prints what a save holds
+// @usage saveconv old.dat new.dat | saveconv --show file.dat
+
+#include <iostream>
+#include <cstring>
+#include <string>
+#include "rules.h"
+#include "savefile.h"
+
+using namespace std;
+
+static void show(const SavedGame& game){
+    cout << "players:  " << game.playerOneName << (game.playerOneCpu ? " (cpu)" : "") << " - "
+         << game.playerTwoName << (game.playerTwoCpu ? " (cpu)" : "") << endl;
+    cout << "score:    " << game.p1 << " - " << game.p2 << (game.winner ? ", won by player " + to_string(game.winner) : "") << endl;
+    cout << "start:    " << toFen(game.start) << endl;
+    cout << "moves:    " << game.history.size() << endl;
+    cout << "position: " << toFen(game.position) << endl;
+}
+
+int main(int argc, char** argv){
+    bool showOnly = argc == 3 && strcmp(argv[1], "--show") == 0;
+    if(argc != 3){
+        cerr << "usage: saveconv old.dat new.dat | saveconv --show file.dat" << endl;
+        return 2;
+    }
+    SavedGame game;
+    string input = showOnly ? argv[2] : argv[1];
+    int status = readSaveFile(input, game);
+    if(status != saveOk && status != saveLegacyConverted){
+        cerr << input << ": " << saveStatusText(status) << endl;
+        return 1;
+    }
+    cout << input << ": " << saveStatusText(status) << endl;
+    show(game);
+    if(showOnly)
+        return 0;
+    if(writeSaveFile(argv[2], game) != saveOk){
+        cerr << argv[2] << ": " << saveStatusText(saveCannotOpen) << endl;
+        return 1;
+    }
+    cout << "wrote " << argv[2] << " (format version " << SAVE_VERSION << ")" << endl;
+    return 0;
+}
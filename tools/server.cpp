@@ -0,0 +1,667 @@
+// @file server.cpp
+// @brief headless game server hosting many games from one process, and a load test for it
+// @usage server [--port N] [--host ADDR] [--unix PATH] [--workers N] [--hash MB] [--move-ms N] [--clock-ms N]
+//        server load [--sessions N] [--connections N] [--ai N] [--rate N] [--seconds S] [--unix PATH]
+//            opens N games (--ai of them against the computer, the others played from both seats) and
+//            plays random moves at --rate moves/sec in all, reporting how fast each is acknowledged.
+//        server spectate [--games N] [--watchers N] [--plies N] [--unix PATH]
+//            plays N games of random moves, each watched by every watcher connection, and reports the
+//            bytes a move costs a watcher and how many frames a second reach them
+//            Without --unix the tests start a server of their own on a temporary Unix socket.
+
+#include <iostream>
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cmath>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <queue>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include "rules.h"
+#include "savefile.h"
+#include "server.h"
+#include "spectate.h"
+
+using namespace std;
+
+typedef chrono::steady_clock Clock;
+
+static GameServer* running = nullptr;
+
+static void stopServer(int){
+    if(running)
+        running->stop();
+}
+
+/// @brief allows as many descriptors as the system lets this process have: a client per game
+static void raiseFileLimit(){
+    rlimit limit;
+    if(getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur < limit.rlim_max){
+        limit.rlim_cur = limit.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &limit);
+    }
+}
+
+enum loadState{
+    loadStarting,       // new sent, waiting for its game line
+    loadJoining,        // join sent for the second seat
+    loadIdle,           // waiting for its next move time
+    loadAcking,         // move sent, waiting for ok
+    loadWaiting         // waiting for the computer's move
+};
+
+/// @brief one game of the load test, seen from the client
+struct LoadGame{
+    uint64_t id = 0;
+    int connection = 0;
+    bool computer = false;
+    int state = loadStarting;
+    Position position;
+    Clock::time_point sent;
+};
+
+struct LoadConnection{
+    int fd = -1;
+    string in;
+    string out;
+    vector<int> starting;           // games waiting for the answer to their new, oldest first
+    size_t nextStarting = 0;
+};
+
+struct LoadTest{
+    vector<LoadGame> games;
+    vector<LoadConnection> connections;
+    unordered_map<uint64_t, int> byId;
+    priority_queue<pair<double, int>, vector<pair<double, int>>, greater<pair<double, int>>> due;  // seconds, game
+    vector<double> latencies;       // microseconds from a move to its ok
+    Clock::time_point start;
+    double meanGap = 1;             // seconds between the moves of one game
+    int moveMs = 20;
+    uint64_t seed = 0x9E3779B97F4A7C15ull;
+    uint64_t computerMoves = 0;
+    uint64_t errors = 0;
+    uint64_t restarts = 0;
+
+    double now() const { return chrono::duration<double>(Clock::now() - start).count(); }
+
+    uint64_t random(){
+        seed ^= seed << 13;
+        seed ^= seed >> 7;
+        seed ^= seed << 17;
+        return seed;
+    }
+
+    void newGame(int index){
+        LoadGame& game = games[index];
+        LoadConnection& connection = connections[game.connection];
+        game.state = loadStarting;
+        game.position = startPosition();
+        connection.starting.push_back(index);
+        connection.out += game.computer ? "new ai=black move-ms=" + to_string(moveMs) + "\n" : "new ai=none\n";
+    }
+
+    void schedule(int index, bool first = false){
+        games[index].state = loadIdle;
+        // spread the moves evenly, so the rate stays steady from the start
+        double share = (random() % 1000) / 1000.0;
+        due.push(make_pair(now() + meanGap * (first ? share : 0.5 + share), index));
+    }
+
+    void restart(int index){
+        LoadGame& game = games[index];
+        restarts++;
+        connections[game.connection].out += "leave id=" + to_string(game.id) + "\n";
+        byId.erase(game.id);
+        newGame(index);
+    }
+
+    void sendMove(int index){
+        LoadGame& game = games[index];
+        MoveList moves;
+        generateMoves(game.position, moves);
+        if(moves.empty() || (game.position.kings && random() % 64 == 0)){
+            // over, or kings shuffling about: a game of their own keeps the moves coming
+            restart(index);
+            return;
+        }
+        const Move& move = moves[(int)(random() % (uint64_t)moves.size())];
+        connections[game.connection].out += "move id=" + to_string(game.id) + " m=" + moveToString(move) + "\n";
+        game.position = applyMove(game.position, move);
+        game.state = loadAcking;
+        game.sent = Clock::now();
+    }
+
+    void line(LoadConnection& connection, const string& text){
+        size_t space = text.find(' ');
+        string kind = text.substr(0, space);
+        size_t idAt = text.find("id=");
+        uint64_t id = idAt == string::npos ? 0 : strtoull(text.c_str() + idAt + 3, nullptr, 10);
+        if(kind == "error"){
+            if(errors++ < 5)
+                cerr << "server: " << text << endl;
+            return;
+        }
+        if(kind == "game"){
+            bool white = text.find("side=white") != string::npos;
+            if(white){
+                int index = connection.starting[connection.nextStarting++];
+                if(connection.nextStarting == connection.starting.size()){
+                    connection.starting.clear();
+                    connection.nextStarting = 0;
+                }
+                LoadGame& game = games[index];
+                game.id = id;
+                byId[id] = index;
+                if(game.computer){
+                    schedule(index, true);
+                }else{
+                    game.state = loadJoining;
+                    connection.out += "join id=" + to_string(id) + "\n";
+                }
+            }else if(byId.count(id)){
+                schedule(byId[id], true);
+            }
+            return;
+        }
+        auto found = byId.find(id);
+        if(found == byId.end())
+            return;
+        int index = found->second;
+        LoadGame& game = games[index];
+        if(kind == "ok" && game.state == loadAcking){
+            latencies.push_back(chrono::duration<double, micro>(Clock::now() - game.sent).count());
+            if(isGameOver(game.position))
+                restart(index);
+            else if(game.computer)
+                game.state = loadWaiting;
+            else
+                schedule(index);
+        }else if(kind == "played" && game.state == loadWaiting){
+            size_t at = text.find(" m=");
+            Move move;
+            if(at == string::npos || !parseMove(game.position, text.substr(at + 3, text.find(' ', at + 3) - at - 3), move)){
+                if(errors++ < 5)
+                    cerr << "client: cannot read " << text << endl;
+                restart(index);
+                return;
+            }
+            computerMoves++;
+            game.position = applyMove(game.position, move);
+            if(isGameOver(game.position))
+                restart(index);
+            else
+                schedule(index);
+        }
+    }
+};
+
+static int connectUnix(const string& path){
+    sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    strncpy(address.sun_path, path.c_str(), sizeof(address.sun_path) - 1);
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if(fd < 0 || connect(fd, (sockaddr*)&address, sizeof(address)) != 0){
+        if(fd >= 0)
+            close(fd);
+        return -1;
+    }
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+    return fd;
+}
+
+/// @brief a server of the test's own on a temporary Unix socket, run on another thread
+struct TestServer{
+    GameServer* server = nullptr;
+    thread serving;
+
+    bool start(string& path, const ServerOptions& options){
+        path = "/tmp/dama-server-" + to_string(getpid()) + ".sock";
+        server = new GameServer(options);
+        if(!server->listenUnix(path))
+            return false;
+        serving = thread([this]{ server->run(); });
+        return true;
+    }
+
+    /// @brief stops it and returns its counters; the clients are still connected, so their games are open
+    ServerStats finish(){
+        server->stop();
+        serving.join();
+        ServerStats stats = server->stats();
+        delete server;
+        server = nullptr;
+        return stats;
+    }
+};
+
+static double percentile(vector<double>& values, double share){
+    if(values.empty())
+        return 0;
+    size_t at = min(values.size() - 1, (size_t)(share * values.size()));
+    nth_element(values.begin(), values.begin() + at, values.end());
+    return values[at];
+}
+
+static int loadTest(int sessionCount, int connectionCount, int computerCount, double rate, double seconds,
+                    string path, const ServerOptions& options){
+    raiseFileLimit();
+    TestServer local;
+    if(path.empty() && !local.start(path, options))
+        return 1;
+
+    LoadTest test;
+    test.start = Clock::now();
+    test.meanGap = sessionCount / max(rate, 1.0);
+    test.moveMs = (int)options.moveMs;
+    int poller = epoll_create1(EPOLL_CLOEXEC);
+    connectionCount = max(1, min(connectionCount, sessionCount));
+    test.connections.resize(connectionCount);
+    for(int i = 0; i < connectionCount; i++){
+        int fd = connectUnix(path);
+        if(fd < 0){
+            cerr << "cannot connect to " << path << ": " << strerror(errno) << endl;
+            return 1;
+        }
+        test.connections[i].fd = fd;
+        epoll_event event;
+        event.events = EPOLLIN;
+        event.data.u32 = (uint32_t)i;
+        epoll_ctl(poller, EPOLL_CTL_ADD, fd, &event);
+    }
+    test.games.resize(sessionCount);
+    for(int i = 0; i < sessionCount; i++){
+        test.games[i].connection = i % connectionCount;
+        test.games[i].computer = i < computerCount;
+        test.newGame(i);
+    }
+
+    // the games open first, then the moves start
+    double opened = -1, movesFrom = 0;
+    uint64_t acked = 0;
+    epoll_event events[64];
+    char buffer[1 << 16];
+    while(true){
+        double now = test.now();
+        if(opened < 0 && test.byId.size() == (size_t)sessionCount){
+            opened = now;
+            movesFrom = now;
+            test.latencies.clear();
+            printf("%d games open in %.3f s on %d connection(s)\n", sessionCount, opened, connectionCount);
+        }
+        if(opened >= 0 && now - movesFrom >= seconds)
+            break;
+        while(opened >= 0 && !test.due.empty() && test.due.top().first <= now){
+            int index = test.due.top().second;
+            test.due.pop();
+            if(test.games[index].state == loadIdle)
+                test.sendMove(index);
+        }
+        for(LoadConnection& connection : test.connections){
+            while(!connection.out.empty()){
+                ssize_t sent = send(connection.fd, connection.out.data(), connection.out.size(), MSG_NOSIGNAL);
+                if(sent <= 0)
+                    break;
+                connection.out.erase(0, (size_t)sent);
+            }
+        }
+        int timeout = test.due.empty() ? 10 : max(0, (int)ceil((test.due.top().first - test.now()) * 1000));
+        int count = epoll_wait(poller, events, 64, min(timeout, 10));
+        for(int i = 0; i < count; i++){
+            LoadConnection& connection = test.connections[events[i].data.u32];
+            ssize_t got;
+            while((got = read(connection.fd, buffer, sizeof(buffer))) > 0)
+                connection.in.append(buffer, (size_t)got);
+            if(got == 0){
+                cerr << "the server closed the connection" << endl;
+                return 1;
+            }
+            size_t at = 0, end;
+            while((end = connection.in.find('\n', at)) != string::npos){
+                test.line(connection, connection.in.substr(at, end - at));
+                at = end + 1;
+            }
+            connection.in.erase(0, at);
+        }
+        if(opened < 0 && now > 60){
+            cerr << "only " << test.byId.size() << " of " << sessionCount << " games opened" << endl;
+            return 1;
+        }
+    }
+    double spent = test.now() - movesFrom;
+    acked = test.latencies.size();
+
+    vector<double>& latencies = test.latencies;
+    double p50 = percentile(latencies, 0.5), p99 = percentile(latencies, 0.99), p999 = percentile(latencies, 0.999);
+    double worst = latencies.empty() ? 0 : *max_element(latencies.begin(), latencies.end());
+    printf("%llu moves acknowledged in %.1f s (%.0f/s), %llu computer moves, %llu new games, %llu errors\n",
+           (unsigned long long)acked, spent, acked / spent, (unsigned long long)test.computerMoves,
+           (unsigned long long)test.restarts, (unsigned long long)test.errors);
+    printf("acknowledgement: median %.0f us, p99 %.0f us, p99.9 %.0f us, worst %.0f us\n", p50, p99, p999, worst);
+    if(local.server){
+        ServerStats stats = local.finish();
+        printf("server: %llu games open in %llu KB (%zu bytes each), %llu KB in, %llu KB out\n",
+               (unsigned long long)stats.sessions, (unsigned long long)stats.sessionBytes / 1024, sizeof(GameSession),
+               (unsigned long long)stats.bytesIn / 1024, (unsigned long long)stats.bytesOut / 1024);
+    }
+    for(LoadConnection& connection : test.connections)
+        close(connection.fd);
+    close(poller);
+    return test.errors ? 1 : 0;
+}
+
+/// @brief writes all of a text to a non-blocking socket, waiting when it is full
+static bool sendAll(int fd, const string& text){
+    size_t done = 0;
+    while(done < text.size()){
+        ssize_t sent = send(fd, text.data() + done, text.size() - done, MSG_NOSIGNAL);
+        if(sent > 0){
+            done += (size_t)sent;
+        }else if(sent < 0 && (errno == EAGAIN || errno == EINTR)){
+            pollfd wait = {fd, POLLOUT, 0};
+            poll(&wait, 1, 1000);
+        }else{
+            return false;
+        }
+    }
+    return true;
+}
+
+/// @brief waits for some lines of a non-blocking socket
+static bool readLines(int fd, string& in, size_t count, vector<string>& lines){
+    lines.clear();
+    char buffer[1 << 16];
+    while(lines.size() < count){
+        size_t end = in.find('\n');
+        if(end != string::npos){
+            lines.push_back(in.substr(0, end));
+            in.erase(0, end + 1);
+            continue;
+        }
+        pollfd wait = {fd, POLLIN, 0};
+        if(poll(&wait, 1, 10000) <= 0)
+            return false;
+        ssize_t got = read(fd, buffer, sizeof(buffer));
+        if(got <= 0)
+            return false;
+        in.append(buffer, (size_t)got);
+    }
+    return true;
+}
+
+/// @brief a spectator of the test, watching every game
+struct TestWatcher{
+    int fd = -1;
+    string in;
+    bool spectating = false;        // its text answer to spectate was read, frames follow
+    vector<WatchedGame> games;
+};
+
+static int spectateTest(int gameCount, int watcherCount, int plies, string path, const ServerOptions& options){
+    raiseFileLimit();
+    TestServer local;
+    if(path.empty() && !local.start(path, options))
+        return 1;
+
+    // the player opens every game and takes both seats of each
+    int player = connectUnix(path);
+    string playerIn, commands;
+    vector<string> lines;
+    vector<uint64_t> ids(gameCount);
+    unordered_map<uint64_t, int> byId;
+    for(int i = 0; i < gameCount; i++)
+        commands += "new ai=none\n";
+    if(player < 0 || !sendAll(player, commands) || !readLines(player, playerIn, gameCount, lines)){
+        cerr << "cannot open the games on " << path << endl;
+        return 1;
+    }
+    commands.clear();
+    for(int i = 0; i < gameCount; i++){
+        ids[i] = strtoull(lines[i].c_str() + lines[i].find("id=") + 3, nullptr, 10);
+        byId[ids[i]] = i;
+        commands += "join id=" + to_string(ids[i]) + "\n";
+    }
+    if(!sendAll(player, commands) || !readLines(player, playerIn, gameCount, lines))
+        return 1;
+
+    string watch = "spectate\n";
+    for(uint64_t id : ids)
+        watch += "watch id=" + to_string(id) + "\n";
+    int poller = epoll_create1(EPOLL_CLOEXEC);
+    vector<TestWatcher> watchers(watcherCount);
+    for(int i = 0; i < watcherCount; i++){
+        TestWatcher& watcher = watchers[i];
+        watcher.fd = connectUnix(path);
+        watcher.games.resize(gameCount);
+        if(watcher.fd < 0 || !sendAll(watcher.fd, watch)){
+            cerr << "cannot connect watcher " << i << ": " << strerror(errno) << endl;
+            return 1;
+        }
+        epoll_event event;
+        event.events = EPOLLIN;
+        event.data.u32 = (uint32_t)i;
+        epoll_ctl(poller, EPOLL_CTL_ADD, watcher.fd, &event);
+    }
+    epoll_event event;
+    event.events = EPOLLIN;
+    event.data.u32 = (uint32_t)watcherCount;
+    epoll_ctl(poller, EPOLL_CTL_ADD, player, &event);
+
+    vector<Position> positions(gameCount, startPosition());
+    vector<int> played(gameCount, 0);
+    uint64_t seed = 0x2545F4914F6CDD1Dull;
+    uint64_t snapshots = 0, moveFrames = 0, overFrames = 0, snapshotBytes = 0, moveBytes = 0, received = 0, broken = 0;
+    uint64_t moves = 0, overs = 0;
+    int outstanding = 0;
+    bool playing = false, finished = false;
+    Clock::time_point start = Clock::now(), first, last;
+    epoll_event events[256];
+    char buffer[1 << 16];
+    while(chrono::duration<double>(Clock::now() - start).count() < 120){
+        bool watched = snapshots == (uint64_t)watcherCount * gameCount;
+        if(watched && outstanding == 0 && !finished){
+            // a round: one move in every game still going
+            commands.clear();
+            for(int i = 0; i < gameCount; i++){
+                MoveList list;
+                generateMoves(positions[i], list);
+                if(list.empty() || played[i] >= plies)
+                    continue;
+                seed ^= seed << 13;
+                seed ^= seed >> 7;
+                seed ^= seed << 17;
+                const Move& move = list[(int)(seed % (uint64_t)list.size())];
+                commands += "move id=" + to_string(ids[i]) + " m=" + moveToString(move) + "\n";
+                positions[i] = applyMove(positions[i], move);
+                played[i]++;
+                moves++;
+                overs += isGameOver(positions[i]);
+                outstanding++;
+            }
+            if(!playing){
+                playing = true;
+                first = Clock::now();
+            }
+            finished = outstanding == 0;
+            sendAll(player, commands);
+        }
+        if(finished && moveFrames == moves * watcherCount && overFrames == overs * watcherCount)
+            break;
+        int count = epoll_wait(poller, events, 256, 1000);
+        for(int i = 0; i < count; i++){
+            uint32_t index = events[i].data.u32;
+            if(index == (uint32_t)watcherCount){
+                ssize_t got = read(player, buffer, sizeof(buffer));
+                if(got <= 0)
+                    return 1;
+                playerIn.append(buffer, (size_t)got);
+                size_t at = 0, end;
+                while((end = playerIn.find('\n', at)) != string::npos){
+                    if(playerIn.compare(at, 3, "ok ") == 0)
+                        outstanding--;
+                    else if(playerIn.compare(at, 6, "error ") == 0)
+                        cerr << "server: " << playerIn.substr(at, end - at) << endl;
+                    at = end + 1;
+                }
+                playerIn.erase(0, at);
+                continue;
+            }
+            TestWatcher& watcher = watchers[index];
+            ssize_t got;
+            while((got = read(watcher.fd, buffer, sizeof(buffer))) > 0){
+                watcher.in.append(buffer, (size_t)got);
+                received += (uint64_t)got;
+            }
+            if(!watcher.spectating){
+                size_t end = watcher.in.find('\n');
+                if(end == string::npos)
+                    continue;
+                watcher.in.erase(0, end + 1);
+                watcher.spectating = true;
+            }
+            const uint8_t* data = reinterpret_cast<const uint8_t*>(watcher.in.data());
+            size_t at = 0;
+            SpectateEvent frame;
+            int size;
+            while((size = readSpectateFrame(data + at, watcher.in.size() - at, frame)) > 0){
+                at += (size_t)size;
+                auto game = byId.find(frame.id);
+                if(game == byId.end() || !watcher.games[game->second].apply(frame))
+                    broken++;
+                if(frame.type == spectateSnapshot){
+                    snapshots++;
+                    snapshotBytes += (uint64_t)size;
+                }else if(frame.type == spectateMove){
+                    moveFrames++;
+                    moveBytes += (uint64_t)size;
+                }else if(frame.type == spectateOver){
+                    overFrames++;
+                }
+            }
+            if(size < 0){
+                cerr << "a watcher read a bad frame" << endl;
+                return 1;
+            }
+            watcher.in.erase(0, at);
+            last = Clock::now();
+        }
+    }
+
+    int inStep = 0;
+    for(const TestWatcher& watcher : watchers){
+        for(int i = 0; i < gameCount; i++)
+            inStep += watcher.games[i].synced && samePosition(watcher.games[i].position, positions[i]);
+    }
+    double seconds = chrono::duration<double>(last - first).count();
+    uint64_t frames = moveFrames + overFrames;
+    printf("%d games, each watched by %d connections; %llu moves played\n", gameCount, watcherCount, (unsigned long long)moves);
+    printf("snapshot %.1f bytes, move %.1f bytes on average (the 1.0 Game struct was %zu)\n",
+           snapshots ? (double)snapshotBytes / snapshots : 0.0, moveFrames ? (double)moveBytes / moveFrames : 0.0, LEGACY_SAVE_SIZE);
+    printf("%llu frames (%.2f MB) delivered in %.3f s: %.0f frames/s, %.1f MB/s\n", (unsigned long long)frames,
+           received / 1e6, seconds, frames / seconds, received / 1e6 / seconds);
+    printf("%d of %d boards in step with the games, %llu frames out of order\n", inStep, watcherCount * gameCount,
+           (unsigned long long)broken);
+    if(local.server){
+        ServerStats stats = local.finish();
+        printf("server: %llu frames built, %llu handed to watchers as shared buffers, %llu watches open\n",
+               (unsigned long long)stats.frames, (unsigned long long)stats.framesQueued, (unsigned long long)stats.watchers);
+    }
+    for(const TestWatcher& watcher : watchers)
+        close(watcher.fd);
+    close(player);
+    close(poller);
+    return inStep == watcherCount * gameCount && !broken ? 0 : 1;
+}
+
+int main(int argc, char** argv){
+    ServerOptions options;
+    string host = "127.0.0.1", unixPath;
+    int port = 0;
+    int sessions = 10000, connections = 50, computer = -1;
+    double rate = 10000, seconds = 5;
+    int games = 10, watchers = 1000, plies = 100;
+    bool load = false, spectate = false;
+    for(int i = 1; i < argc; i++){
+        string arg = argv[i];
+        bool value = i + 1 < argc;
+        if(arg == "load")
+            load = true;
+        else if(arg == "spectate")
+            spectate = true;
+        else if(arg == "--games" && value)
+            games = max(1, atoi(argv[++i]));
+        else if(arg == "--watchers" && value)
+            watchers = max(1, atoi(argv[++i]));
+        else if(arg == "--plies" && value)
+            plies = max(1, atoi(argv[++i]));
+        else if(arg == "--port" && value)
+            port = atoi(argv[++i]);
+        else if(arg == "--host" && value)
+            host = argv[++i];
+        else if(arg == "--unix" && value)
+            unixPath = argv[++i];
+        else if(arg == "--workers" && value)
+            options.workers = max(1, atoi(argv[++i]));
+        else if(arg == "--hash" && value)
+            options.hashMb = (size_t)max(1, atoi(argv[++i]));
+        else if(arg == "--move-ms" && value)
+            options.moveMs = (uint32_t)max(1, atoi(argv[++i]));
+        else if(arg == "--clock-ms" && value)
+            options.clockMs = (uint32_t)max(1, atoi(argv[++i]));
+        else if(arg == "--sessions" && value)
+            sessions = max(1, atoi(argv[++i]));
+        else if(arg == "--connections" && value)
+            connections = max(1, atoi(argv[++i]));
+        else if(arg == "--ai" && value)
+            computer = max(0, atoi(argv[++i]));
+        else if(arg == "--rate" && value)
+            rate = atof(argv[++i]);
+        else if(arg == "--seconds" && value)
+            seconds = atof(argv[++i]);
+        else{
+            cerr << "usage: server [--port N] [--host ADDR] [--unix PATH] [--workers N] [--hash MB] [--move-ms N] [--clock-ms N]" << endl
+                 << "       server load [--sessions N] [--connections N] [--ai N] [--rate N] [--seconds S] [--unix PATH]" << endl
+                 << "       server spectate [--games N] [--watchers N] [--plies N] [--unix PATH]" << endl;
+            return 2;
+        }
+    }
+    signal(SIGPIPE, SIG_IGN);
+    if(spectate)
+        return spectateTest(games, watchers, plies, unixPath, options);
+    if(load){
+        if(options.moveMs == ServerOptions().moveMs)
+            options.moveMs = 20;
+        return loadTest(sessions, connections, computer < 0 ? sessions / 10 : computer, rate, seconds, unixPath, options);
+    }
+
+    raiseFileLimit();
+    GameServer server(options);
+    if(!port && unixPath.empty())
+        port = 7500;
+    if((port && !server.listenTcp(host, port)) || (!unixPath.empty() && !server.listenUnix(unixPath)))
+        return 1;
+    running = &server;
+    signal(SIGINT, stopServer);
+    signal(SIGTERM, stopServer);
+    cout << "serving on " << (port ? host + ":" + to_string(port) : string()) << (port && !unixPath.empty() ? " and " : "")
+         << unixPath << " with " << options.workers << " search thread(s)" << endl;
+    server.run();
+    ServerStats stats = server.stats();
+    cout << stats.gamesStarted << " games, " << stats.moves << " moves, " << stats.computerMoves << " computer moves" << endl;
+    return 0;
+}
@@ -0,0 +1,480 @@
+// @file tbgen.cpp
+// @brief builds endgame tablebases by retrograde analysis, one slice (and its colour-swapped twin) at a time
+// @usage tbgen [pieces] [--dtw] [--threads N] [--dir DIR]
+//        pieces     largest number of pieces on the board (default 4, at most TB_MAX_PIECES)
+//        --dtw      store the exact number of plies to the end instead of only win / loss / draw
+//        --threads  worker threads (default: one per core)
+//        --dir      where the slice files go (default "tb"); slices already there are kept, so an
+//                   interrupted run resumes where it stopped
+// Each slice is written twice: <slice>.tb holds one byte per position and is what later slices read
+// while they are solved, <slice>.cdb is the compressed file the game and the search probe.
+
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <cstdlib>
+#include <cstring>
+#include <chrono>
+#include <atomic>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <sys/stat.h>
+#ifdef _WIN32
+#include <direct.h>
+#endif
+#include "rules.h"
+#include "tablebase.h"
+
+using namespace std;
+
+const uint64_t CHUNK_SIZE = 4096;   // positions a worker takes at a time
+const int MAX_LEVELS = 255;         // with distances, a value byte holds plies + 1
+
+static uint64_t rawBytes = 0;       // sizes of the files written, for the summary
+static uint64_t compressedBytes = 0;
+
+/// @brief a worker's own chunks: it takes from the back, idle workers steal from the front
+struct WorkQueue{
+    mutex lock;
+    deque<pair<uint64_t, uint64_t>> chunks;
+};
+
+/// @brief runs body over [0, count) in chunks on several threads; each thread starts with its own
+///        contiguous share and steals from the others when it runs out, so slow chunks (long capture
+///        trees) do not leave threads idle
+static void parallelFor(uint64_t count, int threads, const function<void(uint64_t, uint64_t)>& body){
+    vector<unique_ptr<WorkQueue>> queues;
+    for(int t = 0; t < threads; t++)
+        queues.emplace_back(new WorkQueue());
+    uint64_t chunkCount = (count + CHUNK_SIZE - 1) / CHUNK_SIZE;
+    for(uint64_t c = 0; c < chunkCount; c++){
+        uint64_t begin = c * CHUNK_SIZE;
+        uint64_t end = begin + CHUNK_SIZE < count ? begin + CHUNK_SIZE : count;
+        queues[c * threads / chunkCount]->chunks.push_back(make_pair(begin, end));
+    }
+
+    auto worker = [&](int id){
+        while(true){
+            pair<uint64_t, uint64_t> chunk;
+            bool found = false;
+            {
+                lock_guard<mutex> guard(queues[id]->lock);
+                if(!queues[id]->chunks.empty()){
+                    chunk = queues[id]->chunks.back();
+                    queues[id]->chunks.pop_back();
+                    found = true;
+                }
+            }
+            for(int k = 1; k < threads && !found; k++){
+                WorkQueue& victim = *queues[(id + k) % threads];
+                lock_guard<mutex> guard(victim.lock);
+                if(!victim.chunks.empty()){
+                    chunk = victim.chunks.front();
+                    victim.chunks.pop_front();
+                    found = true;
+                }
+            }
+            // nothing is ever added, so empty queues everywhere means the work is done
+            if(!found)
+                return;
+            body(chunk.first, chunk.second);
+        }
+    };
+    vector<thread> pool;
+    for(int t = 1; t < threads; t++)
+        pool.emplace_back(worker, t);
+    worker(0);
+    for(thread& t : pool)
+        t.join();
+}
+
+/// @brief a solved slice another slice's moves lead into
+struct Dependency{
+    TBSlice slice;
+    vector<uint8_t> values;
+};
+
+/// @brief the slice pair being solved and everything its moves can reach. Captures and promotions
+///        leave the pair, so only its quiet moves lead from one of its positions to another: these
+///        are the children counted and the moves taken back, everything else is read from the
+///        dependencies once.
+struct Solver{
+    TBSlice slices[2];
+    int sliceCount;
+    uint64_t sizes[2];
+    unique_ptr<atomic<uint8_t>[]> values[2];
+    unique_ptr<atomic<uint8_t>[]> unresolved[2];    // quiet moves to positions not known to be won
+    unique_ptr<atomic<uint8_t>[]> longestLoss[2];   // with distances: the most plies to lose so far
+    vector<unique_ptr<Dependency>> dependencies;
+    bool distances;
+    atomic<bool> tooLong{false};    // a result needs more plies than a byte can hold
+};
+
+// A queued position is its index over both slices (the second slice after the first), shifted
+// left, with the low bit set when it is lost.
+typedef vector<uint64_t> Level;
+
+/// @brief the value of the position after a capture or a promotion, for the player to move there
+///        (black); it lies in a dependency
+static uint8_t childValue(const Solver& solver, const Position& child){
+    Position flipped = flipPosition(child);
+    if(!flipped.white)
+        return TB_LOSS;
+    TBSlice slice = sliceOf(flipped);
+    for(const auto& dependency : solver.dependencies){
+        if(slice == dependency->slice)
+            return dependency->values[positionIndex(slice, flipped)];
+    }
+    return TB_DRAW;     // not reached: every dependency is loaded before the positions are counted
+}
+
+/// @brief true if a move keeps the position in the slice pair (neither takes nor crowns a piece)
+static bool quietMove(const Position& pos, const Move& move){
+    return !move.captures && ((pos.kings & (1u << move.from)) || !((1u << move.to) & TOP_ROW));
+}
+
+/// @brief where a result found at one level is decided: wins and losses share the queue, a level
+///        per ply when distances are kept, otherwise any order gives the same values
+static int levelOf(Solver& solver, int plies, int level){
+    if(!solver.distances)
+        return level + 1;
+    if(plies >= MAX_LEVELS){
+        solver.tooLong = true;
+        return level + 1;
+    }
+    return plies;
+}
+
+/// @brief counts the moves of one position: a position without moves is lost, the value of every
+///        capture and promotion is read, and the quiet moves are left to the propagation
+/// @param solver,t,index the slice pair, which of the two slices and the position's index
+/// @param queue,base the levels the decided positions go to and the position's index over both slices
+static void countMoves(Solver& solver, int t, uint64_t index, vector<Level>& queue, uint64_t base){
+    Position pos = positionAt(solver.slices[t], index);
+    MoveList moves;
+    generateMoves(pos, moves);
+    uint64_t entry = (base + index) << 1;
+    if(moves.empty()){
+        queue[0].push_back(entry | 1);
+        return;
+    }
+    int quiet = 0, fastestWin = -1, longestLoss = 0;
+    bool drawn = false;
+    for(const Move& m : moves){
+        if(quietMove(pos, m)){
+            quiet++;
+            continue;
+        }
+        uint8_t child = childValue(solver, applyMove(pos, m));
+        if(tbIsLoss(child)){
+            if(fastestWin < 0 || tbPlies(child) + 1 < fastestWin)
+                fastestWin = tbPlies(child) + 1;
+        }else if(tbIsWin(child)){
+            if(tbPlies(child) + 1 > longestLoss)
+                longestLoss = tbPlies(child) + 1;
+        }else{
+            drawn = true;
+        }
+    }
+    // a move to a drawn or lost position is never resolved, so the position cannot be lost
+    bool escapes = drawn || fastestWin >= 0;
+    solver.unresolved[t][index].store((uint8_t)(quiet + (escapes ? 1 : 0)), memory_order_relaxed);
+    if(solver.distances)
+        solver.longestLoss[t][index].store((uint8_t)longestLoss, memory_order_relaxed);
+    if(fastestWin >= 0)
+        queue[levelOf(solver, fastestWin, 0)].push_back(entry);
+    else if(!quiet && !escapes)
+        queue[levelOf(solver, longestLoss, 0)].push_back(entry | 1);
+}
+
+/// @brief decides a queued position and takes back every quiet move that led to it: a loss makes
+///        each predecessor a win one ply later, a win resolves one of its moves, and a predecessor
+///        whose moves are all resolved is lost
+/// @param solver,entry,level the slice pair, the queued position and the level being decided
+/// @param later where the predecessors decided go, by level
+static void decide(Solver& solver, uint64_t entry, int level, vector<Level>& later){
+    uint64_t g = entry >> 1;
+    bool lost = entry & 1;
+    int t = g < solver.sizes[0] ? 0 : 1;
+    uint64_t index = t ? g - solver.sizes[0] : g;
+    uint8_t undecided = TB_DRAW;
+    uint8_t value = solver.distances ? (uint8_t)(level + 1) : (lost ? TB_LOSS : TB_WIN);
+    if(!solver.values[t][index].compare_exchange_strong(undecided, value, memory_order_relaxed))
+        return;     // a faster win was found first
+
+    // black made the last move: seen from black's side it was white's, and white is to move before it
+    Position after = flipPosition(positionAt(solver.slices[t], index));
+    uint32_t empty = ~(after.white | after.black);
+    for(uint32_t pieces = after.white; pieces; pieces &= pieces - 1){
+        int square = firstSquare(pieces);
+        uint32_t bit = 1u << square;
+        bool king = (after.kings & bit) != 0;
+        uint32_t origins = 0;
+        if(king){
+            for(int dir = upLeft; dir <= downRight; dir++){
+                for(uint32_t step = shiftSquares(bit, dir) & empty; step; step = shiftSquares(step, dir) & empty)
+                    origins |= step;
+            }
+        }else{
+            // white men move up, so they came from below
+            origins = (shiftSquares(bit, downLeft) | shiftSquares(bit, downRight)) & empty;
+        }
+        for(; origins; origins &= origins - 1){
+            uint32_t from = origins & (0u - origins);
+            Position before = after;
+            before.white = (after.white & ~bit) | from;
+            if(king)
+                before.kings = (after.kings & ~bit) | from;
+            before.whiteToMove = true;
+            // captures are compulsory, so the quiet move was only legal without one
+            if(hasCapture(before))
+                continue;
+            TBSlice slice = sliceOf(before);
+            int u = slice == solver.slices[0] ? 0 : 1;
+            uint64_t i = positionIndex(slice, before);
+            if(solver.values[u][i].load(memory_order_relaxed) != TB_DRAW)
+                continue;
+            uint64_t predecessor = (u ? solver.sizes[0] + i : i) << 1;
+            if(lost){
+                int target = levelOf(solver, level + 1, level);
+                later[target - level - 1].push_back(predecessor);
+                continue;
+            }
+            int longest = level + 1;
+            if(solver.distances){
+                atomic<uint8_t>& known = solver.longestLoss[u][i];
+                uint8_t seen = known.load(memory_order_relaxed);
+                while(seen < longest && !known.compare_exchange_weak(seen, (uint8_t)longest, memory_order_relaxed)){}
+            }
+            // the last move resolved sees every longer loss recorded before it
+            if(solver.unresolved[u][i].fetch_sub(1, memory_order_acq_rel) == 1){
+                if(solver.distances)
+                    longest = solver.longestLoss[u][i].load(memory_order_relaxed);
+                int target = levelOf(solver, longest, level);
+                later[target - level - 1].push_back(predecessor | 1);
+            }
+        }
+    }
+}
+
+/// @brief loads every solved slice the moves of a slice can lead to: captures remove opponent
+///        pieces, a promotion turns one of the mover's men into a king
+static bool loadDependencies(Solver& solver, const string& dir){
+    for(int t = 0; t < solver.sliceCount; t++){
+        const TBSlice& s = solver.slices[t];
+        for(int promoted = 0; promoted <= 1 && promoted <= s.whiteMen; promoted++){
+            for(int blackMen = 0; blackMen <= s.blackMen; blackMen++){
+                for(int blackKings = 0; blackKings <= s.blackKings; blackKings++){
+                    if(blackMen + blackKings == 0)
+                        continue;
+                    // after the move black is to move: its slice is the colour-swapped counts
+                    TBSlice child;
+                    child.whiteMen = blackMen;
+                    child.whiteKings = blackKings;
+                    child.blackMen = s.whiteMen - promoted;
+                    child.blackKings = s.whiteKings + promoted;
+                    bool known = false;
+                    for(int u = 0; u < solver.sliceCount; u++)
+                        known = known || child == solver.slices[u];
+                    for(const auto& dependency : solver.dependencies)
+                        known = known || child == dependency->slice;
+                    if(known)
+                        continue;
+                    unique_ptr<Dependency> dependency(new Dependency());
+                    dependency->slice = child;
+                    bool distances;
+                    string path = dir + "/" + sliceName(child) + ".tb";
+                    if(!readSliceFile(path, child, dependency->values, distances)){
+                        cerr << "Error: " << path << " is missing or damaged" << endl;
+                        return false;
+                    }
+                    if(distances != solver.distances){
+                        cerr << "Error: " << path << (distances ? " has" : " has no")
+                             << " distances, run again with the same options or another --dir" << endl;
+                        return false;
+                    }
+                    solver.dependencies.push_back(move(dependency));
+                }
+            }
+        }
+    }
+    return true;
+}
+
+/// @brief solves a slice and its colour-swapped twin together (their moves lead into each other)
+///        and writes their files
+static bool solvePair(const TBSlice& slice, const string& dir, bool distances, int threads){
+    auto start = chrono::steady_clock::now();
+    Solver solver;
+    solver.distances = distances;
+    solver.slices[0] = slice;
+    solver.slices[1] = swapColours(slice);
+    solver.sliceCount = solver.slices[1] == slice ? 1 : 2;
+    uint64_t total = 0;
+    for(int t = 0; t < solver.sliceCount; t++){
+        solver.sizes[t] = sliceSize(solver.slices[t]);
+        solver.values[t].reset(new atomic<uint8_t>[solver.sizes[t]]());
+        solver.unresolved[t].reset(new atomic<uint8_t>[solver.sizes[t]]());
+        if(distances)
+            solver.longestLoss[t].reset(new atomic<uint8_t>[solver.sizes[t]]());
+        total += solver.sizes[t];
+    }
+    if(!loadDependencies(solver, dir))
+        return false;
+
+    // the decided positions wait in one list per level; without distances every result goes one
+    // level later than the position that decided it, which keeps the lists short
+    vector<Level> queue(solver.distances ? MAX_LEVELS : 2);
+    mutex queueLock;
+    auto merge = [&](vector<Level>& found, size_t first){
+        lock_guard<mutex> guard(queueLock);
+        for(size_t k = 0; k < found.size(); k++){
+            if(found[k].empty())
+                continue;
+            if(first + k >= queue.size())
+                queue.resize(first + k + 1);
+            queue[first + k].insert(queue[first + k].end(), found[k].begin(), found[k].end());
+        }
+    };
+    parallelFor(total, threads, [&](uint64_t begin, uint64_t end){
+        vector<Level> found(solver.distances ? MAX_LEVELS : 2);
+        for(uint64_t i = begin; i < end; i++){
+            int t = i < solver.sizes[0] ? 0 : 1;
+            countMoves(solver, t, t ? i - solver.sizes[0] : i, found, t ? solver.sizes[0] : 0);
+        }
+        merge(found, 0);
+    });
+
+    int levels = 0;
+    for(int level = 0; level < (int)queue.size(); level++){
+        Level current;
+        current.swap(queue[level]);
+        if(current.empty())
+            continue;
+        levels = level + 1;
+        parallelFor(current.size(), threads, [&](uint64_t begin, uint64_t end){
+            vector<Level> later(solver.distances ? MAX_LEVELS - level : 1);
+            for(uint64_t i = begin; i < end; i++)
+                decide(solver, current[i], level, later);
+            merge(later, level + 1);
+        });
+    }
+    if(solver.tooLong){
+        cerr << "Error: " << sliceName(slice) << " has results longer than " << MAX_LEVELS - 1 << " plies, run without --dtw" << endl;
+        return false;
+    }
+
+    uint64_t wins = 0, losses = 0, draws = 0;
+    int longest = 0;
+    for(int t = 0; t < solver.sliceCount; t++){
+        // atomic<uint8_t> has the layout of uint8_t
+        const uint8_t* values = reinterpret_cast<const uint8_t*>(solver.values[t].get());
+        for(uint64_t i = 0; i < solver.sizes[t]; i++){
+            if(tbIsWin(values[i]))
+                wins++;
+            else if(tbIsLoss(values[i]))
+                losses++;
+            else
+                draws++;
+            if(values[i] && tbPlies(values[i]) > longest)
+                longest = tbPlies(values[i]);
+        }
+        string path = dir + "/" + sliceName(solver.slices[t]) + ".tb";
+        if(!writeSliceFile(path, solver.slices[t], values, solver.sizes[t], distances)){
+            cerr << "Error: unable to write " << path << endl;
+            return false;
+        }
+        uint64_t compressed = writeCompressedSlice(dir + "/" + sliceName(solver.slices[t]) + ".cdb",
+                                                   solver.slices[t], values, solver.sizes[t], distances);
+        if(!compressed){
+            cerr << "Error: unable to write " << dir << "/" << sliceName(solver.slices[t]) << ".cdb" << endl;
+            return false;
+        }
+        rawBytes += solver.sizes[t];
+        compressedBytes += compressed;
+    }
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    cout << setw(14) << (solver.sliceCount == 2 ? sliceName(slice) + "+" + sliceName(solver.slices[1]) : sliceName(slice))
+         << "  " << setw(12) << total << " positions  win " << wins << "  loss " << losses << "  draw " << draws
+         << "  levels " << levels;
+    if(distances)
+        cout << "  longest " << longest << " plies";
+    cout << "  " << fixed << setprecision(2) << seconds << " s" << endl;
+    cout.unsetf(ios::fixed);
+    return true;
+}
+
+int main(int argc, char** argv){
+    int pieces = 4;
+    bool distances = false;
+    int threads = (int)thread::hardware_concurrency();
+    string dir = "tb";
+
+    for(int i = 1; i < argc; i++){
+        if(strcmp(argv[i], "--dtw") == 0){
+            distances = true;
+        }else if(strcmp(argv[i], "--threads") == 0 && i + 1 < argc){
+            threads = atoi(argv[++i]);
+        }else if(strcmp(argv[i], "--dir") == 0 && i + 1 < argc){
+            dir = argv[++i];
+        }else{
+            pieces = atoi(argv[i]);
+        }
+    }
+    if(pieces < 2 || pieces > TB_MAX_PIECES){
+        cerr << "Error: pieces must be between 2 and " << TB_MAX_PIECES << endl;
+        return 1;
+    }
+    if(threads < 1)
+        threads = 1;
+#ifdef _WIN32
+    _mkdir(dir.c_str());
+#else
+    mkdir(dir.c_str(), 0755);
+#endif
+
+    cout << "tablebases up to " << pieces << " pieces in " << dir << "/, " << threads << " threads"
+         << (distances ? ", distances in plies" : "") << endl;
+    auto start = chrono::steady_clock::now();
+    vector<TBSlice> slices = listSlices(pieces);
+    int skipped = 0;
+    for(size_t i = 0; i < slices.size(); i++){
+        const TBSlice& slice = slices[i];
+        TBSlice twin = swapColours(slice);
+        // listSlices puts the twin right after its slice
+        if(twin != slice)
+            i++;
+        // checkpoint: a slice pair whose files are complete was solved by an earlier run
+        vector<uint8_t> values[2];
+        bool stored[2];
+        if(readSliceFile(dir + "/" + sliceName(slice) + ".tb", slice, values[0], stored[0]) && stored[0] == distances &&
+           readSliceFile(dir + "/" + sliceName(twin) + ".tb", twin, values[1], stored[1]) && stored[1] == distances){
+            // runs from before the compressed format have no .cdb files yet
+            for(int t = 0; t < 2; t++){
+                const TBSlice& done = t ? twin : slice;
+                string path = dir + "/" + sliceName(done) + ".cdb";
+                ifstream existing(path, ios::binary);
+                if(!existing.is_open() && !writeCompressedSlice(path, done, values[t].data(), values[t].size(), distances)){
+                    cerr << "Error: unable to write " << path << endl;
+                    return 1;
+                }
+            }
+            skipped++;
+            continue;
+        }
+        if(!solvePair(slice, dir, distances, threads))
+            return 1;
+    }
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    if(skipped)
+        cout << skipped << " slice pairs were already solved" << endl;
+    if(compressedBytes)
+        cout << "written " << rawBytes << " bytes of values, " << compressedBytes << " bytes compressed ("
+             << fixed << setprecision(1) << 100.0 * compressedBytes / rawBytes << "%)" << endl;
+    cout << "done in " << fixed << setprecision(2) << seconds << " s" << endl;
+    return 0;
+}
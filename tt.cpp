@@ -0,0 +1,130 @@
+// @file tt.cpp
+// @brief lockless transposition table
+
+#include "tt.h"
+
+const int BUCKET_SIZE = 4;      // slots probed per position, 64 bytes
+const int NO_MOVE = 0xFF;
+
+// data layout: score (16 bits) | depth (8) | bound (2) | age (6) | move index (8) | from (5) | to (5)
+static uint64_t pack(int score, int depth, int bound, int age, int moveIndex, int moveFrom, int moveTo){
+    return (uint64_t)(uint16_t)(int16_t)score
+         | (uint64_t)(depth & 0xFF) << 16
+         | (uint64_t)(bound & 3) << 24
+         | (uint64_t)(age & 63) << 26
+         | (uint64_t)(moveIndex & 0xFF) << 32
+         | (uint64_t)(moveFrom & 31) << 40
+         | (uint64_t)(moveTo & 31) << 45;
+}
+
+static int dataDepth(uint64_t data){ return (int)((data >> 16) & 0xFF); }
+static int dataAge(uint64_t data){ return (int)((data >> 26) & 63); }
+
+TranspositionTable::TranspositionTable(){
+    resize(DEFAULT_HASH_MB);
+}
+
+TranspositionTable::~TranspositionTable(){
+    delete[] slots;
+}
+
+void TranspositionTable::resize(size_t megabytes){
+    size_t count = BUCKET_SIZE;
+    while(count * 2 * sizeof(TTEntry) <= megabytes * 1024 * 1024)
+        count *= 2;
+    if(count != slotCount){
+        delete[] slots;
+        slots = new TTEntry[count];
+        slotCount = count;
+        mask = (uint64_t)(count - 1) & ~(uint64_t)(BUCKET_SIZE - 1);
+    }
+    clear();
+}
+
+void TranspositionTable::clear(){
+    for(size_t i = 0; i < slotCount; i++){
+        slots[i].check.store(0, std::memory_order_relaxed);
+        slots[i].data.store(0, std::memory_order_relaxed);
+    }
+    age = 0;
+    probes = hits = stores = 0;
+}
+
+void TranspositionTable::newSearch(){
+    age = (age + 1) & 63;
+}
+
+bool TranspositionTable::probe(uint64_t key, TTHit& hit){
+    TTEntry* bucket = slots + (key & mask);
+    for(int i = 0; i < BUCKET_SIZE; i++){
+        uint64_t data = bucket[i].data.load(std::memory_order_relaxed);
+        uint64_t check = bucket[i].check.load(std::memory_order_relaxed);
+        if((check ^ data) != key || data == 0)
+            continue;
+        hit.score = (int16_t)(data & 0xFFFF);
+        hit.depth = dataDepth(data);
+        hit.bound = (int)((data >> 24) & 3);
+        int index = (int)((data >> 32) & 0xFF);
+        hit.moveIndex = index == NO_MOVE ? -1 : index;
+        hit.moveFrom = (int)((data >> 40) & 31);
+        hit.moveTo = (int)((data >> 45) & 31);
+        return true;
+    }
+    return false;
+}
+
+void TranspositionTable::store(uint64_t key, int score, int depth, int bound, int moveIndex, int moveFrom, int moveTo){
+    TTEntry* bucket = slots + (key & mask);
+    if(depth < 0)
+        depth = 0;
+    if(moveIndex < 0 || moveIndex >= NO_MOVE)
+        moveIndex = NO_MOVE;
+
+    // the same position, else the shallowest entry from an older search, else the shallowest
+    TTEntry* target = bucket;
+    int worst = 1 << 30;
+    for(int i = 0; i < BUCKET_SIZE; i++){
+        uint64_t data = bucket[i].data.load(std::memory_order_relaxed);
+        uint64_t check = bucket[i].check.load(std::memory_order_relaxed);
+        if(data == 0 || (check ^ data) == key){
+            target = bucket + i;
+            if(data != 0 && moveIndex == NO_MOVE && (check ^ data) == key){
+                // keep the best move a shallower search does not know
+                moveIndex = (int)((data >> 32) & 0xFF);
+                moveFrom = (int)((data >> 40) & 31);
+                moveTo = (int)((data >> 45) & 31);
+            }
+            break;
+        }
+        int value = dataDepth(data) + (dataAge(data) == age ? 256 : 0);
+        if(value < worst){
+            worst = value;
+            target = bucket + i;
+        }
+    }
+    uint64_t data = pack(score, depth, bound, age, moveIndex, moveFrom, moveTo);
+    target->check.store(key ^ data, std::memory_order_relaxed);
+    target->data.store(data, std::memory_order_relaxed);
+}
+
+void TranspositionTable::addCounts(uint64_t probeCount, uint64_t hitCount, uint64_t storeCount){
+    probes.fetch_add(probeCount, std::memory_order_relaxed);
+    hits.fetch_add(hitCount, std::memory_order_relaxed);
+    stores.fetch_add(storeCount, std::memory_order_relaxed);
+}
+
+TTStats TranspositionTable::stats() const{
+    TTStats result;
+    result.probes = probes.load(std::memory_order_relaxed);
+    result.hits = hits.load(std::memory_order_relaxed);
+    result.stores = stores.load(std::memory_order_relaxed);
+    size_t sample = slotCount < 1000 ? slotCount : 1000;
+    int used = 0;
+    for(size_t i = 0; i < sample; i++){
+        uint64_t data = slots[i].data.load(std::memory_order_relaxed);
+        if(data != 0 && dataAge(data) == age)
+            used++;
+    }
+    result.fillPermille = sample ? (int)(used * 1000 / sample) : 0;
+    return result;
+}
@@ -0,0 +1,87 @@
+// @file tt.h
+// @brief transposition table shared by the search threads: fixed size, power of two, lockless
+
+#ifndef TT_H
+#define TT_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+const int DEFAULT_HASH_MB = 32;
+
+enum boundType{
+    boundNone,
+    boundUpper,     // the score is at most this (every move failed low)
+    boundLower,     // the score is at least this (a move failed high)
+    boundExact
+};
+
+/// @brief what a probe found
+struct TTHit{
+    int score;
+    int depth;
+    int bound;
+    int moveIndex;      // index of the best move in generateMoves order, -1 if none
+    int moveFrom;       // from / to of that move, to reject it if the list has changed
+    int moveTo;
+};
+
+/// @brief fill and hit counters, for tuning the table size
+struct TTStats{
+    uint64_t probes;
+    uint64_t hits;
+    uint64_t stores;
+    int fillPermille;   // share of sampled slots written by the current search
+};
+
+/// @brief A slot stores key ^ data next to data. A reader that races with a writer sees a key
+///        that no longer matches and treats the slot as empty, so threads share the table without locks.
+struct TTEntry{
+    std::atomic<uint64_t> check;
+    std::atomic<uint64_t> data;
+};
+
+class TranspositionTable{
+public:
+    TranspositionTable();
+    ~TranspositionTable();
+    TranspositionTable(const TranspositionTable&) = delete;
+    TranspositionTable& operator=(const TranspositionTable&) = delete;
+
+    /// @brief reallocates the table, rounded down to a power of two number of slots, and clears it
+    /// @param megabytes the memory to use
+    void resize(size_t megabytes);
+
+    /// @brief forgets every stored position
+    void clear();
+
+    /// @brief marks the start of a new search so older entries are replaced first
+    void newSearch();
+
+    /// @brief looks a position up
+    /// @param key,hit the Zobrist key and what the table knows about it
+    /// @return true if the position was found
+    bool probe(uint64_t key, TTHit& hit);
+
+    /// @brief stores a search result
+    void store(uint64_t key, int score, int depth, int bound, int moveIndex, int moveFrom, int moveTo);
+
+    /// @brief adds a search thread's probe counts; threads count locally so the hot path never
+    ///        writes a shared counter
+    void addCounts(uint64_t probeCount, uint64_t hitCount, uint64_t storeCount);
+
+    TTStats stats() const;
+    size_t sizeMb() const { return (slotCount * sizeof(TTEntry)) >> 20; }
+
+private:
+    TTEntry* slots = nullptr;
+    size_t slotCount = 0;
+    uint64_t mask = 0;          // index mask of the first slot of a bucket
+    uint8_t age = 0;
+    std::atomic<uint64_t> probes{0};
+    std::atomic<uint64_t> hits{0};
+    std::atomic<uint64_t> stores{0};
+};
+
+#endif